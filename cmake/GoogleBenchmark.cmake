@@ -0,0 +1,42 @@
+# Download and build google benchmark
+
+set(GBENCH_VERSION 1.1.0)
+set(GBENCH_NAME benchmark-${GBENCH_VERSION})
+set(GBENCH_TAR_PATH ${DEP_ROOT_DIR}/${GBENCH_NAME}.tar.gz)
+
+if(NOT EXISTS ${GBENCH_TAR_PATH})
+    message(STATUS "Downloading Google Benchmark...")
+    file(DOWNLOAD https://github.com/google/benchmark/archive/v${GBENCH_VERSION}.tar.gz ${GBENCH_TAR_PATH})
+endif()
+
+if(NOT EXISTS ${DEP_ROOT_DIR}/${GBENCH_NAME})
+    message(STATUS "Extracting Google Benchmark...")
+    execute_process(COMMAND ${CMAKE_COMMAND} -E tar xzf ${GBENCH_TAR_PATH} WORKING_DIRECTORY ${DEP_ROOT_DIR})
+endif()
+
+if(NOT EXISTS ${DEP_ROOT_DIR}/${GBENCH_NAME}/build)
+    message("Configuring Google Benchmark...")
+    file(MAKE_DIRECTORY ${DEP_ROOT_DIR}/${GBENCH_NAME}/build)
+    execute_process(COMMAND ${CMAKE_COMMAND}
+            "-DCMAKE_BUILD_TYPE=Release"
+            "-DBENCHMARK_ENABLE_TESTING=OFF"
+            "-H${DEP_ROOT_DIR}/${GBENCH_NAME}"
+            "-B${DEP_ROOT_DIR}/${GBENCH_NAME}/build"
+            RESULT_VARIABLE
+            GBENCH_CONFIGURE)
+    if(NOT GBENCH_CONFIGURE EQUAL 0)
+        message(FATAL_ERROR "Google Benchmark Configure failed!")
+    endif()
+
+    message("Building Google Benchmark locally...")
+    execute_process(COMMAND ${CMAKE_COMMAND} --build
+            "${DEP_ROOT_DIR}/${GBENCH_NAME}/build"
+            RESULT_VARIABLE
+            GBENCH_BUILD)
+    if(NOT GBENCH_BUILD EQUAL 0)
+        message(FATAL_ERROR "Google Benchmark build failed!")
+    endif()
+endif()
+
+# the library is referenced by full path since `benchmark` already names our own executable target
+set(GBENCH_LIBRARIES ${DEP_ROOT_DIR}/${GBENCH_NAME}/build/src/libbenchmark.a)
@@ -12,6 +12,10 @@ void del_drop_collection(http_req & req, http_res & res);
 
 void get_debug(http_req & req, http_res & res);
 
+void get_metrics(http_req & req, http_res & res);
+
+void get_collection_stats(http_req & req, http_res & res);
+
 void get_search(http_req & req, http_res & res);
 
 void get_collection_summary(http_req & req, http_res & res);
@@ -20,15 +24,46 @@ void get_collection_export(http_req & req, http_res & res);
 
 void post_add_document(http_req & req, http_res & res);
 
+void post_import_documents(http_req & req, http_res & res);
+
 void get_fetch_document(http_req & req, http_res & res);
 
+void patch_update_document(http_req & req, http_res & res);
+
 void del_remove_document(http_req & req, http_res & res);
 
 void get_replication_updates(http_req &req, http_res &res);
 
+void get_replication_stream(http_req &req, http_res &res);
+
+// Streams a point-in-time dump of the whole store as length-prefixed key/value frames,
+// preceded by the snapshot's WAL sequence number. Used to bootstrap a fresh replica.
+void get_replication_store_snapshot(http_req &req, http_res &res);
+
+// Writes a fresh index snapshot of the given collection and streams the file, so that a
+// bootstrapping replica can restore the in-memory index without re-indexing every document.
+void get_replication_index_snapshot(http_req &req, http_res &res);
+
 void on_send_response(void *data);
 
 void collection_export_handler(http_req* req, http_res* res, void* data);
 
+void replication_stream_handler(http_req* req, http_res* res, void* data);
+
+void search_stream_handler(http_req* req, http_res* res, void* data);
+
+// pages at least this big are streamed hit-by-hit instead of being serialized in one go
+static const size_t SEARCH_STREAM_MIN_PER_PAGE = 50;
+
+// Export chunking: the reader thread hands records over in chunks of roughly this size,
+// and stays at most this many chunks ahead of the client.
+static const size_t EXPORT_CHUNK_BYTES = 64 * 1024;
+static const size_t EXPORT_MAX_BUFFERED_CHUNKS = 8;
+
 static constexpr const char* SEND_RESPONSE_MSG = "send_response";
-static constexpr const char* REPLICATION_EVENT_MSG = "replication_event";
\ No newline at end of file
+static constexpr const char* REPLICATION_EVENT_MSG = "replication_event";
+
+// How long a replication request from a caught-up replica is held open waiting
+// for new WAL entries, before an empty response is sent (long-polling)
+static const size_t REPLICATION_LONG_POLL_MS = 30 * 1000;
+static const size_t REPLICATION_LONG_POLL_TICK_MS = 100;
\ No newline at end of file
@@ -18,6 +18,9 @@ private:
     }
 
 public:
+    // replaces the contents with `new_array` through a single re-encode - used by posting list compaction
+    void load(const uint32_t *new_array, const uint32_t array_length);
+
     uint32_t at(uint32_t index);
 
     bool contains(uint32_t value);
@@ -26,5 +29,9 @@ public:
 
     bool append(uint32_t value);
 
+    // appends a run of values with a single sizing pass - the per-element variant
+    // re-evaluates the compressed size and growth for every value
+    bool append(const uint32_t* values, const uint32_t values_length);
+
     void remove_index(uint32_t start_index, uint32_t end_index);
 };
\ No newline at end of file
@@ -20,6 +20,10 @@ protected:
     uint32_t min = std::numeric_limits<uint32_t>::max();
     uint32_t max = std::numeric_limits<uint32_t>::min();
 
+    // when set, `in` points into externally managed storage (e.g. a memory-mapped offset
+    // store): reads work as usual, but the payload is neither owned nor writable here
+    bool external = false;
+
     static inline uint32_t required_bits(const uint32_t v) {
         return (uint32_t) (v == 0 ? 0 : 32 - __builtin_clz(v));
     }
@@ -32,13 +36,37 @@ public:
     }
 
     ~array_base() {
-        delete[] in;
+        if(!external) {
+            delete[] in;
+        }
         in = nullptr;
     }
 
+    // points the array at an externally managed copy of its compressed payload (which must be
+    // `getLengthInBytes()` long) and frees the heap storage - reads keep working unchanged
+    void use_external(uint8_t* data);
+
+    // copies an external payload back to the heap so the array can be mutated again
+    void make_owned();
+
+    bool is_external();
+
     uint32_t* uncompress();
 
     uint32_t getSizeInBytes();
 
     uint32_t getLength();
+
+    uint32_t getLengthInBytes();
+
+    uint32_t getMin();
+
+    uint32_t getMax();
+
+    // compressed representation, `getLengthInBytes()` long - used for serializing to disk
+    const uint8_t* get_raw();
+
+    // adopts a compressed blob previously obtained via `get_raw()`, without re-encoding
+    void load_raw(const uint8_t* data, const uint32_t num_length_bytes, const uint32_t arr_length,
+                  const uint32_t arr_min, const uint32_t arr_max);
 };
\ No newline at end of file
@@ -3,6 +3,8 @@
 #include <cstddef>
 #include <stdint.h>
 #include <array>
+#include <vector>
+#include <utility>
 
 /* Different intersection routines adapted from:
  * https://github.com/lemire/SIMDCompressionAndIntersection/blob/master/src/intersection.cpp
@@ -12,5 +14,13 @@ public:
   // Fast scalar scheme designed by N. Kurz. Returns the size of out (intersected set)
   static size_t and_scalar(const uint32_t *A, const size_t lenA, const uint32_t *B, const size_t lenB, uint32_t **out);
 
+  // Intersection entry point: picks between the scalar merge, a one-sided galloping search and
+  // SIMD kernels depending on how skewed the two lengths are and what the CPU supports.
+  static size_t intersect(const uint32_t *A, const size_t lenA, const uint32_t *B, const size_t lenB, uint32_t **out);
+
   static size_t or_scalar(const uint32_t *A, const size_t lenA, const uint32_t *B, const size_t lenB, uint32_t **out);
-};
\ No newline at end of file
+
+  // Heap based k-way union of multiple sorted arrays with a single output allocation.
+  // Duplicates are removed. Returns the size of out (merged set).
+  static size_t or_many(const std::vector<std::pair<uint32_t*, size_t>> & arrays, uint32_t **out);
+};
@@ -3,9 +3,14 @@
 
 #include <stdint.h>
 #include <stdbool.h>
+#include <stdio.h>
 #include <vector>
+#include <string>
+#include <unordered_map>
+#include <mutex>
 #include "array.h"
 #include "sorted_array.h"
+#include "id_list.h"
 
 #define IGNORE_PRINTF 1
 
@@ -88,7 +93,7 @@ typedef struct {
  * Container for holding the documents that belong to a leaf.
  */
 typedef struct {
-    sorted_array ids;
+    id_list ids;
     sorted_array offset_index;
     array offsets;
 } art_values;
@@ -104,12 +109,42 @@ typedef struct {
     unsigned char key[];
 } art_leaf;
 
+/**
+ * A chunk of arena memory. Nodes and leaves are carved out of these chunks,
+ * and the memory is returned to the OS only in bulk when the tree is destroyed.
+ */
+typedef struct art_block {
+    struct art_block *next;
+    size_t size;
+    size_t used;
+} art_block;
+
+#define ART_ARENA_BLOCK_SIZE (256 * 1024)
+
+// freed leaves are recycled through free lists bucketed by their 8-byte rounded size
+#define ART_LEAF_FREE_LISTS 32
+
+/**
+ * Per-tree slab allocator with free lists for the fixed node sizes and for
+ * small leaves. Keeps the nodes of a tree packed together in memory, instead
+ * of scattering them across the heap one tiny allocation at a time.
+ */
+typedef struct {
+    art_block *head;
+    void *free_nodes[4];                      // one free list per node type
+    void *free_leaves[ART_LEAF_FREE_LISTS];
+} art_arena;
+
+struct art_completion_cache;
+
 /**
  * Main struct, points to root.
  */
 typedef struct {
     art_node *root;
     uint64_t size;
+    art_arena arena;
+    struct art_completion_cache *completion;
 } art_tree;
 
 /*
@@ -128,6 +163,31 @@ enum token_ordering {
     MAX_SCORE
 };
 
+// keeps the per-prefix completion map from growing without bound during bulk indexing
+#define ART_COMPLETION_CACHE_ENTRIES 512
+
+/**
+ * Completion cache for search-as-you-type: memoizes the ranked top-k leaves of an exact
+ * prefix so that hot zero-typo prefix lookups skip the topk traversal entirely.
+ *
+ * An entry is dropped when an insert under its prefix could alter its contents: a leaf
+ * outside the entry whose rank value reaches the entry's floor, or any new leaf while the
+ * entry holds fewer than k leaves. Leaves already cached only ever improve with inserts
+ * and are simply re-ranked when served. Deletes clear the cache wholesale - they happen
+ * during compaction, which is rare relative to keystrokes.
+ */
+struct art_completion_entry {
+    std::vector<art_leaf*> leaves;   // ranked best-first
+    uint32_t max_words;
+    token_ordering token_order;
+    int64_t floor_value;             // rank value of the weakest cached leaf; -1 when not full
+};
+
+struct art_completion_cache {
+    std::unordered_map<std::string, art_completion_entry> entries;
+    std::mutex lock;
+};
+
 enum NUM_COMPARATOR {
     LESS_THAN,
     LESS_THAN_EQUALS,
@@ -194,6 +254,12 @@ void* art_insert(art_tree *t, const unsigned char *key, int key_len, art_documen
  */
 void* art_delete(art_tree *t, const unsigned char *key, int key_len);
 
+/**
+ * Drops every completion cache entry of the tree. Must be called whenever leaves shrink
+ * without going through art_insert/art_delete (e.g. posting list compaction).
+ */
+void art_completion_clear(art_tree *t);
+
 /**
  * Searches for a value in the ART tree
  * @arg t The tree
@@ -228,6 +294,12 @@ art_leaf* art_maximum(art_tree *t);
  */
 int art_iter(art_tree *t, art_callback cb, void *data);
 
+/**
+ * Returns the bytes of memory held by the tree, including the posting
+ * data of its leaves.
+ */
+uint64_t art_memory_usage(art_tree *t);
+
 /**
  * Iterates through the entries pairs in the map,
  * invoking a callback for each that matches a given prefix.
@@ -242,6 +314,18 @@ int art_iter(art_tree *t, art_callback cb, void *data);
  */
 int art_iter_prefix(art_tree *t, const unsigned char *prefix, int prefix_len, art_callback cb, void *data);
 
+/**
+ * Serializes all the leaves of the tree (key, score and posting data) into a flat on-disk format.
+ * @return true on success
+ */
+bool art_tree_serialize(art_tree *t, FILE *fp);
+
+/**
+ * Restores a tree previously written by art_tree_serialize into an initialized, empty tree.
+ * @return true on success
+ */
+bool art_tree_deserialize(art_tree *t, FILE *fp);
+
 /**
  * Returns leaves that match a given string within a fuzzy distance of max_cost.
  */
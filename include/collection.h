@@ -4,11 +4,13 @@
 #include <vector>
 #include <string>
 #include <unordered_map>
+#include <atomic>
 #include <thread>
 #include <mutex>
 #include <condition_variable>
 #include <art.h>
 #include <index.h>
+#include <search_queue.h>
 #include <number.h>
 #include <sparsepp.h>
 #include <store.h>
@@ -16,6 +18,34 @@
 #include <json.hpp>
 #include <field.h>
 #include <option.h>
+#include <flat_record.h>
+
+// One document of an indexing batch: either a flat record produced by the schema-driven
+// scanner (fast path, pre-validated) or a parsed DOM document.
+struct index_record {
+    uint32_t seq_id;
+    bool is_flat;
+    flat_record flat;
+    nlohmann::json document;
+
+    index_record(uint32_t seq_id, const nlohmann::json & document):
+            seq_id(seq_id), is_flat(false), document(document) {
+
+    }
+
+    index_record(uint32_t seq_id, flat_record && flat):
+            seq_id(seq_id), is_flat(true), flat(std::move(flat)) {
+
+    }
+};
+
+// One hit of a streamed search response: the raw stored document plus its precomputed
+// highlight, so that the HTTP layer can emit the hit without parsing or re-serializing it.
+struct search_hit {
+    std::string json_doc;
+    std::string highlight_field;  // empty when the matched field cannot be highlighted
+    std::string snippet;
+};
 
 class Collection {
 private:
@@ -27,11 +57,31 @@ private:
 
     std::vector<Index*> indices;
 
-    std::vector<std::thread*> index_threads;
+    // Pool of threads that executes queued search tasks, so that independent queries
+    // run concurrently across shards and cores
+    SearchQueue* search_queue;
+
+    std::vector<std::thread*> search_workers;
+
+    // Rewrites posting lists of shards whose tombstone density crossed the threshold,
+    // keeping the expensive pass off the write path
+    std::thread* compaction_thread;
+
+    std::mutex compaction_m;
+
+    std::condition_variable compaction_cv;
+
+    std::vector<Index*> compaction_candidates;
+
+    bool quit_compaction;
 
     // Auto incrementing record ID used internally for indexing - not exposed to the client
     uint32_t next_seq_id;
 
+    // Bumped on every mutation - cached search results embed this, so a write
+    // cheaply invalidates them without having to track which queries are affected
+    std::atomic<uint64_t> write_generation;
+
     Store* store;
 
     std::vector<field> fields;
@@ -46,17 +96,78 @@ private:
 
     size_t num_indices;
 
+    // Guards the shard layout (`indices` / `num_indices`) against an in-flight reshard:
+    // regular operations hold the shared side, while reshard() takes the exclusive side
+    // only to drain in-flight operations and swap layouts.
+    std::mutex layout_m;
+
+    std::condition_variable layout_cv;
+
+    size_t num_layout_users;
+
+    bool layout_change_active;
+
+    void layout_lock();
+
+    void layout_unlock();
+
+    void layout_exclusive_lock();
+
+    void layout_exclusive_unlock();
+
+    struct layout_guard {
+        Collection* collection;
+        layout_guard(Collection* collection): collection(collection) { collection->layout_lock(); }
+        ~layout_guard() { collection->layout_unlock(); }
+    };
+
+    // Reshard streaming state: while a reshard is running, `reshard_indices` is the shadow
+    // layout being populated and `reshard_watermark` is the seq_id the streamer has indexed
+    // up to. Mutations of already-streamed documents are forwarded to the shadow layout by
+    // update() and remove(), serialized against streaming batches via `reshard_forward_m`.
+    std::mutex reshard_forward_m;
+
+    std::vector<Index*> reshard_indices;
+
+    size_t reshard_num_indices;
+
+    uint32_t reshard_watermark;
+
+    std::atomic<bool> reshard_running;
+
+    // In-memory mirror of the store's doc_id -> seq_id keys, maintained by add() and remove()
+    // and warmed on load, so that id lookups and duplicate checks cost a hash probe instead of
+    // a KV store read. A miss is authoritative: the id does not exist.
+    spp::sparse_hash_map<std::string, uint32_t> doc_id_index;
+
+    std::mutex doc_id_index_m;
+
+    // fans a batch of records out to the shards of `target_indices`, one thread per shard
+    size_t batch_index_into(std::vector<Index*> & target_indices, std::vector<index_record> & records);
+
     std::string get_doc_id_key(const std::string & doc_id);
 
     std::string get_seq_id_key(uint32_t seq_id);
 
     Option<uint32_t> validate_index_in_memory(const nlohmann::json &document, uint32_t seq_id);
 
+    int32_t get_points_from_doc(const nlohmann::json &document);
+
+    void run_search_worker();
+
+    void run_compaction_worker();
+
+    // Builds a highlight snippet by slicing byte ranges of `text` directly, given the
+    // positions of the tokens to be highlighted. `token_indices` is sorted and de-duped.
+    void highlight_snippet(const std::string & text, std::vector<size_t> & token_indices,
+                           std::string & snippet) const;
+
 public:
     Collection() = delete;
 
     Collection(const std::string name, const uint32_t collection_id, const uint32_t next_seq_id, Store *store,
-               const std::vector<field> & fields, const std::string & default_sorting_field, const size_t num_indices=4);
+               const std::vector<field> & fields, const std::string & default_sorting_field, const size_t num_indices=4,
+               const size_t num_search_workers=4);
 
     ~Collection();
 
@@ -74,12 +185,17 @@ public:
 
     uint32_t get_next_seq_id();
 
+    uint64_t get_write_generation();
+
     void set_next_seq_id(uint32_t seq_id);
 
     void increment_next_seq_id_field();
 
     Option<uint32_t> doc_id_to_seq_id(std::string doc_id);
 
+    // rebuilds the doc_id index from the store - called once when a collection is loaded
+    void warm_doc_id_index();
+
     std::vector<std::string> get_facet_fields();
 
     std::vector<field> get_sort_fields();
@@ -92,21 +208,72 @@ public:
 
     Option<nlohmann::json> add(const std::string & json_str);
 
+    // Imports a JSONL body: documents are validated and indexed in batches, with each batch written
+    // to the store through a single write batch. Returns a summary with per-line errors.
+    Option<nlohmann::json> add_many(const std::string & jsonl_str);
+
+    // When `stream_hits` is given, hits are appended there as raw stored documents with
+    // precomputed highlights (so the caller can stream them out incrementally) and the
+    // returned JSON carries only the envelope: found, facet counts and the cursor.
     Option<nlohmann::json> search(std::string query, const std::vector<std::string> search_fields,
                           const std::string & simple_filter_query, const std::vector<std::string> & facet_fields,
                           const std::vector<sort_by> & sort_fields, const int num_typos,
                           const size_t per_page = 10, const size_t page = 1,
-                          const token_ordering token_order = FREQUENCY, const bool prefix = false);
+                          const token_ordering token_order = FREQUENCY, const bool prefix = false,
+                          const bool exhaustive_search = true, const std::string & search_after = "",
+                          std::vector<search_hit>* stream_hits = nullptr,
+                          const size_t max_candidates = Index::DEFAULT_MAX_CANDIDATES);
+
+    // Applies a partial update to a stored document: only the fields whose values actually
+    // changed are re-indexed, so touching a couple of numeric fields does not pay for
+    // re-tokenizing the rest of the document. Returns the full updated document.
+    Option<nlohmann::json> update(const std::string & id, const std::string & json_patch_str);
 
     Option<nlohmann::json> get(const std::string & id);
 
+    // Bytes held by the in-memory index structures, rolled up per field across all shards,
+    // plus a collection-wide total. Walks every posting list, so keep it off the hot path.
+    nlohmann::json get_memory_stats();
+
     Option<std::string> remove(const std::string & id, const bool remove_from_store = true);
 
     Option<uint32_t> index_in_memory(const nlohmann::json & document, uint32_t seq_id);
 
+    // Indexes a batch of records by fanning each document out to its shard, with one indexing
+    // thread per shard. DOM documents that fail validation are skipped; flat records were
+    // already validated by the scanner. Returns the number indexed.
+    size_t batch_index_in_memory(std::vector<index_record> & records);
+
+    // Persists the in-memory index of all shards so that a restart can skip re-indexing documents.
+    Option<bool> save_index_snapshot(const std::string & snapshot_path);
+
+    // Restores the in-memory index from a snapshot file. Returns the sequence ID watermark: documents
+    // with a seq_id >= the watermark are not part of the snapshot and must be replayed from the store.
+    Option<uint32_t> load_index_snapshot(const std::string & snapshot_path);
+
+    size_t get_num_indices();
+
+    // Re-partitions the collection across `new_num_indices` shards while it keeps serving.
+    // Documents are streamed from the store into a shadow layout in the background; only the
+    // final tail and the layout swap itself hold up reads and writes. The new shard count is
+    // not persisted here - CollectionManager::reshard_collection updates the collection meta.
+    Option<bool> reshard(const size_t new_num_indices);
+
+    static const uint32_t INDEX_SNAPSHOT_MAGIC = 0x54534E50;  // "TSNP"
+    static const uint32_t INDEX_SNAPSHOT_VERSION = 2;  // v2 added the numeric range index section
+
     static const int MAX_SEARCH_TOKENS = 10;
     static const int MAX_RESULTS = 500;
 
+    static const size_t IMPORT_BATCH_SIZE = 1000;
+
+    static const size_t MAX_NUM_INDICES = 64;
+
+    static const size_t RESHARD_BATCH_SIZE = 1000;
+
+    // Queued searches beyond this limit block the caller, applying back-pressure under heavy load
+    static const size_t SEARCH_QUEUE_CAPACITY = 64;
+
     // strings under this length will be fully highlighted, instead of showing a snippet of relevant portion
     enum {SNIPPET_STR_ABOVE_LEN = 30};
 
@@ -2,6 +2,9 @@
 
 #include <iostream>
 #include <string>
+#include <list>
+#include <mutex>
+#include <unordered_map>
 #include <sparsepp.h>
 #include "store.h"
 #include "field.h"
@@ -24,10 +27,33 @@ private:
     static constexpr const char* COLLECTION_ID_KEY = "id";
     static constexpr const char* COLLECTION_SEARCH_FIELDS_KEY = "fields";
     static constexpr const char* COLLECTION_DEFAULT_SORTING_FIELD_KEY = "default_sorting_field";
+    static constexpr const char* COLLECTION_NUM_INDICES_KEY = "num_indices";
 
     std::string auth_key;
     std::string search_only_auth_key;
 
+    // protects the collection maps during the parallel load at startup
+    std::mutex m_collections;
+
+    // Caches serialized search responses, since a small set of queries dominates production
+    // traffic. Keys embed the collection's write generation, so entries of a mutated collection
+    // simply stop matching and age out of the LRU instead of requiring an explicit wipe.
+    struct result_cache_entry {
+        std::string key;
+        std::string result_json;
+    };
+
+    std::list<result_cache_entry> result_cache_lru;  // most recently used in front
+
+    std::unordered_map<std::string, std::list<result_cache_entry>::iterator> result_cache_map;
+
+    size_t result_cache_bytes;
+
+    std::mutex result_cache_m;
+
+    // Loads a single collection (snapshot restore + replay of newer writes) and registers it
+    Option<bool> load_collection(const std::string & collection_meta_json, const bool next_coll_id_exists);
+
     CollectionManager();
 
     ~CollectionManager() = default;
@@ -55,7 +81,12 @@ public:
     bool search_only_auth_key_matches(std::string auth_key_sent);
 
     Option<Collection*> create_collection(const std::string name, const std::vector<field> & fields,
-                                          const std::string & default_sorting_field);
+                                          const std::string & default_sorting_field,
+                                          const size_t num_indices = 4);
+
+    // Re-partitions a collection across a different number of shards while it keeps serving,
+    // and persists the new shard count in the collection meta.
+    Option<bool> reshard_collection(const std::string & collection_name, const size_t new_num_indices);
 
     Collection* get_collection(const std::string & collection_name);
 
@@ -65,11 +96,26 @@ public:
 
     Option<bool> drop_collection(std::string collection_name, const bool remove_from_store = true);
 
+    std::string get_index_snapshot_path(const uint32_t collection_id) const;
+
+    // Writes an index snapshot for every collection - called during graceful shutdown
+    void save_index_snapshots();
+
     uint32_t get_next_collection_id();
 
     void set_next_collection_id(uint32_t next_id);
 
     Store* get_store();
 
+    // copies the cached serialized response into `result_json`
+    bool result_cache_get(const std::string & cache_key, std::string & result_json);
+
+    void result_cache_put(const std::string & cache_key, const std::string & result_json);
+
+    static const size_t LOAD_BATCH_SIZE = 1000;
+
+    static const size_t RESULT_CACHE_BUDGET_BYTES = 32 * 1048576;
+
     static constexpr const char* NEXT_COLLECTION_ID_KEY = "$CI";
+    static constexpr const char* INDEX_SNAPSHOT_DIR_NAME = "snapshots";
 };
\ No newline at end of file
@@ -129,29 +129,124 @@ struct facet {
     }
 };
 
+/*
+* Dictionary-encoded facet storage: every distinct value string gets a dense integer id,
+* and per-document value ids are addressed directly by seq_id. The common single-valued
+* document stores its value id inline in `slots`, so counting it is one array read;
+* multi-valued documents park their ids in `multi_values` behind a flagged slot.
+*/
 struct facet_value {
     // use string to int mapping for saving memory
     spp::sparse_hash_map<std::string, uint32_t> value_index;
-    spp::sparse_hash_map<uint32_t, std::string> index_value;
+    std::vector<std::string> index_value;  // dense reverse dictionary, addressed by value id
 
-    spp::sparse_hash_map<uint32_t, std::vector<uint32_t>> doc_values;
+    static const uint32_t NO_VALUE = 0xFFFFFFFF;
+    static const uint32_t MULTI_FLAG = 0x80000000;  // top bit marks a multi-valued slot
+
+    std::vector<uint32_t> slots;                    // addressed by seq_id
+    std::vector<std::vector<uint32_t>> multi_values;
 
     uint32_t get_value_index(const std::string & value) {
-        if(value_index.count(value) != 0) {
-            return value_index[value];
+        const auto it = value_index.find(value);
+        if(it != value_index.end()) {
+            return it->second;
         }
 
         uint32_t new_index = value_index.size();
         value_index.emplace(value, new_index);
-        index_value.emplace(new_index, value);
+        index_value.push_back(value);
         return new_index;
     }
 
+    // restores a dictionary entry from a snapshot, where ids arrive in arbitrary order
+    void load_value(const std::string & value, const uint32_t value_idx) {
+        value_index.emplace(value, value_idx);
+        if(index_value.size() <= value_idx) {
+            index_value.resize(value_idx + 1);
+        }
+        index_value[value_idx] = value;
+    }
+
+    void assign_slot(uint32_t doc_seq_id, const std::vector<uint32_t> & value_ids) {
+        if(slots.size() <= doc_seq_id) {
+            slots.resize(doc_seq_id + 1, NO_VALUE);
+        }
+
+        if(value_ids.size() == 1) {
+            slots[doc_seq_id] = value_ids[0];
+        } else {
+            slots[doc_seq_id] = MULTI_FLAG | (uint32_t) multi_values.size();
+            multi_values.push_back(value_ids);
+        }
+    }
+
     void index_values(uint32_t doc_seq_id, const std::vector<std::string> & values) {
-        std::vector<uint32_t> value_vec(values.size());
+        std::vector<uint32_t> value_ids(values.size());
         for(size_t i = 0; i < values.size(); i++) {
-            value_vec[i] = get_value_index(values[i]);
+            value_ids[i] = get_value_index(values[i]);
+        }
+        assign_slot(doc_seq_id, value_ids);
+    }
+
+    // copies the doc's value ids out (slow path - counting uses count_doc instead)
+    bool get_values(uint32_t doc_seq_id, std::vector<uint32_t> & value_ids) const {
+        if(doc_seq_id >= slots.size() || slots[doc_seq_id] == NO_VALUE) {
+            return false;
+        }
+
+        const uint32_t slot = slots[doc_seq_id];
+        if((slot & MULTI_FLAG) == 0) {
+            value_ids.push_back(slot);
+        } else {
+            const std::vector<uint32_t> & ids = multi_values[slot & ~MULTI_FLAG];
+            value_ids.insert(value_ids.end(), ids.begin(), ids.end());
+        }
+
+        return true;
+    }
+
+    // bumps the counters of the doc's values - `counts` must be sized to the dictionary
+    inline void count_doc(uint32_t doc_seq_id, size_t* counts) const {
+        if(doc_seq_id >= slots.size()) {
+            return ;
+        }
+
+        const uint32_t slot = slots[doc_seq_id];
+        if(slot == NO_VALUE) {
+            return ;
+        }
+
+        if((slot & MULTI_FLAG) == 0) {
+            counts[slot]++;
+            return ;
         }
-        doc_values.emplace(doc_seq_id, value_vec);
+
+        for(const uint32_t value_id: multi_values[slot & ~MULTI_FLAG]) {
+            counts[value_id]++;
+        }
+    }
+
+    void erase(uint32_t doc_seq_id) {
+        if(doc_seq_id < slots.size()) {
+            // a multi-valued entry stays behind in `multi_values` so other slots keep
+            // their positions - the handful of bytes is reclaimed on snapshot reload
+            slots[doc_seq_id] = NO_VALUE;
+        }
+    }
+
+    // Approximate heap bytes held by the facet structures: string payloads are counted once
+    // per container they appear in, hash table overhead is not.
+    size_t memory_usage() const {
+        size_t bytes = slots.capacity() * sizeof(uint32_t);
+
+        for(const auto & value_entry: value_index) {
+            bytes += 2 * (value_entry.first.size() + sizeof(std::string)) + sizeof(uint32_t);
+        }
+
+        for(const auto & value_ids: multi_values) {
+            bytes += sizeof(std::vector<uint32_t>) + value_ids.capacity() * sizeof(uint32_t);
+        }
+
+        return bytes;
     }
 };
\ No newline at end of file
@@ -0,0 +1,353 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <cstdlib>
+#include <cstring>
+#include <cstdint>
+#include <limits>
+#include <unordered_map>
+#include "field.h"
+
+// A borrowed slice of the import buffer - valid only while that buffer is alive
+struct flat_string {
+    const char* data;
+    size_t len;
+
+    flat_string(): data(nullptr), len(0) {
+
+    }
+
+    std::string to_string() const {
+        return std::string(data, len);
+    }
+};
+
+// The typed values of one schema field, parsed without a DOM. Only the vector matching
+// the schema type is populated.
+struct flat_field_values {
+    field schema;
+    bool seen;
+    std::vector<flat_string> str_values;
+    std::vector<int64_t> int_values;
+    std::vector<float> float_values;
+    std::vector<bool> bool_values;
+
+    flat_field_values(const field & schema): schema(schema), seen(false) {
+
+    }
+};
+
+struct flat_record {
+    bool has_id;
+    flat_string id;
+    int32_t points;
+    std::vector<flat_field_values> fields;
+
+    flat_record(): has_id(false), points(0) {
+
+    }
+};
+
+/*
+* Schema-driven scanner that parses a JSON document straight into a flat_record, skipping the
+* DOM entirely. It is deliberately strict: any document it cannot handle - malformed JSON,
+* schema mismatch, escape sequences inside indexed strings, duplicate keys, numeric overflow -
+* makes parse() return false, and the caller falls back to the DOM path which produces the
+* proper validation error.
+*/
+struct flat_record_scanner {
+
+    static bool parse(const std::string & json_str, const std::unordered_map<std::string, field> & schema,
+                      const std::string & default_sorting_field, flat_record & record) {
+        record.has_id = false;
+        record.fields.clear();
+        record.fields.reserve(schema.size());
+
+        for(const auto & name_field: schema) {
+            record.fields.push_back(flat_field_values(name_field.second));
+        }
+
+        const char* p = json_str.c_str();
+        const char* end = p + json_str.size();
+
+        skip_ws(p, end);
+        if(p == end || *p != '{') return false;
+        p++;
+        skip_ws(p, end);
+
+        if(p != end && *p == '}') {
+            p++;
+        } else {
+            while(true) {
+                flat_string key;
+                if(!parse_string(p, end, key)) return false;
+
+                skip_ws(p, end);
+                if(p == end || *p != ':') return false;
+                p++;
+                skip_ws(p, end);
+
+                if(key.len == 2 && strncmp(key.data, "id", 2) == 0) {
+                    // a non-string id must take the DOM path, which rejects it with a 400
+                    if(record.has_id || !parse_string(p, end, record.id)) return false;
+                    record.has_id = true;
+                } else {
+                    flat_field_values* values = nullptr;
+                    for(flat_field_values & field_values: record.fields) {
+                        if(field_values.schema.name.size() == key.len &&
+                           strncmp(field_values.schema.name.data(), key.data, key.len) == 0) {
+                            values = &field_values;
+                            break;
+                        }
+                    }
+
+                    if(values == nullptr) {
+                        if(!skip_value(p, end)) return false;
+                    } else {
+                        if(values->seen || !parse_field_value(p, end, *values)) return false;
+                        values->seen = true;
+                    }
+                }
+
+                skip_ws(p, end);
+                if(p == end) return false;
+                if(*p == ',') { p++; skip_ws(p, end); continue; }
+                if(*p == '}') { p++; break; }
+                return false;
+            }
+        }
+
+        skip_ws(p, end);
+        if(p != end) return false;
+
+        // a missing schema field must surface as a validation error via the DOM path
+        for(const flat_field_values & field_values: record.fields) {
+            if(!field_values.seen) return false;
+        }
+
+        return compute_points(default_sorting_field, record);
+    }
+
+private:
+
+    static void skip_ws(const char* & p, const char* end) {
+        while(p != end && (*p == ' ' || *p == '\t' || *p == '\r' || *p == '\n')) {
+            p++;
+        }
+    }
+
+    // captures the contents of a quoted string; escape sequences are rejected, since the
+    // record must be able to reference the raw buffer without unescaping
+    static bool parse_string(const char* & p, const char* end, flat_string & out) {
+        if(p == end || *p != '"') return false;
+        p++;
+
+        out.data = p;
+        while(p != end && *p != '"') {
+            if(*p == '\\') return false;
+            p++;
+        }
+
+        if(p == end) return false;
+        out.len = p - out.data;
+        p++;
+        return true;
+    }
+
+    static bool parse_int(const char* & p, const char* end, int64_t & out) {
+        char* num_end = nullptr;
+        out = strtoll(p, &num_end, 10);
+
+        if(num_end == p || num_end > end) return false;
+
+        // a fractional or exponent part means this is not an integer literal
+        if(num_end != end && (*num_end == '.' || *num_end == 'e' || *num_end == 'E')) return false;
+
+        p = num_end;
+        return true;
+    }
+
+    static bool parse_float(const char* & p, const char* end, float & out) {
+        char* num_end = nullptr;
+        out = strtof(p, &num_end);
+
+        if(num_end == p || num_end > end) return false;
+
+        p = num_end;
+        return true;
+    }
+
+    static bool parse_bool(const char* & p, const char* end, bool & out) {
+        if(end - p >= 4 && strncmp(p, "true", 4) == 0) {
+            out = true;
+            p += 4;
+            return true;
+        }
+
+        if(end - p >= 5 && strncmp(p, "false", 5) == 0) {
+            out = false;
+            p += 5;
+            return true;
+        }
+
+        return false;
+    }
+
+    static bool parse_scalar(const char* & p, const char* end, const std::string & type,
+                             flat_field_values & values) {
+        if(type == field_types::STRING || type == field_types::STRING_ARRAY) {
+            flat_string value;
+            if(!parse_string(p, end, value)) return false;
+            values.str_values.push_back(value);
+            return true;
+        }
+
+        if(type == field_types::INT32 || type == field_types::INT32_ARRAY) {
+            int64_t value;
+            if(!parse_int(p, end, value)) return false;
+            if(value > std::numeric_limits<int32_t>::max() ||
+               value < std::numeric_limits<int32_t>::min()) return false;
+            values.int_values.push_back(value);
+            return true;
+        }
+
+        if(type == field_types::INT64 || type == field_types::INT64_ARRAY) {
+            int64_t value;
+            if(!parse_int(p, end, value)) return false;
+            values.int_values.push_back(value);
+            return true;
+        }
+
+        if(type == field_types::FLOAT || type == field_types::FLOAT_ARRAY) {
+            // an integer literal is acceptable for a float field, like in the DOM path
+            float value;
+            if(!parse_float(p, end, value)) return false;
+            values.float_values.push_back(value);
+            return true;
+        }
+
+        if(type == field_types::BOOL || type == field_types::BOOL_ARRAY) {
+            bool value;
+            if(!parse_bool(p, end, value)) return false;
+            values.bool_values.push_back(value);
+            return true;
+        }
+
+        return false;
+    }
+
+    static bool parse_field_value(const char* & p, const char* end, flat_field_values & values) {
+        const std::string & type = values.schema.type;
+
+        const bool is_array = (type == field_types::STRING_ARRAY || type == field_types::INT32_ARRAY ||
+                               type == field_types::INT64_ARRAY || type == field_types::FLOAT_ARRAY ||
+                               type == field_types::BOOL_ARRAY);
+
+        if(!is_array) {
+            return parse_scalar(p, end, type, values);
+        }
+
+        if(p == end || *p != '[') return false;
+        p++;
+        skip_ws(p, end);
+
+        if(p != end && *p == ']') {
+            p++;
+            return true;
+        }
+
+        while(true) {
+            if(!parse_scalar(p, end, type, values)) return false;
+
+            skip_ws(p, end);
+            if(p == end) return false;
+            if(*p == ',') { p++; skip_ws(p, end); continue; }
+            if(*p == ']') { p++; return true; }
+            return false;
+        }
+    }
+
+    // skips over the value of a key that is not part of the schema
+    static bool skip_value(const char* & p, const char* end) {
+        if(p == end) return false;
+
+        if(*p == '"') {
+            p++;
+            while(p != end && *p != '"') {
+                if(*p == '\\') p++;  // escapes are fine here, the value is not captured
+                if(p != end) p++;
+            }
+            if(p == end) return false;
+            p++;
+            return true;
+        }
+
+        if(*p == '{' || *p == '[') {
+            size_t depth = 0;
+            while(p != end) {
+                if(*p == '"') {
+                    p++;
+                    while(p != end && *p != '"') {
+                        if(*p == '\\') p++;
+                        if(p != end) p++;
+                    }
+                    if(p == end) return false;
+                } else if(*p == '{' || *p == '[') {
+                    depth++;
+                } else if(*p == '}' || *p == ']') {
+                    depth--;
+                    if(depth == 0) {
+                        p++;
+                        return true;
+                    }
+                }
+                p++;
+            }
+            return false;
+        }
+
+        // number, bool or null: scan to the next delimiter
+        const char* start = p;
+        while(p != end && *p != ',' && *p != '}' && *p != ']' &&
+              *p != ' ' && *p != '\t' && *p != '\r' && *p != '\n') {
+            p++;
+        }
+        return p != start;
+    }
+
+    static bool compute_points(const std::string & default_sorting_field, flat_record & record) {
+        if(default_sorting_field.empty()) {
+            record.points = 0;
+            return true;
+        }
+
+        for(const flat_field_values & values: record.fields) {
+            if(values.schema.name != default_sorting_field) {
+                continue;
+            }
+
+            if(values.schema.type == field_types::INT32 || values.schema.type == field_types::INT64) {
+                if(values.int_values[0] > std::numeric_limits<int32_t>::max() ||
+                   values.int_values[0] < std::numeric_limits<int32_t>::min()) return false;
+                record.points = (int32_t) values.int_values[0];
+                return true;
+            }
+
+            if(values.schema.type == field_types::FLOAT) {
+                // serialize float to an integer and reverse the inverted range, like get_points_from_doc
+                int32_t points;
+                float n = values.float_values[0];
+                memcpy(&points, &n, sizeof(int32_t));
+                points ^= ((points >> (std::numeric_limits<int32_t>::digits - 1)) | INT32_MIN);
+                points = -1 * (INT32_MAX - points);
+                record.points = points;
+                return true;
+            }
+
+            return false;
+        }
+
+        return false;
+    }
+};
@@ -5,6 +5,10 @@
 
 /*
   NOTE: This is a really primitive blocking client meant only for specific Typesense use cases.
+
+  A single curl easy handle is cached across calls, so repeated requests to the same host reuse
+  the underlying keep-alive connection instead of paying a TCP+TLS handshake every time. This
+  matters for replication, where the replica polls the master in a tight loop.
 */
 class HttpClient {
 private:
@@ -12,9 +16,46 @@ private:
     std::string url;
     std::string api_key;
 
+    CURL *curl;
+
+    struct curl_slist *headers;
+
+    CURL* get_curl_handle() {
+        if(curl == nullptr) {
+            curl = curl_easy_init();
+            std::string api_key_header = std::string("x-typesense-api-key: ") + api_key;
+            headers = curl_slist_append(nullptr, api_key_header.c_str());
+            curl_easy_setopt(curl, CURLOPT_HTTPHEADER, headers);
+            curl_easy_setopt(curl, CURLOPT_SSL_VERIFYPEER, 0L);  // to allow self-signed certs
+            curl_easy_setopt(curl, CURLOPT_TCP_KEEPALIVE, 1L);   // detect dead peers on idle connections
+        }
+
+        return curl;
+    }
+
 public:
-    HttpClient(std::string url, std::string api_key): url(url), api_key(api_key) {
+    HttpClient(std::string url, std::string api_key): url(url), api_key(api_key),
+                                                      curl(nullptr), headers(nullptr) {
+
+    }
+
+    ~HttpClient() {
+        if(curl != nullptr) {
+            curl_easy_cleanup(curl);
+        }
+
+        if(headers != nullptr) {
+            curl_slist_free_all(headers);
+        }
+    }
+
+    HttpClient(HttpClient const&) = delete;
+    void operator=(HttpClient const&) = delete;
 
+    // changes the target of subsequent requests - the cached connection is reused
+    // when only the path or the query string differs
+    void set_url(const std::string & new_url) {
+        url = new_url;
     }
 
     static size_t curl_write (void *contents, size_t size, size_t nmemb, std::string *s) {
@@ -23,22 +64,34 @@ public:
     }
 
     long get_reponse(std::string & response) {
-        CURL *curl = curl_easy_init();
+        CURL *curl = get_curl_handle();
+        buffer.clear();
+
         curl_easy_setopt(curl, CURLOPT_URL, url.c_str());
-        curl_easy_setopt(curl, CURLOPT_SSL_VERIFYPEER, 0L);  // to allow self-signed certs
         curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, HttpClient::curl_write);
         curl_easy_setopt(curl, CURLOPT_WRITEDATA, &buffer);
-
-        struct curl_slist *chunk = NULL;
-        std::string api_key_header = std::string("x-typesense-api-key: ") + api_key;
-        chunk = curl_slist_append(chunk, api_key_header.c_str());
-        curl_easy_setopt(curl, CURLOPT_HTTPHEADER, chunk);
+        curl_easy_setopt(curl, CURLOPT_FAILONERROR, 0L);
 
         curl_easy_perform(curl);
         long http_code = 0;
         curl_easy_getinfo (curl, CURLINFO_RESPONSE_CODE, &http_code);
-        curl_easy_cleanup(curl);
         response = buffer;
         return http_code;
     }
-};
\ No newline at end of file
+
+    // Streams the response body through `callback` as chunks arrive, so that the full body
+    // is never buffered in memory. The callback has the same signature as CURLOPT_WRITEFUNCTION.
+    long get_response_stream(size_t (*callback)(void*, size_t, size_t, void*), void* context) {
+        CURL *curl = get_curl_handle();
+
+        curl_easy_setopt(curl, CURLOPT_URL, url.c_str());
+        curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, callback);
+        curl_easy_setopt(curl, CURLOPT_WRITEDATA, context);
+        curl_easy_setopt(curl, CURLOPT_FAILONERROR, 1L);  // error bodies must not reach the stream callback
+
+        curl_easy_perform(curl);
+        long http_code = 0;
+        curl_easy_getinfo (curl, CURLINFO_RESPONSE_CODE, &http_code);
+        return http_code;
+    }
+};
@@ -8,6 +8,7 @@
 #define H2O_USE_LIBUV 0
 extern "C" {
     #include "h2o.h"
+    #include "h2o/multithread.h"
 }
 
 class HttpServer;
@@ -19,7 +20,16 @@ struct http_res {
     HttpServer* server;
     bool final;
 
-    http_res(): content_type_header("application/json; charset=utf-8"), final(true) {
+    // set by a streaming chunk handler that has no data ready yet: the chunk is withheld
+    // and the stream resumes when the producer sends a STREAM_PROCEED_MSG nudge
+    bool paused;
+
+    // opaque handle to the stream's generator, filled in by stream_response() - producers
+    // pass it back as the payload of STREAM_PROCEED_MSG
+    void* generator;
+
+    http_res(): content_type_header("application/json; charset=utf-8"), final(true),
+                paused(false), generator(nullptr) {
 
     }
 
@@ -76,6 +86,11 @@ struct http_res {
 
 struct http_req {
     h2o_req_t* _req;
+
+    // receiver of the event loop that owns this request's connection - async messages
+    // concerning this request must be sent here so that the response is written on the right loop
+    h2o_multithread_receiver_t* receiver;
+
     std::map<std::string, std::string> params;
     std::string body;
 };
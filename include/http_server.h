@@ -9,36 +9,60 @@ extern "C" {
     #include "h2o/multithread.h"
 }
 
+#include <atomic>
 #include <map>
 #include <string>
+#include <thread>
+#include <vector>
 #include <stdio.h>
 #include "http_data.h"
+#include "route_trie.h"
 
 struct request_response {
     http_req* req;
     http_res* response;
 };
 
+// One event loop per worker thread: each carries its own h2o context, accept context,
+// SO_REUSEPORT listener and message queue, so the kernel balances connections across
+// loops and async messages can be routed back to the loop that owns a request.
+struct evloop_worker {
+    h2o_context_t ctx;
+    h2o_accept_ctx_t accept_ctx;
+    h2o_socket_t* listener_socket;
+    h2o_multithread_queue_t* message_queue;
+    h2o_multithread_receiver_t* message_receiver;
+
+    evloop_worker(): listener_socket(nullptr), message_queue(nullptr), message_receiver(nullptr) {
+
+    }
+};
+
 class HttpServer {
 private:
     h2o_globalconf_t config;
     h2o_compress_args_t compress_args;
-    h2o_context_t ctx;
-    h2o_accept_ctx_t* accept_ctx;
     h2o_hostconf_t *hostconf;
-    h2o_socket_t* listener_socket;
-    h2o_multithread_queue_t* message_queue;
-    h2o_multithread_receiver_t* message_receiver;
-    bool exit_loop = false;
+    SSL_CTX* ssl_ctx;
+
+    std::vector<evloop_worker*> loop_workers;
+    std::vector<std::thread> loop_threads;
+
+    std::atomic<bool> exit_loop;
 
     std::vector<route_path> routes;
 
+    // compiled once at registration time, so dispatch is O(path length) with no regex
+    route_trie routes_trie;
+
     std::map<std::string, void (*)(void*)> message_handlers;
 
     const std::string listen_address;
 
     const uint32_t listen_port;
 
+    const size_t num_threads;
+
     std::string ssl_cert_path;
 
     std::string ssl_cert_key_path;
@@ -51,7 +75,9 @@ private:
 
     int setup_ssl(const char *cert_file, const char *key_file);
 
-    int create_listener();
+    int create_listener(evloop_worker* worker);
+
+    int run_worker(evloop_worker* worker, bool is_primary);
 
     h2o_pathconf_t *register_handler(h2o_hostconf_t *hostconf, const char *path,
                                      int (*on_req)(h2o_handler_t *, h2o_req_t *));
@@ -66,11 +92,17 @@ private:
 
     static int send_401_unauthorized(h2o_req_t *req);
 
+    void send_message_to(h2o_multithread_receiver_t* receiver, const std::string & type, void* data);
+
+    // the receiver of the loop that owns the given request's connection
+    h2o_multithread_receiver_t* get_receiver(h2o_context_t* ctx);
+
     static constexpr const char* SEND_RESPONSE_MSG = "send_response";
 
 public:
     HttpServer(std::string listen_address, uint32_t listen_port,
-               std::string ssl_cert_path, std::string ssl_cert_key_path, bool cors_enabled);
+               std::string ssl_cert_path, std::string ssl_cert_key_path, bool cors_enabled,
+               size_t num_threads = 4);
 
     ~HttpServer();
 
@@ -84,9 +116,12 @@ public:
 
     void del(const std::string & path, void (*handler)(http_req & req, http_res & res), bool async = false);
 
+    void patch(const std::string & path, void (*handler)(http_req & req, http_res & res), bool async = false);
+
     void on(const std::string & message, void (*handler)(void*));
 
-    void send_message(const std::string & type, void* data);
+    // without an explicit receiver, the message is handled on the primary loop
+    void send_message(const std::string & type, void* data, h2o_multithread_receiver_t* receiver = nullptr);
 
     void send_response(http_req* request, const http_res* response);
 
@@ -97,14 +132,18 @@ public:
 
     static void response_stop(h2o_generator_t *generator, h2o_req_t *req);
 
+    // resumes a stream that was paused because its background producer had no data ready
+    static void on_stream_proceed(void *data);
+
     int run();
 
     void stop();
 
-    void clear_timeouts(const std::vector<h2o_timeout_t*> & timeouts);
+    void clear_timeouts(h2o_context_t & ctx, const std::vector<h2o_timeout_t*> & timeouts);
 
     static void on_stop_server(void *data);
 
     static constexpr const char* AUTH_HEADER = "x-typesense-api-key";
     static constexpr const char* STOP_SERVER_MESSAGE = "STOP_SERVER";
-};
\ No newline at end of file
+    static constexpr const char* STREAM_PROCEED_MSG = "stream_proceed";
+};
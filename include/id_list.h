@@ -0,0 +1,87 @@
+#pragma once
+
+#include <stdio.h>
+#include <stdint.h>
+#include "sorted_array.h"
+
+/**
+ * Hybrid posting list that holds the document IDs of a token.
+ *
+ * Sparse tokens are kept in a FOR-compressed `sorted_array`. Once a token becomes dense enough
+ * (roaring-style cardinality/density threshold), the IDs are promoted to a flat bitmap, so that
+ * stop-word-class tokens with millions of postings avoid per-block decompression on every
+ * intersection. The interface mirrors the parts of `sorted_array` used by the ART leaves.
+ */
+class id_list {
+private:
+    sorted_array* sarr;  // sparse, FOR-compressed form (null once promoted)
+
+    uint64_t* bits;      // dense bitmap form (null while sparse)
+    uint32_t num_words;
+
+    uint32_t bitmap_length;
+    uint32_t bitmap_min;
+    uint32_t bitmap_max;
+
+    void promote();
+
+    void ensure_word_capacity(uint32_t word_index);
+
+    // number of set bits before `value` (a lower bound style rank)
+    uint32_t rank(uint32_t value) const;
+
+public:
+    // promotion happens only above this cardinality...
+    static const uint32_t DENSE_MIN_LENGTH = 4096;
+
+    // ... and only when at least 1/16th of the ID range is populated
+    static const uint32_t DENSE_DIVISOR = 16;
+
+    id_list();
+
+    ~id_list();
+
+    id_list(const id_list&) = delete;
+
+    id_list& operator=(const id_list&) = delete;
+
+    bool is_dense() const;
+
+    uint32_t getLength() const;
+
+    uint32_t getMin() const;
+
+    uint32_t getMax() const;
+
+    bool append(uint32_t value);
+
+    bool contains(uint32_t value) const;
+
+    uint32_t at(uint32_t index) const;
+
+    uint32_t indexOf(uint32_t value) const;
+
+    // `values` must be sorted - an absent value gets an index of `getLength()`
+    void indexOf(const uint32_t *values, const size_t values_len, uint32_t* indices) const;
+
+    uint32_t* uncompress() const;
+
+    // heap bytes held by the list's current backing form
+    size_t memory_usage() const;
+
+    void remove_values(uint32_t *sorted_values, uint32_t values_length);
+
+    // Intersects against an uncompressed sorted array. Dense lists are probed bit-by-bit,
+    // without materializing the whole list. `results_out` must be deleted by the caller.
+    size_t intersect(const uint32_t *sorted_ids, const size_t ids_len, uint32_t **results_out) const;
+
+    // Container-to-container operators that pick a fast path based on the forms of both sides
+    static size_t intersect(const id_list & a, const id_list & b, uint32_t **results_out);
+
+    static size_t do_union(const id_list & a, const id_list & b, uint32_t **results_out);
+
+    // Snapshot serialization: the on-disk form matches the in-memory form
+    bool serialize(FILE *fp) const;
+
+    bool deserialize(FILE *fp);
+};
@@ -3,6 +3,7 @@
 #include <string>
 #include <unordered_map>
 #include <vector>
+#include <list>
 #include <mutex>
 #include <condition_variable>
 #include <art.h>
@@ -13,6 +14,11 @@
 #include <json.hpp>
 #include <field.h>
 #include <option.h>
+#include <sort_column.h>
+#include <range_index.h>
+#include <flat_record.h>
+#include <query_metrics.h>
+#include <offset_store.h>
 #include "string_utils.h"
 
 struct token_candidates {
@@ -32,9 +38,13 @@ struct search_args {
     size_t page;
     token_ordering token_order;
     bool prefix;
-    std::vector<std::pair<int, Topster<512>::KV>> field_order_kvs;
+    bool exhaustive_search;
+    size_t max_candidates;
+    search_cursor cursor;
+    std::vector<std::pair<int, Topster::KV>> field_order_kvs;
     size_t all_result_ids_len;
     std::vector<std::vector<art_leaf*>> searched_queries;
+    query_timings timings;
     Option<uint32_t> outcome;
 
     search_args(): outcome(0) {
@@ -43,10 +53,12 @@ struct search_args {
 
     search_args(std::string query, std::vector<std::string> search_fields, std::vector<filter> filters,
                 std::vector<facet> facets, std::vector<sort_by> sort_fields_std, int num_typos,
-                size_t per_page, size_t page, token_ordering token_order, bool prefix):
+                size_t per_page, size_t page, token_ordering token_order, bool prefix, bool exhaustive_search,
+                size_t max_candidates, const search_cursor & cursor):
             query(query), search_fields(search_fields), filters(filters), facets(facets),
             sort_fields_std(sort_fields_std), num_typos(num_typos), per_page(per_page), page(page),
-            token_order(token_order), prefix(prefix), all_result_ids_len(0), outcome(0) {
+            token_order(token_order), prefix(prefix), exhaustive_search(exhaustive_search),
+            max_candidates(max_candidates), cursor(cursor), all_result_ids_len(0), outcome(0) {
 
     }
 };
@@ -55,6 +67,9 @@ class Index {
 private:
     std::string name;
 
+    // arena for cold token offset payloads - nullptr when tiered offset storage is off
+    OffsetStore* offset_store;
+
     size_t num_documents;
 
     std::unordered_map<std::string, field> search_schema;
@@ -67,10 +82,85 @@ private:
 
     spp::sparse_hash_map<std::string, facet_value> facet_index;
 
-    spp::sparse_hash_map<std::string, spp::sparse_hash_map<uint32_t, number_t>*> sort_index;
+    spp::sparse_hash_map<std::string, sort_column*> sort_index;
+
+    // Answers numeric range filters with a binary search plus contiguous scan - one per
+    // integer/float field. Tombstoned ids linger here until compact(), since do_filtering
+    // excludes them at read time anyway.
+    spp::sparse_hash_map<std::string, range_index*> numeric_range_index;
 
     StringUtils string_utils;
 
+    // Caches the ids produced by do_filtering, since production traffic tends to repeat
+    // the same handful of filter expressions. Wiped whenever the index is mutated.
+    struct filter_cache_entry {
+        std::string key;
+        uint32_t* ids;
+        uint32_t ids_length;
+    };
+
+    std::list<filter_cache_entry> filter_cache_lru;  // most recently used in front
+
+    std::unordered_map<std::string, std::list<filter_cache_entry>::iterator> filter_cache_map;
+
+    size_t filter_cache_bytes;
+
+    std::mutex filter_cache_m;
+
+    // Gates the in-memory structures of this shard (ART trees, posting lists, facet and sort
+    // indices), all of which are mutated in place. Searches are admitted concurrently, while a
+    // write excludes them - but only on its own shard, so indexing no longer stalls the whole
+    // collection and searches wait just for the duration of a single document's mutation.
+    std::mutex rw_m;
+
+    std::condition_variable rw_cv;
+
+    size_t num_readers;
+
+    bool writer_active;
+
+    void read_lock();
+
+    void read_unlock();
+
+    void write_lock();
+
+    void write_unlock();
+
+    struct read_guard {
+        Index* index;
+        read_guard(Index* index): index(index) { index->read_lock(); }
+        ~read_guard() { index->read_unlock(); }
+    };
+
+    struct write_guard {
+        Index* index;
+        write_guard(Index* index): index(index) { index->write_lock(); }
+        ~write_guard() { index->write_unlock(); }
+    };
+
+    // Tombstones of lazily deleted documents: a removal only records the seq_id here (plus cheap
+    // facet and sort index erases) and searches skip tombstoned ids at read time. The posting
+    // lists themselves are rewritten later by compact(), once tombstones are dense enough for a
+    // full pass over the ART leaves to be worthwhile.
+    spp::sparse_hash_set<uint32_t> deleted_ids;
+
+    // in-place removal of tombstoned ids from a sorted result array - returns the new length
+    size_t exclude_deleted_ids(uint32_t* ids, size_t ids_len) const;
+
+    // inserts (or erases, when `erase` is set) a document's numeric values into the field's range index
+    void range_index_values(const field & a_field, const nlohmann::json & document,
+                            const uint32_t seq_id, const bool erase);
+
+    static std::string filter_cache_key(const std::vector<filter> & filters);
+
+    // copies the cached ids into `filter_ids_out` (caller owns the copy)
+    bool filter_cache_get(const std::string & cache_key, uint32_t** filter_ids_out, uint32_t* filter_ids_length);
+
+    void filter_cache_put(const std::string & cache_key, const uint32_t* filter_ids, uint32_t filter_ids_length);
+
+    void clear_filter_cache();
+
     static inline std::vector<art_leaf *> next_suggestion(const std::vector<token_candidates> &token_candidates_vec,
                                                           long long int n);
 
@@ -82,22 +172,26 @@ private:
 
     void do_facets(std::vector<facet> & facets, uint32_t* result_ids, size_t results_size);
 
-    void populate_token_positions(const std::vector<art_leaf *> &query_suggestion,
-                                  spp::sparse_hash_map<const art_leaf *, uint32_t *> &leaf_to_indices,
-                                  size_t result_index, std::vector<std::vector<uint16_t>> &token_positions) const;
+    // moves the offset payloads of leaves that are still heap-resident into the offset store;
+    // must be called with the write gate held
+    void freeze_offsets();
 
     void search_field(std::string & query, const std::string & field, uint32_t *filter_ids, size_t filter_ids_length,
                       std::vector<facet> & facets, const std::vector<sort_by> & sort_fields,
                       const int num_typos, const size_t num_results,
                       std::vector<std::vector<art_leaf*>> & searched_queries,
-                      Topster<512> & topster, uint32_t** all_result_ids,
-                      size_t & all_result_ids_len, const token_ordering token_order = FREQUENCY, const bool prefix = false);
+                      Topster & topster, uint32_t** all_result_ids,
+                      size_t & all_result_ids_len, query_timings & timings,
+                      const token_ordering token_order = FREQUENCY,
+                      const bool prefix = false, const bool exhaustive_search = true,
+                      const size_t max_candidates = DEFAULT_MAX_CANDIDATES);
 
     void search_candidates(uint32_t* filter_ids, size_t filter_ids_length, std::vector<facet> & facets,
                            const std::vector<sort_by> & sort_fields, std::vector<token_candidates> & token_to_candidates,
                            const token_ordering token_order, std::vector<std::vector<art_leaf*>> & searched_queries,
-                           Topster<512> & topster, size_t & total_results, uint32_t** all_result_ids,
-                           size_t & all_result_ids_len, const size_t & max_results, const bool prefix);
+                           Topster & topster, size_t & total_results, uint32_t** all_result_ids,
+                           size_t & all_result_ids_len, const size_t & max_results, const bool prefix,
+                           const bool exhaustive_search, const size_t max_candidates, query_timings & timings);
 
     void index_string_field(const std::string & text, const uint32_t score, art_tree *t, uint32_t seq_id,
                             const bool verbatim) const;
@@ -121,37 +215,79 @@ private:
     
     void index_bool_array_field(const std::vector<bool> & values, const uint32_t score, art_tree *t, uint32_t seq_id) const;
 
-    void remove_and_shift_offset_index(sorted_array &offset_index, const uint32_t *indices_sorted,
-                                       const uint32_t indices_length);
-
 public:
     Index() = delete;
 
+    // `offsets_path` enables tiered offset storage: the compressed token offset payloads of
+    // cold leaves are moved into an append-only memory-mapped arena at this path, letting the
+    // OS page them out. An empty path keeps everything on the heap.
     Index(const std::string name, std::unordered_map<std::string, field> search_schema,
-          std::unordered_map<std::string, field> facet_schema, std::unordered_map<std::string, field> sort_schema);
+          std::unordered_map<std::string, field> facet_schema, std::unordered_map<std::string, field> sort_schema,
+          const std::string & offsets_path = "");
 
     ~Index();
 
-    void run_search();
-
     void search(Option<uint32_t> & outcome, std::string query, const std::vector<std::string> search_fields,
                           const std::vector<filter> & filters, std::vector<facet> & facets,
                           std::vector<sort_by> sort_fields_std, const int num_typos,
                           const size_t per_page, const size_t page,
-                          const token_ordering token_order, const bool prefix,
-                          std::vector<std::pair<int, Topster<512>::KV>> & field_order_kv,
-                          size_t & all_result_ids_len, std::vector<std::vector<art_leaf*>> & searched_queries);
-
-    Option<uint32_t> remove(const uint32_t seq_id, nlohmann::json & document);
+                          const token_ordering token_order, const bool prefix, const bool exhaustive_search,
+                          const size_t max_candidates, const search_cursor & cursor,
+                          std::vector<std::pair<int, Topster::KV>> & field_order_kv,
+                          size_t & all_result_ids_len, std::vector<std::vector<art_leaf*>> & searched_queries,
+                          query_timings & timings);
+
+    Option<uint32_t> remove(const uint32_t seq_id);
+
+    // Re-indexes only the given fields of a document, leaving the posting lists of unchanged
+    // fields untouched - for a numeric field this is a single delete/insert pair on the encoded
+    // key plus a sort index write. The max_score hints of unchanged fields keep the old points,
+    // which is harmless since they are only pruning upper bounds.
+    Option<uint32_t> update_fields(const nlohmann::json & old_document, const nlohmann::json & new_document,
+                                   const std::vector<std::string> & changed_fields, const uint32_t seq_id,
+                                   const int32_t points);
+
+    // Rewrites the posting lists of all fields without their tombstoned ids, and deletes leaves
+    // that become empty. Takes the shard's write gate for the duration of the pass.
+    void compact();
+
+    // whether tombstones have crossed the density threshold that makes a compaction pass worthwhile
+    bool needs_compaction();
+
+    // Per-field bytes held by this shard's in-memory structures (ART tree with posting data,
+    // sort column, facet maps and range index). Walks the ART leaves, so it is not free -
+    // meant for the stats endpoint, not the hot path.
+    nlohmann::json get_memory_stats();
 
     void score_results(const std::vector<sort_by> & sort_fields, const int & query_index, const uint32_t total_cost,
-                       Topster<512> &topster, const std::vector<art_leaf *> & query_suggestion,
+                       Topster &topster, const std::vector<art_leaf *> & query_suggestion,
                        const uint32_t *result_ids, const size_t result_size) const;
 
     Option<uint32_t> index_in_memory(const nlohmann::json & document, uint32_t seq_id, int32_t points);
 
+    // Indexes a pre-validated flat record produced by the schema-driven scanner, without a DOM.
+    Option<uint32_t> index_in_memory(const flat_record & record, uint32_t seq_id, int32_t points);
+
+    // Serializes the in-memory state (ART trees with their posting data, sort index and facet index) to fp.
+    bool snapshot_save(FILE* fp);
+
+    // Restores state previously written by snapshot_save. The index must be freshly constructed.
+    bool snapshot_load(FILE* fp);
+
     static const int SEARCH_LIMIT_NUM = 100;  // for limiting number of results on multiple candidates / query rewrites
 
+    // Cap on the number of suggestion combinations (cartesian product of per-token typo
+    // candidates) evaluated for a query - the expansion budget exposed as `max_candidates`
+    static const size_t DEFAULT_MAX_CANDIDATES = 10;
+
+    static const size_t FILTER_CACHE_BUDGET_BYTES = 4 * 1048576;  // per-shard memory budget of the filter cache
+
+    // compaction kicks in only after this many tombstones accumulate...
+    static const size_t COMPACTION_MIN_TOMBSTONES = 1000;
+
+    // ... and once tombstones make up at least this percentage of the shard's documents
+    static const size_t COMPACTION_TOMBSTONE_PCT = 10;
+
     // strings under this length will be fully highlighted, instead of showing a snippet of relevant portion
     enum {SNIPPET_STR_ABOVE_LEN = 30};
 
@@ -160,19 +296,5 @@ public:
     static constexpr const char* COLLECTION_NEXT_SEQ_PREFIX = "$CS";
     static constexpr const char* SEQ_ID_PREFIX = "$SI";
     static constexpr const char* DOC_ID_PREFIX = "$DI";
-
-    /*
-     * Concurrency Primitives
-    */
-
-    // Used for passing control back and forth between main and worker threads
-    std::mutex m;
-    std::condition_variable cv;
-
-    bool ready;       // prevents spurious wake up of the worker thread
-    bool processed;   // prevents spurious wake up of the main thread
-    bool terminate;   // used for interrupting the thread during tear down
-
-    search_args search_params;
 };
 
@@ -2,7 +2,7 @@
 
 #include <stdint.h>
 #include <vector>
-#include <queue>
+#include <cstring>
 #include <stdlib.h>
 #include <limits>
 #include "logger.h"
@@ -13,8 +13,6 @@
 #define D(x)
 #endif
 
-#define TokenOffsetHeap std::priority_queue<TokenOffset, std::vector<TokenOffset>, TokenOffset>
-
 const size_t WINDOW_SIZE = 10;
 const uint16_t MAX_DISPLACEMENT = std::numeric_limits<uint16_t>::max();
 const uint16_t MAX_TOKENS_DISTANCE = 100;
@@ -29,6 +27,12 @@ struct TokenOffset {
     }
 };
 
+// Non-owning view over one token's sorted offsets within a single document.
+struct OffsetSlice {
+    const uint16_t* offsets;
+    size_t len;
+};
+
 struct Match {
   uint16_t words_present;
   uint16_t distance;
@@ -53,17 +57,32 @@ struct Match {
     }
   }
 
-  static inline void addTopOfHeapToWindow(TokenOffsetHeap &heap, std::queue<TokenOffset> &window,
-                                           std::vector<std::vector<uint16_t>> &token_offsets, uint16_t *token_offset) {
-    TokenOffset top = heap.top();
-    heap.pop();
-    window.push(top);
+  // `pending` holds at most one upcoming offset per token, so a linear scan beats a heap
+  static inline size_t min_pending_index(const TokenOffset* pending, const size_t num_pending) {
+    size_t min_index = 0;
+    for(size_t i = 1; i < num_pending; i++) {
+      if(pending[i].offset < pending[min_index].offset) {
+        min_index = i;
+      }
+    }
+    return min_index;
+  }
+
+  static inline void addMinPendingToWindow(TokenOffset* pending, size_t & num_pending, const size_t min_index,
+                                           const OffsetSlice* token_offsets, std::vector<TokenOffset> &window,
+                                           uint16_t *token_offset) {
+    TokenOffset top = pending[min_index];
+    window.push_back(top);
     token_offset[top.token_id] = std::min(token_offset[top.token_id], top.offset);
     top.offset_index++;
 
-    // Must refill the heap - push the next offset of the same token
-    if(top.offset_index < token_offsets[top.token_id].size()) {
-        heap.push(TokenOffset{top.token_id, token_offsets[top.token_id][top.offset_index], top.offset_index});
+    // Must refill the slot - the next offset of the same token, or drop the slot when exhausted
+    if(top.offset_index < token_offsets[top.token_id].len) {
+        pending[min_index] = TokenOffset{top.token_id, token_offsets[top.token_id].offsets[top.offset_index],
+                                         top.offset_index};
+    } else {
+        pending[min_index] = pending[num_pending - 1];
+        num_pending--;
     }
   }
 
@@ -87,22 +106,30 @@ struct Match {
   *  a) How many tokens are present in the document
   *  b) The proximity between the tokens in the document
   *
-  *  We use a priority queue to read the offset vectors in a sorted manner, slide a window of a given size, and
+  *  We read the offset slices in a merged, sorted manner, slide a window of a given size, and
   *  compute the max_match and min_displacement of target tokens across the windows.
+  *
+  *  The kernel itself does not allocate: `window` is caller-owned scratch whose capacity is
+  *  reused across calls, which is what makes batch scoring of a result block allocation-free.
   */
-  static Match match(uint32_t doc_id, std::vector<std::vector<uint16_t>> &token_offsets) {
-    std::priority_queue<TokenOffset, std::vector<TokenOffset>, TokenOffset> heap;
-
-    for(uint8_t token_id=0; token_id < token_offsets.size(); token_id++) {
-      heap.push(TokenOffset{token_id, token_offsets[token_id].front(), 0});
+  static Match match(uint32_t doc_id, const OffsetSlice* token_offsets, const size_t num_tokens,
+                     std::vector<TokenOffset> &window) {
+    // at most one upcoming offset per token is pending at any time
+    TokenOffset pending[WINDOW_SIZE];
+    size_t num_pending = 0;
+
+    for(uint8_t token_id=0; token_id < num_tokens; token_id++) {
+      pending[num_pending++] = TokenOffset{token_id, token_offsets[token_id].offsets[0], 0};
     }
 
-    // heap now contains the first occurring offset of each token in the given document
+    // `pending` now contains the first occurring offset of each token in the given document
 
     uint16_t max_match = 0;
     uint16_t min_displacement = MAX_DISPLACEMENT;
 
-    std::queue<TokenOffset> window;
+    window.clear();
+    size_t window_head = 0;
+
     uint16_t token_offset[WINDOW_SIZE] = { };
     std::fill_n(token_offset, WINDOW_SIZE, MAX_DISPLACEMENT);
 
@@ -111,18 +138,23 @@ struct Match {
     std::fill_n(min_token_offset, WINDOW_SIZE, MAX_DISPLACEMENT);
 
     do {
-      if(window.empty()) {
-        addTopOfHeapToWindow(heap, window, token_offsets, token_offset);
+      if(window_head == window.size()) {
+        addMinPendingToWindow(pending, num_pending, min_pending_index(pending, num_pending),
+                              token_offsets, window, token_offset);
       }
 
       D(LOG(INFO) << "Loop till window fills... doc_id: " << doc_id;)
 
-      // Fill the queue with tokens within a given window frame size of the start offset
+      // Fill the window with tokens within a given window frame size of the start offset
       // At the same time, we also record the *last* occurrence of each token within the window
       // For e.g. if `cat` appeared at offsets 1,3 and 5, we will record `token_offset[cat] = 5`
-      const uint16_t start_offset = window.front().offset;
-      while(!heap.empty() && heap.top().offset < start_offset+WINDOW_SIZE) {
-        addTopOfHeapToWindow(heap, window, token_offsets, token_offset);
+      const uint16_t start_offset = window[window_head].offset;
+      while(num_pending != 0) {
+        const size_t min_index = min_pending_index(pending, num_pending);
+        if(pending[min_index].offset >= start_offset+WINDOW_SIZE) {
+          break;
+        }
+        addMinPendingToWindow(pending, num_pending, min_index, token_offsets, window, token_offset);
       }
 
       D(LOG(INFO) << "----");
@@ -131,7 +163,7 @@ struct Match {
       uint16_t num_match = 0;
       uint16_t displacement = 0;
 
-      for(size_t token_id=0; token_id<token_offsets.size(); token_id++) {
+      for(size_t token_id=0; token_id<num_tokens; token_id++) {
         // If a token appeared within the window, we would have recorded its offset
         if(token_offset[token_id] != MAX_DISPLACEMENT) {
           num_match++;
@@ -155,14 +187,14 @@ struct Match {
       if(num_match > max_match || (num_match == max_match && displacement < min_displacement)) {
         min_displacement = displacement;
         // record the token positions (for highlighting)
-        memcpy(min_token_offset, token_offset, token_offsets.size()*sizeof(uint16_t));
+        memcpy(min_token_offset, token_offset, num_tokens*sizeof(uint16_t));
         max_match = num_match;
       }
 
       // As we slide the window, drop the first token of the window from the computation
-      token_offset[window.front().token_id] = MAX_DISPLACEMENT;
-      window.pop();
-    } while(!heap.empty());
+      token_offset[window[window_head].token_id] = MAX_DISPLACEMENT;
+      window_head++;
+    } while(num_pending != 0);
 
     // do run-length encoding of the min token positions/offsets
     uint16_t token_start_offset = 0;
@@ -171,7 +203,7 @@ struct Match {
 
     // identify the first token which is actually present and use that as the base for run-length encoding
     size_t token_index = 0;
-    while(token_index < token_offsets.size()) {
+    while(token_index < num_tokens) {
       if(min_token_offset[token_index] != MAX_DISPLACEMENT) {
         token_start_offset = min_token_offset[token_index];
         break;
@@ -180,7 +212,19 @@ struct Match {
     }
 
     const uint16_t distance = MAX_TOKENS_DISTANCE - min_displacement;
-    pack_token_offsets(min_token_offset, token_offsets.size(), token_start_offset, packed_offset_diffs);
+    pack_token_offsets(min_token_offset, num_tokens, token_start_offset, packed_offset_diffs);
     return Match(max_match, distance, token_start_offset, packed_offset_diffs);
   }
+
+  // Convenience wrapper over the slice kernel for callers that score a single document
+  // (highlighting, tests) - batch scoring in `Index::score_results` uses the slice form directly.
+  static Match match(uint32_t doc_id, std::vector<std::vector<uint16_t>> &token_offsets) {
+    OffsetSlice token_slices[WINDOW_SIZE];
+    for(size_t token_id=0; token_id < token_offsets.size(); token_id++) {
+      token_slices[token_id] = OffsetSlice{token_offsets[token_id].data(), token_offsets[token_id].size()};
+    }
+
+    std::vector<TokenOffset> window;
+    return match(doc_id, token_slices, token_offsets.size(), window);
+  }
 };
@@ -0,0 +1,53 @@
+#pragma once
+
+#include <stdint.h>
+#include <string>
+#include <mutex>
+
+/*
+ * Append-only memory-mapped arena that holds the compressed token offset payloads of an Index.
+ *
+ * Offsets make up roughly half of the resident index memory but are read only for the handful
+ * of documents that reach scoring, so they are moved here during background maintenance. The
+ * arena is a sparse file that is unlinked right after being mapped: the mapping stays valid,
+ * the kernel can write cold pages out and reclaim them under memory pressure, and the blocks
+ * are freed automatically when the Index goes away - even after a crash.
+ *
+ * Space of payloads that are copied back to the heap (because their leaf got mutated again) is
+ * not reclaimed until the arena is rebuilt; freeze passes log the fill level.
+ */
+class OffsetStore {
+private:
+    const std::string path;
+
+    int fd;
+
+    uint8_t* base;
+
+    const size_t capacity;
+
+    size_t used;
+
+    std::mutex m;
+
+public:
+    OffsetStore() = delete;
+
+    OffsetStore(const std::string & path, const size_t capacity = DEFAULT_CAPACITY);
+
+    ~OffsetStore();
+
+    // whether the backing file could be created and mapped
+    bool ok();
+
+    // copies `len` bytes into the arena and returns a pointer to the stable mapped copy,
+    // or nullptr when the arena cannot hold them
+    uint8_t* append(const uint8_t* data, const size_t len);
+
+    size_t bytes_used();
+
+    size_t get_capacity();
+
+    // sparse: blocks are allocated only as pages are actually written
+    static const size_t DEFAULT_CAPACITY = ((size_t) 1) << 30;
+};
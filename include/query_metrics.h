@@ -0,0 +1,177 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <mutex>
+#include <atomic>
+#include <algorithm>
+
+// stages of a search request that are timed individually
+enum query_stage {
+    STAGE_FILTER = 0,
+    STAGE_TOKEN_SEARCH,
+    STAGE_SCORING,
+    STAGE_FACETING,
+    STAGE_HYDRATION,
+    STAGE_HIGHLIGHTING,
+    NUM_QUERY_STAGES
+};
+
+// Per-request timing context: a fixed array of accumulated microseconds, one slot per stage.
+// Recording a span costs two clock reads and an add - nothing is allocated on the hot path.
+struct query_timings {
+    uint64_t stage_micros[NUM_QUERY_STAGES];
+    bool stage_ran[NUM_QUERY_STAGES];
+
+    // work counters for the slow query log
+    uint64_t leaves_expanded;    // ART leaves returned by fuzzy token searches
+    uint64_t ids_scanned;        // posting ids that reached scoring
+    uint64_t topster_evictions;  // results that pushed a lower-ranked entry out of a full topster
+    uint64_t max_typo_cost;      // highest total typo cost among the scored suggestions
+
+    query_timings(): leaves_expanded(0), ids_scanned(0), topster_evictions(0), max_typo_cost(0) {
+        memset(stage_micros, 0, sizeof(stage_micros));
+        memset(stage_ran, 0, sizeof(stage_ran));
+    }
+
+    static uint64_t now_micros() {
+        return std::chrono::duration_cast<std::chrono::microseconds>(
+                std::chrono::high_resolution_clock::now().time_since_epoch()).count();
+    }
+
+    void record(const query_stage stage, const uint64_t begin_micros) {
+        stage_micros[stage] += now_micros() - begin_micros;
+        stage_ran[stage] = true;
+    }
+
+    // folds in the timings of a per-field (or per-shard) search that ran on its own context
+    void merge(const query_timings & other) {
+        for(size_t stage = 0; stage < NUM_QUERY_STAGES; stage++) {
+            stage_micros[stage] += other.stage_micros[stage];
+            stage_ran[stage] = stage_ran[stage] || other.stage_ran[stage];
+        }
+
+        leaves_expanded += other.leaves_expanded;
+        ids_scanned += other.ids_scanned;
+        topster_evictions += other.topster_evictions;
+        max_typo_cost = std::max(max_typo_cost, other.max_typo_cost);
+    }
+};
+
+/*
+* Process-wide aggregation of per-stage query timings into log-scale histograms, from which
+* GET /metrics reports p50/p95/p99 latencies per stage. A finished request folds its timings
+* in with a single mutex acquisition; stages that did not run in a request are not counted,
+* so each stage's percentiles cover only the requests that actually exercised it.
+*/
+class QueryMetrics {
+private:
+    // bucket 0 counts sub-microsecond spans; bucket i counts spans of [2^(i-1), 2^i) microseconds
+    static const size_t NUM_BUCKETS = 40;
+
+    uint64_t bucket_counts[NUM_QUERY_STAGES][NUM_BUCKETS];
+
+    uint64_t stage_counts[NUM_QUERY_STAGES];
+
+    std::mutex m;
+
+    // searches that take longer than this are logged with a stage breakdown; negative disables
+    std::atomic<int64_t> slow_query_threshold_micros;
+
+    QueryMetrics(): slow_query_threshold_micros(-1) {
+        memset(bucket_counts, 0, sizeof(bucket_counts));
+        memset(stage_counts, 0, sizeof(stage_counts));
+    }
+
+    // smallest value that lies above every span of the bucket
+    static uint64_t bucket_upper_bound(const size_t bucket) {
+        return (bucket == 0) ? 1 : (uint64_t(1) << bucket);
+    }
+
+    // upper bound of the first bucket at which the cumulative count reaches the percentile
+    uint64_t percentile(const query_stage stage, const size_t pct) {
+        const uint64_t rank = (stage_counts[stage] * pct + 99) / 100;
+        uint64_t cumulative = 0;
+
+        for(size_t bucket = 0; bucket < NUM_BUCKETS; bucket++) {
+            cumulative += bucket_counts[stage][bucket];
+            if(cumulative >= rank) {
+                return bucket_upper_bound(bucket);
+            }
+        }
+
+        return bucket_upper_bound(NUM_BUCKETS - 1);
+    }
+
+public:
+    struct stage_stats {
+        std::string stage;
+        uint64_t count;
+        uint64_t p50_micros;
+        uint64_t p95_micros;
+        uint64_t p99_micros;
+    };
+
+    static QueryMetrics & get_instance() {
+        static QueryMetrics instance;
+        return instance;
+    }
+
+    static std::string stage_name(const query_stage stage) {
+        switch(stage) {
+            case STAGE_FILTER: return "filter";
+            case STAGE_TOKEN_SEARCH: return "token_search";
+            case STAGE_SCORING: return "scoring";
+            case STAGE_FACETING: return "faceting";
+            case STAGE_HYDRATION: return "hydration";
+            case STAGE_HIGHLIGHTING: return "highlighting";
+            default: return "unknown";
+        }
+    }
+
+    void set_slow_query_threshold_ms(const int64_t threshold_ms) {
+        slow_query_threshold_micros = (threshold_ms < 0) ? -1 : threshold_ms * 1000;
+    }
+
+    int64_t get_slow_query_threshold_micros() {
+        return slow_query_threshold_micros;
+    }
+
+    void add(const query_timings & timings) {
+        std::lock_guard<std::mutex> lock(m);
+
+        for(size_t stage = 0; stage < NUM_QUERY_STAGES; stage++) {
+            if(!timings.stage_ran[stage]) {
+                continue;
+            }
+
+            const uint64_t micros = timings.stage_micros[stage];
+            size_t bucket = (micros == 0) ? 0 : (64 - __builtin_clzll(micros));
+            bucket = std::min(bucket, NUM_BUCKETS - 1);
+
+            bucket_counts[stage][bucket] += 1;
+            stage_counts[stage] += 1;
+        }
+    }
+
+    std::vector<stage_stats> get_stats() {
+        std::lock_guard<std::mutex> lock(m);
+        std::vector<stage_stats> stats;
+
+        for(size_t stage = 0; stage < NUM_QUERY_STAGES; stage++) {
+            const query_stage a_stage = (query_stage) stage;
+            stage_stats a_stats;
+            a_stats.stage = stage_name(a_stage);
+            a_stats.count = stage_counts[stage];
+            a_stats.p50_micros = (stage_counts[stage] == 0) ? 0 : percentile(a_stage, 50);
+            a_stats.p95_micros = (stage_counts[stage] == 0) ? 0 : percentile(a_stage, 95);
+            a_stats.p99_micros = (stage_counts[stage] == 0) ? 0 : percentile(a_stage, 99);
+            stats.push_back(a_stats);
+        }
+
+        return stats;
+    }
+};
@@ -0,0 +1,78 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <vector>
+#include <limits>
+#include <algorithm>
+#include "art.h"
+
+/*
+* A value-ordered column of (value, seq_id) pairs for a numeric field. A range predicate is
+* answered with a binary search for the boundary plus a contiguous scan, instead of collecting
+* every matching encoded-key ART leaf and unioning their id lists. Values are stored as
+* order-preserving int64 encodings, so integers, floats and bools share one comparison path.
+*/
+struct range_index {
+    // sorted by (value, seq_id)
+    std::vector<std::pair<int64_t, uint32_t>> entries;
+
+    // order-preserving integer encoding of a float - the same transform the ART keys use
+    static int64_t encode_value(float value) {
+        int32_t i;
+        memcpy(&i, &value, sizeof(int32_t));
+        i ^= ((i >> (std::numeric_limits<int32_t>::digits - 1)) | INT32_MIN);
+        return i;
+    }
+
+    void insert(const int64_t value, const uint32_t seq_id) {
+        const std::pair<int64_t, uint32_t> entry = std::make_pair(value, seq_id);
+        entries.insert(std::lower_bound(entries.begin(), entries.end(), entry), entry);
+    }
+
+    void erase(const int64_t value, const uint32_t seq_id) {
+        const std::pair<int64_t, uint32_t> entry = std::make_pair(value, seq_id);
+        const auto it = std::lower_bound(entries.begin(), entries.end(), entry);
+
+        if(it != entries.end() && *it == entry) {
+            entries.erase(it);
+        }
+    }
+
+    // Appends the ids satisfying `<comparator> value` to `ids`. The ids come out in value
+    // order, so the caller must sort (and de-dupe for array fields) the collected ids once.
+    void query(const int64_t value, const NUM_COMPARATOR comparator, std::vector<uint32_t> & ids) const {
+        const auto lower = std::lower_bound(entries.begin(), entries.end(),
+                                            std::make_pair(value, std::numeric_limits<uint32_t>::min()));
+        const auto upper = std::upper_bound(entries.begin(), entries.end(),
+                                            std::make_pair(value, std::numeric_limits<uint32_t>::max()));
+
+        auto begin = entries.begin();
+        auto end = entries.end();
+
+        switch(comparator) {
+            case EQUALS:
+                begin = lower; end = upper; break;
+            case LESS_THAN:
+                end = lower; break;
+            case LESS_THAN_EQUALS:
+                end = upper; break;
+            case GREATER_THAN:
+                begin = upper; break;
+            case GREATER_THAN_EQUALS:
+                begin = lower; break;
+        }
+
+        for(auto it = begin; it != end; ++it) {
+            ids.push_back(it->second);
+        }
+    }
+
+    size_t size() const {
+        return entries.size();
+    }
+
+    size_t memory_usage() const {
+        return entries.capacity() * sizeof(std::pair<int64_t, uint32_t>);
+    }
+};
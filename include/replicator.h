@@ -7,7 +7,10 @@
 #include <json.hpp>
 #include <thread>
 #include <string>
+#include <map>
 #include <iostream>
+#include <cstdio>
+#include <sys/stat.h>
 #include "logger.h"
 
 struct ReplicationEvent {
@@ -87,59 +90,308 @@ public:
     }
 };
 
+/*
+ *  Decodes the master's replication stream of length-prefixed write batches. Complete batches are
+ *  applied as they are decoded, so at most one batch (plus a partial frame) is ever held in memory.
+ */
+struct ReplicationStream {
+    std::string buffer;
+    IterateBatchHandler* handler;
+    Store* store;
+    uint64_t num_batches_applied;
+
+    ReplicationStream(IterateBatchHandler* handler, Store* store): handler(handler), store(store),
+                                                                   num_batches_applied(0) {
+
+    }
+
+    static size_t on_chunk(void *contents, size_t size, size_t nmemb, void *context) {
+        ReplicationStream* stream = static_cast<ReplicationStream*>(context);
+        stream->buffer.append((char*)contents, size*nmemb);
+
+        // drain all complete length-prefixed frames from the buffer
+        while(stream->buffer.size() >= 4) {
+            uint32_t batch_size = StringUtils::deserialize_uint32_t(stream->buffer.substr(0, 4));
+
+            if(stream->buffer.size() < 4 + batch_size) {
+                // wait for the rest of the frame to arrive
+                break;
+            }
+
+            const std::string batch_serialized = stream->buffer.substr(4, batch_size);
+            stream->buffer.erase(0, 4 + batch_size);
+
+            // first write to memory, then to the store
+            rocksdb::WriteBatch write_batch(batch_serialized);
+            write_batch.Iterate(stream->handler);
+            stream->store->_get_db_unsafe()->Write(rocksdb::WriteOptions(), &write_batch);
+            stream->num_batches_applied++;
+        }
+
+        return size*nmemb;
+    }
+};
+
+/*
+ *  Decodes a master's store snapshot dump: an 8-byte header carrying the snapshot's WAL sequence
+ *  number, followed by length-prefixed key/value frames. Pairs are written to the local store in
+ *  batches as they are decoded, so at most one batch (plus a partial frame) is ever held in memory.
+ */
+struct StoreDumpStream {
+    std::string buffer;
+    Store* store;
+    bool got_header;
+    uint64_t master_seq;
+    uint64_t num_keys;
+    rocksdb::WriteBatch batch;
+    size_t batch_keys;
+
+    static const size_t DUMP_WRITE_BATCH_SIZE = 1000;
+
+    StoreDumpStream(Store* store): store(store), got_header(false), master_seq(0),
+                                   num_keys(0), batch_keys(0) {
+
+    }
+
+    void flush() {
+        if(batch_keys != 0) {
+            store->batch_write(batch);
+            batch.Clear();
+            batch_keys = 0;
+        }
+    }
+
+    static size_t on_chunk(void *contents, size_t size, size_t nmemb, void *context) {
+        StoreDumpStream* stream = static_cast<StoreDumpStream*>(context);
+        stream->buffer.append((char*)contents, size*nmemb);
+
+        if(!stream->got_header && stream->buffer.size() >= 8) {
+            const uint64_t hi = StringUtils::deserialize_uint32_t(stream->buffer.substr(0, 4));
+            const uint64_t lo = StringUtils::deserialize_uint32_t(stream->buffer.substr(4, 4));
+            stream->master_seq = (hi << 32) | lo;
+            stream->buffer.erase(0, 8);
+            stream->got_header = true;
+        }
+
+        // drain all complete key/value frames from the buffer
+        while(stream->got_header && stream->buffer.size() >= 4) {
+            uint32_t key_size = StringUtils::deserialize_uint32_t(stream->buffer.substr(0, 4));
+            if(stream->buffer.size() < 4 + key_size + 4) {
+                break;
+            }
+
+            uint32_t value_size = StringUtils::deserialize_uint32_t(stream->buffer.substr(4 + key_size, 4));
+            if(stream->buffer.size() < 4 + key_size + 4 + value_size) {
+                break;
+            }
+
+            stream->batch.Put(stream->buffer.substr(4, key_size),
+                              stream->buffer.substr(4 + key_size + 4, value_size));
+            stream->buffer.erase(0, 4 + key_size + 4 + value_size);
+            stream->num_keys++;
+
+            if(++stream->batch_keys == DUMP_WRITE_BATCH_SIZE) {
+                stream->flush();
+            }
+        }
+
+        return size*nmemb;
+    }
+};
+
+// curl write callback that spools the response body straight into a file
+struct FileDownloadStream {
+    FILE* fp;
+
+    static size_t on_chunk(void *contents, size_t size, size_t nmemb, void *context) {
+        FileDownloadStream* stream = static_cast<FileDownloadStream*>(context);
+        return fwrite(contents, 1, size*nmemb, stream->fp);
+    }
+};
+
 class Replicator {
 public:
+    /*
+     *  Maps the local WAL position of a bootstrapped replica onto the master's. The value is
+     *  "<master_seq>:<local_seq>", where both sequence numbers point at the same logical state.
+     *  Every replicated batch advances both WALs by the same amount, so the offset between the
+     *  two stays valid forever.
+     */
+    static constexpr const char* BOOTSTRAP_SEQ_KEY = "$RB";
+
+    /*
+     *  Bootstraps a replica with an empty data directory from the master, so that it can start
+     *  serving in minutes (bounded by transfer bandwidth) instead of replaying the master's
+     *  entire WAL. Index snapshots of every collection are fetched first, then a point-in-time
+     *  dump of the master's store: loading then restores the in-memory indices from the
+     *  snapshots and replays only the tail between each snapshot's watermark and the dump.
+     *  Must be called before collections are loaded.
+     */
+    static bool bootstrap(const std::string & master_host_port, const std::string & api_key, Store& store) {
+        HttpClient client(master_host_port, api_key);
+
+        // the snapshots must be taken *before* the store dump: every document past a snapshot's
+        // watermark is then covered either by the local replay from the dump or by the WAL tail.
+        // (A document deleted on the master between its snapshot and the dump can linger in the
+        // replica's index - the window is kept small by fetching the dump right away.)
+        client.set_url(master_host_port + "/collections");
+        std::string collections_json;
+        long status_code = client.get_reponse(collections_json);
+
+        if(status_code != 200) {
+            LOG(ERR) << "Failed to fetch the master's collections, status_code=" << status_code;
+            return false;
+        }
+
+        nlohmann::json collections;
+        try {
+            collections = nlohmann::json::parse(collections_json);
+        } catch(...) {
+            LOG(ERR) << "Failed to parse the master's collections response.";
+            return false;
+        }
+
+        const std::string & snapshot_dir = store.get_state_dir_path() + "/" +
+                                           CollectionManager::INDEX_SNAPSHOT_DIR_NAME;
+        mkdir(snapshot_dir.c_str(), 0755);  // no-op when the directory already exists
+
+        // collection IDs are not known until the dump has been applied, so the fetched
+        // snapshot files are keyed by name first and renamed afterwards
+        std::map<std::string, std::string> fetched_snapshots;  // collection name => file path
+
+        for(const nlohmann::json & collection_json: collections) {
+            const std::string & collection_name = collection_json["name"];
+            const std::string & snapshot_path = snapshot_dir + "/bootstrap_" + collection_name + ".snapshot";
+
+            LOG(INFO) << "Fetching the index snapshot of collection " << collection_name << "...";
+
+            FileDownloadStream file_stream;
+            file_stream.fp = fopen(snapshot_path.c_str(), "wb");
+
+            if(file_stream.fp == nullptr) {
+                LOG(ERR) << "Could not open " << snapshot_path << " for writing.";
+                return false;
+            }
+
+            client.set_url(master_host_port + "/replication/index_snapshot?collection=" + collection_name);
+            status_code = client.get_response_stream(FileDownloadStream::on_chunk, &file_stream);
+            fclose(file_stream.fp);
+
+            if(status_code != 200) {
+                // not fatal: the collection will simply be re-indexed from the copied store
+                LOG(ERR) << "Failed to fetch the index snapshot of collection " << collection_name
+                         << ", status_code=" << status_code << " - it will be re-indexed locally.";
+                std::remove(snapshot_path.c_str());
+            } else {
+                fetched_snapshots[collection_name] = snapshot_path;
+            }
+        }
+
+        LOG(INFO) << "Fetching the master's store snapshot...";
+
+        client.set_url(master_host_port + "/replication/store_snapshot");
+        StoreDumpStream dump_stream(&store);
+        status_code = client.get_response_stream(StoreDumpStream::on_chunk, &dump_stream);
+
+        if(status_code != 200 || !dump_stream.got_header) {
+            LOG(ERR) << "Failed to fetch the master's store snapshot, status_code=" << status_code;
+            return false;
+        }
+
+        dump_stream.flush();
+        LOG(INFO) << "Copied " << dump_stream.num_keys << " keys from the master "
+                  << "(snapshot sequence number: " << dump_stream.master_seq << ").";
+
+        // move the fetched snapshot files to where loading looks for them, now that the
+        // collection IDs are known from the copied metas
+        std::vector<std::string> collection_meta_jsons;
+        store.scan_fill(Collection::COLLECTION_META_PREFIX, collection_meta_jsons);
+
+        for(const std::string & collection_meta_json: collection_meta_jsons) {
+            nlohmann::json collection_meta;
+            try {
+                collection_meta = nlohmann::json::parse(collection_meta_json);
+            } catch(...) {
+                LOG(ERR) << "Failed to parse collection meta JSON: " << collection_meta_json;
+                return false;
+            }
+
+            const std::string & collection_name = collection_meta[CollectionManager::COLLECTION_NAME_KEY];
+            const uint32_t collection_id = collection_meta[CollectionManager::COLLECTION_ID_KEY];
+
+            const auto fetched_it = fetched_snapshots.find(collection_name);
+            if(fetched_it != fetched_snapshots.end()) {
+                const std::string & target_path = snapshot_dir + "/" + std::to_string(collection_id) + ".snapshot";
+                std::rename(fetched_it->second.c_str(), target_path.c_str());
+                fetched_snapshots.erase(fetched_it);
+            }
+        }
+
+        // snapshots of collections dropped on the master while the dump was streaming
+        for(const auto & fetched_snapshot: fetched_snapshots) {
+            std::remove(fetched_snapshot.second.c_str());
+        }
+
+        // Record the sequence number correspondence. The key write itself is one more local
+        // operation, so the local side of the mapping is the sequence number right after it.
+        const uint64_t local_seq = store.get_latest_seq_number() + 1;
+        store.insert(BOOTSTRAP_SEQ_KEY, std::to_string(dump_stream.master_seq) + ":" + std::to_string(local_seq));
+
+        return true;
+    }
+
     static void start(HttpServer* server, const std::string master_host_port, const std::string api_key, Store& store) {
         size_t total_runs = 0;
 
+        // a single client is reused across polls, so the connection to the master stays
+        // alive instead of a TCP+TLS handshake being paid on every cycle
+        HttpClient client(master_host_port, api_key);
+
+        // a bootstrapped replica's local sequence numbers are offset from the master's:
+        // translate them using the correspondence recorded at bootstrap time
+        int64_t master_seq_offset = 0;
+        std::string bootstrap_seq;
+
+        if(store.get(BOOTSTRAP_SEQ_KEY, bootstrap_seq) == StoreStatus::FOUND) {
+            std::vector<std::string> seq_parts;
+            StringUtils::split(bootstrap_seq, seq_parts, ":");
+            master_seq_offset = std::stoll(seq_parts[0]) - std::stoll(seq_parts[1]);
+        }
+
         while(true) {
             IterateBatchHandler handler(server);
             uint64_t latest_seq_num = store.get_latest_seq_number();
+            uint64_t master_seq_num = (uint64_t) ((int64_t) latest_seq_num + master_seq_offset);
 
             if(total_runs++ % 20 == 0) {
-                // roughly every 60 seconds
                 LOG(INFO) << "Replica's latest sequence number: " << latest_seq_num;
             }
 
-            HttpClient client(
-                master_host_port+"/replication/updates?seq_number="+std::to_string(latest_seq_num+1), api_key
+            client.set_url(
+                master_host_port+"/replication/stream?seq_number="+std::to_string(master_seq_num+1)
             );
 
-            std::string json_response;
-            long status_code = client.get_reponse(json_response);
+            ReplicationStream stream(&handler, &store);
+            long status_code = client.get_response_stream(ReplicationStream::on_chunk, &stream);
 
             if(status_code == 200) {
-                nlohmann::json json_content = nlohmann::json::parse(json_response);
-                nlohmann::json updates = json_content["updates"];
-
-                // first write to memory
-                for (nlohmann::json::iterator update = updates.begin(); update != updates.end(); ++update) {
-                    const std::string update_decoded = StringUtils::base64_decode(*update);
-                    rocksdb::WriteBatch write_batch(update_decoded);
-                    write_batch.Iterate(&handler);
+                if(stream.num_batches_applied > 0) {
+                    LOG(INFO) << "Replica has consumed " << stream.num_batches_applied
+                              << " updates from master. Replica's latest sequence number is now "
+                              << store.get_latest_seq_number();
                 }
 
-                // now write to store
-                for (nlohmann::json::iterator update = updates.begin(); update != updates.end(); ++update) {
-                    const std::string update_decoded = StringUtils::base64_decode(*update);
-                    rocksdb::WriteBatch write_batch(update_decoded);
-                    store._get_db_unsafe()->Write(rocksdb::WriteOptions(), &write_batch);
-                }
-
-                if(updates.size() > 0) {
-                    LOG(INFO) << "Replica has consumed " << latest_seq_num+updates.size() << "/"
-                              << json_content["latest_seq_num"] << " updates from master.";
+                if(!stream.buffer.empty()) {
+                    LOG(ERR) << "Replication stream ended with " << stream.buffer.size()
+                             << " bytes of an incomplete write batch - it will be fetched again.";
                 }
 
+                // no sleep here: when the replica is caught up, the master long-polls and
+                // responds only once new WAL entries appear, so polling again immediately is cheap
             } else {
                 LOG(ERR) << "Replication error while fetching records from master, status_code=" << status_code;
-
-                if(status_code != 0) {
-                    LOG(ERR) << json_response;
-                }
+                std::this_thread::sleep_for(std::chrono::milliseconds(3000));
             }
-
-            std::this_thread::sleep_for(std::chrono::milliseconds(3000));
         }
     }
 
@@ -0,0 +1,109 @@
+#pragma once
+
+#include <cstring>
+#include <string>
+#include <vector>
+
+/*
+* A routing trie compiled once at route registration time. Path segments form the edges:
+* literal segments are matched exactly, while `:param` segments become a wildcard child
+* that matches any single segment. The HTTP method is treated as the first segment, so a
+* single trie dispatches every method. Lookups walk (pointer, length) slices of the raw
+* request path and allocate nothing.
+*/
+class route_trie {
+private:
+    struct trie_node {
+        std::vector<std::pair<std::string, trie_node*>> children;
+        trie_node* param_child;
+        int route_index;
+
+        trie_node(): param_child(nullptr), route_index(-1) {
+
+        }
+
+        ~trie_node() {
+            for(auto & child: children) {
+                delete child.second;
+            }
+            delete param_child;
+        }
+
+        trie_node* get_child(const char* part, size_t len) const {
+            for(const auto & child: children) {
+                if(child.first.size() == len && memcmp(child.first.data(), part, len) == 0) {
+                    return child.second;
+                }
+            }
+
+            return nullptr;
+        }
+    };
+
+    trie_node root;
+
+    static int find_segment(const trie_node* node, const std::vector<std::pair<const char*, size_t>> & segments,
+                            size_t depth) {
+        if(depth == segments.size()) {
+            return node->route_index;
+        }
+
+        const trie_node* literal_child = node->get_child(segments[depth].first, segments[depth].second);
+        if(literal_child != nullptr) {
+            int route_index = find_segment(literal_child, segments, depth+1);
+            if(route_index != -1) {
+                return route_index;
+            }
+        }
+
+        // a literal dead-end can still be matched by a wildcard at this depth
+        if(node->param_child != nullptr) {
+            return find_segment(node->param_child, segments, depth+1);
+        }
+
+        return -1;
+    }
+
+public:
+    route_trie() = default;
+    route_trie(const route_trie&) = delete;
+    route_trie& operator=(const route_trie&) = delete;
+
+    void add(const std::string & http_method, const std::vector<std::string> & path_parts, int route_index) {
+        trie_node* node = &root;
+
+        trie_node* method_child = node->get_child(http_method.data(), http_method.size());
+        if(method_child == nullptr) {
+            method_child = new trie_node();
+            node->children.push_back(std::make_pair(http_method, method_child));
+        }
+        node = method_child;
+
+        for(const std::string & segment: path_parts) {
+            if(!segment.empty() && segment[0] == ':') {
+                if(node->param_child == nullptr) {
+                    node->param_child = new trie_node();
+                }
+                node = node->param_child;
+            } else {
+                trie_node* child = node->get_child(segment.data(), segment.size());
+                if(child == nullptr) {
+                    child = new trie_node();
+                    node->children.push_back(std::make_pair(segment, child));
+                }
+                node = child;
+            }
+        }
+
+        if(node->route_index == -1) {
+            // the first registration wins, matching the old first-match linear scan
+            node->route_index = route_index;
+        }
+    }
+
+    // `segments` must begin with the HTTP method, followed by the path segments.
+    // Returns the registered route index, or -1 when no route matches.
+    int find(const std::vector<std::pair<const char*, size_t>> & segments) const {
+        return find_segment(&root, segments, 0);
+    }
+};
@@ -0,0 +1,104 @@
+#pragma once
+
+#include <deque>
+#include <mutex>
+#include <condition_variable>
+
+class Index;
+struct search_args;
+
+// Tracks the completion of a single query that has been fanned out to multiple index shards.
+struct search_latch {
+    std::mutex m;
+    std::condition_variable cv;
+    size_t num_pending;
+
+    search_latch(const size_t num_pending): num_pending(num_pending) {
+
+    }
+
+    void wait() {
+        std::unique_lock<std::mutex> lk(m);
+        cv.wait(lk, [this]{return num_pending == 0;});
+    }
+
+    void done() {
+        {
+            std::lock_guard<std::mutex> lk(m);
+            num_pending--;
+        }
+        cv.notify_one();
+    }
+};
+
+// A search against a single index shard, placed on the queue by Collection::search
+struct search_task {
+    Index* index;
+    search_args* params;
+    search_latch* latch;
+};
+
+// Bounded multi-producer, multi-consumer queue that feeds a collection's pool of search workers.
+// Producers block when the queue is full, so an overloaded collection applies back-pressure
+// on callers instead of queueing requests without limit.
+class SearchQueue {
+private:
+    const size_t capacity;
+
+    bool terminate;   // used for interrupting the worker threads during tear down
+
+    std::deque<search_task> tasks;
+
+    std::mutex m;
+    std::condition_variable not_empty;
+    std::condition_variable not_full;
+
+public:
+    SearchQueue(const size_t capacity): capacity(capacity), terminate(false) {
+
+    }
+
+    // Blocks while the queue is full. Tasks added after shutdown are dropped.
+    void add(const search_task & task) {
+        {
+            std::unique_lock<std::mutex> lk(m);
+            not_full.wait(lk, [this]{return tasks.size() < capacity || terminate;});
+
+            if(terminate) {
+                return;
+            }
+
+            tasks.push_back(task);
+        }
+
+        not_empty.notify_one();
+    }
+
+    // Blocks while the queue is empty. Returns false once the queue has been shut down and drained.
+    bool remove(search_task & task) {
+        {
+            std::unique_lock<std::mutex> lk(m);
+            not_empty.wait(lk, [this]{return !tasks.empty() || terminate;});
+
+            if(tasks.empty()) {
+                return false;
+            }
+
+            task = tasks.front();
+            tasks.pop_front();
+        }
+
+        not_full.notify_one();
+        return true;
+    }
+
+    void shutdown() {
+        {
+            std::lock_guard<std::mutex> lk(m);
+            terminate = true;
+        }
+
+        not_empty.notify_all();
+        not_full.notify_all();
+    }
+};
@@ -0,0 +1,103 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <algorithm>
+#include "number.h"
+
+/*
+* A dense column of sort attribute values addressed directly by seq_id, so that scoring
+* fetches a sort attribute with a plain array read instead of a hash probe. A validity
+* bitmap tracks which slots actually hold a value, since not every document carries
+* every sort field.
+*/
+struct sort_column {
+    number_t* values;
+    uint64_t* valid;
+    uint32_t num_slots;
+    uint32_t num_values;
+
+    sort_column(): values(nullptr), valid(nullptr), num_slots(0), num_values(0) {
+
+    }
+
+    ~sort_column() {
+        delete[] values;
+        delete[] valid;
+    }
+
+    sort_column(const sort_column&) = delete;
+    sort_column& operator=(const sort_column&) = delete;
+
+    bool has(uint32_t seq_id) const {
+        return seq_id < num_slots && (valid[seq_id >> 6] & (1ULL << (seq_id & 63))) != 0;
+    }
+
+    // fills `value` and returns true when the document has a value for this column
+    bool get(uint32_t seq_id, number_t & value) const {
+        if(!has(seq_id)) {
+            return false;
+        }
+
+        value = values[seq_id];
+        return true;
+    }
+
+    void set(uint32_t seq_id, const number_t & value) {
+        if(seq_id >= num_slots) {
+            grow(seq_id);
+        }
+
+        if(!has(seq_id)) {
+            num_values++;
+        }
+
+        values[seq_id] = value;
+        valid[seq_id >> 6] |= (1ULL << (seq_id & 63));
+    }
+
+    void erase(uint32_t seq_id) {
+        if(has(seq_id)) {
+            valid[seq_id >> 6] &= ~(1ULL << (seq_id & 63));
+            num_values--;
+        }
+    }
+
+    uint32_t size() const {
+        return num_values;
+    }
+
+    // heap bytes held by the value slots and the validity bitmap
+    size_t memory_usage() const {
+        return num_slots * sizeof(number_t) + ((num_slots + 63) / 64) * sizeof(uint64_t);
+    }
+
+    // warms the cache line holding the slot for an id that is about to be read
+    void prefetch(uint32_t seq_id) const {
+        if(seq_id < num_slots) {
+            __builtin_prefetch(values + seq_id, 0);
+        }
+    }
+
+private:
+
+    void grow(uint32_t seq_id) {
+        uint32_t new_slots = std::max(num_slots * 2, seq_id + 1);
+        new_slots = std::max(new_slots, (uint32_t) 64);
+
+        number_t* new_values = new number_t[new_slots];
+        uint64_t* new_valid = new uint64_t[(new_slots + 63) / 64]();
+
+        if(num_slots != 0) {
+            std::copy(values, values + num_slots, new_values);
+            std::copy(valid, valid + (num_slots + 63) / 64, new_valid);
+        }
+
+        delete[] values;
+        delete[] valid;
+
+        values = new_values;
+        valid = new_valid;
+        num_slots = new_slots;
+    }
+};
@@ -19,12 +19,14 @@ private:
         return METADATA_OVERHEAD + 4 + for_compressed_size_bits(new_length, bnew);
     }
 
-    uint32_t lower_bound_search_bits(const uint8_t *in, uint32_t imin, uint32_t imax, uint32_t base,
-                                     uint32_t bits, uint32_t value, uint32_t *actual);
+    enum {UNPACK_BLOCK_SIZE = 256};
 
-    void binary_search_indices(const uint32_t *values, int low_vindex, int high_vindex,
-                               int low_index, int high_index, uint32_t base, uint32_t bits,
-                               uint32_t *indices);
+    // Decodes `count` values beginning at `start` from the FOR-packed payload into `out`.
+    // Reads whole 64-bit words instead of re-walking the bit offsets for every element.
+    void unpack_block(uint32_t base, uint32_t bits, uint32_t start, uint32_t count, uint32_t *out);
+
+    // Index of the first element >= value within an unpacked block (branch-free).
+    static uint32_t block_lower_bound(const uint32_t *block, uint32_t count, uint32_t value);
 
 public:
 
@@ -41,5 +43,8 @@ public:
     // returns false if malloc fails
     bool append(uint32_t value);
 
+    // appends an ascending run of values with a single sizing pass; returns false if malloc fails
+    bool append(const uint32_t* values, const uint32_t values_length);
+
     void remove_values(uint32_t *sorted_values, uint32_t values_length);
 };
\ No newline at end of file
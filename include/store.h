@@ -5,6 +5,9 @@
 #include <string>
 #include <sstream>
 #include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
 #include <option.h>
 #include <rocksdb/db.h>
 #include <rocksdb/write_batch.h>
@@ -48,6 +51,42 @@ private:
     rocksdb::DB *db;
     rocksdb::Options options;
 
+    // Group commit: batches from writers that arrive while a group is open are appended into
+    // one WriteBatch and hit the WAL as a single write. The first writer of a group becomes
+    // its leader, holds the window open briefly for others to join, and flushes for everyone.
+    struct commit_group {
+        rocksdb::WriteBatch batch;
+        bool flushed = false;
+        bool ok = false;
+        size_t num_writers = 0;
+    };
+
+    // Replays the operations of one writer's batch into the group's combined batch
+    class BatchAppendHandler : public rocksdb::WriteBatch::Handler {
+    private:
+        rocksdb::WriteBatch & dest;
+    public:
+        BatchAppendHandler(rocksdb::WriteBatch & dest): dest(dest) { }
+
+        virtual void Put(const rocksdb::Slice& key, const rocksdb::Slice& value) override {
+            dest.Put(key, value);
+        }
+
+        virtual void Delete(const rocksdb::Slice& key) override {
+            dest.Delete(key);
+        }
+
+        virtual void Merge(const rocksdb::Slice& key, const rocksdb::Slice& value) override {
+            dest.Merge(key, value);
+        }
+    };
+
+    commit_group* open_group = nullptr;
+
+    std::mutex group_commit_m;
+
+    std::condition_variable group_commit_cv;
+
 public:
 
     Store() = delete;
@@ -88,8 +127,54 @@ public:
     }
 
     bool batch_write(rocksdb::WriteBatch& batch) {
-        rocksdb::Status status = db->Write(rocksdb::WriteOptions(), &batch);
-        return status.ok();
+        std::unique_lock<std::mutex> lock(group_commit_m);
+
+        const bool leader = (open_group == nullptr);
+        if(leader) {
+            open_group = new commit_group();
+        }
+
+        commit_group* group = open_group;
+        group->num_writers++;
+
+        BatchAppendHandler handler(group->batch);
+        batch.Iterate(&handler);
+
+        if(!leader) {
+            // a leader is already holding the window open and will flush on our behalf
+            group_commit_cv.wait(lock, [group]{ return group->flushed; });
+            bool write_ok = group->ok;
+            group->num_writers--;
+            if(group->num_writers == 0) {
+                delete group;
+            }
+            return write_ok;
+        }
+
+        if(group->num_writers == 1) {
+            // wait briefly so that concurrent writers can join the group; wakes early
+            // (harmlessly) if the condition variable is signalled for another group
+            group_commit_cv.wait_for(lock, std::chrono::microseconds(GROUP_COMMIT_WINDOW_US));
+        }
+
+        // close the group before flushing, so the next group can form during the write
+        open_group = nullptr;
+        lock.unlock();
+
+        rocksdb::Status status = db->Write(rocksdb::WriteOptions(), &group->batch);
+
+        lock.lock();
+        group->ok = status.ok();
+        group->flushed = true;
+        group_commit_cv.notify_all();
+
+        bool write_ok = group->ok;
+        group->num_writers--;
+        if(group->num_writers == 0) {
+            delete group;
+        }
+
+        return write_ok;
     }
 
     bool contains(const std::string& key) const {
@@ -113,6 +198,34 @@ public:
         return StoreStatus::ERROR;
     }
 
+    /*
+       Fetches all `keys` in a single batched read, so that block cache misses overlap
+       instead of being served one point lookup at a time.
+     */
+    std::vector<StoreStatus> multi_get(const std::vector<std::string>& keys, std::vector<std::string>& values) const {
+        std::vector<rocksdb::Slice> key_slices;
+        for(const std::string & key: keys) {
+            key_slices.push_back(rocksdb::Slice(key));
+        }
+
+        std::vector<rocksdb::Status> statuses = db->MultiGet(rocksdb::ReadOptions(), key_slices, &values);
+
+        std::vector<StoreStatus> store_statuses;
+        for(size_t i = 0; i < statuses.size(); i++) {
+            if(statuses[i].ok()) {
+                store_statuses.push_back(StoreStatus::FOUND);
+            } else if(statuses[i].IsNotFound()) {
+                store_statuses.push_back(StoreStatus::NOT_FOUND);
+            } else {
+                LOG(ERR) << "Error while fetching the key: " << keys[i] << " - status is: "
+                         << statuses[i].ToString();
+                store_statuses.push_back(StoreStatus::ERROR);
+            }
+        }
+
+        return store_statuses;
+    }
+
     bool remove(const std::string& key) {
         rocksdb::Status status = db->Delete(rocksdb::WriteOptions(), key);
         return status.ok();
@@ -129,6 +242,30 @@ public:
         return it;
     };
 
+    const rocksdb::Snapshot* get_snapshot() {
+        return db->GetSnapshot();
+    }
+
+    void release_snapshot(const rocksdb::Snapshot* snapshot) {
+        db->ReleaseSnapshot(snapshot);
+    }
+
+    // the WAL sequence number the snapshot corresponds to - everything up to and including
+    // this sequence number is visible through the snapshot, nothing after it is
+    uint64_t get_snapshot_seq_number(const rocksdb::Snapshot* snapshot) const {
+        return snapshot->GetSequenceNumber();
+    }
+
+    // iterates a consistent point-in-time view, so a long scan neither observes later
+    // writes nor competes with them for the freshest memtable state
+    rocksdb::Iterator* scan_snapshot(const rocksdb::Snapshot* snapshot, const std::string & prefix) {
+        rocksdb::ReadOptions read_opts;
+        read_opts.snapshot = snapshot;
+        rocksdb::Iterator* iter = db->NewIterator(read_opts);
+        iter->Seek(prefix);
+        return iter;
+    }
+
     void scan_fill(const std::string & prefix, std::vector<std::string> & values) {
         rocksdb::Iterator *iter = db->NewIterator(rocksdb::ReadOptions());
         for (iter->Seek(prefix); iter->Valid() && iter->key().starts_with(prefix); iter->Next()) {
@@ -190,6 +327,39 @@ public:
         return Option<std::vector<std::string>*>(updates);
     }
 
+    /*
+       Returns a raw iterator over the transaction log, positioned at `seq_number`. Used by the streaming
+       replication endpoint so that write batches can be sent one at a time instead of being materialized.
+       A nullptr value indicates that the replica has already caught up.
+     */
+    Option<rocksdb::TransactionLogIterator*> get_update_iterator(const uint64_t seq_number) const {
+        const uint64_t local_latest_seq_num = db->GetLatestSequenceNumber();
+
+        if(seq_number == local_latest_seq_num+1) {
+            // replica has caught up, nothing to iterate
+            return Option<rocksdb::TransactionLogIterator*>(nullptr);
+        }
+
+        rocksdb::unique_ptr<rocksdb::TransactionLogIterator> iter;
+        rocksdb::Status status = db->GetUpdatesSince(seq_number, &iter);
+
+        if(!status.ok()) {
+            std::ostringstream error;
+            error << "Unable to fetch updates. " << "Master's latest sequence number is " << local_latest_seq_num;
+            return Option<rocksdb::TransactionLogIterator*>(400, error.str());
+        }
+
+        if(!iter->Valid() && !(local_latest_seq_num == 0 && seq_number == 0)) {
+            std::ostringstream error;
+            error << "Invalid iterator. Master's latest sequence number is " << local_latest_seq_num << " but "
+                  << "updates are requested from sequence number " << seq_number << ". "
+                  << "The master's WAL entries might have expired (they are kept only for 24 hours).";
+            return Option<rocksdb::TransactionLogIterator*>(400, error.str());
+        }
+
+        return Option<rocksdb::TransactionLogIterator*>(iter.release());
+    }
+
     void close() {
         delete db;
         db = nullptr;
@@ -200,11 +370,18 @@ public:
         db->Flush(options);
     }
 
+    const std::string & get_state_dir_path() const {
+        return state_dir_path;
+    }
+
     // Only for internal tests
     rocksdb::DB* _get_db_unsafe() const {
         return db;
     }
 
+    // How long a group leader keeps the commit window open for other writers to join
+    static const size_t GROUP_COMMIT_WINDOW_US = 500;
+
     void print_memory_usage() {
         std::string index_usage;
         db->GetProperty("rocksdb.estimate-table-readers-mem", &index_usage);
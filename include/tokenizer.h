@@ -0,0 +1,87 @@
+#pragma once
+
+#include <string>
+#include "string_utils.h"
+
+/*
+* Single-pass whitespace tokenizer that yields (ptr, len) views instead of materializing a
+* vector of per-token string copies. The view points into a reusable buffer owned by the
+* tokenizer, so the steady state allocates nothing: ASCII tokens are normalized (lowercased,
+* special characters dropped) with a plain byte scan, and only tokens containing non-ASCII
+* bytes fall back to the ICU path of StringUtils::unicode_normalize.
+*
+* Tokens are numbered by their position among the whitespace-separated words of the input,
+* matching what StringUtils::split followed by unicode_normalize used to produce: a word
+* that normalizes to an empty string is still yielded (with len 0), since its ordinal is
+* part of the stored offsets.
+*/
+class Tokenizer {
+private:
+    const char* input;
+    const size_t input_len;
+    size_t pos;
+    const bool normalize;
+    const StringUtils & string_utils;
+    std::string buf;  // reusable storage for the current normalized token
+
+public:
+    Tokenizer(const std::string & text, const StringUtils & string_utils, const bool normalize=true):
+            input(text.c_str()), input_len(text.size()), pos(0), normalize(normalize),
+            string_utils(string_utils) {
+        buf.reserve(64);
+    }
+
+    // Yields the next token, whose view stays valid only until the following call.
+    // `raw_token_len` is the length of the word before normalization - typo costs are
+    // bounded by what the user actually typed, not by what survives normalization.
+    bool next(const char* & token, size_t & token_len, size_t & raw_token_len) {
+        while(pos < input_len && input[pos] == ' ') {
+            pos++;
+        }
+
+        if(pos == input_len) {
+            return false;
+        }
+
+        const size_t start = pos;
+        bool ascii_only = true;
+
+        while(pos < input_len && input[pos] != ' ') {
+            if((signed char) input[pos] < 0) {
+                ascii_only = false;
+            }
+            pos++;
+        }
+
+        raw_token_len = pos - start;
+
+        if(!normalize) {
+            token = input + start;
+            token_len = raw_token_len;
+            return true;
+        }
+
+        buf.clear();
+
+        if(ascii_only) {
+            for(size_t i = start; i < pos; i++) {
+                const char c = input[i];
+                if(isalnum(c)) {
+                    buf += (char) tolower(c);
+                }
+            }
+        } else {
+            buf.assign(input + start, raw_token_len);
+            string_utils.unicode_normalize(buf);
+        }
+
+        token = buf.c_str();  // NUL terminated, so it can be handed to ART as a key directly
+        token_len = buf.size();
+        return true;
+    }
+
+    bool next(const char* & token, size_t & token_len) {
+        size_t raw_token_len;
+        return next(token, token_len, raw_token_len);
+    }
+};
@@ -3,15 +3,38 @@
 #include <cstdint>
 #include <climits>
 #include <cstdio>
+#include <cstring>
 #include <algorithm>
-#include <sparsepp.h>
 #include <match_score.h>
 #include <number.h>
 
 /*
-* Remembers the max-K elements seen so far using a min-heap
+* Decoded `search_after` cursor: the full ranking tuple of the last hit returned by the
+* previous page. Hits that do not rank strictly below it are rejected at the topster, so
+* deep pagination runs in constant memory instead of growing the heap to page * per_page.
+*/
+struct search_cursor {
+    bool valid;
+    uint64_t match_score;
+    number_t primary_attr;
+    number_t secondary_attr;
+    int field_order;
+    uint64_t key;
+
+    search_cursor(): valid(false), match_score(0), field_order(0), key(0) {
+
+    }
+};
+
+/*
+* Remembers the max-K elements seen so far using a min-heap. K is a runtime parameter
+* (page * per_page), so the common 10-result query maintains a 10-element heap.
+*
+* `add` runs once per scored document, so the hot path avoids heavyweight machinery:
+* the heap holds 4-byte indices into the KV array (sifts move indices, the 40-byte KV
+* structs stay put), and duplicate keys are detected with a small linear-probing table
+* sized to K instead of a general-purpose hash set.
 */
-template <size_t MAX_SIZE=512>
 struct Topster {
     struct KV {
         uint16_t query_index;
@@ -19,79 +42,181 @@ struct Topster {
         uint64_t match_score;
         number_t primary_attr;
         number_t secondary_attr;
-    } data[MAX_SIZE];
+    };
+
+    const uint32_t MAX_SIZE;
+
+    KV* data;            // KV slots - written once and never moved
+    uint32_t* heap;      // min-heap of indices into `data`
 
     uint32_t size;
 
-    spp::sparse_hash_set<uint64_t> dedup_keys;
+    // results that pushed a lower-ranked entry out of a full topster - surfaced by the slow query log
+    uint64_t evictions;
+
+    // open-addressing dedup table: `dedup_used[b]` marks bucket occupancy, since 0 is a valid key
+    uint32_t dedup_mask;
+    uint64_t* dedup_keys;
+    uint8_t* dedup_used;
+
+    // How a candidate that ties with the ceiling on the ranking attributes compares to it.
+    // Such ties are broken first by field order and then by key, and a per-field topster
+    // knows its field, so the policy can be fixed up front.
+    enum ceiling_tie_policy { TIES_RANK_ABOVE, TIES_ON_KEY, TIES_RANK_BELOW };
+
+    // exclusive upper bound for cursor-based pagination: only candidates ranking strictly
+    // below it are accepted, so the heap stays fixed-size no matter how deep the page
+    bool has_ceiling;
+    uint64_t ceiling_match_score;
+    number_t ceiling_primary_attr;
+    number_t ceiling_secondary_attr;
+    uint64_t ceiling_key;
+    ceiling_tie_policy tie_policy;
 
-    Topster(): size(0){
+    explicit Topster(uint32_t max_size = 512): MAX_SIZE(max_size < 1 ? 1 : max_size),
+                                               size(0), evictions(0), has_ceiling(false) {
+        data = new KV[MAX_SIZE];
+        heap = new uint32_t[MAX_SIZE];
 
+        // at most half-full at capacity K, so probe runs stay short
+        uint32_t table_size = 4;
+        while(table_size < 2 * MAX_SIZE) {
+            table_size <<= 1;
+        }
+
+        dedup_mask = table_size - 1;
+        dedup_keys = new uint64_t[table_size];
+        dedup_used = new uint8_t[table_size];
+        memset(dedup_used, 0, table_size);
     }
 
-    template <typename T> static inline void swapMe(T& a, T& b) {
-        T c = a;
-        a = b;
-        b = c;
+    ~Topster() {
+        delete[] data;
+        delete[] heap;
+        delete[] dedup_keys;
+        delete[] dedup_used;
+    }
+
+    Topster(const Topster &) = delete;
+    Topster & operator=(const Topster &) = delete;
+
+    static inline uint32_t hash_key(uint64_t key) {
+        key *= 0x9E3779B97F4A7C15ULL;  // Fibonacci hashing - mixes the high bits into the low ones
+        return (uint32_t)(key >> 32);
+    }
+
+    // returns the bucket holding `key`, or the empty bucket where it would be inserted
+    uint32_t dedup_bucket(const uint64_t key) const {
+        uint32_t bucket = hash_key(key) & dedup_mask;
+        while(dedup_used[bucket] != 0 && dedup_keys[bucket] != key) {
+            bucket = (bucket + 1) & dedup_mask;
+        }
+        return bucket;
+    }
+
+    void dedup_insert(const uint64_t key) {
+        const uint32_t bucket = dedup_bucket(key);
+        dedup_keys[bucket] = key;
+        dedup_used[bucket] = 1;
+    }
+
+    // backward-shift deletion keeps probe chains intact without tombstones
+    void dedup_erase(const uint64_t key) {
+        uint32_t hole = dedup_bucket(key);
+        if(dedup_used[hole] == 0) {
+            return ;
+        }
+
+        uint32_t bucket = (hole + 1) & dedup_mask;
+        while(dedup_used[bucket] != 0) {
+            const uint32_t ideal = hash_key(dedup_keys[bucket]) & dedup_mask;
+            if(((bucket - ideal) & dedup_mask) >= ((bucket - hole) & dedup_mask)) {
+                dedup_keys[hole] = dedup_keys[bucket];
+                hole = bucket;
+            }
+            bucket = (bucket + 1) & dedup_mask;
+        }
+
+        dedup_used[hole] = 0;
+    }
+
+    void set_ceiling(const uint64_t match_score, const number_t & primary_attr, const number_t & secondary_attr,
+                     const uint64_t key, const ceiling_tie_policy policy) {
+        has_ceiling = true;
+        ceiling_match_score = match_score;
+        ceiling_primary_attr = primary_attr;
+        ceiling_secondary_attr = secondary_attr;
+        ceiling_key = key;
+        tie_policy = policy;
     }
 
     void add(const uint64_t &key, const uint16_t &query_index, const uint64_t &match_score, const number_t &primary_attr,
              const number_t &secondary_attr) {
+        if(has_ceiling) {
+            const auto candidate = std::tie(match_score, primary_attr, secondary_attr);
+            const auto ceiling = std::tie(ceiling_match_score, ceiling_primary_attr, ceiling_secondary_attr);
+
+            if(candidate > ceiling) {
+                return;
+            }
+
+            if(candidate == ceiling) {
+                // keys sort descending when the ranking attributes and field order tie
+                if(tie_policy == TIES_RANK_ABOVE || (tie_policy == TIES_ON_KEY && key >= ceiling_key)) {
+                    return;
+                }
+            }
+        }
+
         if (size >= MAX_SIZE) {
-            if(!is_greater(data[0], match_score, primary_attr, secondary_attr)) {
+            if(!is_greater(data[heap[0]], match_score, primary_attr, secondary_attr)) {
                 // when incoming value is less than the smallest in the heap, ignore
                 return;
             }
 
-            if(dedup_keys.count(key) != 0) {
+            const uint32_t bucket = dedup_bucket(key);
+            if(dedup_used[bucket] != 0) {
                 // when the key already exists, ignore
                 return ;
             }
 
-            dedup_keys.erase(data[0].key);
-            dedup_keys.insert(key);
-
-            data[0].key = key;
-            data[0].query_index = query_index;
-            data[0].match_score = match_score;
-            data[0].primary_attr = primary_attr;
-            data[0].secondary_attr = secondary_attr;
-
-            // sift to maintain heap property
-            uint32_t i = 0;
-            while ((2*i+1) < MAX_SIZE) {
-                uint32_t next = (uint32_t) (2 * i + 1);
-                if (next+1 < MAX_SIZE && is_greater_kv(data[next], data[next+1])) {
-                    next++;
-                }
+            dedup_erase(data[heap[0]].key);
+            dedup_insert(key);
+            evictions++;
 
-                if (is_greater_kv(data[i], data[next])) {
-                    swapMe(data[i], data[next]);
-                } else {
-                    break;
-                }
+            // overwrite the evicted minimum's KV slot in place, then restore the heap
+            KV & kv = data[heap[0]];
+            kv.key = key;
+            kv.query_index = query_index;
+            kv.match_score = match_score;
+            kv.primary_attr = primary_attr;
+            kv.secondary_attr = secondary_attr;
 
-                i = next;
-            }
+            sift_down(0);
         } else {
-            if(dedup_keys.count(key) != 0) {
+            const uint32_t bucket = dedup_bucket(key);
+            if(dedup_used[bucket] != 0) {
                 // when the key already exists, ignore
                 return ;
             }
 
-            dedup_keys.insert(key);
+            dedup_keys[bucket] = key;
+            dedup_used[bucket] = 1;
 
-            data[size].key = key;
-            data[size].query_index = query_index;
-            data[size].match_score = match_score;
-            data[size].primary_attr = primary_attr;
-            data[size].secondary_attr = secondary_attr;
+            KV & kv = data[size];
+            kv.key = key;
+            kv.query_index = query_index;
+            kv.match_score = match_score;
+            kv.primary_attr = primary_attr;
+            kv.secondary_attr = secondary_attr;
 
+            heap[size] = size;
             size++;
+
             for (uint32_t i = size - 1; i > 0;) {
                 uint32_t parent = (i-1)/2;
-                if (is_greater_kv(data[parent], data[i])) {
-                    swapMe(data[i], data[parent]);
+                if (is_greater_kv(data[heap[parent]], data[heap[i]])) {
+                    std::swap(heap[i], heap[parent]);
                     i = parent;
                 } else {
                     break;
@@ -100,29 +225,62 @@ struct Topster {
         }
     }
 
+    void sift_down(uint32_t i) {
+        while ((2*i+1) < size) {
+            uint32_t next = (uint32_t) (2 * i + 1);
+            if (next+1 < size && is_greater_kv(data[heap[next]], data[heap[next+1]])) {
+                next++;
+            }
+
+            if (is_greater_kv(data[heap[i]], data[heap[next]])) {
+                std::swap(heap[i], heap[next]);
+            } else {
+                break;
+            }
+
+            i = next;
+        }
+    }
+
     static bool is_greater(const struct KV& i, uint64_t match_score, number_t primary_attr, number_t secondary_attr) {
         return std::tie (match_score, primary_attr, secondary_attr) >
                std::tie (i.match_score, i.primary_attr, i.secondary_attr);
     }
 
     static bool is_greater_kv(const struct KV &i, const struct KV &j) {
-        return std::tie(i.match_score, i.primary_attr, i.secondary_attr) >
-               std::tie(j.match_score, j.primary_attr, j.secondary_attr);
+        // keys break exact ranking ties descending, matching the cursor's tie policy - this
+        // makes the sorted iteration order a strict total order, so the per-topster outputs
+        // can be merged without a re-sort
+        return std::tie(i.match_score, i.primary_attr, i.secondary_attr, i.key) >
+               std::tie(j.match_score, j.primary_attr, j.secondary_attr, j.key);
     }
 
+    // orders the heap indices for iteration via getKV() - no further adds after this
     void sort() {
-        std::stable_sort(std::begin(data), std::begin(data) + size, is_greater_kv);
+        KV* kvs = data;
+        std::stable_sort(heap, heap + size, [kvs](uint32_t a, uint32_t b) {
+            return is_greater_kv(kvs[a], kvs[b]);
+        });
     }
 
     void clear(){
         size = 0;
+        evictions = 0;
+        has_ceiling = false;
+        memset(dedup_used, 0, dedup_mask + 1);
+    }
+
+    // Smallest match score currently retained. A valid pruning threshold only once
+    // the topster is full, so zero is returned until then.
+    uint64_t min_match_score() {
+        return (size >= MAX_SIZE) ? data[heap[0]].match_score : 0;
     }
 
     uint64_t getKeyAt(uint32_t index) {
-        return data[index].key;
+        return data[heap[index]].key;
     }
 
     KV getKV(uint32_t index) {
-        return data[index];
+        return data[heap[index]];
     }
-};
\ No newline at end of file
+};
@@ -1,7 +1,10 @@
 #include <regex>
 #include <chrono>
 #include <thread>
+#include <mutex>
+#include <condition_variable>
 #include <sys/resource.h>
+#include <sys/stat.h>
 #include "api.h"
 #include "string_utils.h"
 #include "collection.h"
@@ -156,6 +159,22 @@ void get_debug(http_req & req, http_res & res) {
     res.send_200(result.dump());
 }
 
+void get_metrics(http_req & req, http_res & res) {
+    nlohmann::json result;
+    result["query_stages"] = nlohmann::json::object();
+
+    for(const QueryMetrics::stage_stats & stats: QueryMetrics::get_instance().get_stats()) {
+        nlohmann::json stage;
+        stage["count"] = stats.count;
+        stage["p50_micros"] = stats.p50_micros;
+        stage["p95_micros"] = stats.p95_micros;
+        stage["p99_micros"] = stats.p99_micros;
+        result["query_stages"][stats.stage] = stage;
+    }
+
+    res.send_200(result.dump());
+}
+
 void get_search(http_req & req, http_res & res) {
     auto begin = std::chrono::high_resolution_clock::now();
 
@@ -170,6 +189,9 @@ void get_search(http_req & req, http_res & res) {
     const char *PAGE = "page";
     const char *CALLBACK = "callback";
     const char *RANK_TOKENS_BY = "rank_tokens_by";
+    const char *EXHAUSTIVE_SEARCH = "exhaustive_search";
+    const char *SEARCH_AFTER = "search_after";
+    const char *MAX_CANDIDATES = "max_candidates";
 
     if(req.params.count(NUM_TYPOS) == 0) {
         req.params[NUM_TYPOS] = "2";
@@ -207,6 +229,15 @@ void get_search(http_req & req, http_res & res) {
         return res.send_400("Parameter `" + std::string(PAGE) + "` must be an unsigned integer.");
     }
 
+    // budget on the number of typo-corrected query combinations evaluated per field
+    if(req.params.count(MAX_CANDIDATES) == 0) {
+        req.params[MAX_CANDIDATES] = std::to_string(Index::DEFAULT_MAX_CANDIDATES);
+    }
+
+    if(!StringUtils::is_uint64_t(req.params[MAX_CANDIDATES]) || req.params[MAX_CANDIDATES] == "0") {
+        return res.send_400("Parameter `" + std::string(MAX_CANDIDATES) + "` must be a positive integer.");
+    }
+
     std::string filter_str = req.params.count(FILTER) != 0 ? req.params[FILTER] : "";
 
     std::vector<std::string> search_fields;
@@ -246,6 +277,12 @@ void get_search(http_req & req, http_res & res) {
 
     bool prefix = (req.params[PREFIX] == "true");
 
+    if(req.params.count(EXHAUSTIVE_SEARCH) == 0) {
+        req.params[EXHAUSTIVE_SEARCH] = "true";
+    }
+
+    bool exhaustive_search = (req.params[EXHAUSTIVE_SEARCH] == "true");
+
     if(req.params.count(RANK_TOKENS_BY) == 0) {
         req.params[RANK_TOKENS_BY] = "DEFAULT_SORTING_FIELD";
     }
@@ -253,10 +290,76 @@ void get_search(http_req & req, http_res & res) {
     StringUtils::toupper(req.params[RANK_TOKENS_BY]);
     token_ordering token_order = (req.params[RANK_TOKENS_BY] == "DEFAULT_SORTING_FIELD") ? MAX_SCORE : FREQUENCY;
 
+    // The cache key embeds the collection ID (not the name, so that dropping and re-creating a
+    // collection cannot alias old entries) and its write generation, which makes entries of a
+    // mutated collection stop matching without an explicit wipe.
+    const std::string & cache_key = std::to_string(collection->get_collection_id()) + "\x1E" +
+                                    std::to_string(collection->get_write_generation()) + "\x1E" +
+                                    req.params[QUERY] + "\x1E" + req.params[QUERY_BY] + "\x1E" + filter_str + "\x1E" +
+                                    req.params[FACET_BY] + "\x1E" +
+                                    (req.params.count(SORT_BY) != 0 ? req.params[SORT_BY] : "") + "\x1E" +
+                                    req.params[NUM_TYPOS] + "\x1E" + req.params[PER_PAGE] + "\x1E" +
+                                    req.params[PAGE] + "\x1E" + req.params[PREFIX] + "\x1E" +
+                                    req.params[RANK_TOKENS_BY] + "\x1E" + req.params[EXHAUSTIVE_SEARCH] + "\x1E" +
+                                    (req.params.count(SEARCH_AFTER) != 0 ? req.params[SEARCH_AFTER] : "") + "\x1E" +
+                                    req.params[MAX_CANDIDATES];
+
+    std::string cached_results_json_str;
+    if(collectionManager.result_cache_get(cache_key, cached_results_json_str)) {
+        if(req.params.count(CALLBACK) == 0) {
+            return res.send_200(cached_results_json_str);
+        } else {
+            return res.send_200(req.params[CALLBACK] + "(" + cached_results_json_str + ");");
+        }
+    }
+
+    const std::string & search_after_val = req.params.count(SEARCH_AFTER) != 0 ? req.params[SEARCH_AFTER] : "";
+
+    // Large pages are streamed hit-by-hit through the same machinery as the export endpoint, so
+    // the response is never materialized as one JSON blob. Streamed responses skip the result
+    // cache (a single large page would push out many small entries) and JSONP, which needs the
+    // whole body up front for wrapping.
+    if(std::stoull(req.params[PER_PAGE]) >= SEARCH_STREAM_MIN_PER_PAGE && req.params.count(CALLBACK) == 0) {
+        search_stream_state* state = new search_stream_state();
+
+        Option<nlohmann::json> stream_op = collection->search(req.params[QUERY], search_fields, filter_str,
+                                                   facet_fields, sort_fields, std::stoi(req.params[NUM_TYPOS]),
+                                                   std::stoi(req.params[PER_PAGE]), std::stoi(req.params[PAGE]),
+                                                   token_order, prefix, exhaustive_search, search_after_val,
+                                                   &state->hits, std::stoull(req.params[MAX_CANDIDATES]));
+
+        if(!stream_op.ok()) {
+            delete state;
+            return res.send(stream_op.code(), stream_op.error());
+        }
+
+        uint64_t searchTimeMillis = std::chrono::duration_cast<std::chrono::milliseconds>(
+                                         std::chrono::high_resolution_clock::now() - begin).count();
+
+        const nlohmann::json & envelope = stream_op.get();
+
+        state->prelude = "{\"found\": " + std::to_string(envelope["found"].get<size_t>()) + ", \"hits\": [";
+
+        state->epilogue = "]";
+        if(envelope.count("facet_counts") != 0) {
+            state->epilogue += ", \"facet_counts\": " + envelope["facet_counts"].dump();
+        }
+        if(envelope.count("search_after") != 0) {
+            state->epilogue += ", \"search_after\": " + envelope["search_after"].dump();
+        }
+        state->epilogue += ", \"page\": " + req.params[PAGE] +
+                           ", \"search_time_ms\": " + std::to_string(searchTimeMillis) + "}";
+
+        res.status_code = 200;
+        res.server->stream_response(search_stream_handler, req, res, (void *) state);
+        return ;
+    }
+
     Option<nlohmann::json> result_op = collection->search(req.params[QUERY], search_fields, filter_str, facet_fields,
                                                sort_fields, std::stoi(req.params[NUM_TYPOS]),
                                                std::stoi(req.params[PER_PAGE]), std::stoi(req.params[PAGE]),
-                                               token_order, prefix);
+                                               token_order, prefix, exhaustive_search, search_after_val,
+                                               nullptr, std::stoull(req.params[MAX_CANDIDATES]));
 
     uint64_t timeMillis = std::chrono::duration_cast<std::chrono::milliseconds>(
                                std::chrono::high_resolution_clock::now() - begin).count();
@@ -273,6 +376,8 @@ void get_search(http_req & req, http_res & res) {
     result["page"] = std::stoi(req.params[PAGE]);
     const std::string & results_json_str = result.dump();
 
+    collectionManager.result_cache_put(cache_key, results_json_str);
+
     //struct rusage r_usage;
     //getrusage(RUSAGE_SELF,&r_usage);
     //LOG(INFO) << "Memory usage: " << r_usage.ru_maxrss;
@@ -295,35 +400,181 @@ void get_collection_summary(http_req & req, http_res & res) {
     }
 
     nlohmann::json json_response = collection_summary_json(collection);
+    json_response["memory_used_bytes"] = collection->get_memory_stats()["total_bytes"];
     res.send_200(json_response.dump());
 }
 
-void collection_export_handler(http_req* req, http_res* res, void* data) {
+void get_collection_stats(http_req & req, http_res & res) {
     CollectionManager & collectionManager = CollectionManager::get_instance();
-    Collection* collection = collectionManager.get_collection(req->params["collection"]);
+    Collection* collection = collectionManager.get_collection(req.params["collection"]);
 
-    if(!collection) {
-        return res->send_404();
+    if(collection == nullptr) {
+        return res.send_404();
     }
 
-    const std::string seq_id_prefix = collection->get_seq_id_collection_prefix();
+    nlohmann::json json_response;
+    json_response["name"] = collection->get_name();
+    json_response["num_documents"] = collection->get_num_documents();
+    json_response["memory"] = collection->get_memory_stats();
+    res.send_200(json_response.dump());
+}
 
-    rocksdb::Iterator* it = reinterpret_cast<rocksdb::Iterator*>(data);
+// Everything a streamed search response needs after Collection::search has returned: hits are
+// emitted one per chunk by splicing raw stored documents, so the full response is never
+// materialized in memory and no DOM is built outside of highlighting.
+struct search_stream_state {
+    std::string prelude;   // opening of the envelope, up to and including `"hits": [`
+    std::string epilogue;  // closing of the envelope: facet counts, cursor, timings
+    std::vector<search_hit> hits;
+    size_t next_hit;
 
-    if(it->Valid() && it->key().ToString().compare(0, seq_id_prefix.size(), seq_id_prefix) == 0) {
-        res->body = it->value().ToString();
-        res->final = false;
-        it->Next();
+    search_stream_state(): next_hit(0) {
 
-        // apppend a new line character if there is going to be one more record to send
-        if(it->Valid() && it->key().ToString().compare(0, seq_id_prefix.size(), seq_id_prefix) == 0) {
-            res->body += "\n";
+    }
+};
+
+void search_stream_handler(http_req* req, http_res* res, void* data) {
+    search_stream_state* state = static_cast<search_stream_state*>(data);
+
+    if(res->final) {
+        // client went away mid-stream
+        delete state;
+        return ;
+    }
+
+    if(state->next_hit < state->hits.size()) {
+        const search_hit & hit = state->hits[state->next_hit];
+
+        std::string chunk;
+        if(state->next_hit == 0) {
+            chunk += state->prelude;
         }
+
+        chunk += "{\"document\":" + hit.json_doc;
+        if(!hit.highlight_field.empty()) {
+            // the field name and snippet are arbitrary text, so they are escaped via dump()
+            chunk += ",\"highlight\":{" + nlohmann::json(hit.highlight_field).dump() + ":" +
+                     nlohmann::json(hit.snippet).dump() + "}";
+        }
+        chunk += "}";
+
+        state->next_hit++;
+        if(state->next_hit < state->hits.size()) {
+            chunk += ",";
+        }
+
+        res->body = chunk;
+        res->final = false;
     } else {
+        // a response without any hits must still open the envelope
+        res->body = (state->hits.empty() ? state->prelude : "") + state->epilogue;
+        res->final = true;
+        delete state;
+    }
+}
+
+// Shared between the export's reader thread and its chunk handler. The reader streams from
+// a store snapshot into a bounded chunk buffer; the handler only ever drains that buffer, so
+// the event loop never waits on RocksDB. When the buffer runs dry the stream is paused and
+// resumed with a STREAM_PROCEED_MSG nudge once the reader catches up.
+struct export_state {
+    Store* store;
+    const rocksdb::Snapshot* snapshot;
+    std::string seq_id_prefix;
+
+    std::mutex m;
+    std::condition_variable cv;
+    std::vector<std::string> chunks;
+    bool reader_done;
+    bool aborted;
+    bool starved;  // the handler paused the stream and awaits a nudge
+    size_t refs;   // reader thread + chunk handler
+
+    HttpServer* server;
+    h2o_multithread_receiver_t* receiver;
+    void* generator;
+};
+
+static void export_state_unref(export_state* state) {
+    state->m.lock();
+    const size_t refs = --state->refs;
+    state->m.unlock();
+
+    if(refs == 0) {
+        delete state;
+    }
+}
+
+void collection_export_handler(http_req* req, http_res* res, void* data) {
+    export_state* state = static_cast<export_state*>(data);
+
+    if(res->final) {
+        // client went away mid-stream: tell the reader thread to wind down
+        std::unique_lock<std::mutex> lock(state->m);
+        state->aborted = true;
+        state->cv.notify_all();
+        lock.unlock();
+
+        export_state_unref(state);
+        return ;
+    }
+
+    std::unique_lock<std::mutex> lock(state->m);
+
+    if(!state->chunks.empty()) {
+        res->body = std::move(state->chunks.front());
+        state->chunks.erase(state->chunks.begin());
+        res->final = false;
+
+        // the reader may be blocked on buffer space
+        state->cv.notify_all();
+        return ;
+    }
+
+    if(state->reader_done) {
         res->body = "";
         res->final = true;
-        delete it;
+        lock.unlock();
+
+        export_state_unref(state);
+        return ;
+    }
+
+    // the buffer ran dry: withhold this chunk and wait for the reader's nudge
+    res->paused = true;
+    state->starved = true;
+}
+
+// consumes the starved flag, so at most one nudge is ever in flight per stream
+static void export_nudge_if_starved(export_state* state) {
+    state->m.lock();
+    const bool starved = state->starved;
+    state->starved = false;
+    state->m.unlock();
+
+    if(starved) {
+        state->server->send_message(HttpServer::STREAM_PROCEED_MSG, state->generator, state->receiver);
+    }
+}
+
+// Hands a chunk over to the stream handler, blocking while the buffer is full.
+// The chunk is left empty and ready for reuse. Returns false once the stream has been aborted.
+static bool export_push_chunk(export_state* state, std::string & chunk) {
+    std::unique_lock<std::mutex> lock(state->m);
+    state->cv.wait(lock, [state]() {
+        return state->chunks.size() < EXPORT_MAX_BUFFERED_CHUNKS || state->aborted;
+    });
+
+    if(state->aborted) {
+        return false;
     }
+
+    state->chunks.push_back(std::move(chunk));
+    chunk.clear();
+    lock.unlock();
+
+    export_nudge_if_starved(state);
+    return true;
 }
 
 void get_collection_export(http_req & req, http_res & res) {
@@ -332,18 +583,97 @@ void get_collection_export(http_req & req, http_res & res) {
 
     if(collection == nullptr) {
         res.send_404();
-        res.server->send_message(SEND_RESPONSE_MSG, new request_response{&req, &res});
+        res.server->send_message(SEND_RESPONSE_MSG, new request_response{&req, &res}, req.receiver);
         return ;
     }
 
-    const std::string seq_id_prefix = collection->get_seq_id_collection_prefix();
+    const char *RATE_MB_PER_SEC = "rate_mb_per_sec";
+    uint64_t rate_mb_per_sec = 0;  // unlimited
+
+    if(req.params.count(RATE_MB_PER_SEC) != 0) {
+        if(!StringUtils::is_uint64_t(req.params[RATE_MB_PER_SEC]) || req.params[RATE_MB_PER_SEC] == "0") {
+            res.send_400("The value of the parameter `rate_mb_per_sec` must be a positive integer.");
+            res.server->send_message(SEND_RESPONSE_MSG, new request_response{&req, &res}, req.receiver);
+            return ;
+        }
 
-    rocksdb::Iterator* it = collectionManager.get_store()->get_iterator();
-    it->Seek(seq_id_prefix);
+        rate_mb_per_sec = std::stoull(req.params[RATE_MB_PER_SEC]);
+    }
 
-    res.content_type_header = "application/octet-stream";
+    export_state* state = new export_state();
+    state->store = collectionManager.get_store();
+    // the snapshot pins a consistent view, so documents written during a long export
+    // neither appear in it nor are blocked by it
+    state->snapshot = state->store->get_snapshot();
+    state->seq_id_prefix = collection->get_seq_id_collection_prefix();
+    state->reader_done = false;
+    state->aborted = false;
+    state->starved = false;
+    state->refs = 2;
+    state->server = res.server;
+    state->receiver = req.receiver;
+
+    // sent as text so that the compressor filter applies - h2o does not consider
+    // application/octet-stream compressible, and exported JSONL shrinks a lot on the wire
+    res.content_type_header = "text/plain; charset=utf-8";
     res.status_code = 200;
-    res.server->stream_response(collection_export_handler, req, res, (void *) it);
+    res.server->stream_response(collection_export_handler, req, res, (void *) state);
+    state->generator = res.generator;
+
+    std::thread reader([state, rate_mb_per_sec]() {
+        rocksdb::Iterator* it = state->store->scan_snapshot(state->snapshot, state->seq_id_prefix);
+
+        std::string chunk;
+        uint64_t bytes_in_window = 0;
+        auto window_begin = std::chrono::high_resolution_clock::now();
+        bool aborted = false;
+
+        while(!aborted && it->Valid() && it->key().starts_with(state->seq_id_prefix)) {
+            chunk += it->value().ToString();
+            it->Next();
+
+            const bool has_more = it->Valid() && it->key().starts_with(state->seq_id_prefix);
+            if(has_more) {
+                chunk += "\n";
+            }
+
+            if(chunk.size() < EXPORT_CHUNK_BYTES && has_more) {
+                continue;
+            }
+
+            if(rate_mb_per_sec != 0) {
+                bytes_in_window += chunk.size();
+                if(bytes_in_window >= rate_mb_per_sec * 1024 * 1024) {
+                    const auto elapsed = std::chrono::high_resolution_clock::now() - window_begin;
+                    if(elapsed < std::chrono::seconds(1)) {
+                        std::this_thread::sleep_for(std::chrono::seconds(1) - elapsed);
+                    }
+                    bytes_in_window = 0;
+                    window_begin = std::chrono::high_resolution_clock::now();
+                }
+            }
+
+            if(!export_push_chunk(state, chunk)) {
+                aborted = true;
+                break;
+            }
+        }
+
+        delete it;
+        state->store->release_snapshot(state->snapshot);
+
+        {
+            std::lock_guard<std::mutex> lock(state->m);
+            state->reader_done = true;
+        }
+
+        // wakes a stream that paused after the last buffered chunk was drained; in the
+        // abort case this nudge performs the deferred teardown instead
+        export_nudge_if_starved(state);
+        export_state_unref(state);
+    });
+
+    reader.detach();
 }
 
 void post_add_document(http_req & req, http_res & res) {
@@ -363,6 +693,23 @@ void post_add_document(http_req & req, http_res & res) {
     }
 }
 
+void post_import_documents(http_req & req, http_res & res) {
+    CollectionManager & collectionManager = CollectionManager::get_instance();
+    Collection* collection = collectionManager.get_collection(req.params["collection"]);
+
+    if(collection == nullptr) {
+        return res.send_404();
+    }
+
+    Option<nlohmann::json> import_op = collection->add_many(req.body);
+
+    if(!import_op.ok()) {
+        res.send(import_op.code(), import_op.error());
+    } else {
+        res.send_200(import_op.get().dump());
+    }
+}
+
 void get_fetch_document(http_req & req, http_res & res) {
     std::string doc_id = req.params["id"];
 
@@ -381,6 +728,24 @@ void get_fetch_document(http_req & req, http_res & res) {
     }
 }
 
+void patch_update_document(http_req & req, http_res & res) {
+    std::string doc_id = req.params["id"];
+
+    CollectionManager & collectionManager = CollectionManager::get_instance();
+    Collection* collection = collectionManager.get_collection(req.params["collection"]);
+    if(collection == nullptr) {
+        return res.send_404();
+    }
+
+    Option<nlohmann::json> updated_doc_op = collection->update(doc_id, req.body);
+
+    if(!updated_doc_op.ok()) {
+        res.send(updated_doc_op.code(), updated_doc_op.error());
+    } else {
+        res.send_200(updated_doc_op.get().dump());
+    }
+}
+
 void del_remove_document(http_req & req, http_res & res) {
     std::string doc_id = req.params["id"];
 
@@ -418,10 +783,19 @@ void get_replication_updates(http_req & req, http_res & res) {
 
         CollectionManager & collectionManager = CollectionManager::get_instance();
         Store* store = collectionManager.get_store();
+
+        // long-poll: when the replica has caught up, hold the request open until new WAL
+        // entries appear (or the window lapses) instead of bouncing an empty response
+        size_t waited_ms = 0;
+        while(store->get_latest_seq_number() < seq_number && waited_ms < REPLICATION_LONG_POLL_MS) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(REPLICATION_LONG_POLL_TICK_MS));
+            waited_ms += REPLICATION_LONG_POLL_TICK_MS;
+        }
+
         Option<std::vector<std::string>*> updates_op = store->get_updates_since(seq_number, MAX_UPDATES_TO_SEND);
         if(!updates_op.ok()) {
             res.send(updates_op.code(), updates_op.error());
-            res.server->send_message(SEND_RESPONSE_MSG, new request_response{&req, &res});
+            res.server->send_message(SEND_RESPONSE_MSG, new request_response{&req, &res}, req.receiver);
             return ;
         }
 
@@ -437,13 +811,219 @@ void get_replication_updates(http_req & req, http_res & res) {
         json_response["latest_seq_num"] = latest_seq_num;
 
         res.send_200(json_response.dump());
-        res.server->send_message(SEND_RESPONSE_MSG, new request_response{&req, &res});
+        res.server->send_message(SEND_RESPONSE_MSG, new request_response{&req, &res}, req.receiver);
         delete updates;
     });
 
     response_thread.detach();
 }
 
+void replication_stream_handler(http_req* req, http_res* res, void* data) {
+    rocksdb::TransactionLogIterator* iter = reinterpret_cast<rocksdb::TransactionLogIterator*>(data);
+
+    if(res->final) {
+        // client went away mid-stream
+        delete iter;
+        return ;
+    }
+
+    if(iter->Valid()) {
+        // each chunk is a single length-prefixed write batch, so only one batch is ever held in memory
+        rocksdb::BatchResult batch_result = iter->GetBatch();
+        const std::string & write_batch_serialized = batch_result.writeBatchPtr->Data();
+        res->body = StringUtils::serialize_uint32_t(write_batch_serialized.size()) + write_batch_serialized;
+        res->final = false;
+        iter->Next();
+    } else {
+        res->body = "";
+        res->final = true;
+        delete iter;
+    }
+}
+
+void get_replication_stream(http_req & req, http_res & res) {
+    if(!StringUtils::is_uint64_t(req.params["seq_number"])) {
+        res.send_400("The value of the parameter `seq_number` must be an unsigned integer.");
+        res.server->send_message(SEND_RESPONSE_MSG, new request_response{&req, &res}, req.receiver);
+        return ;
+    }
+
+    uint64_t seq_number = std::stoull(req.params["seq_number"]);
+
+    CollectionManager & collectionManager = CollectionManager::get_instance();
+    Store* store = collectionManager.get_store();
+
+    Option<rocksdb::TransactionLogIterator*> iter_op = store->get_update_iterator(seq_number);
+    if(!iter_op.ok()) {
+        res.send(iter_op.code(), iter_op.error());
+        res.server->send_message(SEND_RESPONSE_MSG, new request_response{&req, &res}, req.receiver);
+        return ;
+    }
+
+    if(iter_op.get() == nullptr) {
+        // Replica has caught up - long-poll off the main thread until new WAL entries appear
+        // (or the window lapses), then send an empty body: the replica reconnects right away
+        // over its kept-alive connection and streams the new entries with a fresh iterator.
+        std::thread wait_thread([&req, &res, store, seq_number]() {
+            size_t waited_ms = 0;
+            while(store->get_latest_seq_number() < seq_number && waited_ms < REPLICATION_LONG_POLL_MS) {
+                std::this_thread::sleep_for(std::chrono::milliseconds(REPLICATION_LONG_POLL_TICK_MS));
+                waited_ms += REPLICATION_LONG_POLL_TICK_MS;
+            }
+
+            res.status_code = 200;
+            res.body = "";
+            res.server->send_message(SEND_RESPONSE_MSG, new request_response{&req, &res}, req.receiver);
+        });
+
+        wait_thread.detach();
+        return ;
+    }
+
+    res.content_type_header = "application/octet-stream";
+    res.status_code = 200;
+    res.server->stream_response(replication_stream_handler, req, res, (void *) iter_op.get());
+}
+
+void get_replication_store_snapshot(http_req & req, http_res & res) {
+    CollectionManager & collectionManager = CollectionManager::get_instance();
+
+    export_state* state = new export_state();
+    state->store = collectionManager.get_store();
+    // the snapshot pins a consistent view of the whole store, and its exact WAL sequence
+    // number is sent ahead of the dump so the replica knows where live updates resume
+    state->snapshot = state->store->get_snapshot();
+    state->reader_done = false;
+    state->aborted = false;
+    state->starved = false;
+    state->refs = 2;
+    state->server = res.server;
+    state->receiver = req.receiver;
+
+    res.content_type_header = "application/octet-stream";
+    res.status_code = 200;
+    res.server->stream_response(collection_export_handler, req, res, (void *) state);
+    state->generator = res.generator;
+
+    const uint64_t snapshot_seq = state->store->get_snapshot_seq_number(state->snapshot);
+
+    std::thread reader([state, snapshot_seq]() {
+        rocksdb::Iterator* it = state->store->scan_snapshot(state->snapshot, "");
+
+        // an 8-byte header carrying the snapshot's sequence number, followed by a
+        // [key length][key][value length][value] frame for every key in the store
+        std::string chunk = StringUtils::serialize_uint32_t((uint32_t) (snapshot_seq >> 32)) +
+                            StringUtils::serialize_uint32_t((uint32_t) (snapshot_seq & 0xFFFFFFFF));
+
+        bool aborted = false;
+
+        for(; !aborted && it->Valid(); it->Next()) {
+            const std::string & key = it->key().ToString();
+            const std::string & value = it->value().ToString();
+
+            chunk += StringUtils::serialize_uint32_t(key.size()) + key +
+                     StringUtils::serialize_uint32_t(value.size()) + value;
+
+            if(chunk.size() >= EXPORT_CHUNK_BYTES) {
+                aborted = !export_push_chunk(state, chunk);
+            }
+        }
+
+        if(!aborted && !chunk.empty()) {
+            export_push_chunk(state, chunk);
+        }
+
+        delete it;
+        state->store->release_snapshot(state->snapshot);
+
+        {
+            std::lock_guard<std::mutex> lock(state->m);
+            state->reader_done = true;
+        }
+
+        export_nudge_if_starved(state);
+        export_state_unref(state);
+    });
+
+    reader.detach();
+}
+
+void get_replication_index_snapshot(http_req & req, http_res & res) {
+    CollectionManager & collectionManager = CollectionManager::get_instance();
+    Collection* collection = collectionManager.get_collection(req.params["collection"]);
+
+    if(collection == nullptr) {
+        res.send_404();
+        res.server->send_message(SEND_RESPONSE_MSG, new request_response{&req, &res}, req.receiver);
+        return ;
+    }
+
+    Store* store = collectionManager.get_store();
+    const std::string & snapshot_dir = store->get_state_dir_path() + "/" +
+                                       CollectionManager::INDEX_SNAPSHOT_DIR_NAME;
+    mkdir(snapshot_dir.c_str(), 0755);  // no-op when the directory already exists
+
+    // written to a bootstrap-specific path, so the shutdown snapshot is never clobbered
+    const std::string snapshot_path = snapshot_dir + "/" +
+                                      std::to_string(collection->get_collection_id()) + ".bootstrap";
+
+    Option<bool> save_op = collection->save_index_snapshot(snapshot_path);
+    if(!save_op.ok()) {
+        res.send(save_op.code(), save_op.error());
+        res.server->send_message(SEND_RESPONSE_MSG, new request_response{&req, &res}, req.receiver);
+        return ;
+    }
+
+    export_state* state = new export_state();
+    state->store = store;
+    state->snapshot = nullptr;  // streams a file, not the store
+    state->reader_done = false;
+    state->aborted = false;
+    state->starved = false;
+    state->refs = 2;
+    state->server = res.server;
+    state->receiver = req.receiver;
+
+    res.content_type_header = "application/octet-stream";
+    res.status_code = 200;
+    res.server->stream_response(collection_export_handler, req, res, (void *) state);
+    state->generator = res.generator;
+
+    std::thread reader([state, snapshot_path]() {
+        FILE* fp = fopen(snapshot_path.c_str(), "rb");
+
+        if(fp == nullptr) {
+            LOG(ERR) << "Could not open index snapshot for streaming: " << snapshot_path;
+        } else {
+            std::string chunk;
+            chunk.resize(EXPORT_CHUNK_BYTES);
+            size_t bytes_read;
+
+            while((bytes_read = fread(&chunk[0], 1, EXPORT_CHUNK_BYTES, fp)) > 0) {
+                chunk.resize(bytes_read);
+                if(!export_push_chunk(state, chunk)) {
+                    break;
+                }
+                chunk.resize(EXPORT_CHUNK_BYTES);
+            }
+
+            fclose(fp);
+        }
+
+        remove(snapshot_path.c_str());
+
+        {
+            std::lock_guard<std::mutex> lock(state->m);
+            state->reader_done = true;
+        }
+
+        export_nudge_if_starved(state);
+        export_state_unref(state);
+    });
+
+    reader.detach();
+}
+
 void on_send_response(void *data) {
     request_response* req_res = static_cast<request_response*>(data);
     req_res->response->server->send_response(req_res->req, req_res->response);
@@ -1,5 +1,29 @@
 #include "array.h"
 
+void array::load(const uint32_t *new_array, const uint32_t array_length) {
+    min = std::numeric_limits<uint32_t>::max();
+    max = std::numeric_limits<uint32_t>::min();
+
+    for(uint32_t i = 0; i < array_length; i++) {
+        if(new_array[i] < min) min = new_array[i];
+        if(new_array[i] > max) max = new_array[i];
+    }
+
+    uint32_t size_required = (uint32_t) (unsorted_append_size_required(max, array_length) * FOR_GROWTH_FACTOR);
+    uint8_t *out = new uint8_t[size_required];
+    uint32_t actual_size = for_compress_unsorted(new_array, out, array_length);
+
+    if(!external) {
+        delete[] in;
+    }
+    external = false;
+
+    in = out;
+    length = array_length;
+    size_bytes = size_required;
+    length_bytes = actual_size;
+}
+
 uint32_t array::at(uint32_t index) {
     return for_select(in, index);
 }
@@ -14,6 +38,11 @@ uint32_t array::indexOf(uint32_t value) {
 }
 
 bool array::append(uint32_t value) {
+    if(external) {
+        // frozen payloads live in the offset store and must not be written through
+        make_owned();
+    }
+
     uint32_t size_required = unsorted_append_size_required(value, length+1);
 
     if(size_required+FOR_ELE_SIZE > size_bytes) {
@@ -41,6 +70,56 @@ bool array::append(uint32_t value) {
     return true;
 }
 
+bool array::append(const uint32_t* values, const uint32_t values_length) {
+    if(values_length == 0) {
+        return true;
+    }
+
+    if(external) {
+        // frozen payloads live in the offset store and must not be written through
+        make_owned();
+    }
+
+    uint32_t new_min = min;
+    uint32_t new_max = max;
+
+    for(uint32_t i = 0; i < values_length; i++) {
+        if(values[i] < new_min) new_min = values[i];
+        if(values[i] > new_max) new_max = values[i];
+    }
+
+    // the buffer is sized for the whole run once, instead of re-evaluating the compressed
+    // size and growth per element
+    uint32_t size_required = METADATA_OVERHEAD + 4 +
+                             for_compressed_size_bits(length + values_length, required_bits(new_max - new_min));
+
+    if(size_required+FOR_ELE_SIZE > size_bytes) {
+        size_t new_size = (size_t) (size_required * FOR_GROWTH_FACTOR);
+        uint8_t *new_location = (uint8_t *) realloc(in, new_size);
+        if(new_location == NULL) {
+            abort();
+        }
+        in = new_location;
+        size_bytes = (uint32_t) new_size;
+    }
+
+    uint32_t new_length_bytes = length_bytes;
+
+    for(uint32_t i = 0; i < values_length; i++) {
+        new_length_bytes = for_append_unsorted(in, length + i, values[i]);
+        if(new_length_bytes == 0) {
+            abort();
+        }
+    }
+
+    length_bytes = new_length_bytes;
+    length += values_length;
+    min = new_min;
+    max = new_max;
+
+    return true;
+}
+
 void array::remove_index(uint32_t start_index, uint32_t end_index) {
     uint32_t *curr_array = uncompress();
 
@@ -66,7 +145,10 @@ void array::remove_index(uint32_t start_index, uint32_t end_index) {
 
     delete[] curr_array;
     delete[] new_array;
-    delete[] in;
+    if(!external) {
+        delete[] in;
+    }
+    external = false;
 
     in = out;
     length = new_index;
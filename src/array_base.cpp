@@ -13,3 +13,66 @@ uint32_t array_base::getSizeInBytes() {
 uint32_t array_base::getLength() {
     return length;
 }
+
+uint32_t array_base::getLengthInBytes() {
+    return length_bytes;
+}
+
+uint32_t array_base::getMin() {
+    return min;
+}
+
+uint32_t array_base::getMax() {
+    return max;
+}
+
+const uint8_t* array_base::get_raw() {
+    return in;
+}
+
+void array_base::use_external(uint8_t* data) {
+    if(!external) {
+        delete[] in;
+    }
+
+    in = data;
+    size_bytes = length_bytes;
+    external = true;
+}
+
+void array_base::make_owned() {
+    if(!external) {
+        return ;
+    }
+
+    uint8_t* copy = new uint8_t[length_bytes];
+    memcpy(copy, in, length_bytes);
+
+    in = copy;
+    size_bytes = length_bytes;
+    external = false;
+}
+
+bool array_base::is_external() {
+    return external;
+}
+
+void array_base::load_raw(const uint8_t *data, const uint32_t num_length_bytes, const uint32_t arr_length,
+                          const uint32_t arr_min, const uint32_t arr_max) {
+    uint32_t size_required = (uint32_t) ((num_length_bytes + METADATA_OVERHEAD + FOR_ELE_SIZE) * FOR_GROWTH_FACTOR);
+    uint8_t *out = new uint8_t[size_required];
+    memset(out, 0, size_required);
+    memcpy(out, data, num_length_bytes);
+
+    if(!external) {
+        delete[] in;
+    }
+    external = false;
+    in = out;
+
+    size_bytes = size_required;
+    length_bytes = num_length_bytes;
+    length = arr_length;
+    min = arr_min;
+    max = arr_max;
+}
@@ -1,5 +1,227 @@
 #include "array_utils.h"
 #include <memory.h>
+#include <algorithm>
+#include <queue>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+// When one list is at least this many times longer than the other, galloping into the longer
+// list beats a linear merge.
+static const size_t GALLOP_LEN_RATIO = 16;
+
+// Returns the index of the first element in arr[pos..len) that is >= target, via an
+// exponential probe followed by a binary search over the probed range.
+static size_t gallop_lower_bound(const uint32_t *arr, size_t pos, const size_t len, const uint32_t target) {
+    size_t step = 1;
+    while(pos + step < len && arr[pos + step] < target) {
+        pos += step;
+        step <<= 1;
+    }
+
+    size_t hi = std::min(pos + step, len);
+    while(pos < hi) {
+        size_t mid = pos + (hi - pos) / 2;
+        if(arr[mid] < target) {
+            pos = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+
+    return pos;
+}
+
+// One-sided intersection: for every element of the short list, gallops ahead in the long list.
+// Cost is O(len_small * log(len_large)) instead of O(len_large).
+static size_t and_gallop(const uint32_t *small, const size_t len_small,
+                         const uint32_t *large, const size_t len_large, uint32_t *out) {
+    size_t pos = 0, out_len = 0;
+
+    for(size_t i = 0; i < len_small; i++) {
+        pos = gallop_lower_bound(large, pos, len_large, small[i]);
+        if(pos == len_large) {
+            break;
+        }
+
+        if(large[pos] == small[i]) {
+            out[out_len++] = small[i];
+        }
+    }
+
+    return out_len;
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+
+// Byte-level shuffle masks used to left-pack the matched elements of a 4-wide compare.
+static __m128i shuffle_dict[16];
+
+static bool prepare_shuffle_dict() {
+    for(int mask = 0; mask < 16; mask++) {
+        int counter = 0;
+        char permutation[16];
+        memset(permutation, 0xFF, sizeof(permutation));
+        for(char b = 0; b < 4; b++) {
+            if(mask & (1 << b)) {
+                permutation[counter * 4] = 4 * b;
+                permutation[counter * 4 + 1] = 4 * b + 1;
+                permutation[counter * 4 + 2] = 4 * b + 2;
+                permutation[counter * 4 + 3] = 4 * b + 3;
+                counter++;
+            }
+        }
+        shuffle_dict[mask] = _mm_loadu_si128(reinterpret_cast<const __m128i *>(permutation));
+    }
+
+    return true;
+}
+
+static const bool shuffle_dict_ready = prepare_shuffle_dict();
+
+// Block-wise SSE intersection for lists of comparable lengths: compares each 4-wide block of A
+// against all rotations of a 4-wide block of B, then left-packs the matches into out.
+__attribute__((target("sse4.1,popcnt")))
+static size_t and_sse(const uint32_t *A, const size_t lenA,
+                      const uint32_t *B, const size_t lenB, uint32_t *out) {
+    size_t i = 0, j = 0, out_len = 0;
+    const size_t st_a = (lenA / 4) * 4;
+    const size_t st_b = (lenB / 4) * 4;
+
+    while(i < st_a && j < st_b) {
+        __m128i v_a = _mm_loadu_si128(reinterpret_cast<const __m128i *>(A + i));
+        __m128i v_b = _mm_loadu_si128(reinterpret_cast<const __m128i *>(B + j));
+
+        __m128i cmp_mask = _mm_cmpeq_epi32(v_a, v_b);
+        __m128i rot1 = _mm_shuffle_epi32(v_b, _MM_SHUFFLE(0, 3, 2, 1));
+        cmp_mask = _mm_or_si128(cmp_mask, _mm_cmpeq_epi32(v_a, rot1));
+        __m128i rot2 = _mm_shuffle_epi32(v_b, _MM_SHUFFLE(1, 0, 3, 2));
+        cmp_mask = _mm_or_si128(cmp_mask, _mm_cmpeq_epi32(v_a, rot2));
+        __m128i rot3 = _mm_shuffle_epi32(v_b, _MM_SHUFFLE(2, 1, 0, 3));
+        cmp_mask = _mm_or_si128(cmp_mask, _mm_cmpeq_epi32(v_a, rot3));
+
+        const int mask = _mm_movemask_ps(_mm_castsi128_ps(cmp_mask));
+        __m128i packed = _mm_shuffle_epi8(v_a, shuffle_dict[mask]);
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(out + out_len), packed);
+        out_len += _mm_popcnt_u32(mask);
+
+        const uint32_t a_max = A[i + 3];
+        const uint32_t b_max = B[j + 3];
+        if(a_max <= b_max) {
+            i += 4;
+        }
+        if(b_max <= a_max) {
+            j += 4;
+        }
+    }
+
+    // intersect the scalar tails
+    while(i < lenA && j < lenB) {
+        if(A[i] < B[j]) {
+            i++;
+        } else if(A[i] > B[j]) {
+            j++;
+        } else {
+            out[out_len++] = A[i];
+            i++;
+            j++;
+        }
+    }
+
+    return out_len;
+}
+
+// Galloping intersection for heavily skewed lists: exponential + binary search over 8-element
+// blocks of the long list, with a single AVX2 compare against the final block.
+__attribute__((target("avx2")))
+static size_t and_avx2_gallop(const uint32_t *small, const size_t len_small,
+                              const uint32_t *large, const size_t len_large, uint32_t *out) {
+    size_t out_len = 0;
+    size_t block = 0;
+    const size_t num_blocks = len_large / 8;
+
+    for(size_t i = 0; i < len_small; i++) {
+        const uint32_t target = small[i];
+
+        size_t step = 1;
+        while(block + step < num_blocks && large[(block + step) * 8 + 7] < target) {
+            block += step;
+            step <<= 1;
+        }
+
+        size_t hi = std::min(block + step, num_blocks);
+        while(block < hi) {
+            size_t mid = block + (hi - block) / 2;
+            if(large[mid * 8 + 7] < target) {
+                block = mid + 1;
+            } else {
+                hi = mid;
+            }
+        }
+
+        if(block == num_blocks) {
+            // target can only lie in the scalar tail of the long list
+            const size_t pos = gallop_lower_bound(large, num_blocks * 8, len_large, target);
+            if(pos != len_large && large[pos] == target) {
+                out[out_len++] = target;
+            }
+            continue;
+        }
+
+        __m256i v_target = _mm256_set1_epi32(target);
+        __m256i v_block = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(large + block * 8));
+        __m256i cmp = _mm256_cmpeq_epi32(v_target, v_block);
+        if(_mm256_movemask_epi8(cmp) != 0) {
+            out[out_len++] = target;
+        }
+    }
+
+    return out_len;
+}
+
+#endif
+
+size_t ArrayUtils::intersect(const uint32_t *A, const size_t lenA,
+                             const uint32_t *B, const size_t lenB, uint32_t **results) {
+    if(lenA == 0 || lenB == 0) {
+        return 0;
+    }
+
+    // order the lists so that `small` is the shorter one
+    const uint32_t *small = A, *large = B;
+    size_t len_small = lenA, len_large = lenB;
+    if(len_small > len_large) {
+        std::swap(small, large);
+        std::swap(len_small, len_large);
+    }
+
+#if defined(__x86_64__) || defined(__i386__)
+    static const bool has_avx2 = __builtin_cpu_supports("avx2");
+    static const bool has_sse4 = __builtin_cpu_supports("sse4.1") && __builtin_cpu_supports("popcnt");
+
+    if(len_large / len_small >= GALLOP_LEN_RATIO) {
+        *results = new uint32_t[len_small];
+        if(has_avx2) {
+            return and_avx2_gallop(small, len_small, large, len_large, *results);
+        }
+        return and_gallop(small, len_small, large, len_large, *results);
+    }
+
+    if(has_sse4 && shuffle_dict_ready) {
+        // the SSE kernel stores a full 4-wide register per block, so leave room for the overshoot
+        *results = new uint32_t[len_small + 4];
+        return and_sse(small, len_small, large, len_large, *results);
+    }
+#else
+    if(len_large / len_small >= GALLOP_LEN_RATIO) {
+        *results = new uint32_t[len_small];
+        return and_gallop(small, len_small, large, len_large, *results);
+    }
+#endif
+
+    return and_scalar(A, lenA, B, lenB, results);
+}
 
 size_t ArrayUtils::and_scalar(const uint32_t *A, const size_t lenA,
                               const uint32_t *B, const size_t lenB, uint32_t **results) {
@@ -96,4 +318,53 @@ size_t ArrayUtils::or_scalar(const uint32_t *A, const size_t lenA,
   delete[] results;
 
   return res_index;
-}
\ No newline at end of file
+}
+size_t ArrayUtils::or_many(const std::vector<std::pair<uint32_t*, size_t>> & arrays, uint32_t **out) {
+    size_t total_len = 0;
+    for(const auto & array_pair: arrays) {
+        total_len += array_pair.second;
+    }
+
+    if(total_len == 0) {
+        *out = nullptr;
+        return 0;
+    }
+
+    uint32_t* results = new uint32_t[total_len];
+    size_t res_index = 0;
+
+    // min-heap of (head value, array index) — the position of each array's cursor is tracked separately
+    std::priority_queue<std::pair<uint32_t, size_t>, std::vector<std::pair<uint32_t, size_t>>,
+                        std::greater<std::pair<uint32_t, size_t>>> min_heap;
+    std::vector<size_t> positions(arrays.size(), 0);
+
+    for(size_t i = 0; i < arrays.size(); i++) {
+        if(arrays[i].first != nullptr && arrays[i].second != 0) {
+            min_heap.push(std::make_pair(arrays[i].first[0], i));
+        }
+    }
+
+    while(!min_heap.empty()) {
+        const std::pair<uint32_t, size_t> head = min_heap.top();
+        min_heap.pop();
+
+        if(res_index == 0 || results[res_index-1] != head.first) {
+            results[res_index] = head.first;
+            res_index++;
+        }
+
+        const size_t arr_index = head.second;
+        positions[arr_index]++;
+
+        if(positions[arr_index] < arrays[arr_index].second) {
+            min_heap.push(std::make_pair(arrays[arr_index].first[positions[arr_index]], arr_index));
+        }
+    }
+
+    // shrink fit
+    *out = new uint32_t[res_index];
+    memcpy(*out, results, res_index * sizeof(uint32_t));
+    delete[] results;
+
+    return res_index;
+}
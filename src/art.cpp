@@ -95,34 +95,84 @@ bool compare_art_node_score_pq(const art_node* a, const art_node* b) {
     return !compare_art_node_score(a, b);
 }
 
+static const size_t node_sizes[] = {sizeof(art_node4), sizeof(art_node16),
+                                    sizeof(art_node48), sizeof(art_node256)};
+
+/**
+ * Carves `size` bytes out of the arena's current block, starting a new
+ * block when the current one is exhausted.
+ */
+static void* arena_alloc(art_arena *arena, size_t size) {
+    size = (size + 7) & ~((size_t)7);  // keep allocations 8-byte aligned
+
+    art_block *block = arena->head;
+    if (!block || block->used + size > block->size) {
+        size_t block_size = (size > ART_ARENA_BLOCK_SIZE) ? size : ART_ARENA_BLOCK_SIZE;
+        block = (art_block *) malloc(sizeof(art_block) + block_size);
+        block->next = arena->head;
+        block->size = block_size;
+        block->used = 0;
+        arena->head = block;
+    }
+
+    void *ptr = ((char *) (block + 1)) + block->used;
+    block->used += size;
+    return ptr;
+}
+
 /**
- * Allocates a node of the given type,
+ * Allocates a node of the given type from the tree's arena,
  * initializes to zero and sets the type.
  */
-static art_node* alloc_node(uint8_t type) {
-    art_node* n;
+static art_node* alloc_node(art_tree *t, uint8_t type) {
     switch (type) {
         case NODE4:
-            n = (art_node *) calloc(1, sizeof(art_node4));
-            break;
         case NODE16:
-            n = (art_node *) calloc(1, sizeof(art_node16));
-            break;
         case NODE48:
-            n = (art_node *) calloc(1, sizeof(art_node48));
-            break;
         case NODE256:
-            n = (art_node *) calloc(1, sizeof(art_node256));
             break;
         default:
             abort();
     }
+
+    art_node* n;
+    void **free_list = &t->arena.free_nodes[type - 1];
+
+    if (*free_list) {
+        n = (art_node *) *free_list;
+        *free_list = *((void **) n);
+    } else {
+        n = (art_node *) arena_alloc(&t->arena, node_sizes[type - 1]);
+    }
+
+    memset(n, 0, node_sizes[type - 1]);
     n->type = type;
     n->max_score = 0;
     n->max_token_count = 0;
     return n;
 }
 
+// Returns a node's memory to the size class free list of the tree's arena
+static void free_node(art_tree *t, art_node *n) {
+    void **free_list = &t->arena.free_nodes[n->type - 1];
+    *((void **) n) = *free_list;
+    *free_list = n;
+}
+
+static size_t leaf_alloc_size(uint32_t key_len) {
+    return (sizeof(art_leaf) + key_len + 7) & ~((size_t)7);
+}
+
+// Small leaves are recycled via bucketed free lists, while oversized
+// ones simply stay in the arena until the tree is destroyed
+static void free_leaf(art_tree *t, art_leaf *l) {
+    const size_t bucket = leaf_alloc_size(l->key_len) / 8;
+    if (bucket < ART_LEAF_FREE_LISTS) {
+        *((void **) l) = t->arena.free_leaves[bucket];
+        t->arena.free_leaves[bucket] = l;
+    }
+}
+
 /**
  * Initializes an ART tree
  * @return 0 on success.
@@ -130,10 +180,13 @@ static art_node* alloc_node(uint8_t type) {
 int art_tree_init(art_tree *t) {
     t->root = NULL;
     t->size = 0;
+    memset(&t->arena, 0, sizeof(art_arena));
+    t->completion = new art_completion_cache();
     return 0;
 }
 
-// Recursively destroys the tree
+// Recursively releases the posting containers of the tree: the node and
+// leaf memory itself belongs to the arena and is torn down in bulk
 static void destroy_node(art_node *n) {
     // Break if null
     if (!n) return;
@@ -142,7 +195,6 @@ static void destroy_node(art_node *n) {
     if (IS_LEAF(n)) {
         art_leaf *leaf = (art_leaf *) LEAF_RAW(n);
         delete leaf->values;
-        free(leaf);
         return;
     }
 
@@ -187,9 +239,6 @@ static void destroy_node(art_node *n) {
         default:
             abort();
     }
-
-    // Free ourself on the way up
-    free(n);
 }
 
 /**
@@ -198,6 +247,21 @@ static void destroy_node(art_node *n) {
  */
 int art_tree_destroy(art_tree *t) {
     destroy_node(t->root);
+
+    // bulk teardown: a handful of free() calls instead of one per node and leaf
+    art_block *block = t->arena.head;
+    while (block) {
+        art_block *next = block->next;
+        free(block);
+        block = next;
+    }
+
+    t->root = NULL;
+    t->size = 0;
+    memset(&t->arena, 0, sizeof(art_arena));
+
+    delete t->completion;
+    t->completion = NULL;
     return 0;
 }
 
@@ -215,6 +279,7 @@ void compare_and_match_leaf(const unsigned char *int_str, int int_str_len, const
 
 static art_node** find_child(art_node *n, unsigned char c) {
     int i, mask, bitfield;
+    __m128i cmp;
     union {
         art_node4 *p1;
         art_node16 *p2;
@@ -224,34 +289,38 @@ static art_node** find_child(art_node *n, unsigned char c) {
     switch (n->type) {
         case NODE4:
             p.p1 = (art_node4*)n;
-            for (i=0;i < n->num_children; i++) {
-                if (p.p1->keys[i] == c)
-                    return &p.p1->children[i];
-            }
+
+            // Same SSE comparison as node16. With at most 4 children the 16 byte load
+            // over-reads into the children array, which is still within the node.
+            cmp = _mm_cmpeq_epi8(_mm_set1_epi8(c),
+                                 _mm_loadu_si128((__m128i*)p.p1->keys));
+
+            mask = (1 << n->num_children) - 1;
+            bitfield = _mm_movemask_epi8(cmp) & mask;
+
+            if (bitfield)
+                return &p.p1->children[__builtin_ctz(bitfield)];
             break;
 
-            {
-                __m128i cmp;
-                case NODE16:
-                    p.p2 = (art_node16*)n;
-
-                // Compare the key to all 16 stored keys
-                cmp = _mm_cmpeq_epi8(_mm_set1_epi8(c),
-                                     _mm_loadu_si128((__m128i*)p.p2->keys));
-
-                // Use a mask to ignore children that don't exist
-                mask = (1 << n->num_children) - 1;
-                bitfield = _mm_movemask_epi8(cmp) & mask;
-
-                /*
-                 * If we have a match (any bit set) then we can
-                 * return the pointer match using ctz to get
-                 * the index.
-                 */
-                if (bitfield)
-                    return &p.p2->children[__builtin_ctz(bitfield)];
-                break;
-            }
+        case NODE16:
+            p.p2 = (art_node16*)n;
+
+            // Compare the key to all 16 stored keys
+            cmp = _mm_cmpeq_epi8(_mm_set1_epi8(c),
+                                 _mm_loadu_si128((__m128i*)p.p2->keys));
+
+            // Use a mask to ignore children that don't exist
+            mask = (1 << n->num_children) - 1;
+            bitfield = _mm_movemask_epi8(cmp) & mask;
+
+            /*
+             * If we have a match (any bit set) then we can
+             * return the pointer match using ctz to get
+             * the index.
+             */
+            if (bitfield)
+                return &p.p2->children[__builtin_ctz(bitfield)];
+            break;
 
         case NODE48:
             p.p3 = (art_node48*)n;
@@ -272,6 +341,12 @@ static art_node** find_child(art_node *n, unsigned char c) {
     return NULL;
 }
 
+// Child pointers can be tagged leaves, so the tag bit is masked off to make sure
+// the prefetch hits the line the node actually lives on.
+static inline void prefetch_node(const art_node *n) {
+    __builtin_prefetch((const void *)((uintptr_t) n & ~((uintptr_t) 1)));
+}
+
 // Simple inlined if
 static inline int min(int a, int b) {
     return (a < b) ? a : b;
@@ -345,6 +420,7 @@ void* art_search(const art_tree *t, const unsigned char *key, int key_len) {
         // Recursively search
         child = find_child(n, key[depth]);
         n = (child) ? *child : NULL;
+        if (n) prefetch_node(n);
         depth++;
     }
     return NULL;
@@ -421,14 +497,21 @@ static void add_document_to_leaf(const art_document *document, art_leaf *leaf) {
     leaf->values->ids.append(document->id);
     uint32_t curr_index = leaf->values->offsets.getLength();
     leaf->values->offset_index.append(curr_index);
+    leaf->values->offsets.append(document->offsets, document->offsets_len);
+}
 
-    for(uint32_t i=0; i<document->offsets_len; i++) {
-        leaf->values->offsets.append(document->offsets[i]);
+static art_leaf* make_leaf(art_tree *t, const unsigned char *key, uint32_t key_len, art_document *document) {
+    const size_t size = leaf_alloc_size(key_len);
+    const size_t bucket = size / 8;
+    art_leaf *l;
+
+    if (bucket < ART_LEAF_FREE_LISTS && t->arena.free_leaves[bucket]) {
+        l = (art_leaf *) t->arena.free_leaves[bucket];
+        t->arena.free_leaves[bucket] = *((void **) l);
+    } else {
+        l = (art_leaf *) arena_alloc(&t->arena, size);
     }
-}
 
-static art_leaf* make_leaf(const unsigned char *key, uint32_t key_len, art_document *document) {
-    art_leaf *l = (art_leaf *) malloc(sizeof(art_leaf) + key_len);
     l->values = new art_values;
     l->max_score = 0;
     l->key_len = key_len;
@@ -455,7 +538,8 @@ static void copy_header(art_node *dest, art_node *src) {
     memcpy(dest->partial, src->partial, min(MAX_PREFIX_LEN, src->partial_len));
 }
 
-static void add_child256(art_node256 *n, art_node **ref, unsigned char c, void *child) {
+static void add_child256(art_tree *t, art_node256 *n, art_node **ref, unsigned char c, void *child) {
+    (void)t;
     (void)ref;
     n->n.max_score = MAX(n->n.max_score, ((art_leaf *) LEAF_RAW(child))->max_score);
     n->n.max_token_count = MAX(n->n.max_token_count, ((art_leaf *) LEAF_RAW(child))->values->ids.getLength());
@@ -463,7 +547,7 @@ static void add_child256(art_node256 *n, art_node **ref, unsigned char c, void *
     n->children[c] = (art_node *) child;
 }
 
-static void add_child48(art_node48 *n, art_node **ref, unsigned char c, void *child) {
+static void add_child48(art_tree *t, art_node48 *n, art_node **ref, unsigned char c, void *child) {
     if (n->n.num_children < 48) {
         int pos = 0;
         while (n->children[pos]) pos++;
@@ -473,7 +557,7 @@ static void add_child48(art_node48 *n, art_node **ref, unsigned char c, void *ch
         n->keys[c] = pos + 1;
         n->n.num_children++;
     } else {
-        art_node256 *new_n = (art_node256*)alloc_node(NODE256);
+        art_node256 *new_n = (art_node256*)alloc_node(t, NODE256);
         for (int i=0;i<256;i++) {
             if (n->keys[i]) {
                 new_n->children[i] = n->children[n->keys[i] - 1];
@@ -481,12 +565,12 @@ static void add_child48(art_node48 *n, art_node **ref, unsigned char c, void *ch
         }
         copy_header((art_node*)new_n, (art_node*)n);
         *ref = (art_node*)new_n;
-        free(n);
-        add_child256(new_n, ref, c, child);
+        free_node(t, (art_node*)n);
+        add_child256(t, new_n, ref, c, child);
     }
 }
 
-static void add_child16(art_node16 *n, art_node **ref, unsigned char c, void *child) {
+static void add_child16(art_tree *t, art_node16 *n, art_node **ref, unsigned char c, void *child) {
     if (n->n.num_children < 16) {
         __m128i cmp;
 
@@ -516,7 +600,7 @@ static void add_child16(art_node16 *n, art_node **ref, unsigned char c, void *ch
         n->n.num_children++;
 
     } else {
-        art_node48 *new_n = (art_node48*)alloc_node(NODE48);
+        art_node48 *new_n = (art_node48*)alloc_node(t, NODE48);
 
         // Copy the child pointers and populate the key map
         memcpy(new_n->children, n->children,
@@ -526,12 +610,12 @@ static void add_child16(art_node16 *n, art_node **ref, unsigned char c, void *ch
         }
         copy_header((art_node*)new_n, (art_node*)n);
         *ref = (art_node*)new_n;
-        free(n);
-        add_child48(new_n, ref, c, child);
+        free_node(t, (art_node*)n);
+        add_child48(t, new_n, ref, c, child);
     }
 }
 
-static void add_child4(art_node4 *n, art_node **ref, unsigned char c, void *child) {
+static void add_child4(art_tree *t, art_node4 *n, art_node **ref, unsigned char c, void *child) {
     if (n->n.num_children < 4) {
         int idx;
         for (idx=0; idx < n->n.num_children; idx++) {
@@ -554,7 +638,7 @@ static void add_child4(art_node4 *n, art_node **ref, unsigned char c, void *chil
         n->n.num_children++;
 
     } else {
-        art_node16 *new_n = (art_node16*)alloc_node(NODE16);
+        art_node16 *new_n = (art_node16*)alloc_node(t, NODE16);
 
         // Copy the child pointers and the key map
         memcpy(new_n->children, n->children,
@@ -563,21 +647,21 @@ static void add_child4(art_node4 *n, art_node **ref, unsigned char c, void *chil
                 sizeof(unsigned char)*n->n.num_children);
         copy_header((art_node*)new_n, (art_node*)n);
         *ref = (art_node*)new_n;
-        free(n);
-        add_child16(new_n, ref, c, child);
+        free_node(t, (art_node*)n);
+        add_child16(t, new_n, ref, c, child);
     }
 }
 
-static void add_child(art_node *n, art_node **ref, unsigned char c, void *child) {
+static void add_child(art_tree *t, art_node *n, art_node **ref, unsigned char c, void *child) {
     switch (n->type) {
         case NODE4:
-            return add_child4((art_node4*)n, ref, c, child);
+            return add_child4(t, (art_node4*)n, ref, c, child);
         case NODE16:
-            return add_child16((art_node16*)n, ref, c, child);
+            return add_child16(t, (art_node16*)n, ref, c, child);
         case NODE48:
-            return add_child48((art_node48*)n, ref, c, child);
+            return add_child48(t, (art_node48*)n, ref, c, child);
         case NODE256:
-            return add_child256((art_node256*)n, ref, c, child);
+            return add_child256(t, (art_node256*)n, ref, c, child);
         default:
             abort();
     }
@@ -607,10 +691,10 @@ static int prefix_mismatch(const art_node *n, const unsigned char *key, int key_
     return idx;
 }
 
-static void* recursive_insert(art_node *n, art_node **ref, const unsigned char *key, uint32_t key_len, art_document *document, uint32_t num_hits, int depth, int *old) {
+static void* recursive_insert(art_tree *t, art_node *n, art_node **ref, const unsigned char *key, uint32_t key_len, art_document *document, uint32_t num_hits, int depth, int *old) {
     // If we are at a NULL node, inject a leaf
     if (!n) {
-        *ref = (art_node*)SET_LEAF(make_leaf(key, key_len, document));
+        *ref = (art_node*)SET_LEAF(make_leaf(t, key, key_len, document));
         return NULL;
     }
 
@@ -632,10 +716,10 @@ static void* recursive_insert(art_node *n, art_node **ref, const unsigned char *
         }
 
         // New value, we must split the leaf into a node4
-        art_node4 *new_n = (art_node4*)alloc_node(NODE4);
+        art_node4 *new_n = (art_node4*)alloc_node(t, NODE4);
 
         // Create a new leaf
-        art_leaf *l2 = make_leaf(key, key_len, document);
+        art_leaf *l2 = make_leaf(t, key, key_len, document);
 
         uint32_t longest_prefix = longest_common_prefix(l, l2, depth);
         new_n->n.partial_len = longest_prefix;
@@ -643,8 +727,8 @@ static void* recursive_insert(art_node *n, art_node **ref, const unsigned char *
 
         // Add the leafs to the new node4
         *ref = (art_node*)new_n;
-        add_child4(new_n, ref, l->key[depth+longest_prefix], SET_LEAF(l));
-        add_child4(new_n, ref, l2->key[depth+longest_prefix], SET_LEAF(l2));
+        add_child4(t, new_n, ref, l->key[depth+longest_prefix], SET_LEAF(l));
+        add_child4(t, new_n, ref, l2->key[depth+longest_prefix], SET_LEAF(l2));
         return NULL;
     }
 
@@ -661,28 +745,28 @@ static void* recursive_insert(art_node *n, art_node **ref, const unsigned char *
         }
 
         // Create a new node
-        art_node4 *new_n = (art_node4*)alloc_node(NODE4);
+        art_node4 *new_n = (art_node4*)alloc_node(t, NODE4);
         *ref = (art_node*)new_n;
         new_n->n.partial_len = prefix_diff;
         memcpy(new_n->n.partial, n->partial, min(MAX_PREFIX_LEN, prefix_diff));
 
         // Adjust the prefix of the old node
         if (n->partial_len <= MAX_PREFIX_LEN) {
-            add_child4(new_n, ref, n->partial[prefix_diff], n);
+            add_child4(t, new_n, ref, n->partial[prefix_diff], n);
             n->partial_len -= (prefix_diff+1);
             memmove(n->partial, n->partial+prefix_diff+1,
                     min(MAX_PREFIX_LEN, n->partial_len));
         } else {
             n->partial_len -= (prefix_diff+1);
             art_leaf *l = minimum(n);
-            add_child4(new_n, ref, l->key[depth+prefix_diff], n);
+            add_child4(t, new_n, ref, l->key[depth+prefix_diff], n);
             memcpy(n->partial, l->key+depth+prefix_diff+1,
                    min(MAX_PREFIX_LEN, n->partial_len));
         }
 
         // Insert the new leaf
-        art_leaf *l = make_leaf(key, key_len, document);
-        add_child4(new_n, ref, key[depth+prefix_diff], SET_LEAF(l));
+        art_leaf *l = make_leaf(t, key, key_len, document);
+        add_child4(t, new_n, ref, key[depth+prefix_diff], SET_LEAF(l));
         return NULL;
     }
 
@@ -691,15 +775,111 @@ static void* recursive_insert(art_node *n, art_node **ref, const unsigned char *
     // Find a child to recurse to
     art_node **child = find_child(n, key[depth]);
     if (child) {
-        return recursive_insert(*child, child, key, key_len, document, num_hits, depth + 1, old);
+        return recursive_insert(t, *child, child, key, key_len, document, num_hits, depth + 1, old);
     }
 
     // No child, node goes within us
-    art_leaf *l = make_leaf(key, key_len, document);
-    add_child(n, ref, key[depth], SET_LEAF(l));
+    art_leaf *l = make_leaf(t, key, key_len, document);
+    add_child(t, n, ref, key[depth], SET_LEAF(l));
     return NULL;
 }
 
+// the rank value that topk ordering uses for a leaf, for a given token ordering
+static int64_t completion_rank_value(const art_leaf *l, const token_ordering token_order) {
+    return (token_order == FREQUENCY) ? (int64_t) l->values->ids.getLength() : (int64_t) l->max_score;
+}
+
+void art_completion_clear(art_tree *t) {
+    art_completion_cache *cache = t->completion;
+    std::lock_guard<std::mutex> lock(cache->lock);
+    cache->entries.clear();
+}
+
+static bool art_completion_get(const art_tree *t, const unsigned char *term, const int term_len,
+                               const int max_words, const token_ordering token_order,
+                               std::vector<art_leaf *> &results) {
+    art_completion_cache *cache = t->completion;
+    std::lock_guard<std::mutex> lock(cache->lock);
+
+    const auto it = cache->entries.find(std::string((const char *) term, term_len));
+    if(it == cache->entries.end() || it->second.max_words != (uint32_t) max_words ||
+       it->second.token_order != token_order) {
+        return false;
+    }
+
+    art_completion_entry & entry = it->second;
+
+    // cached leaves only ever improve with inserts, so re-rank before serving
+    if(token_order == FREQUENCY) {
+        std::sort(entry.leaves.begin(), entry.leaves.end(), compare_art_leaf_frequency);
+    } else {
+        std::sort(entry.leaves.begin(), entry.leaves.end(), compare_art_leaf_score);
+    }
+
+    results.insert(results.end(), entry.leaves.begin(), entry.leaves.end());
+    return true;
+}
+
+static void art_completion_put(art_tree *t, const unsigned char *term, const int term_len,
+                               const int max_words, const token_ordering token_order,
+                               const std::vector<art_leaf *> &results) {
+    art_completion_cache *cache = t->completion;
+    std::lock_guard<std::mutex> lock(cache->lock);
+
+    if(cache->entries.size() >= ART_COMPLETION_CACHE_ENTRIES) {
+        cache->entries.clear();
+    }
+
+    art_completion_entry entry;
+    entry.leaves = results;
+    entry.max_words = (uint32_t) max_words;
+    entry.token_order = token_order;
+    entry.floor_value = (results.size() >= (size_t) max_words) ?
+                        completion_rank_value(results.back(), token_order) : -1;
+
+    cache->entries[std::string((const char *) term, term_len)] = entry;
+}
+
+// Drops the cached completions of every prefix of `key` that the freshly inserted or
+// updated leaf could now rank into. Called on each insert, so the empty-cache exit
+// must stay first - bulk indexing takes it almost every time.
+static void art_completion_invalidate(art_tree *t, const unsigned char *key, int key_len) {
+    art_completion_cache *cache = t->completion;
+    std::lock_guard<std::mutex> lock(cache->lock);
+
+    if(cache->entries.empty()) {
+        return;
+    }
+
+    const art_leaf *l = (const art_leaf *) art_search(t, key, key_len);
+    if(l == NULL) {
+        return;
+    }
+
+    // walk the prefixes of the inserted key (the trailing null is never part of a prefix)
+    std::string prefix;
+    prefix.reserve(key_len);
+
+    for(int i = 0; i < key_len - 1; i++) {
+        prefix += (char) key[i];
+        const auto it = cache->entries.find(prefix);
+        if(it == cache->entries.end()) {
+            continue;
+        }
+
+        art_completion_entry & entry = it->second;
+
+        // a leaf that is already cached keeps its slot - it is re-ranked when served
+        if(std::find(entry.leaves.begin(), entry.leaves.end(), l) != entry.leaves.end()) {
+            continue;
+        }
+
+        if(entry.floor_value < 0 || completion_rank_value(l, entry.token_order) >= entry.floor_value) {
+            cache->entries.erase(it);
+        }
+    }
+}
+
 /**
  * Inserts a new value into the ART tree
  * @arg t The tree
@@ -712,19 +892,21 @@ static void* recursive_insert(art_node *n, art_node **ref, const unsigned char *
 void* art_insert(art_tree *t, const unsigned char *key, int key_len, art_document* document, uint32_t num_hits) {
     int old_val = 0;
 
-    void *old = recursive_insert(t->root, &t->root, key, key_len, document, num_hits, 0, &old_val);
+    void *old = recursive_insert(t, t->root, &t->root, key, key_len, document, num_hits, 0, &old_val);
     if (!old_val) t->size++;
+
+    art_completion_invalidate(t, key, key_len);
     return old;
 }
 
-static void remove_child256(art_node256 *n, art_node **ref, unsigned char c) {
+static void remove_child256(art_tree *t, art_node256 *n, art_node **ref, unsigned char c) {
     n->children[c] = NULL;
     n->n.num_children--;
 
     // Resize to a node48 on underflow, not immediately to prevent
     // trashing if we sit on the 48/49 boundary
     if (n->n.num_children == 37) {
-        art_node48 *new_n = (art_node48*)alloc_node(NODE48);
+        art_node48 *new_n = (art_node48*)alloc_node(t, NODE48);
         *ref = (art_node*)new_n;
         copy_header((art_node*)new_n, (art_node*)n);
 
@@ -736,18 +918,18 @@ static void remove_child256(art_node256 *n, art_node **ref, unsigned char c) {
                 pos++;
             }
         }
-        free(n);
+        free_node(t, (art_node*)n);
     }
 }
 
-static void remove_child48(art_node48 *n, art_node **ref, unsigned char c) {
+static void remove_child48(art_tree *t, art_node48 *n, art_node **ref, unsigned char c) {
     int pos = n->keys[c];
     n->keys[c] = 0;
     n->children[pos-1] = NULL;
     n->n.num_children--;
 
     if (n->n.num_children == 12) {
-        art_node16 *new_n = (art_node16*)alloc_node(NODE16);
+        art_node16 *new_n = (art_node16*)alloc_node(t, NODE16);
         *ref = (art_node*)new_n;
         copy_header((art_node*)new_n, (art_node*)n);
 
@@ -760,27 +942,27 @@ static void remove_child48(art_node48 *n, art_node **ref, unsigned char c) {
                 child++;
             }
         }
-        free(n);
+        free_node(t, (art_node*)n);
     }
 }
 
-static void remove_child16(art_node16 *n, art_node **ref, art_node **l) {
+static void remove_child16(art_tree *t, art_node16 *n, art_node **ref, art_node **l) {
     int pos = l - n->children;
     memmove(n->keys+pos, n->keys+pos+1, n->n.num_children - 1 - pos);
     memmove(n->children+pos, n->children+pos+1, (n->n.num_children - 1 - pos)*sizeof(void*));
     n->n.num_children--;
 
     if (n->n.num_children == 3) {
-        art_node4 *new_n = (art_node4*)alloc_node(NODE4);
+        art_node4 *new_n = (art_node4*)alloc_node(t, NODE4);
         *ref = (art_node*)new_n;
         copy_header((art_node*)new_n, (art_node*)n);
         memcpy(new_n->keys, n->keys, 4);
         memcpy(new_n->children, n->children, 4*sizeof(void*));
-        free(n);
+        free_node(t, (art_node*)n);
     }
 }
 
-static void remove_child4(art_node4 *n, art_node **ref, art_node **l) {
+static void remove_child4(art_tree *t, art_node4 *n, art_node **ref, art_node **l) {
     int pos = l - n->children;
     memmove(n->keys+pos, n->keys+pos+1, n->n.num_children - 1 - pos);
     memmove(n->children+pos, n->children+pos+1, (n->n.num_children - 1 - pos)*sizeof(void*));
@@ -807,26 +989,26 @@ static void remove_child4(art_node4 *n, art_node **ref, art_node **l) {
             child->partial_len += n->n.partial_len + 1;
         }
         *ref = child;
-        free(n);
+        free_node(t, (art_node*)n);
     }
 }
 
-static void remove_child(art_node *n, art_node **ref, unsigned char c, art_node **l) {
+static void remove_child(art_tree *t, art_node *n, art_node **ref, unsigned char c, art_node **l) {
     switch (n->type) {
         case NODE4:
-            return remove_child4((art_node4*)n, ref, l);
+            return remove_child4(t, (art_node4*)n, ref, l);
         case NODE16:
-            return remove_child16((art_node16*)n, ref, l);
+            return remove_child16(t, (art_node16*)n, ref, l);
         case NODE48:
-            return remove_child48((art_node48*)n, ref, c);
+            return remove_child48(t, (art_node48*)n, ref, c);
         case NODE256:
-            return remove_child256((art_node256*)n, ref, c);
+            return remove_child256(t, (art_node256*)n, ref, c);
         default:
             abort();
     }
 }
 
-static art_leaf* recursive_delete(art_node *n, art_node **ref, const unsigned char *key, int key_len, int depth) {
+static art_leaf* recursive_delete(art_tree *t, art_node *n, art_node **ref, const unsigned char *key, int key_len, int depth) {
     // Search terminated
     if (!n) return NULL;
 
@@ -862,14 +1044,14 @@ static art_leaf* recursive_delete(art_node *n, art_node **ref, const unsigned ch
     if (IS_LEAF(*child)) {
         art_leaf *l = (art_leaf *) LEAF_RAW(*child);
         if (!leaf_matches(l, key, key_len, depth)) {
-            remove_child(n, ref, key[depth], child);
+            remove_child(t, n, ref, key[depth], child);
             return l;
         }
         return NULL;
 
         // Recurse
     } else {
-        return recursive_delete(*child, child, key, key_len, depth+1);
+        return recursive_delete(t, *child, child, key, key_len, depth+1);
     }
 }
 
@@ -882,11 +1064,14 @@ static art_leaf* recursive_delete(art_node *n, art_node **ref, const unsigned ch
  * the value pointer is returned.
  */
 void* art_delete(art_tree *t, const unsigned char *key, int key_len) {
-    art_leaf *l = recursive_delete(t->root, &t->root, key, key_len, 0);
+    art_leaf *l = recursive_delete(t, t->root, &t->root, key, key_len, 0);
     if (l) {
+        // cached completions may reference the freed leaf
+        art_completion_clear(t);
+
         t->size--;
         void *old = l->values;
-        free(l);
+        free_leaf(t, l);
         return old;
     }
     return NULL;
@@ -1042,6 +1227,31 @@ int art_iter(art_tree *t, art_callback cb, void *data) {
     return recursive_iter(t->root, cb, data);
 }
 
+static int leaf_memory_usage(void *data, const unsigned char *key, uint32_t key_len, void *value) {
+    art_values *values = (art_values *) value;
+    uint64_t *total = (uint64_t *) data;
+    *total += sizeof(art_values) + values->ids.memory_usage() +
+              values->offset_index.getSizeInBytes() + values->offsets.getSizeInBytes();
+    return 0;
+}
+
+/**
+ * Bytes of memory held by the tree: the arena blocks carrying the nodes
+ * and leaves, plus the posting data hanging off each leaf.
+ */
+uint64_t art_memory_usage(art_tree *t) {
+    uint64_t total = 0;
+
+    art_block *block = t->arena.head;
+    while (block) {
+        total += sizeof(art_block) + block->size;
+        block = block->next;
+    }
+
+    art_iter(t, leaf_memory_usage, &total);
+    return total;
+}
+
 /**
  * Checks if a leaf prefix matches
  * @return 0 on success.
@@ -1128,6 +1338,7 @@ int art_iter_prefix(art_tree *t, const unsigned char *key, int key_len, art_call
         // Recursively search
         child = find_child(n, key[depth]);
         n = (child) ? *child : NULL;
+        if (n) prefetch_node(n);
         depth++;
     }
     return 0;
@@ -1148,15 +1359,47 @@ static inline void copyIntArray2(const int *src, int *dest, const int len) {
 }
 
 static inline int levenshtein_dist(const int depth, const char p, const char c, const unsigned char* term, const int term_len,
-                                   const int* irow, const int* jrow, int* krow) {
-    int row_min = std::numeric_limits<int>::max();
-    const int columns = term_len+1;
-    krow[0] = jrow[0] + 1;
-
+                                   const int* irow, const int* jrow, int* krow, const int max_cost) {
     // Calculate levenshtein distance incrementally (j => column, b => term):
     // https://en.wikipedia.org/wiki/Damerau%E2%80%93Levenshtein_distance#Optimal_string_alignment_distance
 
-    for(int column=1; column<columns; column++) {
+    // Only a band of cells around the diagonal is computed: a cell more than `band` columns off the
+    // diagonal is at least `band+1` edits away, which the callers can never accept (they abandon a
+    // path once the running cost exceeds 2*max_cost). Cells just outside the band are clamped to
+    // INF so that later rows and the final-column checks read a safely large value. This turns the
+    // per-node row cost from O(term_len) into O(max_cost) without changing any result.
+    // `jrow[0]` carries the exact number of characters consumed so far (D[i][0] == i),
+    // which stays correct even across compressed paths where `depth` advances differently
+    const int row_num = jrow[0] + 1;
+    const int band = 2 * max_cost;
+    const int INF = band + 1;
+
+    int lo = row_num - band;
+    if(lo < 1) {
+        lo = 1;
+    }
+
+    int hi = row_num + band;
+    if(hi > term_len) {
+        hi = term_len;
+    }
+
+    krow[0] = row_num;
+
+    if(lo > term_len) {
+        // the whole row is off the band - mark the final column so that stale
+        // values can never be mistaken for a match
+        krow[term_len] = INF;
+        return INF;
+    }
+
+    if(lo > 1) {
+        krow[lo - 1] = INF;
+    }
+
+    int row_min = std::numeric_limits<int>::max();
+
+    for(int column=lo; column<=hi; column++) {
         int delete_cost = jrow[column] + 1;
         int insert_cost = krow[column - 1] + 1;
 
@@ -1174,6 +1417,10 @@ static inline int levenshtein_dist(const int depth, const char p, const char c,
         }
     }
 
+    if(hi < term_len) {
+        krow[hi + 1] = INF;
+    }
+
     return row_min;
 }
 
@@ -1190,6 +1437,9 @@ static inline void art_fuzzy_children(char p, const art_node *n, int depth, cons
                 child_char = ((art_node4*)n)->keys[i];
                 printf("4!child_char: %c, %d, depth: %d\n", child_char, child_char, depth);
                 child = ((art_node4*)n)->children[i];
+                // the recursion computes a full levenshtein row before touching the child,
+                // which gives the prefetch time to pull the node in
+                prefetch_node(child);
                 art_fuzzy_recurse(p, child_char, child, depth, term, term_len, irow, jrow, min_cost, max_cost, prefix, results);
             }
             break;
@@ -1199,18 +1449,30 @@ static inline void art_fuzzy_children(char p, const art_node *n, int depth, cons
                 child_char = ((art_node16*)n)->keys[i];
                 printf("16!child_char: %c, depth: %d\n", child_char, depth);
                 child = ((art_node16*)n)->children[i];
+                prefetch_node(child);
                 art_fuzzy_recurse(p, child_char, child, depth, term, term_len, irow, jrow, min_cost, max_cost, prefix, results);
             }
             break;
         case NODE48:
             printf("\nNODE48\n");
-            for (int i=255; i >= 0; i--) {
-                int ix = ((art_node48*)n)->keys[i];
-                if (!ix) continue;
-                child = ((art_node48*)n)->children[ix - 1];
-                child_char = (char)i;
-                printf("48!child_char: %c, depth: %d, ix: %d\n", child_char, depth, ix);
-                art_fuzzy_recurse(p, child_char, child, depth, term, term_len, irow, jrow, min_cost, max_cost, prefix, results);
+            // The 256-entry indirection array is mostly empty, so it is scanned 16 bytes at a
+            // time: one movemask test skips a whole empty chunk. Bits are consumed from the
+            // highest down to preserve the descending iteration order.
+            for (int chunk = 15; chunk >= 0; chunk--) {
+                __m128i vec = _mm_loadu_si128((__m128i*)(((art_node48*)n)->keys + (chunk * 16)));
+                int occupied = (~_mm_movemask_epi8(_mm_cmpeq_epi8(vec, _mm_setzero_si128()))) & 0xFFFF;
+
+                while (occupied) {
+                    int bit = 31 - __builtin_clz(occupied);
+                    int i = (chunk * 16) + bit;
+                    int ix = ((art_node48*)n)->keys[i];
+                    child = ((art_node48*)n)->children[ix - 1];
+                    child_char = (char)i;
+                    printf("48!child_char: %c, depth: %d, ix: %d\n", child_char, depth, ix);
+                    prefetch_node(child);
+                    art_fuzzy_recurse(p, child_char, child, depth, term, term_len, irow, jrow, min_cost, max_cost, prefix, results);
+                    occupied &= ~(1 << bit);
+                }
             }
             break;
         case NODE256:
@@ -1220,6 +1482,7 @@ static inline void art_fuzzy_children(char p, const art_node *n, int depth, cons
                 child_char = (char) i;
                 printf("256!child_char: %c, depth: %d\n", child_char, depth);
                 child = ((art_node256*)n)->children[i];
+                prefetch_node(child);
                 art_fuzzy_recurse(p, child_char, child, depth, term, term_len, irow, jrow, min_cost, max_cost, prefix, results);
             }
             break;
@@ -1250,7 +1513,7 @@ static void art_fuzzy_recurse(char p, char c, const art_node *n, int depth, cons
     copyIntArray2(irow, rows[i], columns);
     copyIntArray2(jrow, rows[j], columns);
 
-    int cost = levenshtein_dist(depth, p, c, term, term_len, rows[i], rows[j], rows[k]);
+    int cost = levenshtein_dist(depth, p, c, term, term_len, rows[i], rows[j], rows[k], max_cost);
     rotate(i, j, k);
     p = c;
 
@@ -1281,7 +1544,7 @@ static void art_fuzzy_recurse(char p, char c, const art_node *n, int depth, cons
         // If at any point, `cost > 2*max_cost` we can terminate immediately as we can never recover from that
         while(depth < end_index && cost <= 2*max_cost) {
             c = l->key[depth];
-            cost = levenshtein_dist(depth, p, c, term, term_len, rows[i], rows[j], rows[k]);
+            cost = levenshtein_dist(depth, p, c, term, term_len, rows[i], rows[j], rows[k], max_cost);
             printf("leaf char: %c\n", l->key[depth]);
             printf("cost: %d, depth: %d, term_len: %d\n", cost, depth, term_len);
             rotate(i, j, k);
@@ -1289,15 +1552,19 @@ static void art_fuzzy_recurse(char p, char c, const art_node *n, int depth, cons
             depth++;
         }
 
-        // rows[j][columns-1] holds the final cost
-        if(rows[j][columns-1] >= min_cost && rows[j][columns-1] <= max_cost) {
+        // rows[j][columns-1] holds the final cost. When the leaf is shorter than the term by more
+        // than the band, the final column was never computed - but such a key is too many edits
+        // away to ever match, so it can be rejected without looking.
+        if(term_len <= rows[j][0] + 2*max_cost &&
+           rows[j][columns-1] >= min_cost && rows[j][columns-1] <= max_cost) {
             results.push_back(n);
         }
 
         return ;
     }
 
-    if(prefix && depth >= term_len && rows[j][columns-1] <= max_cost) {
+    if(prefix && depth >= term_len && term_len <= rows[j][0] + 2*max_cost &&
+       rows[j][columns-1] <= max_cost) {
         // For a prefix search, we store the node and not recurse further right now
         results.push_back(n);
         return ;
@@ -1311,12 +1578,12 @@ static void art_fuzzy_recurse(char p, char c, const art_node *n, int depth, cons
     for(int idx=0; idx<end_index; idx++) {
         c = n->partial[idx];
         printf("partial: %c\n", c);
-        rows[k][0] = rows[j][0] + 1;
-        cost = levenshtein_dist(depth, p, c, term, term_len, rows[i], rows[j], rows[k]);
+        cost = levenshtein_dist(depth, p, c, term, term_len, rows[i], rows[j], rows[k], max_cost);
         rotate(i, j, k);
         p = c;
         
-        if(prefix && depth+idx+1 >= term_len && rows[j][columns-1] <= max_cost) {
+        if(prefix && depth+idx+1 >= term_len && term_len <= rows[j][0] + 2*max_cost &&
+           rows[j][columns-1] <= max_cost) {
             // For a prefix search, we store the node and not recurse further right now
             results.push_back(n);
             return ;
@@ -1336,6 +1603,14 @@ int art_fuzzy_search(art_tree *t, const unsigned char *term, const int term_len,
                      const int max_words, const token_ordering token_order, const bool prefix,
                      std::vector<art_leaf *> &results) {
 
+    // hot search-as-you-type path: an exact prefix with no typo budget can be served
+    // straight from the completion cache, skipping fuzzy descent and topk traversal
+    const bool cacheable = prefix && min_cost == 0 && max_cost == 0 && results.empty();
+
+    if(cacheable && art_completion_get(t, term, term_len, max_words, token_order, results)) {
+        return 0;
+    }
+
     std::vector<const art_node*> nodes;
     int irow[term_len + 1];
     int jrow[term_len + 1];
@@ -1379,6 +1654,11 @@ int art_fuzzy_search(art_tree *t, const unsigned char *term, const int term_len,
 
     time_micro = microseconds(std::chrono::high_resolution_clock::now() - begin).count();
     //!LOG(INFO) << "Time taken for art_topk_iter: " << time_micro << "us";
+
+    if(cacheable) {
+        art_completion_put(t, term, term_len, max_words, token_order, results);
+    }
+
     return 0;
 }
 
@@ -1635,4 +1915,155 @@ int art_float_search(art_tree *t, float value, NUM_COMPARATOR comparator, std::v
     encode_float(value, chars);
     art_int_fuzzy_recurse(t->root, 0, chars, 8, comparator, results);
     return 0;
-}
\ No newline at end of file
+}
+
+// Writes the compressed representation of an array along with its metadata
+static bool serialize_array_blob(array_base *arr, FILE *fp) {
+    uint32_t arr_meta[4] = {arr->getLength(), arr->getMin(), arr->getMax(), arr->getLengthInBytes()};
+    if(fwrite(arr_meta, sizeof(uint32_t), 4, fp) != 4) return false;
+    if(arr_meta[3] != 0 && fwrite(arr->get_raw(), sizeof(uint8_t), arr_meta[3], fp) != arr_meta[3]) return false;
+    return true;
+}
+
+static bool deserialize_array_blob(array_base *arr, FILE *fp) {
+    uint32_t arr_meta[4];
+    if(fread(arr_meta, sizeof(uint32_t), 4, fp) != 4) return false;
+
+    uint8_t *blob = (uint8_t *) malloc(arr_meta[3]);
+    if(arr_meta[3] != 0 && fread(blob, sizeof(uint8_t), arr_meta[3], fp) != arr_meta[3]) {
+        free(blob);
+        return false;
+    }
+
+    arr->load_raw(blob, arr_meta[3], arr_meta[0], arr_meta[1], arr_meta[2]);
+    free(blob);
+    return true;
+}
+
+static bool serialize_leaf(art_leaf *l, FILE *fp) {
+    if(fwrite(&l->key_len, sizeof(uint32_t), 1, fp) != 1) return false;
+    if(fwrite(l->key, sizeof(unsigned char), l->key_len, fp) != l->key_len) return false;
+    if(fwrite(&l->max_score, sizeof(int32_t), 1, fp) != 1) return false;
+
+    return l->values->ids.serialize(fp) &&
+           serialize_array_blob(&l->values->offset_index, fp) &&
+           serialize_array_blob(&l->values->offsets, fp);
+}
+
+// Recursively serializes all the leaves under a given node
+static bool recursive_serialize(art_node *n, FILE *fp) {
+    if (!n) return true;
+    if (IS_LEAF(n)) {
+        return serialize_leaf((art_leaf *) LEAF_RAW(n), fp);
+    }
+
+    int idx;
+    switch (n->type) {
+        case NODE4:
+            for (int i=0; i < n->num_children; i++) {
+                if(!recursive_serialize(((art_node4*)n)->children[i], fp)) return false;
+            }
+            break;
+        case NODE16:
+            for (int i=0; i < n->num_children; i++) {
+                if(!recursive_serialize(((art_node16*)n)->children[i], fp)) return false;
+            }
+            break;
+        case NODE48:
+            for (int i=0; i < 256; i++) {
+                idx = ((art_node48*)n)->keys[i];
+                if (!idx) continue;
+                if(!recursive_serialize(((art_node48*)n)->children[idx-1], fp)) return false;
+            }
+            break;
+        case NODE256:
+            for (int i=0; i < 256; i++) {
+                if (!((art_node256*)n)->children[i]) continue;
+                if(!recursive_serialize(((art_node256*)n)->children[i], fp)) return false;
+            }
+            break;
+        default:
+            abort();
+    }
+
+    return true;
+}
+
+bool art_tree_serialize(art_tree *t, FILE *fp) {
+    if(fwrite(&t->size, sizeof(uint64_t), 1, fp) != 1) return false;
+    return recursive_serialize(t->root, fp);
+}
+
+// Applies score / token count maxima to the internal nodes along the path of a key. Needed after
+// restoring a leaf's posting data, since its real posting size is known only after the swap.
+static void update_path_maxima(art_node *n, const unsigned char *key, int key_len, int32_t score, uint32_t num_hits) {
+    int depth = 0;
+    while (n && !IS_LEAF(n)) {
+        n->max_score = MAX(n->max_score, score);
+        n->max_token_count = MAX(n->max_token_count, num_hits);
+
+        if (n->partial_len) {
+            int prefix_len = check_prefix(n, key, key_len, depth);
+            if (prefix_len != min(MAX_PREFIX_LEN, n->partial_len)) return;
+            depth = depth + n->partial_len;
+            if (depth >= key_len) return;
+        }
+
+        art_node **child = find_child(n, key[depth]);
+        n = (child) ? *child : NULL;
+        depth++;
+    }
+}
+
+bool art_tree_deserialize(art_tree *t, FILE *fp) {
+    uint64_t num_leaves;
+    if(fread(&num_leaves, sizeof(uint64_t), 1, fp) != 1) return false;
+
+    for(uint64_t i = 0; i < num_leaves; i++) {
+        uint32_t key_len;
+        if(fread(&key_len, sizeof(uint32_t), 1, fp) != 1) return false;
+
+        unsigned char *key = (unsigned char *) malloc(key_len);
+        if(fread(key, sizeof(unsigned char), key_len, fp) != key_len) {
+            free(key);
+            return false;
+        }
+
+        int32_t max_score;
+        if(fread(&max_score, sizeof(int32_t), 1, fp) != 1) {
+            free(key);
+            return false;
+        }
+
+        art_values *values = new art_values;
+        if(!values->ids.deserialize(fp) ||
+           !deserialize_array_blob(&values->offset_index, fp) ||
+           !deserialize_array_blob(&values->offsets, fp)) {
+            delete values;
+            free(key);
+            return false;
+        }
+
+        // insert a placeholder document to create the leaf with proper max_score / max_token_count
+        // propagation in the internal nodes, then swap in the restored posting data
+        art_document dummy_doc = {max_score, 0, 0, nullptr};
+        art_insert(t, key, key_len, &dummy_doc, values->ids.getLength());
+
+        art_leaf *l = (art_leaf *) art_search(t, key, key_len);
+
+        if(l == nullptr) {
+            free(key);
+            delete values;
+            return false;
+        }
+
+        delete l->values;
+        l->values = values;
+        l->max_score = max_score;
+
+        update_path_maxima(t->root, key, key_len, max_score, values->ids.getLength());
+        free(key);
+    }
+
+    return true;
+}
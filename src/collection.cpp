@@ -1,6 +1,7 @@
 #include "collection.h"
 
 #include <numeric>
+#include <algorithm>
 #include <chrono>
 #include <array_utils.h>
 #include <match_score.h>
@@ -13,7 +14,7 @@
 
 Collection::Collection(const std::string name, const uint32_t collection_id, const uint32_t next_seq_id, Store *store,
                        const std::vector<field> &fields, const std::string & default_sorting_field,
-                       const size_t num_indices):
+                       const size_t num_indices, const size_t num_search_workers):
                        name(name), collection_id(collection_id), next_seq_id(next_seq_id), store(store),
                        fields(fields), default_sorting_field(default_sorting_field), num_indices(num_indices) {
 
@@ -31,33 +32,133 @@ Collection::Collection(const std::string name, const uint32_t collection_id, con
     }
 
     for(size_t i = 0; i < num_indices; i++) {
-        Index* index = new Index(name+std::to_string(i), search_schema, facet_schema, sort_schema);
+        Index* index = new Index(name+std::to_string(i), search_schema, facet_schema, sort_schema,
+                                 store->get_state_dir_path() + "/offsets_" + name + std::to_string(i));
         indices.push_back(index);
-        std::thread* thread = new std::thread(&Index::run_search, index);
-        index_threads.push_back(thread);
     }
 
+    search_queue = new SearchQueue(SEARCH_QUEUE_CAPACITY);
+
+    for(size_t i = 0; i < num_search_workers; i++) {
+        std::thread* thread = new std::thread(&Collection::run_search_worker, this);
+        search_workers.push_back(thread);
+    }
+
+    quit_compaction = false;
+    compaction_thread = new std::thread(&Collection::run_compaction_worker, this);
+
     num_documents = 0;
+    write_generation = 0;
+
+    num_layout_users = 0;
+    layout_change_active = false;
+    reshard_num_indices = 0;
+    reshard_watermark = 0;
+    reshard_running = false;
 }
 
 Collection::~Collection() {
-    for(size_t i = 0; i < indices.size(); i++) {
-        std::thread *t = index_threads[i];
-        Index* index = indices[i];
-        index->ready = true;
-        index->terminate = true;
-        index->cv.notify_one();
+    search_queue->shutdown();
+
+    for(std::thread* t: search_workers) {
         t->join();
         delete t;
+    }
+
+    delete search_queue;
+
+    {
+        std::unique_lock<std::mutex> lock(compaction_m);
+        quit_compaction = true;
+    }
+
+    compaction_cv.notify_one();
+    compaction_thread->join();
+    delete compaction_thread;
+
+    for(size_t i = 0; i < indices.size(); i++) {
         delete indices[i];
     }
 }
 
+void Collection::run_search_worker() {
+    search_task task;
+
+    while(search_queue->remove(task)) {
+        search_args* params = task.params;
+        task.index->search(params->outcome, params->query, params->search_fields, params->filters, params->facets,
+                           params->sort_fields_std, params->num_typos, params->per_page, params->page,
+                           params->token_order, params->prefix, params->exhaustive_search, params->max_candidates,
+                           params->cursor, params->field_order_kvs, params->all_result_ids_len,
+                           params->searched_queries, params->timings);
+        task.latch->done();
+    }
+}
+
+void Collection::run_compaction_worker() {
+    while(true) {
+        Index* index = nullptr;
+
+        {
+            std::unique_lock<std::mutex> lock(compaction_m);
+            compaction_cv.wait(lock, [this]{ return quit_compaction || !compaction_candidates.empty(); });
+
+            if(quit_compaction) {
+                return;
+            }
+
+            index = compaction_candidates.back();
+            compaction_candidates.pop_back();
+        }
+
+        // the shard must not be swapped out from under the compaction pass: the guard blocks
+        // a reshard swap, and a shard already replaced by a finished reshard is skipped
+        layout_guard guard(this);
+        if(std::find(indices.begin(), indices.end(), index) != indices.end()) {
+            index->compact();
+        }
+    }
+}
+
+void Collection::layout_lock() {
+    std::unique_lock<std::mutex> lk(layout_m);
+    layout_cv.wait(lk, [this]{return !layout_change_active;});
+    num_layout_users++;
+}
+
+void Collection::layout_unlock() {
+    {
+        std::lock_guard<std::mutex> lk(layout_m);
+        num_layout_users--;
+    }
+
+    layout_cv.notify_all();
+}
+
+void Collection::layout_exclusive_lock() {
+    std::unique_lock<std::mutex> lk(layout_m);
+    layout_cv.wait(lk, [this]{return !layout_change_active && num_layout_users == 0;});
+    layout_change_active = true;
+}
+
+void Collection::layout_exclusive_unlock() {
+    {
+        std::lock_guard<std::mutex> lk(layout_m);
+        layout_change_active = false;
+    }
+
+    layout_cv.notify_all();
+}
+
 uint32_t Collection::get_next_seq_id() {
     store->increment(get_next_seq_id_key(name), 1);
     return next_seq_id++;
 }
 
+uint64_t Collection::get_write_generation() {
+    return write_generation;
+}
+
 void Collection::set_next_seq_id(uint32_t seq_id) {
     next_seq_id = seq_id;
 }
@@ -67,6 +168,8 @@ void Collection::increment_next_seq_id_field() {
 }
 
 Option<nlohmann::json> Collection::add(const std::string & json_str) {
+    layout_guard guard(this);
+
     nlohmann::json document;
     try {
         document = nlohmann::json::parse(json_str);
@@ -75,7 +178,10 @@ Option<nlohmann::json> Collection::add(const std::string & json_str) {
         return Option<nlohmann::json>(400, "Bad JSON.");
     }
 
-    uint32_t seq_id = get_next_seq_id();
+    // the on-disk counter is bumped via a Merge folded into the write batch below,
+    // so that the whole add costs a single WAL write
+    uint32_t seq_id = next_seq_id;
+    increment_next_seq_id_field();
     std::string seq_id_str = std::to_string(seq_id);
 
     if(document.count("id") == 0) {
@@ -85,10 +191,9 @@ Option<nlohmann::json> Collection::add(const std::string & json_str) {
     }
 
     std::string doc_id = document["id"];
-    Option<nlohmann::json> doc_option = get(doc_id);
 
     // we need to check if document ID already exists before attempting to index
-    if(doc_option.ok()) {
+    if(doc_id_to_seq_id(doc_id).ok()) {
         return Option<nlohmann::json>(409, std::string("A document with id ") + doc_id + " already exists.");
     }
 
@@ -101,15 +206,305 @@ Option<nlohmann::json> Collection::add(const std::string & json_str) {
     rocksdb::WriteBatch batch;
     batch.Put(get_doc_id_key(document["id"]), seq_id_str);
     batch.Put(get_seq_id_key(seq_id), document.dump());
+    batch.Merge(get_next_seq_id_key(name), StringUtils::serialize_uint32_t(1));
     bool write_ok = store->batch_write(batch);
 
     if(!write_ok) {
         return Option<nlohmann::json>(500, "Could not write to on-disk storage.");
     }
 
+    {
+        std::lock_guard<std::mutex> lock(doc_id_index_m);
+        doc_id_index[doc_id] = seq_id;
+    }
+
+    write_generation++;
     return Option<nlohmann::json>(document);
 }
 
+Option<nlohmann::json> Collection::add_many(const std::string & jsonl_str) {
+    layout_guard guard(this);
+
+    std::vector<std::string> json_lines;
+    StringUtils::split(jsonl_str, json_lines, "\n");
+
+    if(json_lines.empty()) {
+        return Option<nlohmann::json>(400, "The import body is empty.");
+    }
+
+    nlohmann::json import_errors = nlohmann::json::array();
+    size_t num_imported = 0;
+
+    // Reserve the sequence ID range for the whole import with a single merge operation.
+    // Lines that fail validation waste a sequence ID, which is harmless - they only need to be unique.
+    store->increment(get_next_seq_id_key(name), json_lines.size());
+    uint32_t seq_id = next_seq_id;
+    next_seq_id += json_lines.size();
+
+    // catches duplicate IDs within the import itself and carries the seq_ids into the
+    // doc_id index once the batch has been committed
+    spp::sparse_hash_map<std::string, uint32_t> batched_doc_ids;
+
+    std::vector<index_record> index_batch;
+    rocksdb::WriteBatch write_batch;
+
+    auto record_error = [&import_errors](size_t line_index, const std::string & message) {
+        nlohmann::json err;
+        err["line"] = line_index;
+        err["error"] = message;
+        import_errors.push_back(err);
+    };
+
+    for(size_t i = 0; i < json_lines.size(); i++) {
+        // Fast path: scan the line directly into a typed flat record, skipping DOM materialization.
+        // The scanner is strict, so anything it cannot handle falls through to the DOM path below,
+        // which also produces the per-line validation errors. The flat record borrows string views
+        // from `json_lines`, which outlives every batch_index_in_memory call of this import.
+        flat_record flat;
+
+        if(flat_record_scanner::parse(json_lines[i], search_schema, default_sorting_field, flat)) {
+            const std::string doc_id = flat.has_id ? flat.id.to_string() : std::to_string(seq_id);
+
+            if(batched_doc_ids.count(doc_id) != 0 || doc_id_to_seq_id(doc_id).ok()) {
+                record_error(i, std::string("A document with id ") + doc_id + " already exists.");
+                continue;
+            }
+
+            batched_doc_ids[doc_id] = seq_id;
+            write_batch.Put(get_doc_id_key(doc_id), std::to_string(seq_id));
+
+            if(flat.has_id) {
+                write_batch.Put(get_seq_id_key(seq_id), json_lines[i]);
+            } else {
+                // splice the generated id into the raw line, right after the opening brace
+                write_batch.Put(get_seq_id_key(seq_id), "{\"id\":\"" + doc_id + "\"," +
+                                                        json_lines[i].substr(json_lines[i].find('{') + 1));
+            }
+
+            index_batch.push_back(index_record(seq_id, std::move(flat)));
+            seq_id++;
+        } else {
+            nlohmann::json document;
+
+            try {
+                document = nlohmann::json::parse(json_lines[i]);
+            } catch(const std::exception& e) {
+                record_error(i, "Bad JSON.");
+                continue;
+            }
+
+            if(document.count("id") == 0) {
+                document["id"] = std::to_string(seq_id);
+            } else if(!document["id"].is_string()) {
+                record_error(i, "Document's `id` field should be a string.");
+                continue;
+            }
+
+            const std::string doc_id = document["id"];
+
+            if(batched_doc_ids.count(doc_id) != 0 || doc_id_to_seq_id(doc_id).ok()) {
+                record_error(i, std::string("A document with id ") + doc_id + " already exists.");
+                continue;
+            }
+
+            const Option<uint32_t> & validation_op = validate_index_in_memory(document, seq_id);
+            if(!validation_op.ok()) {
+                record_error(i, validation_op.error());
+                continue;
+            }
+
+            batched_doc_ids[doc_id] = seq_id;
+            write_batch.Put(get_doc_id_key(doc_id), std::to_string(seq_id));
+            write_batch.Put(get_seq_id_key(seq_id), document.dump());
+            index_batch.push_back(index_record(seq_id, document));
+            seq_id++;
+        }
+
+        if(index_batch.size() == IMPORT_BATCH_SIZE) {
+            if(!store->batch_write(write_batch)) {
+                return Option<nlohmann::json>(500, "Could not write to on-disk storage.");
+            }
+
+            {
+                std::lock_guard<std::mutex> lock(doc_id_index_m);
+                for(const auto & id_seq_id: batched_doc_ids) {
+                    doc_id_index[id_seq_id.first] = id_seq_id.second;
+                }
+            }
+
+            num_imported += batch_index_in_memory(index_batch);
+            index_batch.clear();
+            write_batch = rocksdb::WriteBatch();
+            batched_doc_ids.clear();
+        }
+    }
+
+    if(!index_batch.empty()) {
+        if(!store->batch_write(write_batch)) {
+            return Option<nlohmann::json>(500, "Could not write to on-disk storage.");
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(doc_id_index_m);
+            for(const auto & id_seq_id: batched_doc_ids) {
+                doc_id_index[id_seq_id.first] = id_seq_id.second;
+            }
+        }
+
+        num_imported += batch_index_in_memory(index_batch);
+    }
+
+    if(num_imported != 0) {
+        write_generation++;
+    }
+
+    nlohmann::json response;
+    response["num_imported"] = num_imported;
+    response["errors"] = import_errors;
+
+    return Option<nlohmann::json>(response);
+}
+
+Option<nlohmann::json> Collection::update(const std::string & id, const std::string & json_patch_str) {
+    layout_guard guard(this);
+
+    nlohmann::json patch;
+    try {
+        patch = nlohmann::json::parse(json_patch_str);
+    } catch(const std::exception& e) {
+        LOG(ERR) << "JSON error: " << e.what();
+        return Option<nlohmann::json>(400, "Bad JSON.");
+    }
+
+    if(!patch.is_object()) {
+        return Option<nlohmann::json>(400, "The patch body must be a JSON object.");
+    }
+
+    if(patch.count("id") != 0 && patch["id"] != id) {
+        return Option<nlohmann::json>(400, "The `id` field of a document cannot be changed.");
+    }
+
+    const Option<uint32_t> & seq_id_op = doc_id_to_seq_id(id);
+
+    if(!seq_id_op.ok()) {
+        return Option<nlohmann::json>(404, "Could not find a document with id: " + id);
+    }
+
+    uint32_t seq_id = seq_id_op.get();
+
+    std::string old_json_str;
+    StoreStatus doc_status = store->get(get_seq_id_key(seq_id), old_json_str);
+
+    if(doc_status == StoreStatus::NOT_FOUND) {
+        LOG(ERR) << "Sequence ID exists, but document is missing for id: " << id;
+        return Option<nlohmann::json>(404, "Could not find a document with id: " + id);
+    }
+
+    if(doc_status == StoreStatus::ERROR) {
+        return Option<nlohmann::json>(500, "Error while fetching the document.");
+    }
+
+    nlohmann::json old_document;
+    try {
+        old_document = nlohmann::json::parse(old_json_str);
+    } catch(...) {
+        return Option<nlohmann::json>(500, "Error while parsing stored document.");
+    }
+
+    // diff the patch against the stored document: only fields whose values differ are re-indexed
+    nlohmann::json new_document = old_document;
+    std::vector<std::string> changed_fields;
+
+    for(auto patch_field = patch.begin(); patch_field != patch.end(); ++patch_field) {
+        if(patch_field.key() == "id") {
+            continue;
+        }
+
+        if(old_document.count(patch_field.key()) != 0 && old_document[patch_field.key()] == patch_field.value()) {
+            continue;
+        }
+
+        new_document[patch_field.key()] = patch_field.value();
+        changed_fields.push_back(patch_field.key());
+    }
+
+    if(changed_fields.empty()) {
+        return Option<nlohmann::json>(old_document);
+    }
+
+    const Option<uint32_t> & validation_op = validate_index_in_memory(new_document, seq_id);
+    if(!validation_op.ok()) {
+        return Option<nlohmann::json>(validation_op.code(), validation_op.error());
+    }
+
+    Index* index = indices[seq_id % num_indices];
+    const Option<uint32_t> & update_op = index->update_fields(old_document, new_document, changed_fields,
+                                                              seq_id, get_points_from_doc(new_document));
+    if(!update_op.ok()) {
+        return Option<nlohmann::json>(update_op.code(), update_op.error());
+    }
+
+    {
+        // During a reshard, the store write and the shadow-layout forward must be atomic with
+        // respect to streaming batches, so that the document lands in the shadow layout exactly
+        // once: a document below the watermark was streamed pre-update and gets the update
+        // applied here, while one above it will be streamed post-update.
+        std::lock_guard<std::mutex> lock(reshard_forward_m);
+
+        bool write_ok = store->insert(get_seq_id_key(seq_id), new_document.dump());
+
+        if(!write_ok) {
+            return Option<nlohmann::json>(500, "Could not write to on-disk storage.");
+        }
+
+        if(reshard_running && seq_id < reshard_watermark) {
+            reshard_indices[seq_id % reshard_num_indices]->update_fields(old_document, new_document,
+                                                                         changed_fields, seq_id,
+                                                                         get_points_from_doc(new_document));
+        }
+    }
+
+    write_generation++;
+    return Option<nlohmann::json>(new_document);
+}
+
+nlohmann::json Collection::get_memory_stats() {
+    nlohmann::json fields_json = nlohmann::json::object();
+    uint64_t total_bytes = 0;
+
+    for(Index* index: indices) {
+        const nlohmann::json & index_fields = index->get_memory_stats();
+
+        for(auto field_it = index_fields.begin(); field_it != index_fields.end(); ++field_it) {
+            nlohmann::json & field_stats = fields_json[field_it.key()];
+            if(field_stats.is_null()) {
+                field_stats = nlohmann::json::object();
+            }
+
+            for(auto stat_it = field_it.value().begin(); stat_it != field_it.value().end(); ++stat_it) {
+                const uint64_t existing = (field_stats.count(stat_it.key()) != 0) ?
+                                          field_stats[stat_it.key()].get<uint64_t>() : 0;
+                field_stats[stat_it.key()] = existing + stat_it.value().get<uint64_t>();
+            }
+        }
+    }
+
+    for(auto field_it = fields_json.begin(); field_it != fields_json.end(); ++field_it) {
+        uint64_t field_bytes = 0;
+        for(auto stat_it = field_it.value().begin(); stat_it != field_it.value().end(); ++stat_it) {
+            field_bytes += stat_it.value().get<uint64_t>();
+        }
+
+        field_it.value()["total_bytes"] = field_bytes;
+        total_bytes += field_bytes;
+    }
+
+    nlohmann::json memory;
+    memory["fields"] = fields_json;
+    memory["total_bytes"] = total_bytes;
+    return memory;
+}
+
 Option<uint32_t> Collection::validate_index_in_memory(const nlohmann::json &document, uint32_t seq_id) {
     if(document.count(default_sorting_field) == 0) {
         return Option<>(400, "Field `" + default_sorting_field  + "` has been declared as a default sorting field, "
@@ -232,13 +627,7 @@ Option<uint32_t> Collection::validate_index_in_memory(const nlohmann::json &docu
     return Option<>(200);
 }
 
-Option<uint32_t> Collection::index_in_memory(const nlohmann::json &document, uint32_t seq_id) {
-    Option<uint32_t> validation_op = validate_index_in_memory(document, seq_id);
-
-    if(!validation_op.ok()) {
-        return validation_op;
-    }
-
+int32_t Collection::get_points_from_doc(const nlohmann::json &document) {
     int32_t points = 0;
 
     if(!default_sorting_field.empty()) {
@@ -253,6 +642,18 @@ Option<uint32_t> Collection::index_in_memory(const nlohmann::json &document, uin
         }
     }
 
+    return points;
+}
+
+Option<uint32_t> Collection::index_in_memory(const nlohmann::json &document, uint32_t seq_id) {
+    Option<uint32_t> validation_op = validate_index_in_memory(document, seq_id);
+
+    if(!validation_op.ok()) {
+        return validation_op;
+    }
+
+    const int32_t points = get_points_from_doc(document);
+
     Index* index = indices[seq_id % num_indices];
     index->index_in_memory(document, seq_id, points);
 
@@ -260,11 +661,161 @@ Option<uint32_t> Collection::index_in_memory(const nlohmann::json &document, uin
     return Option<>(200);
 }
 
+size_t Collection::batch_index_into(std::vector<Index*> & target_indices, std::vector<index_record> & records) {
+    const size_t num_targets = target_indices.size();
+
+    // partition the records by shard, so that each shard can be indexed by its own thread
+    std::vector<std::vector<index_record*>> shard_records(num_targets);
+    for(index_record & record: records) {
+        shard_records[record.seq_id % num_targets].push_back(&record);
+    }
+
+    std::vector<size_t> shard_counts(num_targets, 0);
+    std::vector<std::thread> shard_threads;
+
+    for(size_t i = 0; i < num_targets; i++) {
+        if(shard_records[i].empty()) {
+            continue;
+        }
+
+        shard_threads.emplace_back([&, i]() {
+            for(index_record* record: shard_records[i]) {
+                if(record->is_flat) {
+                    // flat records were validated by the scanner while being parsed
+                    target_indices[i]->index_in_memory(record->flat, record->seq_id, record->flat.points);
+                    shard_counts[i] += 1;
+                    continue;
+                }
+
+                const Option<uint32_t> & validation_op = validate_index_in_memory(record->document,
+                                                                                  record->seq_id);
+                if(!validation_op.ok()) {
+                    continue;
+                }
+
+                const int32_t points = get_points_from_doc(record->document);
+                target_indices[i]->index_in_memory(record->document, record->seq_id, points);
+                shard_counts[i] += 1;
+            }
+        });
+    }
+
+    for(std::thread & shard_thread: shard_threads) {
+        shard_thread.join();
+    }
+
+    size_t num_indexed = 0;
+    for(size_t shard_count: shard_counts) {
+        num_indexed += shard_count;
+    }
+
+    return num_indexed;
+}
+
+size_t Collection::batch_index_in_memory(std::vector<index_record> & records) {
+    const size_t num_indexed = batch_index_into(indices, records);
+    num_documents += num_indexed;
+    return num_indexed;
+}
+
+// The `search_after` cursor is the full ranking tuple of a hit, serialized as hex-encoded,
+// underscore-joined fields: match score, primary attr, secondary attr, field order and
+// sequence id. Numeric attrs carry a type prefix since sort fields can be integer or float.
+
+static void encode_cursor_number(const number_t & num, std::string & token) {
+    char buf[32];
+
+    if(num.is_float) {
+        uint32_t bits;
+        memcpy(&bits, &num.floatval, sizeof(bits));
+        snprintf(buf, sizeof(buf), "f%x", bits);
+    } else {
+        snprintf(buf, sizeof(buf), "i%llx", (unsigned long long) num.intval);
+    }
+
+    token += buf;
+}
+
+static std::string encode_search_cursor(const std::pair<int, Topster::KV> & field_order_kv) {
+    char buf[48];
+    std::string token;
+
+    snprintf(buf, sizeof(buf), "%llx_", (unsigned long long) field_order_kv.second.match_score);
+    token += buf;
+    encode_cursor_number(field_order_kv.second.primary_attr, token);
+    token += "_";
+    encode_cursor_number(field_order_kv.second.secondary_attr, token);
+    snprintf(buf, sizeof(buf), "_%x_%llx", field_order_kv.first, (unsigned long long) field_order_kv.second.key);
+    token += buf;
+
+    return token;
+}
+
+static bool decode_cursor_number(const std::string & part, number_t & num) {
+    if(part.size() < 2 || (part[0] != 'i' && part[0] != 'f')) {
+        return false;
+    }
+
+    char* end = nullptr;
+    unsigned long long bits = strtoull(part.c_str() + 1, &end, 16);
+
+    if(end == nullptr || *end != '\0') {
+        return false;
+    }
+
+    if(part[0] == 'f') {
+        uint32_t fbits = (uint32_t) bits;
+        float fval;
+        memcpy(&fval, &fbits, sizeof(fval));
+        num = fval;
+    } else {
+        num = (int64_t) bits;
+    }
+
+    return true;
+}
+
+static bool decode_search_cursor(const std::string & token, search_cursor & cursor) {
+    std::vector<std::string> parts;
+    StringUtils::split(token, parts, "_");
+
+    if(parts.size() != 5) {
+        return false;
+    }
+
+    char* end = nullptr;
+    cursor.match_score = strtoull(parts[0].c_str(), &end, 16);
+    if(*end != '\0') {
+        return false;
+    }
+
+    if(!decode_cursor_number(parts[1], cursor.primary_attr) || !decode_cursor_number(parts[2], cursor.secondary_attr)) {
+        return false;
+    }
+
+    cursor.field_order = (int) strtoul(parts[3].c_str(), &end, 16);
+    if(*end != '\0') {
+        return false;
+    }
+
+    cursor.key = strtoull(parts[4].c_str(), &end, 16);
+    if(*end != '\0') {
+        return false;
+    }
+
+    cursor.valid = true;
+    return true;
+}
+
 Option<nlohmann::json> Collection::search(std::string query, const std::vector<std::string> search_fields,
                                   const std::string & simple_filter_query, const std::vector<std::string> & facet_fields,
                                   const std::vector<sort_by> & sort_fields, const int num_typos,
                                   const size_t per_page, const size_t page,
-                                  const token_ordering token_order, const bool prefix) {
+                                  const token_ordering token_order, const bool prefix,
+                                  const bool exhaustive_search, const std::string & search_after,
+                                  std::vector<search_hit>* stream_hits, const size_t max_candidates) {
+    layout_guard guard(this);
+
     std::vector<facet> facets;
 
     // validate search fields
@@ -416,60 +967,79 @@ Option<nlohmann::json> Collection::search(std::string query, const std::vector<s
     }
 
     if((page * per_page) > MAX_RESULTS) {
-        std::string message = "Only the first " + std::to_string(MAX_RESULTS) + " results are available.";
+        std::string message = "Only the first " + std::to_string(MAX_RESULTS) + " results are available. "
+                              "Use the `search_after` cursor to paginate further.";
         return Option<nlohmann::json>(422, message);
     }
 
-    //auto begin = std::chrono::high_resolution_clock::now();
+    search_cursor cursor;
+    if(!search_after.empty() && !decode_search_cursor(search_after, cursor)) {
+        return Option<nlohmann::json>(400, "Invalid `search_after` cursor.");
+    }
+
+    const uint64_t search_begin_micros = query_timings::now_micros();
+    query_timings timings;
 
     // all search queries that were used for generating the results
     std::vector<std::vector<art_leaf*>> searched_queries;
-    std::vector<std::pair<int, Topster<512>::KV>> field_order_kvs;
+    std::vector<std::pair<int, Topster::KV>> field_order_kvs;
+
+    // [begin, end) segments of `field_order_kvs` that are individually sorted - one per
+    // (shard, field) topster - so the result page can be formed by merging them
+    std::vector<std::pair<size_t, size_t>> sorted_runs;
+
     size_t total_found = 0;
 
-    // send data to individual index threads
+    // queue one search task per shard, so that the worker pool can run them concurrently
+    std::vector<search_args*> search_params_vec;
+    search_latch latch(indices.size());
+
     for(Index* index: indices) {
-        index->search_params = search_args(query, search_fields, filters, facets, sort_fields_std,
-                                           num_typos, per_page, page, token_order, prefix);
-        {
-            std::lock_guard<std::mutex> lk(index->m);
-            index->ready = true;
-            index->processed = false;
-        }
-        index->cv.notify_one();
-        //std::this_thread::sleep_for(std::chrono::milliseconds(400));
+        search_args* search_params = new search_args(query, search_fields, filters, facets, sort_fields_std,
+                                                     num_typos, per_page, page, token_order, prefix,
+                                                     exhaustive_search, max_candidates, cursor);
+        search_params_vec.push_back(search_params);
+        search_queue->add(search_task{index, search_params, &latch});
     }
 
-    Option<nlohmann::json> index_search_op({});  // stores the last error across all index threads
+    // wait for all shards of this query to be searched
+    latch.wait();
 
-    for(Index* index: indices) {
-        // wait for the worker
-        {
-            std::unique_lock<std::mutex> lk(index->m);
-            index->cv.wait(lk, [index]{return index->processed;});
-        }
+    Option<nlohmann::json> index_search_op({});  // stores the last error across all index shards
 
-        if(!index->search_params.outcome.ok()) {
-            index_search_op = Option<nlohmann::json>(index->search_params.outcome.code(),
-                                                    index->search_params.outcome.error());
+    for(search_args* search_params: search_params_vec) {
+        if(!search_params->outcome.ok()) {
+            index_search_op = Option<nlohmann::json>(search_params->outcome.code(), search_params->outcome.error());
         }
 
         if(!index_search_op.ok()) {
-            // we still need to iterate without breaking to release the locks
             continue;
         }
 
         // need to remap the search query index before appending
-        for(auto & field_order_kv: index->search_params.field_order_kvs) {
+        size_t run_begin = field_order_kvs.size();
+
+        for(auto & field_order_kv: search_params->field_order_kvs) {
             field_order_kv.second.query_index += searched_queries.size();
+
+            // a change in the field order marks the start of the next field's topster output
+            if(field_order_kvs.size() != run_begin && field_order_kvs.back().first != field_order_kv.first) {
+                sorted_runs.push_back(std::make_pair(run_begin, field_order_kvs.size()));
+                run_begin = field_order_kvs.size();
+            }
+
             field_order_kvs.push_back(field_order_kv);
         }
 
-        searched_queries.insert(searched_queries.end(), index->search_params.searched_queries.begin(),
-                                index->search_params.searched_queries.end());
+        if(run_begin != field_order_kvs.size()) {
+            sorted_runs.push_back(std::make_pair(run_begin, field_order_kvs.size()));
+        }
+
+        searched_queries.insert(searched_queries.end(), search_params->searched_queries.begin(),
+                                search_params->searched_queries.end());
 
-        for(size_t fi = 0; fi < index->search_params.facets.size(); fi++) {
-            auto & this_facet = index->search_params.facets[fi];
+        for(size_t fi = 0; fi < search_params->facets.size(); fi++) {
+            auto & this_facet = search_params->facets[fi];
             auto & acc_facet = facets[fi];
 
             for(auto & facet_kv: this_facet.result_map) {
@@ -486,68 +1056,144 @@ Option<nlohmann::json> Collection::search(std::string query, const std::vector<s
             }
         }
 
-        total_found += index->search_params.all_result_ids_len;
+        total_found += search_params->all_result_ids_len;
+        timings.merge(search_params->timings);
+    }
+
+    for(search_args* search_params: search_params_vec) {
+        delete search_params;
     }
 
     if(!index_search_op.ok()) {
         return index_search_op;
     }
 
-    // All fields are sorted descending
-    std::sort(field_order_kvs.begin(), field_order_kvs.end(),
-      [](const std::pair<int, Topster<512>::KV> & a, const std::pair<int, Topster<512>::KV> & b) {
-          return std::tie(a.second.match_score, a.second.primary_attr, a.second.secondary_attr, a.first, a.second.key) >
-                 std::tie(b.second.match_score, b.second.primary_attr, b.second.secondary_attr, b.first, b.second.key);
-    });
+    // All fields are sorted descending. Each run is already sorted by the same criteria
+    // (Topster::sort breaks ranking ties on the key and the field order is constant within a
+    // run), so a k-way merge of the run heads replaces a global sort - and it can stop as
+    // soon as the requested page is covered, instead of ordering every collected KV.
+    auto kv_is_greater = [](const std::pair<int, Topster::KV> & a, const std::pair<int, Topster::KV> & b) {
+        return std::tie(a.second.match_score, a.second.primary_attr, a.second.secondary_attr, a.first, a.second.key) >
+               std::tie(b.second.match_score, b.second.primary_attr, b.second.secondary_attr, b.first, b.second.key);
+    };
+
+    const size_t max_merged_kvs = page * per_page;
+
+    std::vector<std::pair<int, Topster::KV>> merged_kvs;
+    merged_kvs.reserve(std::min(max_merged_kvs, field_order_kvs.size()));
+
+    while(merged_kvs.size() < max_merged_kvs) {
+        int best_run = -1;
+
+        // the number of runs is small (shards x fields), so a linear scan beats a heap
+        for(size_t i = 0; i < sorted_runs.size(); i++) {
+            if(sorted_runs[i].first == sorted_runs[i].second) {
+                continue;
+            }
+
+            if(best_run == -1 || kv_is_greater(field_order_kvs[sorted_runs[i].first],
+                                               field_order_kvs[sorted_runs[best_run].first])) {
+                best_run = i;
+            }
+        }
+
+        if(best_run == -1) {
+            // all runs are exhausted
+            break;
+        }
+
+        merged_kvs.push_back(field_order_kvs[sorted_runs[best_run].first]);
+        sorted_runs[best_run].first++;
+    }
+
+    field_order_kvs = std::move(merged_kvs);
 
     nlohmann::json result = nlohmann::json::object();
 
     result["hits"] = nlohmann::json::array();
     result["found"] = total_found;
 
+    // folds the request's timings into the process-wide metrics and logs a stage breakdown
+    // when the request crossed the slow query threshold - the g3log sink writes from its own
+    // background thread, so the request only pays for formatting the line
+    auto fold_metrics = [&]() {
+        QueryMetrics::get_instance().add(timings);
+
+        const int64_t slow_threshold_micros = QueryMetrics::get_instance().get_slow_query_threshold_micros();
+        const int64_t took_micros = (int64_t)(query_timings::now_micros() - search_begin_micros);
+
+        if(slow_threshold_micros >= 0 && took_micros > slow_threshold_micros) {
+            LOG(INFO) << "SLOW QUERY: collection=" << name << ", query=`" << query << "`"
+                      << ", took_micros=" << took_micros
+                      << ", typo_cost=" << timings.max_typo_cost
+                      << ", leaves_expanded=" << timings.leaves_expanded
+                      << ", ids_scanned=" << timings.ids_scanned
+                      << ", topster_evictions=" << timings.topster_evictions
+                      << ", filter_micros=" << timings.stage_micros[STAGE_FILTER]
+                      << ", token_search_micros=" << timings.stage_micros[STAGE_TOKEN_SEARCH]
+                      << ", scoring_micros=" << timings.stage_micros[STAGE_SCORING]
+                      << ", faceting_micros=" << timings.stage_micros[STAGE_FACETING]
+                      << ", hydration_micros=" << timings.stage_micros[STAGE_HYDRATION]
+                      << ", highlighting_micros=" << timings.stage_micros[STAGE_HIGHLIGHTING];
+        }
+    };
+
     const int start_result_index = (page - 1) * per_page;
     const int kvsize = field_order_kvs.size();
 
     if(start_result_index > (kvsize - 1)) {
+        fold_metrics();
         return Option<nlohmann::json>(result);
     }
 
     const int end_result_index = std::min(int(page * per_page), kvsize) - 1;
 
+    // hydrate the whole result page with a single batched read
+    std::vector<std::string> seq_id_keys;
+    for(int i = start_result_index; i <= end_result_index; i++) {
+        seq_id_keys.push_back(get_seq_id_key((uint32_t) field_order_kvs[i].second.key));
+    }
+
+    const uint64_t hydration_begin_micros = query_timings::now_micros();
+    std::vector<std::string> json_docs;
+    const std::vector<StoreStatus> & json_doc_statuses = store->multi_get(seq_id_keys, json_docs);
+    timings.record(STAGE_HYDRATION, hydration_begin_micros);
+
     // construct results array
     for(int field_order_kv_index = start_result_index; field_order_kv_index <= end_result_index; field_order_kv_index++) {
         const auto & field_order_kv = field_order_kvs[field_order_kv_index];
-        const std::string& seq_id_key = get_seq_id_key((uint32_t) field_order_kv.second.key);
-
-        std::string json_doc_str;
-        StoreStatus json_doc_status = store->get(seq_id_key, json_doc_str);
+        const size_t page_index = field_order_kv_index - start_result_index;
 
-        if(json_doc_status != StoreStatus::FOUND) {
-            LOG(ERR) << "Could not locate the JSON document for sequence ID: " << seq_id_key;
+        if(json_doc_statuses[page_index] != StoreStatus::FOUND) {
+            LOG(ERR) << "Could not locate the JSON document for sequence ID: " << seq_id_keys[page_index];
             continue;
         }
 
-        nlohmann::json wrapper_doc;
+        const std::string & json_doc_str = json_docs[page_index];
+
+        const std::string & field_name = search_fields[search_fields.size() - field_order_kv.first];
+        field search_field = search_schema.at(field_name);
+
         nlohmann::json document;
 
-        try {
-            document = nlohmann::json::parse(json_doc_str);
-        } catch(...) {
-            return Option<nlohmann::json>(500, "Error while parsing stored document.");
+        // when streaming, the raw stored document is emitted as-is, so the DOM is needed
+        // only to pull out the text of the field being highlighted
+        if(stream_hits == nullptr || search_field.type == field_types::STRING) {
+            const uint64_t parse_begin_micros = query_timings::now_micros();
+            try {
+                document = nlohmann::json::parse(json_doc_str);
+            } catch(...) {
+                return Option<nlohmann::json>(500, "Error while parsing stored document.");
+            }
+            timings.record(STAGE_HYDRATION, parse_begin_micros);
         }
 
-        wrapper_doc["document"] = document;
-        //wrapper_doc["match_score"] = field_order_kv.second.match_score;
-        //wrapper_doc["seq_id"] = (uint32_t) field_order_kv.second.key;
+        std::string snippet;
+        bool highlighted = false;
 
-        // highlight query words in the result
-        const std::string & field_name = search_fields[search_fields.size() - field_order_kv.first];
-        field search_field = search_schema.at(field_name);
-
-        // only string fields are supported for now
+        // highlight query words in the result - only string fields are supported for now
         if(search_field.type == field_types::STRING) {
-            std::vector<std::string> tokens;
-            StringUtils::split(document[field_name], tokens, " ");
+            const uint64_t highlight_begin_micros = query_timings::now_micros();
 
             // positions in the document of each token in the query
             std::vector<std::vector<uint16_t>> token_positions;
@@ -584,35 +1230,41 @@ Option<nlohmann::json> Collection::search(std::string query, const std::vector<s
                 }
             }
 
-            auto minmax = std::minmax_element(token_indices.begin(), token_indices.end());
-
-            // For longer strings, pick surrounding tokens within N tokens of min_index and max_index for the snippet
-            const size_t start_index = (tokens.size() <= SNIPPET_STR_ABOVE_LEN) ? 0 :
-                                       std::max(0, (int)(*(minmax.first)-5));
+            const std::string & text = document[field_name].get_ref<const std::string &>();
+            highlight_snippet(text, token_indices, snippet);
+            highlighted = true;
 
-            const size_t end_index = (tokens.size() <= SNIPPET_STR_ABOVE_LEN) ? tokens.size() :
-                                     std::min((int)tokens.size(), (int)(*(minmax.second)+5));
+            timings.record(STAGE_HIGHLIGHTING, highlight_begin_micros);
+        }
 
-            for(const size_t token_index: token_indices) {
-                tokens[token_index] = "<mark>" + tokens[token_index] + "</mark>";
+        if(stream_hits != nullptr) {
+            search_hit hit;
+            hit.json_doc = std::move(json_docs[page_index]);
+            if(highlighted) {
+                hit.highlight_field = field_name;
+                hit.snippet = snippet;
             }
-
-            std::stringstream snippet_stream;
-            for(size_t snippet_index = start_index; snippet_index < end_index; snippet_index++) {
-                if(snippet_index != start_index) {
-                    snippet_stream << " ";
-                }
-
-                snippet_stream << tokens[snippet_index];
+            stream_hits->push_back(std::move(hit));
+        } else {
+            nlohmann::json wrapper_doc;
+            wrapper_doc["document"] = document;
+            //wrapper_doc["match_score"] = field_order_kv.second.match_score;
+            //wrapper_doc["seq_id"] = (uint32_t) field_order_kv.second.key;
+
+            if(highlighted) {
+                wrapper_doc["highlight"] = nlohmann::json::object();
+                wrapper_doc["highlight"][field_name] = snippet;
             }
 
-            wrapper_doc["highlight"] = nlohmann::json::object();
-            wrapper_doc["highlight"][field_name] = snippet_stream.str();
+            result["hits"].push_back(wrapper_doc);
         }
-
-        result["hits"].push_back(wrapper_doc);
     }
 
+    // cursor for fetching the page that follows this one
+    result["search_after"] = encode_search_cursor(field_order_kvs[end_result_index]);
+
+    fold_metrics();
+
     result["facet_counts"] = nlohmann::json::array();
 
     // populate facets
@@ -649,19 +1301,76 @@ Option<nlohmann::json> Collection::search(std::string query, const std::vector<s
     return result;
 }
 
-Option<nlohmann::json> Collection::get(const std::string & id) {
-    std::string seq_id_str;
-    StoreStatus seq_id_status = store->get(get_doc_id_key(id), seq_id_str);
+void Collection::highlight_snippet(const std::string & text, std::vector<size_t> & token_indices,
+                                   std::string & snippet) const {
+    // The stored offsets identify tokens by position, so the bytes of each token can be
+    // located with a single scan - no tokenizing into a vector of copies and re-joining.
+    std::vector<std::pair<size_t, size_t>> token_ranges;  // [start, end) byte ranges
+    size_t pos = 0;
 
-    if(seq_id_status == StoreStatus::NOT_FOUND) {
-        return Option<nlohmann::json>(404, "Could not find a document with id: " + id);
+    while(pos < text.size()) {
+        if(text[pos] == ' ') {
+            pos++;
+            continue;
+        }
+
+        size_t token_start = pos;
+        while(pos < text.size() && text[pos] != ' ') {
+            pos++;
+        }
+
+        token_ranges.push_back(std::make_pair(token_start, pos));
     }
 
-    if(seq_id_status == StoreStatus::ERROR) {
-        return Option<nlohmann::json>(500, "Error while fetching the document.");
+    if(token_ranges.empty()) {
+        snippet = "";
+        return ;
+    }
+
+    std::sort(token_indices.begin(), token_indices.end());
+    token_indices.erase(std::unique(token_indices.begin(), token_indices.end()), token_indices.end());
+
+    const size_t min_index = token_indices.empty() ? 0 : token_indices.front();
+    const size_t max_index = token_indices.empty() ? 0 : token_indices.back();
+
+    // For longer strings, pick surrounding tokens within N tokens of min_index and max_index for the snippet
+    const size_t start_index = (token_ranges.size() <= SNIPPET_STR_ABOVE_LEN) ? 0 :
+                               (size_t) std::max(0, (int) min_index - 5);
+
+    const size_t end_index = (token_ranges.size() <= SNIPPET_STR_ABOVE_LEN) ? token_ranges.size() :
+                             std::min(token_ranges.size(), max_index + 5);
+
+    const size_t snippet_start = token_ranges[start_index].first;
+    const size_t snippet_end = token_ranges[end_index - 1].second;
+
+    snippet.reserve((snippet_end - snippet_start) + token_indices.size() * 13);  // 13 = strlen of the mark tags
+
+    size_t copy_from = snippet_start;
+
+    for(const size_t token_index: token_indices) {
+        if(token_index < start_index || token_index >= end_index) {
+            continue;
+        }
+
+        const std::pair<size_t, size_t> & range = token_ranges[token_index];
+        snippet.append(text, copy_from, range.first - copy_from);
+        snippet += "<mark>";
+        snippet.append(text, range.first, range.second - range.first);
+        snippet += "</mark>";
+        copy_from = range.second;
     }
 
-    uint32_t seq_id = (uint32_t) std::stol(seq_id_str);
+    snippet.append(text, copy_from, snippet_end - copy_from);
+}
+
+Option<nlohmann::json> Collection::get(const std::string & id) {
+    const Option<uint32_t> & seq_id_op = doc_id_to_seq_id(id);
+
+    if(!seq_id_op.ok()) {
+        return Option<nlohmann::json>(404, "Could not find a document with id: " + id);
+    }
+
+    uint32_t seq_id = seq_id_op.get();
 
     std::string parsed_document;
     StoreStatus doc_status = store->get(get_seq_id_key(seq_id), parsed_document);
@@ -686,18 +1395,15 @@ Option<nlohmann::json> Collection::get(const std::string & id) {
 }
 
 Option<std::string> Collection::remove(const std::string & id, const bool remove_from_store) {
-    std::string seq_id_str;
-    StoreStatus seq_id_status = store->get(get_doc_id_key(id), seq_id_str);
+    layout_guard guard(this);
 
-    if(seq_id_status == StoreStatus::NOT_FOUND) {
-        return Option<std::string>(404, "Could not find a document with id: " + id);
-    }
+    const Option<uint32_t> & seq_id_op = doc_id_to_seq_id(id);
 
-    if(seq_id_status == StoreStatus::ERROR) {
-        return Option<std::string>(500, "Error while fetching the document.");
+    if(!seq_id_op.ok()) {
+        return Option<std::string>(404, "Could not find a document with id: " + id);
     }
 
-    uint32_t seq_id = (uint32_t) std::stol(seq_id_str);
+    uint32_t seq_id = seq_id_op.get();
 
     std::string parsed_document;
     StoreStatus doc_status = store->get(get_seq_id_key(seq_id), parsed_document);
@@ -711,26 +1417,289 @@ Option<std::string> Collection::remove(const std::string & id, const bool remove
         return Option<std::string>(500, "Error while fetching the document.");
     }
 
-    nlohmann::json document;
-    try {
-        document = nlohmann::json::parse(parsed_document);
-    } catch(...) {
-        return Option<std::string>(500, "Error while parsing stored document.");
+    Index* index = indices[seq_id % num_indices];
+    index->remove(seq_id);
+
+    if(index->needs_compaction()) {
+        std::unique_lock<std::mutex> lock(compaction_m);
+        if(std::find(compaction_candidates.begin(), compaction_candidates.end(), index) ==
+           compaction_candidates.end()) {
+            compaction_candidates.push_back(index);
+            compaction_cv.notify_one();
+        }
     }
 
-    Index* index = indices[seq_id % num_indices];
-    index->remove(seq_id, document);
+    {
+        std::lock_guard<std::mutex> lock(reshard_forward_m);
+
+        if(remove_from_store) {
+            store->remove(get_doc_id_key(id));
+            store->remove(get_seq_id_key(seq_id));
 
-    if(remove_from_store) {
-        store->remove(get_doc_id_key(id));
-        store->remove(get_seq_id_key(seq_id));
+            std::lock_guard<std::mutex> id_lock(doc_id_index_m);
+            doc_id_index.erase(id);
+        }
+
+        if(reshard_running) {
+            // tombstoning is idempotent, so the shadow shard is marked regardless of whether
+            // the document has been streamed into it yet
+            reshard_indices[seq_id % reshard_num_indices]->remove(seq_id);
+        }
     }
 
     num_documents -= 1;
+    write_generation++;
 
     return Option<std::string>(id);
 }
 
+Option<bool> Collection::save_index_snapshot(const std::string & snapshot_path) {
+    layout_guard guard(this);
+
+    // write to a temporary file and rename, so that a partially written snapshot is never picked up
+    const std::string tmp_path = snapshot_path + ".tmp";
+    FILE* fp = fopen(tmp_path.c_str(), "wb");
+
+    if(fp == nullptr) {
+        return Option<bool>(500, "Could not open " + tmp_path + " for writing.");
+    }
+
+    uint32_t header[4] = {INDEX_SNAPSHOT_MAGIC, INDEX_SNAPSHOT_VERSION, next_seq_id, (uint32_t) num_indices};
+    bool ok = (fwrite(header, sizeof(uint32_t), 4, fp) == 4);
+
+    uint64_t num_docs = num_documents;
+    ok = ok && (fwrite(&num_docs, sizeof(uint64_t), 1, fp) == 1);
+
+    for(size_t i = 0; ok && i < num_indices; i++) {
+        ok = indices[i]->snapshot_save(fp);
+    }
+
+    ok = (fclose(fp) == 0) && ok;
+
+    if(!ok) {
+        // `::` needed - plain `remove` resolves to Collection::remove here
+        ::remove(tmp_path.c_str());
+        return Option<bool>(500, "Error while writing index snapshot to " + tmp_path);
+    }
+
+    if(rename(tmp_path.c_str(), snapshot_path.c_str()) != 0) {
+        ::remove(tmp_path.c_str());
+        return Option<bool>(500, "Error while renaming " + tmp_path + " to " + snapshot_path);
+    }
+
+    return Option<bool>(true);
+}
+
+Option<uint32_t> Collection::load_index_snapshot(const std::string & snapshot_path) {
+    FILE* fp = fopen(snapshot_path.c_str(), "rb");
+
+    if(fp == nullptr) {
+        return Option<uint32_t>(404, "No index snapshot found at " + snapshot_path);
+    }
+
+    uint32_t header[4];
+    if(fread(header, sizeof(uint32_t), 4, fp) != 4 ||
+       header[0] != INDEX_SNAPSHOT_MAGIC || header[1] != INDEX_SNAPSHOT_VERSION || header[3] != num_indices) {
+        fclose(fp);
+        return Option<uint32_t>(500, "Index snapshot at " + snapshot_path + " has a bad header.");
+    }
+
+    uint64_t num_docs;
+    if(fread(&num_docs, sizeof(uint64_t), 1, fp) != 1) {
+        fclose(fp);
+        return Option<uint32_t>(500, "Index snapshot at " + snapshot_path + " is truncated.");
+    }
+
+    for(size_t i = 0; i < num_indices; i++) {
+        if(!indices[i]->snapshot_load(fp)) {
+            fclose(fp);
+            return Option<uint32_t>(500, "Index snapshot at " + snapshot_path + " is invalid or does not "
+                                         "match the collection schema.");
+        }
+    }
+
+    fclose(fp);
+    num_documents = num_docs;
+
+    // documents with a seq_id >= the watermark were written after this snapshot was taken
+    return Option<uint32_t>(header[2]);
+}
+
+size_t Collection::get_num_indices() {
+    return num_indices;
+}
+
+Option<bool> Collection::reshard(const size_t new_num_indices) {
+    if(new_num_indices < 1 || new_num_indices > MAX_NUM_INDICES) {
+        return Option<bool>(400, "Shard count must be between 1 and " +
+                                 std::to_string(MAX_NUM_INDICES) + ".");
+    }
+
+    if(new_num_indices == num_indices) {
+        return Option<bool>(true);
+    }
+
+    bool expected = false;
+    if(!reshard_running.compare_exchange_strong(expected, true)) {
+        return Option<bool>(409, "Another reshard is already in progress.");
+    }
+
+    // the shadow layout that documents are streamed into while the collection keeps serving
+    std::vector<Index*> new_indices;
+    for(size_t i = 0; i < new_num_indices; i++) {
+        new_indices.push_back(new Index(name+std::to_string(i), search_schema, facet_schema, sort_schema,
+                                        store->get_state_dir_path() + "/offsets_" + name + std::to_string(i)));
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(reshard_forward_m);
+        reshard_indices = new_indices;
+        reshard_num_indices = new_num_indices;
+        reshard_watermark = 0;
+    }
+
+    // Drain in-flight writes, so that every document below the streaming cutoff is fully
+    // committed to the store before the streamer starts reading.
+    layout_exclusive_lock();
+    const uint32_t stream_upto = next_seq_id;
+    layout_exclusive_unlock();
+
+    // Phase 1: stream the stored documents below the cutoff into the shadow layout, in
+    // batches. Reads and writes keep flowing into the live layout meanwhile - mutations of
+    // documents that have already been streamed are forwarded by update() and remove(),
+    // serialized against these batches through `reshard_forward_m`.
+    const std::string seq_id_prefix = get_seq_id_collection_prefix();
+    rocksdb::Iterator* iter = store->scan(seq_id_prefix);
+    bool stream_ok = true;
+
+    while(stream_ok) {
+        std::vector<index_record> batch;
+
+        {
+            std::lock_guard<std::mutex> lock(reshard_forward_m);
+            uint32_t batch_upto = reshard_watermark;
+
+            while(iter->Valid() && iter->key().starts_with(seq_id_prefix) &&
+                  batch.size() < RESHARD_BATCH_SIZE) {
+                const std::string & key = iter->key().ToString();
+                const uint32_t seq_id = StringUtils::deserialize_uint32_t(key.substr(key.size() - 4));
+
+                if(seq_id >= stream_upto) {
+                    break;
+                }
+
+                nlohmann::json document;
+                try {
+                    document = nlohmann::json::parse(iter->value().ToString());
+                } catch(...) {
+                    stream_ok = false;
+                    break;
+                }
+
+                batch.push_back(index_record(seq_id, document));
+                batch_upto = seq_id + 1;
+                iter->Next();
+            }
+
+            if(stream_ok && !batch.empty()) {
+                batch_index_into(new_indices, batch);
+                reshard_watermark = batch_upto;
+            }
+        }
+
+        if(batch.empty()) {
+            break;
+        }
+    }
+
+    delete iter;
+
+    // Phase 2: a brief exclusive window - index the tail that was written while streaming,
+    // then swap the layouts.
+    if(stream_ok) {
+        layout_exclusive_lock();
+
+        std::vector<index_record> batch;
+        rocksdb::Iterator* tail_iter = store->scan(get_seq_id_key(stream_upto));
+
+        while(stream_ok && tail_iter->Valid() && tail_iter->key().starts_with(seq_id_prefix)) {
+            const std::string & key = tail_iter->key().ToString();
+            const uint32_t seq_id = StringUtils::deserialize_uint32_t(key.substr(key.size() - 4));
+
+            nlohmann::json document;
+            try {
+                document = nlohmann::json::parse(tail_iter->value().ToString());
+            } catch(...) {
+                stream_ok = false;
+                break;
+            }
+
+            batch.push_back(index_record(seq_id, document));
+
+            if(batch.size() == RESHARD_BATCH_SIZE) {
+                batch_index_into(new_indices, batch);
+                batch.clear();
+            }
+
+            tail_iter->Next();
+        }
+
+        delete tail_iter;
+
+        if(stream_ok) {
+            if(!batch.empty()) {
+                batch_index_into(new_indices, batch);
+            }
+
+            std::vector<Index*> old_indices = indices;
+            indices = new_indices;
+            const size_t prev_num_indices = num_indices;
+            num_indices = new_num_indices;
+
+            {
+                std::lock_guard<std::mutex> lock(reshard_forward_m);
+                reshard_indices.clear();
+                reshard_num_indices = 0;
+                reshard_watermark = 0;
+            }
+
+            {
+                // queued compaction candidates point into the old layout
+                std::lock_guard<std::mutex> lock(compaction_m);
+                compaction_candidates.clear();
+            }
+
+            layout_exclusive_unlock();
+
+            for(Index* old_index: old_indices) {
+                delete old_index;
+            }
+
+            reshard_running = false;
+
+            LOG(INFO) << "Resharded collection `" << name << "` from " << prev_num_indices
+                      << " to " << new_num_indices << " shards.";
+            return Option<bool>(true);
+        }
+
+        layout_exclusive_unlock();
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(reshard_forward_m);
+        reshard_indices.clear();
+        reshard_num_indices = 0;
+        reshard_watermark = 0;
+    }
+
+    for(Index* new_index: new_indices) {
+        delete new_index;
+    }
+
+    reshard_running = false;
+    return Option<bool>(500, "Error while reading stored documents during reshard.");
+}
+
 std::string Collection::get_next_seq_id_key(const std::string & collection_name) {
     return std::string(COLLECTION_NEXT_SEQ_PREFIX) + "_" + collection_name;
 }
@@ -759,18 +1728,30 @@ uint32_t Collection::get_collection_id() {
 }
 
 Option<uint32_t> Collection::doc_id_to_seq_id(std::string doc_id) {
-    std::string seq_id_str;
-    StoreStatus status = store->get(get_doc_id_key(doc_id), seq_id_str);
-    if(status == StoreStatus::FOUND) {
-        uint32_t seq_id = (uint32_t) std::stoi(seq_id_str);
-        return Option<uint32_t>(seq_id);
+    std::lock_guard<std::mutex> lock(doc_id_index_m);
+    const auto & it = doc_id_index.find(doc_id);
+
+    if(it != doc_id_index.end()) {
+        return Option<uint32_t>(it->second);
     }
 
-    if(status == StoreStatus::NOT_FOUND) {
-        return Option<uint32_t>(404, "Not found.");
+    // the index mirrors the store's doc_id keys, so a miss means the id does not exist
+    return Option<uint32_t>(404, "Not found.");
+}
+
+void Collection::warm_doc_id_index() {
+    const std::string & doc_id_key_prefix = std::to_string(collection_id) + "_" + DOC_ID_PREFIX + "_";
+    rocksdb::Iterator* iter = store->scan(doc_id_key_prefix);
+
+    std::lock_guard<std::mutex> lock(doc_id_index_m);
+
+    while(iter->Valid() && iter->key().starts_with(doc_id_key_prefix)) {
+        const std::string & doc_id = iter->key().ToString().substr(doc_id_key_prefix.size());
+        doc_id_index[doc_id] = (uint32_t) std::stoi(iter->value().ToString());
+        iter->Next();
     }
 
-    return Option<uint32_t>(500, "Error while fetching doc_id from store.");
+    delete iter;
 }
 
 std::vector<std::string> Collection::get_facet_fields() {
@@ -1,11 +1,15 @@
 
 #include <string>
 #include <vector>
+#include <thread>
+#include <mutex>
+#include <algorithm>
 #include <json.hpp>
+#include <sys/stat.h>
 #include "collection_manager.h"
 
 CollectionManager::CollectionManager() {
-
+    result_cache_bytes = 0;
 }
 
 Collection* CollectionManager::init_collection(const nlohmann::json & collection_meta,
@@ -21,17 +25,25 @@ Collection* CollectionManager::init_collection(const nlohmann::json & collection
 
     std::string default_sorting_field = collection_meta[COLLECTION_DEFAULT_SORTING_FIELD_KEY].get<std::string>();
 
+    // metas written before the shard count became configurable carry no key and get the old default
+    size_t num_indices = 4;
+    if(collection_meta.count(COLLECTION_NUM_INDICES_KEY) != 0) {
+        num_indices = collection_meta[COLLECTION_NUM_INDICES_KEY].get<size_t>();
+    }
+
     Collection* collection = new Collection(this_collection_name,
                                             collection_meta[COLLECTION_ID_KEY].get<uint32_t>(),
                                             collection_next_seq_id,
                                             store,
                                             fields,
-                                            default_sorting_field);
+                                            default_sorting_field,
+                                            num_indices);
 
     return collection;
 }
 
 void CollectionManager::add_to_collections(Collection* collection) {
+    std::lock_guard<std::mutex> lock(m_collections);
     collections.emplace(collection->get_name(), collection);
     collection_id_names.emplace(collection->get_collection_id(), collection->get_name());
 }
@@ -58,72 +70,179 @@ Option<bool> CollectionManager::init(Store *store, const std::string & auth_key,
     std::vector<std::string> collection_meta_jsons;
     store->scan_fill(Collection::COLLECTION_META_PREFIX, collection_meta_jsons);
 
-    for(auto & collection_meta_json: collection_meta_jsons) {
-        nlohmann::json collection_meta;
+    if(collection_meta_jsons.empty()) {
+        return Option<bool>(true);
+    }
 
-        try {
-            collection_meta = nlohmann::json::parse(collection_meta_json);
-        } catch(...) {
-            return Option<bool>(500, "Error while parsing collection meta.");
-        }
+    // Load distinct collections concurrently: a small worker pool claims collections off a shared
+    // cursor, so startup is bounded by the largest collection rather than the sum of all of them.
+    size_t num_workers = std::min(collection_meta_jsons.size(), (size_t) std::thread::hardware_concurrency());
+    num_workers = std::max(num_workers, (size_t) 1);  // hardware_concurrency() can return 0
+
+    std::mutex m_cursor;
+    size_t meta_index = 0;
+    Option<bool> first_error(true);
+
+    auto worker = [&]() {
+        while(true) {
+            std::string collection_meta_json;
+
+            {
+                std::lock_guard<std::mutex> lock(m_cursor);
+                if(meta_index >= collection_meta_jsons.size() || !first_error.ok()) {
+                    return;
+                }
+                collection_meta_json = collection_meta_jsons[meta_index++];
+            }
 
-        const std::string & this_collection_name = collection_meta[COLLECTION_NAME_KEY].get<std::string>();
-        std::string collection_next_seq_id_str;
-        StoreStatus next_seq_id_status = store->get(Collection::get_next_seq_id_key(this_collection_name),
-                                                    collection_next_seq_id_str);
+            Option<bool> load_op = load_collection(collection_meta_json, next_coll_id_status == StoreStatus::FOUND);
 
-        if(next_seq_id_status == StoreStatus::ERROR) {
-            return Option<bool>(500, "Error while fetching collection's next sequence ID from the disk for collection "
-                                     "`" + this_collection_name + "`");
+            if(!load_op.ok()) {
+                std::lock_guard<std::mutex> lock(m_cursor);
+                if(first_error.ok()) {
+                    first_error = load_op;
+                }
+            }
         }
+    };
 
-        if(next_seq_id_status == StoreStatus::NOT_FOUND && next_coll_id_status == StoreStatus::FOUND) {
-            return Option<bool>(500, "Next collection id was found, but collection's next sequence ID is missing for "
-                                     "`" + this_collection_name + "`");
-        }
+    std::vector<std::thread> load_threads;
+    for(size_t i = 0; i < num_workers; i++) {
+        load_threads.emplace_back(worker);
+    }
 
-        uint32_t collection_next_seq_id = next_seq_id_status == StoreStatus::NOT_FOUND ? 0 :
-                                          StringUtils::deserialize_uint32_t(collection_next_seq_id_str);
+    for(std::thread & load_thread: load_threads) {
+        load_thread.join();
+    }
 
-        Collection* collection = init_collection(collection_meta, collection_next_seq_id);
+    return first_error;
+}
 
-        // Fetch records from the store and re-create memory index
-        std::vector<std::string> documents;
-        const std::string seq_id_prefix = collection->get_seq_id_collection_prefix();
-        rocksdb::Iterator* iter = store->scan(seq_id_prefix);
+Option<bool> CollectionManager::load_collection(const std::string & collection_meta_json,
+                                                const bool next_coll_id_exists) {
+    nlohmann::json collection_meta;
 
-        while(iter->Valid() && iter->key().starts_with(seq_id_prefix)) {
-            const std::string doc_json_str = iter->value().ToString();
+    try {
+        collection_meta = nlohmann::json::parse(collection_meta_json);
+    } catch(...) {
+        return Option<bool>(500, "Error while parsing collection meta.");
+    }
 
-            nlohmann::json document;
-            try {
-                document = nlohmann::json::parse(doc_json_str);
-            } catch(...) {
-                delete iter;
-                return Option<bool>(500, std::string("Error while parsing stored document from collection " +
-                                                     collection->get_name() + " with key: ") + iter->key().ToString());
-            }
+    const std::string & this_collection_name = collection_meta[COLLECTION_NAME_KEY].get<std::string>();
+    std::string collection_next_seq_id_str;
+    StoreStatus next_seq_id_status = store->get(Collection::get_next_seq_id_key(this_collection_name),
+                                                collection_next_seq_id_str);
 
-            Option<uint32_t> seq_id_op = collection->doc_id_to_seq_id(document["id"]);
-            if(!seq_id_op.ok()) {
-               delete iter;
-               return Option<bool>(500, std::string("Error while fetching sequence id of document id " +
-                                        document["id"].get<std::string>() + " in collection `" +
-                                        collection->get_name() + "`"));
-            }
+    if(next_seq_id_status == StoreStatus::ERROR) {
+        return Option<bool>(500, "Error while fetching collection's next sequence ID from the disk for collection "
+                                 "`" + this_collection_name + "`");
+    }
 
-            collection->index_in_memory(document, seq_id_op.get());
-            iter->Next();
+    if(next_seq_id_status == StoreStatus::NOT_FOUND && next_coll_id_exists) {
+        return Option<bool>(500, "Next collection id was found, but collection's next sequence ID is missing for "
+                                 "`" + this_collection_name + "`");
+    }
+
+    uint32_t collection_next_seq_id = next_seq_id_status == StoreStatus::NOT_FOUND ? 0 :
+                                      StringUtils::deserialize_uint32_t(collection_next_seq_id_str);
+
+    Collection* collection = init_collection(collection_meta, collection_next_seq_id);
+
+    // Restore from an index snapshot when one is available, so that only documents written
+    // after the snapshot have to be re-indexed from the store
+    uint32_t seq_id_watermark = 0;
+    const std::string & snapshot_path = get_index_snapshot_path(collection->get_collection_id());
+    Option<uint32_t> snapshot_op = collection->load_index_snapshot(snapshot_path);
+
+    if(snapshot_op.ok()) {
+        seq_id_watermark = snapshot_op.get();
+        LOG(INFO) << "Loaded index snapshot for collection `" << this_collection_name << "`.";
+    } else if(snapshot_op.code() != 404) {
+        // a bad snapshot could have partially populated the index, so start over with a fresh collection
+        LOG(ERR) << "Could not load index snapshot for collection `" << this_collection_name << "`: "
+                 << snapshot_op.error() << " Falling back to a full re-index.";
+        delete collection;
+        collection = init_collection(collection_meta, collection_next_seq_id);
+    }
+
+    // A snapshot is consumed on load: in-memory state drifts from it as soon as writes happen,
+    // so an unclean shutdown later must fall back to a full replay. A fresh snapshot is written
+    // on every graceful shutdown.
+    remove(snapshot_path.c_str());
+
+    // the replay below resolves every document's seq_id through the doc_id index
+    collection->warm_doc_id_index();
+
+    // Fetch records from the store and re-create memory index, feeding documents to the per-shard
+    // indexing threads in batches
+    std::vector<index_record> batch;
+    const std::string seq_id_prefix = collection->get_seq_id_collection_prefix();
+    rocksdb::Iterator* iter = store->scan(seq_id_prefix + "_" + StringUtils::serialize_uint32_t(seq_id_watermark));
+
+    while(iter->Valid() && iter->key().starts_with(seq_id_prefix)) {
+        const std::string doc_json_str = iter->value().ToString();
+
+        nlohmann::json document;
+        try {
+            document = nlohmann::json::parse(doc_json_str);
+        } catch(...) {
+            delete iter;
+            delete collection;
+            return Option<bool>(500, std::string("Error while parsing stored document from collection " +
+                                                 this_collection_name + " with key: ") + iter->key().ToString());
         }
 
-        delete iter;
+        Option<uint32_t> seq_id_op = collection->doc_id_to_seq_id(document["id"]);
+        if(!seq_id_op.ok()) {
+            delete iter;
+            delete collection;
+            return Option<bool>(500, std::string("Error while fetching sequence id of document id " +
+                                     document["id"].get<std::string>() + " in collection `" +
+                                     this_collection_name + "`"));
+        }
 
-        add_to_collections(collection);
+        batch.push_back(index_record(seq_id_op.get(), document));
+
+        if(batch.size() == LOAD_BATCH_SIZE) {
+            collection->batch_index_in_memory(batch);
+            batch.clear();
+        }
+
+        iter->Next();
     }
 
+    delete iter;
+
+    if(!batch.empty()) {
+        collection->batch_index_in_memory(batch);
+    }
+
+    add_to_collections(collection);
     return Option<bool>(true);
 }
 
+std::string CollectionManager::get_index_snapshot_path(const uint32_t collection_id) const {
+    return store->get_state_dir_path() + "/" + INDEX_SNAPSHOT_DIR_NAME + "/" +
+           std::to_string(collection_id) + ".snapshot";
+}
+
+void CollectionManager::save_index_snapshots() {
+    const std::string & snapshot_dir = store->get_state_dir_path() + "/" + INDEX_SNAPSHOT_DIR_NAME;
+    mkdir(snapshot_dir.c_str(), 0755);  // no-op when the directory already exists
+
+    for(auto & name_collection: collections) {
+        Collection* collection = name_collection.second;
+        Option<bool> save_op = collection->save_index_snapshot(get_index_snapshot_path(collection->get_collection_id()));
+
+        if(save_op.ok()) {
+            LOG(INFO) << "Saved index snapshot for collection `" << name_collection.first << "`.";
+        } else {
+            LOG(ERR) << "Could not save index snapshot for collection `" << name_collection.first << "`: "
+                     << save_op.error();
+        }
+    }
+}
+
 void CollectionManager::dispose() {
     for(auto & name_collection: collections) {
         delete name_collection.second;
@@ -131,6 +250,11 @@ void CollectionManager::dispose() {
     }
 
     collections.clear();
+
+    std::lock_guard<std::mutex> lock(result_cache_m);
+    result_cache_lru.clear();
+    result_cache_map.clear();
+    result_cache_bytes = 0;
 }
 
 bool CollectionManager::auth_key_matches(std::string auth_key_sent) {
@@ -142,11 +266,17 @@ bool CollectionManager::search_only_auth_key_matches(std::string auth_key_sent)
 }
 
 Option<Collection*> CollectionManager::create_collection(const std::string name, const std::vector<field> & fields,
-                                                         const std::string & default_sorting_field) {
+                                                         const std::string & default_sorting_field,
+                                                         const size_t num_indices) {
     if(store->contains(Collection::get_meta_key(name))) {
         return Option<Collection*>(409, std::string("A collection with name `") + name + "` already exists.");
     }
 
+    if(num_indices < 1 || num_indices > Collection::MAX_NUM_INDICES) {
+        return Option<Collection*>(400, "Shard count must be between 1 and " +
+                                        std::to_string(Collection::MAX_NUM_INDICES) + ".");
+    }
+
     nlohmann::json collection_meta;
 
     nlohmann::json fields_json = nlohmann::json::array();;
@@ -162,8 +292,10 @@ Option<Collection*> CollectionManager::create_collection(const std::string name,
     collection_meta[COLLECTION_ID_KEY] = next_collection_id;
     collection_meta[COLLECTION_SEARCH_FIELDS_KEY] = fields_json;
     collection_meta[COLLECTION_DEFAULT_SORTING_FIELD_KEY] = default_sorting_field;
+    collection_meta[COLLECTION_NUM_INDICES_KEY] = num_indices;
 
-    Collection* new_collection = new Collection(name, next_collection_id, 0, store, fields, default_sorting_field);
+    Collection* new_collection = new Collection(name, next_collection_id, 0, store, fields, default_sorting_field,
+                                                num_indices);
     next_collection_id++;
 
     rocksdb::WriteBatch batch;
@@ -181,6 +313,43 @@ Option<Collection*> CollectionManager::create_collection(const std::string name,
     return Option<Collection*>(new_collection);
 }
 
+Option<bool> CollectionManager::reshard_collection(const std::string & collection_name,
+                                                   const size_t new_num_indices) {
+    Collection* collection = get_collection(collection_name);
+
+    if(collection == nullptr) {
+        return Option<bool>(404, "No collection with name `" + collection_name + "` found.");
+    }
+
+    Option<bool> reshard_op = collection->reshard(new_num_indices);
+    if(!reshard_op.ok()) {
+        return reshard_op;
+    }
+
+    // persist the new shard count, so that a restart rebuilds the same layout
+    std::string collection_meta_json;
+    StoreStatus meta_status = store->get(Collection::get_meta_key(collection_name), collection_meta_json);
+
+    if(meta_status != StoreStatus::FOUND) {
+        return Option<bool>(500, "Could not fetch collection meta from the on-disk storage.");
+    }
+
+    nlohmann::json collection_meta;
+    try {
+        collection_meta = nlohmann::json::parse(collection_meta_json);
+    } catch(...) {
+        return Option<bool>(500, "Error while parsing collection meta.");
+    }
+
+    collection_meta[COLLECTION_NUM_INDICES_KEY] = collection->get_num_indices();
+
+    if(!store->insert(Collection::get_meta_key(collection_name), collection_meta.dump())) {
+        return Option<bool>(500, "Could not write to on-disk storage.");
+    }
+
+    return Option<bool>(true);
+}
+
 Collection* CollectionManager::get_collection(const std::string & collection_name) {
     if(collections.count(collection_name) != 0) {
         return collections.at(collection_name);
@@ -231,6 +400,9 @@ Option<bool> CollectionManager::drop_collection(std::string collection_name, con
 
         store->remove(Collection::get_next_seq_id_key(collection_name));
         store->remove(Collection::get_meta_key(collection_name));
+
+        // also remove any index snapshot, so that a future collection with the same id does not pick it up
+        remove(get_index_snapshot_path(collection->get_collection_id()).c_str());
     }
 
     collections.erase(collection_name);
@@ -250,6 +422,47 @@ void CollectionManager::set_next_collection_id(uint32_t next_id) {
     next_collection_id = next_id;
 }
 
+bool CollectionManager::result_cache_get(const std::string & cache_key, std::string & result_json) {
+    std::lock_guard<std::mutex> lock(result_cache_m);
+
+    const auto & it = result_cache_map.find(cache_key);
+    if(it == result_cache_map.end()) {
+        return false;
+    }
+
+    // bump the entry to the front of the LRU list
+    result_cache_lru.splice(result_cache_lru.begin(), result_cache_lru, it->second);
+
+    result_json = it->second->result_json;
+    return true;
+}
+
+void CollectionManager::result_cache_put(const std::string & cache_key, const std::string & result_json) {
+    const size_t entry_bytes = cache_key.size() + result_json.size() + sizeof(result_cache_entry);
+
+    if(entry_bytes > RESULT_CACHE_BUDGET_BYTES) {
+        return;  // a single entry must never blow the whole budget
+    }
+
+    std::lock_guard<std::mutex> lock(result_cache_m);
+
+    if(result_cache_map.count(cache_key) != 0) {
+        return;  // a concurrent search has already cached this query
+    }
+
+    // evict least recently used entries (stale write generations age out this way too)
+    while(result_cache_bytes + entry_bytes > RESULT_CACHE_BUDGET_BYTES && !result_cache_lru.empty()) {
+        const result_cache_entry & oldest = result_cache_lru.back();
+        result_cache_bytes -= oldest.key.size() + oldest.result_json.size() + sizeof(result_cache_entry);
+        result_cache_map.erase(oldest.key);
+        result_cache_lru.pop_back();
+    }
+
+    result_cache_lru.push_front(result_cache_entry{cache_key, result_json});
+    result_cache_map.emplace(cache_key, result_cache_lru.begin());
+    result_cache_bytes += entry_bytes;
+}
+
 Store* CollectionManager::get_store() {
     return store;
 }
\ No newline at end of file
@@ -1,7 +1,6 @@
 #include "http_data.h"
 #include "http_server.h"
 #include "string_utils.h"
-#include <regex>
 #include <thread>
 #include <signal.h>
 #include <h2o.h>
@@ -25,20 +24,25 @@ struct h2o_custom_generator_t {
     void (*handler)(http_req* req, http_res* res, void* data);
     request_response req_res;
     void* data;
+
+    // set when the client aborted while a producer nudge could still be in flight:
+    // the nudge then performs the deferred teardown instead of resuming the stream
+    bool aborted;
 };
 
 HttpServer::HttpServer(std::string listen_address, uint32_t listen_port, std::string ssl_cert_path,
-                       std::string ssl_cert_key_path, bool cors_enabled):
-                       listen_address(listen_address), listen_port(listen_port), ssl_cert_path(ssl_cert_path),
-                       ssl_cert_key_path(ssl_cert_key_path), cors_enabled(cors_enabled) {
-    accept_ctx = new h2o_accept_ctx_t();
+                       std::string ssl_cert_key_path, bool cors_enabled, size_t num_threads):
+                       ssl_ctx(nullptr), exit_loop(false), listen_address(listen_address),
+                       listen_port(listen_port), num_threads(std::max((size_t) 1, num_threads)),
+                       ssl_cert_path(ssl_cert_path), ssl_cert_key_path(ssl_cert_key_path),
+                       cors_enabled(cors_enabled) {
     h2o_config_init(&config);
     hostconf = h2o_config_register_host(&config, h2o_iovec_init(H2O_STRLIT("default")), 65535);
     register_handler(hostconf, "/", catch_all_handler);
 }
 
 void HttpServer::on_accept(h2o_socket_t *listener, const char *err) {
-    HttpServer* http_server = reinterpret_cast<HttpServer*>(listener->data);
+    evloop_worker* worker = reinterpret_cast<evloop_worker*>(listener->data);
     h2o_socket_t *sock;
 
     if (err != NULL) {
@@ -49,18 +53,18 @@ void HttpServer::on_accept(h2o_socket_t *listener, const char *err) {
         return;
     }
 
-    h2o_accept(http_server->accept_ctx, sock);
+    h2o_accept(&worker->accept_ctx, sock);
 }
 
 int HttpServer::setup_ssl(const char *cert_file, const char *key_file) {
     SSL_load_error_strings();
     SSL_library_init();
 
-    accept_ctx->ssl_ctx = SSL_CTX_new(SSLv23_server_method());
+    ssl_ctx = SSL_CTX_new(SSLv23_server_method());
 
     // As recommended by:
     // https://github.com/ssllabs/research/wiki/SSL-and-TLS-Deployment-Best-Practices#23-use-secure-cipher-suites
-    SSL_CTX_set_cipher_list(accept_ctx->ssl_ctx, "ECDHE-ECDSA-AES128-GCM-SHA256:ECDHE-ECDSA-AES256-GCM-SHA384:"
+    SSL_CTX_set_cipher_list(ssl_ctx, "ECDHE-ECDSA-AES128-GCM-SHA256:ECDHE-ECDSA-AES256-GCM-SHA384:"
             "ECDHE-ECDSA-AES128-SHA:ECDHE-ECDSA-AES256-SHA:ECDHE-ECDSA-AES128-SHA256:ECDHE-ECDSA-AES256-SHA384:"
             "ECDHE-RSA-AES128-GCM-SHA256:ECDHE-RSA-AES256-GCM-SHA384:ECDHE-RSA-AES128-SHA:ECDHE-RSA-AES256-SHA:"
             "ECDHE-RSA-AES128-SHA256:ECDHE-RSA-AES256-SHA384:DHE-RSA-AES128-GCM-SHA256:DHE-RSA-AES256-GCM-SHA384:"
@@ -74,82 +78,116 @@ int HttpServer::setup_ssl(const char *cert_file, const char *key_file) {
         return -1;
     }
 
-    SSL_CTX_set_tmp_ecdh(accept_ctx->ssl_ctx, key);
+    SSL_CTX_set_tmp_ecdh(ssl_ctx, key);
     EC_KEY_free(key);
 
-    SSL_CTX_set_options(accept_ctx->ssl_ctx, SSL_OP_NO_SSLv2);
-    SSL_CTX_set_options(accept_ctx->ssl_ctx, SSL_OP_NO_SSLv3);
-    SSL_CTX_set_options(accept_ctx->ssl_ctx, SSL_OP_SINGLE_ECDH_USE);
+    SSL_CTX_set_options(ssl_ctx, SSL_OP_NO_SSLv2);
+    SSL_CTX_set_options(ssl_ctx, SSL_OP_NO_SSLv3);
+    SSL_CTX_set_options(ssl_ctx, SSL_OP_SINGLE_ECDH_USE);
 
-    if (SSL_CTX_use_certificate_chain_file(accept_ctx->ssl_ctx, cert_file) != 1) {
+    if (SSL_CTX_use_certificate_chain_file(ssl_ctx, cert_file) != 1) {
         LOG(ERR) << "An error occurred while trying to load server certificate file:" << cert_file;
         return -1;
     }
-    if (SSL_CTX_use_PrivateKey_file(accept_ctx->ssl_ctx, key_file, SSL_FILETYPE_PEM) != 1) {
+    if (SSL_CTX_use_PrivateKey_file(ssl_ctx, key_file, SSL_FILETYPE_PEM) != 1) {
         LOG(ERR) << "An error occurred while trying to load private key file: " << key_file;
         return -1;
     }
 
-    h2o_ssl_register_alpn_protocols(accept_ctx->ssl_ctx, h2o_http2_alpn_protocols);
+    h2o_ssl_register_alpn_protocols(ssl_ctx, h2o_http2_alpn_protocols);
     return 0;
 }
 
-int HttpServer::create_listener(void) {
+int HttpServer::create_listener(evloop_worker* worker) {
     struct sockaddr_in addr;
-    int fd, reuseaddr_flag = 1;
-
-    if(!ssl_cert_path.empty() && !ssl_cert_key_path.empty()) {
-        int ssl_setup_code = setup_ssl(ssl_cert_path.c_str(), ssl_cert_key_path.c_str());
-        if(ssl_setup_code != 0) {
-            return -1;
-        }
-    }
+    int fd, flag = 1;
 
-    ctx.globalconf->server_name = h2o_strdup(NULL, "", SIZE_MAX);
-
-    accept_ctx->ctx = &ctx;
-    accept_ctx->hosts = config.hosts;
+    worker->accept_ctx.ctx = &worker->ctx;
+    worker->accept_ctx.hosts = config.hosts;
+    worker->accept_ctx.ssl_ctx = ssl_ctx;
 
     memset(&addr, 0, sizeof(addr));
     addr.sin_family = AF_INET;
     addr.sin_port = htons(listen_port);
     inet_pton(AF_INET, listen_address.c_str(), &(addr.sin_addr));
 
+    // every worker binds its own listener: SO_REUSEPORT makes the kernel spread
+    // incoming connections across the loops
     if ((fd = socket(AF_INET, SOCK_STREAM, 0)) == -1 ||
-        setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &reuseaddr_flag, sizeof(reuseaddr_flag)) != 0 ||
+        setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &flag, sizeof(flag)) != 0 ||
+        setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &flag, sizeof(flag)) != 0 ||
         bind(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0 ||
         listen(fd, SOMAXCONN) != 0) {
         return -1;
     }
 
-    listener_socket = h2o_evloop_socket_create(ctx.loop, fd, H2O_SOCKET_FLAG_DONT_READ);
-    listener_socket->data = this;
-    h2o_socket_read_start(listener_socket, on_accept);
+    worker->listener_socket = h2o_evloop_socket_create(worker->ctx.loop, fd, H2O_SOCKET_FLAG_DONT_READ);
+    worker->listener_socket->data = worker;
+    h2o_socket_read_start(worker->listener_socket, on_accept);
 
     return 0;
 }
 
 int HttpServer::run() {
     signal(SIGPIPE, SIG_IGN);
-    h2o_context_init(&ctx, h2o_evloop_create(), &config);
 
-    message_queue = h2o_multithread_create_queue(ctx.loop);
-    message_receiver = new h2o_multithread_receiver_t();
-    h2o_multithread_register_receiver(message_queue, message_receiver, on_message);
+    if(!ssl_cert_path.empty() && !ssl_cert_key_path.empty()) {
+        int ssl_setup_code = setup_ssl(ssl_cert_path.c_str(), ssl_cert_key_path.c_str());
+        if(ssl_setup_code != 0) {
+            return 1;
+        }
+    }
+
+    config.server_name = h2o_strdup(NULL, "", SIZE_MAX);
+
+    on(STOP_SERVER_MESSAGE, HttpServer::on_stop_server);
+    on(STREAM_PROCEED_MSG, HttpServer::on_stream_proceed);
+
+    for(size_t i = 0; i < num_threads; i++) {
+        loop_workers.push_back(new evloop_worker());
+    }
+
+    // secondary loops run on their own threads - the primary loop runs on the caller's thread
+    for(size_t i = 1; i < loop_workers.size(); i++) {
+        evloop_worker* worker = loop_workers[i];
+        loop_threads.emplace_back([this, worker]() {
+            run_worker(worker, false);
+        });
+    }
+
+    int status = run_worker(loop_workers[0], true);
+
+    for(std::thread & loop_thread: loop_threads) {
+        loop_thread.join();
+    }
+
+    return status;
+}
+
+int HttpServer::run_worker(evloop_worker* worker, bool is_primary) {
+    h2o_context_init(&worker->ctx, h2o_evloop_create(), &config);
 
-    if (create_listener() != 0) {
+    worker->message_queue = h2o_multithread_create_queue(worker->ctx.loop);
+    worker->message_receiver = new h2o_multithread_receiver_t();
+    h2o_multithread_register_receiver(worker->message_queue, worker->message_receiver, on_message);
+
+    if (create_listener(worker) != 0) {
         LOG(ERR) << "Failed to listen on " << listen_address << ":" << listen_port << " - " << strerror(errno);
+        exit_loop = true;
         return 1;
-    } else {
+    } else if(is_primary) {
         LOG(INFO) << "Typesense has started. Ready to accept requests on port " << listen_port;
     }
 
-    on(STOP_SERVER_MESSAGE, HttpServer::on_stop_server);
-
     while(!exit_loop) {
-        h2o_evloop_run(ctx.loop, INT32_MAX);
+        h2o_evloop_run(worker->ctx.loop, INT32_MAX);
     }
 
+    // the loop was woken up by the stop message, so the worker winds down its own listener
+    h2o_socket_read_stop(worker->listener_socket);
+    h2o_socket_close(worker->listener_socket);
+    worker->listener_socket = nullptr;
+
     return 0;
 }
 
@@ -157,7 +195,7 @@ void HttpServer::on_stop_server(void *data) {
     // do nothing
 }
 
-void HttpServer::clear_timeouts(const std::vector<h2o_timeout_t*> & timeouts) {
+void HttpServer::clear_timeouts(h2o_context_t & ctx, const std::vector<h2o_timeout_t*> & timeouts) {
     for(h2o_timeout_t* timeout: timeouts) {
         while (!h2o_linklist_is_empty(&timeout->_entries)) {
             h2o_timeout_entry_t *entry = H2O_STRUCT_FROM_MEMBER(h2o_timeout_entry_t, _link, timeout->_entries.next);
@@ -170,14 +208,13 @@ void HttpServer::clear_timeouts(const std::vector<h2o_timeout_t*> & timeouts) {
 }
 
 void HttpServer::stop() {
-    h2o_socket_read_stop(listener_socket);
-    h2o_socket_close(listener_socket);
-
-    // this will break the event loop
+    // this will break the event loops
     exit_loop = true;
 
-    // send a message to activate the idle event loop to exit, just in case
-    send_message(STOP_SERVER_MESSAGE, nullptr);
+    // wake every loop so each worker can observe the flag and wind down its own listener
+    for(evloop_worker* worker: loop_workers) {
+        send_message(STOP_SERVER_MESSAGE, nullptr, worker->message_receiver);
+    }
 }
 
 void HttpServer::on_message(h2o_multithread_receiver_t *receiver, h2o_linklist_t *messages) {
@@ -203,9 +240,12 @@ h2o_pathconf_t* HttpServer::register_handler(h2o_hostconf_t *hostconf, const cha
     handler->http_server = this;
     handler->super.on_req = on_req;
 
-    compress_args.min_size = 256;       // don't gzip less than this size
-    compress_args.brotli.quality = -1;  // disable, not widely supported
-    compress_args.gzip.quality = 1;     // fastest
+    // The compressor is a response filter, so it also compresses streamed responses chunk by
+    // chunk as they pass through. It only kicks in for content types h2o marks as compressible
+    // (text/*, application/json, ...), so handlers must set their content type accordingly.
+    compress_args.min_size = 256;      // responses smaller than this are not worth the CPU
+    compress_args.brotli.quality = 4;  // ~gzip-6 density at a fraction of the cost, for clients that send `br`
+    compress_args.gzip.quality = 1;    // fastest
     h2o_compress_register(pathconf, &compress_args);
 
     return pathconf;
@@ -228,15 +268,45 @@ const char* HttpServer::get_status_reason(uint32_t status_code) {
 
 std::map<std::string, std::string> HttpServer::parse_query(const std::string& query) {
     std::map<std::string, std::string> query_map;
-    std::regex pattern("([\\w+%-]+)=([^&]*)");
 
-    auto words_begin = std::sregex_iterator(query.begin(), query.end(), pattern);
-    auto words_end = std::sregex_iterator();
+    const size_t query_len = query.size();
+    size_t i = (query_len != 0 && query[0] == '?') ? 1 : 0;  // skip the leading `?`
+
+    while(i < query_len) {
+        // key runs up to the next `=`
+        size_t key_start = i;
+        while(i < query_len && query[i] != '=' && query[i] != '&') {
+            i++;
+        }
+
+        if(i == query_len || query[i] == '&') {
+            // a fragment without `=` carries no value
+            if(i < query_len) {
+                i++;
+            }
+            continue;
+        }
+
+        const size_t key_end = i;
+        i++;  // skip `=`
+
+        const size_t value_start = i;
+        while(i < query_len && query[i] != '&') {
+            i++;
+        }
+
+        const size_t value_end = i;
+        if(i < query_len) {
+            i++;  // skip `&`
+        }
+
+        if(key_end == key_start) {
+            continue;
+        }
+
+        std::string key = query.substr(key_start, key_end - key_start);
+        std::string value = StringUtils::url_decode(query.substr(value_start, value_end - value_start));
 
-    for (std::sregex_iterator i = words_begin; i != words_end; i++) {
-        std::string key = (*i)[1].str();
-        std::string raw_value = (*i)[2].str();
-        std::string value = StringUtils::url_decode(raw_value);
         if(query_map.count(key) == 0) {
             query_map[key] = value;
         } else {
@@ -251,14 +321,29 @@ int HttpServer::catch_all_handler(h2o_handler_t *_self, h2o_req_t *req) {
     h2o_custom_req_handler_t *self = (h2o_custom_req_handler_t *)_self;
 
     const std::string & http_method = std::string(req->method.base, req->method.len);
-    const std::string & path = std::string(req->path.base, req->path.len);
 
-    std::vector<std::string> path_with_query_parts;
-    StringUtils::split(path, path_with_query_parts, "?");
-    const std::string & path_without_query = path_with_query_parts[0];
+    // slice the raw path into (pointer, length) segments - route matching allocates nothing.
+    // the method leads the segment list, mirroring how routes are compiled into the trie
+    const char* path_base = req->path.base;
+    const size_t path_len = (req->query_at != SIZE_MAX) ? req->query_at : req->path.len;
 
-    std::vector<std::string> path_parts;
-    StringUtils::split(path_without_query, path_parts, "/");
+    std::vector<std::pair<const char*, size_t>> path_segments;
+    path_segments.push_back(std::make_pair(req->method.base, req->method.len));
+
+    size_t path_pos = 0;
+    while(path_pos < path_len) {
+        if(path_base[path_pos] == '/') {
+            path_pos++;
+            continue;
+        }
+
+        size_t segment_start = path_pos;
+        while(path_pos < path_len && path_base[path_pos] != '/') {
+            path_pos++;
+        }
+
+        path_segments.push_back(std::make_pair(path_base + segment_start, path_pos - segment_start));
+    }
 
     h2o_iovec_t query = req->query_at != SIZE_MAX ?
                         h2o_iovec_init(req->path.base + req->query_at, req->path.len - req->query_at) :
@@ -315,51 +400,39 @@ int HttpServer::catch_all_handler(h2o_handler_t *_self, h2o_req_t *req) {
         }
     }
 
-    for(const route_path & rpath: self->http_server->routes) {
-        if(rpath.path_parts.size() != path_parts.size() || rpath.http_method != http_method) {
-            continue;
-        }
+    const int route_index = self->http_server->routes_trie.find(path_segments);
 
-        bool found = true;
+    if(route_index != -1) {
+        const route_path & rpath = self->http_server->routes[route_index];
 
-        for(size_t i = 0; i < rpath.path_parts.size(); i++) {
-            const std::string & rpart = rpath.path_parts[i];
-            const std::string & given_part = path_parts[i];
-            if(rpart != given_part && rpart[0] != ':') {
-                found = false;
-                goto check_next_route;
-            }
+        bool authenticated = self->http_server->auth_handler(rpath, auth_key_from_header);
+        if(!authenticated) {
+            return send_401_unauthorized(req);
         }
 
-        check_next_route:
-
-        if(found) {
-            bool authenticated = self->http_server->auth_handler(rpath, auth_key_from_header);
-            if(!authenticated) {
-                return send_401_unauthorized(req);
-            }
-
-            // routes match and is an authenticated request - iterate and extract path params
-            for(size_t i = 0; i < rpath.path_parts.size(); i++) {
-                const std::string & path_part = rpath.path_parts[i];
-                if(path_part[0] == ':') {
-                    query_map.emplace(path_part.substr(1), path_parts[i]);
-                }
+        // route matches and is an authenticated request - iterate and extract path params
+        // (the trie guarantees that the segment count lines up with the route's parts)
+        for(size_t i = 0; i < rpath.path_parts.size(); i++) {
+            const std::string & path_part = rpath.path_parts[i];
+            if(path_part[0] == ':') {
+                query_map.emplace(path_part.substr(1),
+                                  std::string(path_segments[i+1].first, path_segments[i+1].second));
             }
+        }
 
-            http_req* request = new http_req{req, query_map, req_body};
-            http_res* response = new http_res();
-            response->server = self->http_server;
-            (rpath.handler)(*request, *response);
-
-            if(!rpath.async) {
-                // If a handler is marked async, it's assumed that it's responsible for sending the response itself
-                // later in an async fashion by calling into the main http thread via a message
-                self->http_server->send_response(request, response);
-            }
+        http_req* request = new http_req{req, self->http_server->get_receiver(req->conn->ctx),
+                                         query_map, req_body};
+        http_res* response = new http_res();
+        response->server = self->http_server;
+        (rpath.handler)(*request, *response);
 
-            return 0;
+        if(!rpath.async) {
+            // If a handler is marked async, it's assumed that it's responsible for sending the response itself
+            // later in an async fashion by calling into the main http thread via a message
+            self->http_server->send_response(request, response);
         }
+
+        return 0;
     }
 
     h2o_generator_t generator = {NULL, NULL};
@@ -373,9 +446,33 @@ int HttpServer::catch_all_handler(h2o_handler_t *_self, h2o_req_t *req) {
     return 0;
 }
 
-void HttpServer::send_message(const std::string & type, void* data) {
+void HttpServer::send_message(const std::string & type, void* data, h2o_multithread_receiver_t* receiver) {
+    if(loop_workers.empty()) {
+        // server has not started yet
+        return ;
+    }
+
+    if(receiver == nullptr) {
+        // server-wide messages (replication events, shutdown) are handled on the primary loop
+        receiver = loop_workers[0]->message_receiver;
+    }
+
+    send_message_to(receiver, type, data);
+}
+
+void HttpServer::send_message_to(h2o_multithread_receiver_t* receiver, const std::string & type, void* data) {
     h2o_custom_res_message_t* message = new h2o_custom_res_message_t{{{NULL, NULL}}, this, type.c_str(), data};
-    h2o_multithread_send_message(message_receiver, &message->super);
+    h2o_multithread_send_message(receiver, &message->super);
+}
+
+h2o_multithread_receiver_t* HttpServer::get_receiver(h2o_context_t* ctx) {
+    for(evloop_worker* worker: loop_workers) {
+        if(&worker->ctx == ctx) {
+            return worker->message_receiver;
+        }
+    }
+
+    return loop_workers[0]->message_receiver;
 }
 
 void HttpServer::send_response(http_req* request, const http_res* response) {
@@ -398,6 +495,11 @@ void HttpServer::response_proceed(h2o_generator_t *generator, h2o_req_t *req) {
     custom_generator->handler(custom_generator->req_res.req, custom_generator->req_res.response,
                               custom_generator->data);
 
+    if(custom_generator->req_res.response->paused) {
+        // the handler has no data yet - its producer will nudge the stream via STREAM_PROCEED_MSG
+        return ;
+    }
+
     h2o_iovec_t body = h2o_strdup(&req->pool, custom_generator->req_res.response->body.c_str(), SIZE_MAX);
     const h2o_send_state_t state = custom_generator->req_res.response->final ?
                                    H2O_SEND_STATE_FINAL : H2O_SEND_STATE_IN_PROGRESS;
@@ -414,19 +516,50 @@ void HttpServer::response_proceed(h2o_generator_t *generator, h2o_req_t *req) {
 void HttpServer::response_stop(h2o_generator_t *generator, h2o_req_t *req) {
     h2o_custom_generator_t* custom_generator = reinterpret_cast<h2o_custom_generator_t*>(generator);
 
+    // let the chunk handler release its streaming state: `final` being set before the
+    // call marks an abort rather than a request for the next chunk
+    custom_generator->req_res.response->final = true;
+    custom_generator->handler(custom_generator->req_res.req, custom_generator->req_res.response,
+                              custom_generator->data);
+
     h2o_dispose_request(req);
+
+    if(custom_generator->req_res.response->paused) {
+        // a producer nudge may still be in flight for this paused stream - defer the
+        // teardown to the nudge so it never dereferences freed memory
+        custom_generator->aborted = true;
+        return ;
+    }
+
     delete custom_generator->req_res.req;
     delete custom_generator->req_res.response;
     delete custom_generator;
 }
 
+void HttpServer::on_stream_proceed(void *data) {
+    h2o_custom_generator_t* custom_generator = reinterpret_cast<h2o_custom_generator_t*>(data);
+
+    if(custom_generator->aborted) {
+        delete custom_generator->req_res.req;
+        delete custom_generator->req_res.response;
+        delete custom_generator;
+        return ;
+    }
+
+    custom_generator->req_res.response->paused = false;
+    response_proceed(&custom_generator->super, custom_generator->req_res.req->_req);
+}
+
 void HttpServer::stream_response(void (*handler)(http_req* req, http_res* res, void* data),
                                  http_req & request, http_res & response, void* data) {
     h2o_req_t* req = request._req;
     h2o_custom_generator_t* custom_generator = new h2o_custom_generator_t {
-        h2o_generator_t {response_proceed, response_stop}, handler, request_response {&request, &response}, data
+        h2o_generator_t {response_proceed, response_stop}, handler, request_response {&request, &response}, data, false
     };
 
+    response.final = false;
+    response.generator = (void *) custom_generator;
+
     req->res.status = response.status_code;
     req->res.reason = get_status_reason(response.status_code);
     h2o_add_header(&req->pool, &req->res.headers, H2O_TOKEN_CONTENT_TYPE, NULL, response.content_type_header.c_str(),
@@ -459,6 +592,7 @@ void HttpServer::get(const std::string & path, void (*handler)(http_req &, http_
     StringUtils::split(path, path_parts, "/");
     route_path rpath = {"GET", path_parts, handler, async};
     routes.push_back(rpath);
+    routes_trie.add("GET", path_parts, routes.size() - 1);
 }
 
 void HttpServer::post(const std::string & path, void (*handler)(http_req &, http_res &), bool async) {
@@ -466,6 +600,7 @@ void HttpServer::post(const std::string & path, void (*handler)(http_req &, http
     StringUtils::split(path, path_parts, "/");
     route_path rpath = {"POST", path_parts, handler, async};
     routes.push_back(rpath);
+    routes_trie.add("POST", path_parts, routes.size() - 1);
 }
 
 void HttpServer::put(const std::string & path, void (*handler)(http_req &, http_res &), bool async) {
@@ -473,6 +608,7 @@ void HttpServer::put(const std::string & path, void (*handler)(http_req &, http_
     StringUtils::split(path, path_parts, "/");
     route_path rpath = {"PUT", path_parts, handler, async};
     routes.push_back(rpath);
+    routes_trie.add("PUT", path_parts, routes.size() - 1);
 }
 
 void HttpServer::del(const std::string & path, void (*handler)(http_req &, http_res &), bool async) {
@@ -480,6 +616,15 @@ void HttpServer::del(const std::string & path, void (*handler)(http_req &, http_
     StringUtils::split(path, path_parts, "/");
     route_path rpath = {"DELETE", path_parts, handler, async};
     routes.push_back(rpath);
+    routes_trie.add("DELETE", path_parts, routes.size() - 1);
+}
+
+void HttpServer::patch(const std::string & path, void (*handler)(http_req &, http_res &), bool async) {
+    std::vector<std::string> path_parts;
+    StringUtils::split(path, path_parts, "/");
+    route_path rpath = {"PATCH", path_parts, handler, async};
+    routes.push_back(rpath);
+    routes_trie.add("PATCH", path_parts, routes.size() - 1);
 }
 
 void HttpServer::on(const std::string & message, void (*handler)(void*)) {
@@ -487,35 +632,41 @@ void HttpServer::on(const std::string & message, void (*handler)(void*)) {
 }
 
 HttpServer::~HttpServer() {
-    // drain all existing messages
-    on_message(message_receiver, &message_receiver->_messages);
-
-    h2o_multithread_unregister_receiver(message_queue, message_receiver);
-    h2o_multithread_destroy_queue(message_queue);
-    free(message_queue);
-    delete message_receiver;
-
-    // remove all timeouts defined in: https://github.com/h2o/h2o/blob/v2.2.2/lib/core/context.c#L142
-    std::vector<h2o_timeout_t*> timeouts = {
-        &ctx.zero_timeout,
-        &ctx.one_sec_timeout,
-        &ctx.hundred_ms_timeout,
-        &ctx.handshake_timeout,
-        &ctx.http1.req_timeout,
-        &ctx.http2.idle_timeout,
-        &ctx.http2.graceful_shutdown_timeout,
-        &ctx.proxy.io_timeout
-    };
-
-    clear_timeouts(timeouts);
-    clear_timeouts({&ctx.zero_timeout});  // needed to clear a deferred timeout that crops up
+    for(evloop_worker* worker: loop_workers) {
+        // drain all existing messages
+        on_message(worker->message_receiver, &worker->message_receiver->_messages);
+
+        h2o_multithread_unregister_receiver(worker->message_queue, worker->message_receiver);
+        h2o_multithread_destroy_queue(worker->message_queue);
+        free(worker->message_queue);
+        delete worker->message_receiver;
+
+        // remove all timeouts defined in: https://github.com/h2o/h2o/blob/v2.2.2/lib/core/context.c#L142
+        std::vector<h2o_timeout_t*> timeouts = {
+            &worker->ctx.zero_timeout,
+            &worker->ctx.one_sec_timeout,
+            &worker->ctx.hundred_ms_timeout,
+            &worker->ctx.handshake_timeout,
+            &worker->ctx.http1.req_timeout,
+            &worker->ctx.http2.idle_timeout,
+            &worker->ctx.http2.graceful_shutdown_timeout,
+            &worker->ctx.proxy.io_timeout
+        };
+
+        clear_timeouts(worker->ctx, timeouts);
+        clear_timeouts(worker->ctx, {&worker->ctx.zero_timeout});  // needed to clear a deferred timeout that crops up
+
+        h2o_context_dispose(&worker->ctx);
+        free(worker->ctx.queue);
+        h2o_evloop_destroy(worker->ctx.loop);
+
+        delete worker;
+    }
 
-    h2o_context_dispose(&ctx);
-    free(ctx.globalconf->server_name.base);
-    free(ctx.queue);
-    h2o_evloop_destroy(ctx.loop);
+    free(config.server_name.base);
     h2o_config_dispose(&config);
 
-    SSL_CTX_free(accept_ctx->ssl_ctx);
-    delete accept_ctx;
+    if(ssl_ctx != nullptr) {
+        SSL_CTX_free(ssl_ctx);
+    }
 }
\ No newline at end of file
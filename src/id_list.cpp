@@ -0,0 +1,371 @@
+#include "id_list.h"
+#include "array_utils.h"
+#include <algorithm>
+
+id_list::id_list(): sarr(new sorted_array), bits(nullptr), num_words(0),
+                    bitmap_length(0), bitmap_min(0), bitmap_max(0) {
+
+}
+
+id_list::~id_list() {
+    delete sarr;
+    delete[] bits;
+}
+
+bool id_list::is_dense() const {
+    return bits != nullptr;
+}
+
+uint32_t id_list::getLength() const {
+    return is_dense() ? bitmap_length : sarr->getLength();
+}
+
+uint32_t id_list::getMin() const {
+    return is_dense() ? bitmap_min : sarr->getMin();
+}
+
+uint32_t id_list::getMax() const {
+    return is_dense() ? bitmap_max : sarr->getMax();
+}
+
+void id_list::ensure_word_capacity(uint32_t word_index) {
+    if(word_index < num_words) {
+        return;
+    }
+
+    uint32_t new_num_words = std::max(word_index + 1, num_words * 2);
+    uint64_t* new_bits = new uint64_t[new_num_words];
+    memset(new_bits, 0, new_num_words * sizeof(uint64_t));
+
+    if(bits != nullptr) {
+        memcpy(new_bits, bits, num_words * sizeof(uint64_t));
+        delete[] bits;
+    }
+
+    bits = new_bits;
+    num_words = new_num_words;
+}
+
+void id_list::promote() {
+    uint32_t* ids = sarr->uncompress();
+    const uint32_t ids_length = sarr->getLength();
+
+    bitmap_min = sarr->getMin();
+    bitmap_max = sarr->getMax();
+    bitmap_length = ids_length;
+
+    ensure_word_capacity(bitmap_max >> 6);
+
+    for(uint32_t i = 0; i < ids_length; i++) {
+        bits[ids[i] >> 6] |= (1ULL << (ids[i] & 63));
+    }
+
+    delete[] ids;
+    delete sarr;
+    sarr = nullptr;
+}
+
+bool id_list::append(uint32_t value) {
+    if(!is_dense()) {
+        if(!sarr->append(value)) {
+            return false;
+        }
+
+        // promote to a bitmap once the token is both large and dense enough
+        const uint32_t range = sarr->getMax() - sarr->getMin() + 1;
+        if(sarr->getLength() >= DENSE_MIN_LENGTH && sarr->getLength() >= range / DENSE_DIVISOR) {
+            promote();
+        }
+
+        return true;
+    }
+
+    ensure_word_capacity(value >> 6);
+
+    uint64_t & word = bits[value >> 6];
+    const uint64_t mask = (1ULL << (value & 63));
+
+    if((word & mask) == 0) {
+        word |= mask;
+        bitmap_length++;
+        if(bitmap_length == 1 || value < bitmap_min) bitmap_min = value;
+        if(value > bitmap_max) bitmap_max = value;
+    }
+
+    return true;
+}
+
+bool id_list::contains(uint32_t value) const {
+    if(!is_dense()) {
+        return sarr->contains(value);
+    }
+
+    if((value >> 6) >= num_words) {
+        return false;
+    }
+
+    return (bits[value >> 6] >> (value & 63)) & 1;
+}
+
+uint32_t id_list::at(uint32_t index) const {
+    if(!is_dense()) {
+        return sarr->at(index);
+    }
+
+    uint32_t count = 0;
+    for(uint32_t i = 0; i < num_words; i++) {
+        const uint32_t word_count = __builtin_popcountll(bits[i]);
+        if(count + word_count > index) {
+            uint64_t word = bits[i];
+            for(uint32_t skipped = index - count; skipped != 0; skipped--) {
+                word &= word - 1;  // clear lowest set bit
+            }
+            return (i << 6) + __builtin_ctzll(word);
+        }
+        count += word_count;
+    }
+
+    return 0;  // out of bounds, like reading past a sorted_array
+}
+
+uint32_t id_list::rank(uint32_t value) const {
+    const uint32_t word_index = (value >> 6);
+    uint32_t count = 0;
+
+    for(uint32_t i = 0; i < word_index && i < num_words; i++) {
+        count += __builtin_popcountll(bits[i]);
+    }
+
+    if(word_index < num_words) {
+        count += __builtin_popcountll(bits[word_index] & ((1ULL << (value & 63)) - 1));
+    }
+
+    return count;
+}
+
+uint32_t id_list::indexOf(uint32_t value) const {
+    if(!is_dense()) {
+        return sarr->indexOf(value);
+    }
+
+    return contains(value) ? rank(value) : bitmap_length;
+}
+
+void id_list::indexOf(const uint32_t *values, const size_t values_len, uint32_t* indices) const {
+    if(!is_dense()) {
+        sarr->indexOf(values, values_len, indices);
+        return;
+    }
+
+    // values are sorted, so the bitmap can be ranked in one incremental pass
+    uint32_t word_index = 0;
+    uint32_t count = 0;
+
+    for(size_t i = 0; i < values_len; i++) {
+        const uint32_t target_word = (values[i] >> 6);
+
+        if(target_word >= num_words) {
+            indices[i] = bitmap_length;
+            continue;
+        }
+
+        while(word_index < target_word) {
+            count += __builtin_popcountll(bits[word_index]);
+            word_index++;
+        }
+
+        const uint64_t mask = (1ULL << (values[i] & 63));
+        if(bits[target_word] & mask) {
+            indices[i] = count + __builtin_popcountll(bits[target_word] & (mask - 1));
+        } else {
+            indices[i] = bitmap_length;
+        }
+    }
+}
+
+uint32_t* id_list::uncompress() const {
+    if(!is_dense()) {
+        return sarr->uncompress();
+    }
+
+    uint32_t* out = new uint32_t[bitmap_length];
+    uint32_t out_index = 0;
+
+    for(uint32_t i = 0; i < num_words; i++) {
+        uint64_t word = bits[i];
+        while(word != 0) {
+            out[out_index++] = (i << 6) + __builtin_ctzll(word);
+            word &= word - 1;
+        }
+    }
+
+    return out;
+}
+
+size_t id_list::memory_usage() const {
+    if(!is_dense()) {
+        return sizeof(sorted_array) + sarr->getSizeInBytes();
+    }
+
+    return num_words * sizeof(uint64_t);
+}
+
+void id_list::remove_values(uint32_t *sorted_values, uint32_t values_length) {
+    if(!is_dense()) {
+        sarr->remove_values(sorted_values, values_length);
+        return;
+    }
+
+    for(uint32_t i = 0; i < values_length; i++) {
+        const uint32_t value = sorted_values[i];
+        if((value >> 6) >= num_words) {
+            continue;
+        }
+
+        uint64_t & word = bits[value >> 6];
+        const uint64_t mask = (1ULL << (value & 63));
+
+        if(word & mask) {
+            word &= ~mask;
+            bitmap_length--;
+        }
+    }
+}
+
+size_t id_list::intersect(const uint32_t *sorted_ids, const size_t ids_len, uint32_t **results_out) const {
+    if(!is_dense()) {
+        uint32_t* ids = sarr->uncompress();
+        size_t results_len = ArrayUtils::intersect(ids, sarr->getLength(), sorted_ids, ids_len, results_out);
+        delete[] ids;
+        return results_len;
+    }
+
+    // probe the bitmap instead of materializing millions of IDs
+    uint32_t* results = new uint32_t[ids_len];
+    size_t results_len = 0;
+
+    for(size_t i = 0; i < ids_len; i++) {
+        if(contains(sorted_ids[i])) {
+            results[results_len++] = sorted_ids[i];
+        }
+    }
+
+    *results_out = results;
+    return results_len;
+}
+
+size_t id_list::intersect(const id_list & a, const id_list & b, uint32_t **results_out) {
+    if(a.is_dense() && b.is_dense()) {
+        // word-wise AND over the common prefix of the two bitmaps
+        const uint32_t common_words = std::min(a.num_words, b.num_words);
+        uint32_t* results = new uint32_t[std::min(a.bitmap_length, b.bitmap_length)];
+        size_t results_len = 0;
+
+        for(uint32_t i = 0; i < common_words; i++) {
+            uint64_t word = a.bits[i] & b.bits[i];
+            while(word != 0) {
+                results[results_len++] = (i << 6) + __builtin_ctzll(word);
+                word &= word - 1;
+            }
+        }
+
+        *results_out = results;
+        return results_len;
+    }
+
+    if(a.is_dense() || b.is_dense()) {
+        // probe the sparse side against the bitmap
+        const id_list & sparse = a.is_dense() ? b : a;
+        const id_list & dense = a.is_dense() ? a : b;
+
+        uint32_t* ids = sparse.uncompress();
+        size_t results_len = dense.intersect(ids, sparse.getLength(), results_out);
+        delete[] ids;
+        return results_len;
+    }
+
+    uint32_t* a_ids = a.uncompress();
+    uint32_t* b_ids = b.uncompress();
+    size_t results_len = ArrayUtils::intersect(a_ids, a.getLength(), b_ids, b.getLength(), results_out);
+    delete[] a_ids;
+    delete[] b_ids;
+    return results_len;
+}
+
+size_t id_list::do_union(const id_list & a, const id_list & b, uint32_t **results_out) {
+    if(a.is_dense() && b.is_dense()) {
+        const uint32_t max_words = std::max(a.num_words, b.num_words);
+        uint32_t* results = new uint32_t[a.bitmap_length + b.bitmap_length];
+        size_t results_len = 0;
+
+        for(uint32_t i = 0; i < max_words; i++) {
+            uint64_t word = (i < a.num_words ? a.bits[i] : 0) | (i < b.num_words ? b.bits[i] : 0);
+            while(word != 0) {
+                results[results_len++] = (i << 6) + __builtin_ctzll(word);
+                word &= word - 1;
+            }
+        }
+
+        *results_out = results;
+        return results_len;
+    }
+
+    uint32_t* a_ids = a.uncompress();
+    uint32_t* b_ids = b.uncompress();
+    size_t results_len = ArrayUtils::or_scalar(a_ids, a.getLength(), b_ids, b.getLength(), results_out);
+    delete[] a_ids;
+    delete[] b_ids;
+    return results_len;
+}
+
+bool id_list::serialize(FILE *fp) const {
+    const uint8_t dense_flag = is_dense() ? 1 : 0;
+    if(fwrite(&dense_flag, sizeof(uint8_t), 1, fp) != 1) return false;
+
+    if(!is_dense()) {
+        uint32_t arr_meta[4] = {sarr->getLength(), sarr->getMin(), sarr->getMax(), sarr->getLengthInBytes()};
+        if(fwrite(arr_meta, sizeof(uint32_t), 4, fp) != 4) return false;
+        if(arr_meta[3] != 0 && fwrite(sarr->get_raw(), sizeof(uint8_t), arr_meta[3], fp) != arr_meta[3]) return false;
+        return true;
+    }
+
+    uint32_t bitmap_meta[4] = {bitmap_length, bitmap_min, bitmap_max, num_words};
+    if(fwrite(bitmap_meta, sizeof(uint32_t), 4, fp) != 4) return false;
+    if(num_words != 0 && fwrite(bits, sizeof(uint64_t), num_words, fp) != num_words) return false;
+    return true;
+}
+
+bool id_list::deserialize(FILE *fp) {
+    uint8_t dense_flag;
+    if(fread(&dense_flag, sizeof(uint8_t), 1, fp) != 1) return false;
+
+    uint32_t meta[4];
+    if(fread(meta, sizeof(uint32_t), 4, fp) != 4) return false;
+
+    if(dense_flag == 0) {
+        uint8_t *blob = (uint8_t *) malloc(meta[3]);
+        if(meta[3] != 0 && fread(blob, sizeof(uint8_t), meta[3], fp) != meta[3]) {
+            free(blob);
+            return false;
+        }
+
+        sarr->load_raw(blob, meta[3], meta[0], meta[1], meta[2]);
+        free(blob);
+        return true;
+    }
+
+    delete sarr;
+    sarr = nullptr;
+    delete[] bits;
+
+    num_words = meta[3];
+    bits = new uint64_t[num_words];
+    if(num_words != 0 && fread(bits, sizeof(uint64_t), num_words, fp) != num_words) {
+        return false;
+    }
+
+    bitmap_length = meta[0];
+    bitmap_min = meta[1];
+    bitmap_max = meta[2];
+    return true;
+}
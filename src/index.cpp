@@ -2,21 +2,30 @@
 
 #include <numeric>
 #include <chrono>
+#include <thread>
 #include <unordered_map>
 #include <array_utils.h>
 #include <match_score.h>
 #include <string_utils.h>
+#include <tokenizer.h>
 #include <art.h>
 #include "logger.h"
 
 Index::Index(const std::string name, std::unordered_map<std::string, field> search_schema,
-             std::unordered_map<std::string, field> facet_schema, std::unordered_map<std::string, field> sort_schema):
+             std::unordered_map<std::string, field> facet_schema, std::unordered_map<std::string, field> sort_schema,
+             const std::string & offsets_path):
         name(name), search_schema(search_schema), facet_schema(facet_schema), sort_schema(sort_schema) {
 
+    offset_store = offsets_path.empty() ? nullptr : new OffsetStore(offsets_path);
+
     for(const auto pair: search_schema) {
         art_tree *t = new art_tree;
         art_tree_init(t);
         search_index.emplace(pair.first, t);
+
+        if(pair.second.is_integer() || pair.second.is_float()) {
+            numeric_range_index.emplace(pair.first, new range_index());
+        }
     }
 
     for(const auto pair: facet_schema) {
@@ -25,18 +34,50 @@ Index::Index(const std::string name, std::unordered_map<std::string, field> sear
     }
 
     for(const auto pair: sort_schema) {
-        spp::sparse_hash_map<uint32_t, number_t> * doc_to_score = new spp::sparse_hash_map<uint32_t, number_t>();
-        sort_index.emplace(pair.first, doc_to_score);
+        sort_index.emplace(pair.first, new sort_column());
     }
 
     num_documents = 0;
+    filter_cache_bytes = 0;
+    num_readers = 0;
+    writer_active = false;
+}
+
+void Index::read_lock() {
+    std::unique_lock<std::mutex> lk(rw_m);
+    rw_cv.wait(lk, [this]{return !writer_active;});
+    num_readers++;
+}
+
+void Index::read_unlock() {
+    {
+        std::lock_guard<std::mutex> lk(rw_m);
+        num_readers--;
+    }
 
-    ready = false;
-    processed = false;
-    terminate = false;
+    rw_cv.notify_all();
+}
+
+void Index::write_lock() {
+    std::unique_lock<std::mutex> lk(rw_m);
+    rw_cv.wait(lk, [this]{return !writer_active && num_readers == 0;});
+    writer_active = true;
+}
+
+void Index::write_unlock() {
+    {
+        std::lock_guard<std::mutex> lk(rw_m);
+        writer_active = false;
+    }
+
+    rw_cv.notify_all();
 }
 
 Index::~Index() {
+    clear_filter_cache();
+
+    // trees must go first: frozen leaves point into the store's mapping
+
     for(auto & name_tree: search_index) {
         art_tree_destroy(name_tree.second);
         delete name_tree.second;
@@ -51,10 +92,23 @@ Index::~Index() {
     }
 
     sort_index.clear();
+
+    for(auto & name_rindex: numeric_range_index) {
+        delete name_rindex.second;
+        name_rindex.second = nullptr;
+    }
+
+    numeric_range_index.clear();
+
+    delete offset_store;
+    offset_store = nullptr;
 }
 
 Option<uint32_t> Index::index_in_memory(const nlohmann::json &document, uint32_t seq_id, int32_t points) {
     // assumes that validation has already been done
+    write_guard guard(this);
+    clear_filter_cache();
+
     for(const std::pair<std::string, field> & field_pair: search_schema) {
         const std::string & field_name = field_pair.first;
         art_tree *t = search_index.at(field_name);
@@ -91,17 +145,19 @@ Option<uint32_t> Index::index_in_memory(const nlohmann::json &document, uint32_t
             index_bool_array_field(values, points, t, seq_id);
         }
 
+        range_index_values(field_pair.second, document, seq_id, false);
+
         // add numerical values automatically into sort index
         if(field_pair.second.type == field_types::INT32 || field_pair.second.type == field_types::INT64 ||
                 field_pair.second.type == field_types::FLOAT || field_pair.second.type == field_types::BOOL) {
-            spp::sparse_hash_map<uint32_t, number_t> *doc_to_score = sort_index.at(field_pair.first);
+            sort_column *doc_to_score = sort_index.at(field_pair.first);
 
             if(document[field_pair.first].is_number_integer()) {
-                doc_to_score->emplace(seq_id, document[field_pair.first].get<int64_t>());
+                doc_to_score->set(seq_id, number_t(document[field_pair.first].get<int64_t>()));
             } else if(document[field_pair.first].is_number_float()) {
-                doc_to_score->emplace(seq_id, document[field_pair.first].get<float>());
+                doc_to_score->set(seq_id, number_t(document[field_pair.first].get<float>()));
             } else if(document[field_pair.first].is_boolean()) {
-                doc_to_score->emplace(seq_id, (int64_t) document[field_pair.first].get<bool>());
+                doc_to_score->set(seq_id, number_t((int64_t) document[field_pair.first].get<bool>()));
             }
         }
     }
@@ -122,6 +178,323 @@ Option<uint32_t> Index::index_in_memory(const nlohmann::json &document, uint32_t
     return Option<>(200);
 }
 
+Option<uint32_t> Index::index_in_memory(const flat_record & record, uint32_t seq_id, int32_t points) {
+    // the schema-driven scanner validated the record while parsing it
+    write_guard guard(this);
+    clear_filter_cache();
+
+    for(const flat_field_values & field_values: record.fields) {
+        const field & a_field = field_values.schema;
+        art_tree *t = search_index.at(a_field.name);
+
+        if(a_field.type == field_types::STRING) {
+            index_string_field(field_values.str_values[0].to_string(), points, t, seq_id, a_field.is_facet());
+        } else if(a_field.type == field_types::INT32) {
+            index_int32_field((int32_t) field_values.int_values[0], points, t, seq_id);
+        } else if(a_field.type == field_types::INT64) {
+            index_int64_field(field_values.int_values[0], points, t, seq_id);
+        } else if(a_field.type == field_types::FLOAT) {
+            index_float_field(field_values.float_values[0], points, t, seq_id);
+        } else if(a_field.type == field_types::BOOL) {
+            index_bool_field(field_values.bool_values[0], points, t, seq_id);
+        } else if(a_field.type == field_types::STRING_ARRAY) {
+            std::vector<std::string> strings;
+            strings.reserve(field_values.str_values.size());
+            for(const flat_string & str_value: field_values.str_values) {
+                strings.push_back(str_value.to_string());
+            }
+            index_string_array_field(strings, points, t, seq_id, a_field.is_facet());
+        } else if(a_field.type == field_types::INT32_ARRAY) {
+            std::vector<int32_t> values(field_values.int_values.begin(), field_values.int_values.end());
+            index_int32_array_field(values, points, t, seq_id);
+        } else if(a_field.type == field_types::INT64_ARRAY) {
+            index_int64_array_field(field_values.int_values, points, t, seq_id);
+        } else if(a_field.type == field_types::FLOAT_ARRAY) {
+            index_float_array_field(field_values.float_values, points, t, seq_id);
+        } else if(a_field.type == field_types::BOOL_ARRAY) {
+            index_bool_array_field(field_values.bool_values, points, t, seq_id);
+        }
+
+        if(a_field.is_integer()) {
+            range_index* rindex = numeric_range_index.at(a_field.name);
+            for(const int64_t value: field_values.int_values) {
+                rindex->insert(value, seq_id);
+            }
+        } else if(a_field.is_float()) {
+            range_index* rindex = numeric_range_index.at(a_field.name);
+            for(const float value: field_values.float_values) {
+                rindex->insert(range_index::encode_value(value), seq_id);
+            }
+        }
+
+        // add numerical values automatically into sort index
+        if(a_field.type == field_types::INT32 || a_field.type == field_types::INT64) {
+            sort_index.at(a_field.name)->set(seq_id, number_t(field_values.int_values[0]));
+        } else if(a_field.type == field_types::FLOAT) {
+            sort_index.at(a_field.name)->set(seq_id, number_t(field_values.float_values[0]));
+        } else if(a_field.type == field_types::BOOL) {
+            sort_index.at(a_field.name)->set(seq_id, number_t((int64_t) field_values.bool_values[0]));
+        }
+    }
+
+    for(const flat_field_values & field_values: record.fields) {
+        if(facet_schema.count(field_values.schema.name) == 0) {
+            continue;
+        }
+
+        facet_value & fvalue = facet_index.at(field_values.schema.name);
+        std::vector<std::string> values;
+        values.reserve(field_values.str_values.size());
+        for(const flat_string & str_value: field_values.str_values) {
+            values.push_back(str_value.to_string());
+        }
+        fvalue.index_values(seq_id, values);
+    }
+
+    num_documents += 1;
+    return Option<>(200);
+}
+
+static bool fwrite_string(const std::string & value, FILE* fp) {
+    uint32_t len = value.size();
+    if(fwrite(&len, sizeof(uint32_t), 1, fp) != 1) return false;
+    return len == 0 || fwrite(value.data(), sizeof(char), len, fp) == len;
+}
+
+static bool fread_string(std::string & value, FILE* fp) {
+    uint32_t len;
+    if(fread(&len, sizeof(uint32_t), 1, fp) != 1) return false;
+    value.resize(len);
+    return len == 0 || fread(&value[0], sizeof(char), len, fp) == len;
+}
+
+bool Index::snapshot_save(FILE* fp) {
+    // purge tombstones first, so that deleted documents cannot resurface through the snapshot
+    compact();
+
+    read_guard guard(this);
+
+    uint64_t index_num_documents = num_documents;
+    if(fwrite(&index_num_documents, sizeof(uint64_t), 1, fp) != 1) return false;
+
+    uint32_t num_trees = search_index.size();
+    if(fwrite(&num_trees, sizeof(uint32_t), 1, fp) != 1) return false;
+
+    for(const auto & field_tree: search_index) {
+        if(!fwrite_string(field_tree.first, fp)) return false;
+        if(!art_tree_serialize(field_tree.second, fp)) return false;
+    }
+
+    uint32_t num_sort_fields = sort_index.size();
+    if(fwrite(&num_sort_fields, sizeof(uint32_t), 1, fp) != 1) return false;
+
+    for(const auto & field_scores: sort_index) {
+        if(!fwrite_string(field_scores.first, fp)) return false;
+
+        const sort_column *column = field_scores.second;
+
+        uint32_t num_scores = column->size();
+        if(fwrite(&num_scores, sizeof(uint32_t), 1, fp) != 1) return false;
+
+        for(uint32_t seq_id = 0; seq_id < column->num_slots; seq_id++) {
+            if(!column->has(seq_id)) continue;
+
+            if(fwrite(&seq_id, sizeof(uint32_t), 1, fp) != 1) return false;
+
+            const number_t & score = column->values[seq_id];
+            uint8_t is_float = score.is_float;
+            if(fwrite(&is_float, sizeof(uint8_t), 1, fp) != 1) return false;
+
+            if(is_float) {
+                if(fwrite(&score.floatval, sizeof(float), 1, fp) != 1) return false;
+            } else {
+                if(fwrite(&score.intval, sizeof(int64_t), 1, fp) != 1) return false;
+            }
+        }
+    }
+
+    uint32_t num_facet_fields = facet_index.size();
+    if(fwrite(&num_facet_fields, sizeof(uint32_t), 1, fp) != 1) return false;
+
+    for(auto & field_facets: facet_index) {
+        if(!fwrite_string(field_facets.first, fp)) return false;
+
+        const facet_value & fvalue = field_facets.second;
+
+        uint32_t num_values = fvalue.value_index.size();
+        if(fwrite(&num_values, sizeof(uint32_t), 1, fp) != 1) return false;
+
+        for(const auto & value_idx: fvalue.value_index) {
+            if(!fwrite_string(value_idx.first, fp)) return false;
+            if(fwrite(&value_idx.second, sizeof(uint32_t), 1, fp) != 1) return false;
+        }
+
+        uint32_t num_docs = 0;
+        for(uint32_t seq_id = 0; seq_id < fvalue.slots.size(); seq_id++) {
+            if(fvalue.slots[seq_id] != facet_value::NO_VALUE) {
+                num_docs++;
+            }
+        }
+        if(fwrite(&num_docs, sizeof(uint32_t), 1, fp) != 1) return false;
+
+        for(uint32_t seq_id = 0; seq_id < fvalue.slots.size(); seq_id++) {
+            std::vector<uint32_t> value_indices;
+            if(!fvalue.get_values(seq_id, value_indices)) {
+                continue;
+            }
+
+            if(fwrite(&seq_id, sizeof(uint32_t), 1, fp) != 1) return false;
+
+            uint32_t num_indices = value_indices.size();
+            if(fwrite(&num_indices, sizeof(uint32_t), 1, fp) != 1) return false;
+
+            if(num_indices != 0 && fwrite(value_indices.data(), sizeof(uint32_t), num_indices, fp)
+                                   != num_indices) {
+                return false;
+            }
+        }
+    }
+
+    uint32_t num_range_fields = numeric_range_index.size();
+    if(fwrite(&num_range_fields, sizeof(uint32_t), 1, fp) != 1) return false;
+
+    for(const auto & name_rindex: numeric_range_index) {
+        if(!fwrite_string(name_rindex.first, fp)) return false;
+
+        const range_index* rindex = name_rindex.second;
+
+        uint32_t num_entries = rindex->entries.size();
+        if(fwrite(&num_entries, sizeof(uint32_t), 1, fp) != 1) return false;
+
+        for(const std::pair<int64_t, uint32_t> & entry: rindex->entries) {
+            if(fwrite(&entry.first, sizeof(int64_t), 1, fp) != 1) return false;
+            if(fwrite(&entry.second, sizeof(uint32_t), 1, fp) != 1) return false;
+        }
+    }
+
+    return true;
+}
+
+bool Index::snapshot_load(FILE* fp) {
+    write_guard guard(this);
+
+    uint64_t index_num_documents;
+    if(fread(&index_num_documents, sizeof(uint64_t), 1, fp) != 1) return false;
+
+    uint32_t num_trees;
+    if(fread(&num_trees, sizeof(uint32_t), 1, fp) != 1) return false;
+
+    for(uint32_t i = 0; i < num_trees; i++) {
+        std::string field_name;
+        if(!fread_string(field_name, fp)) return false;
+
+        // the schema of the snapshot must line up with the collection meta on disk
+        if(search_index.count(field_name) == 0) return false;
+        if(!art_tree_deserialize(search_index.at(field_name), fp)) return false;
+    }
+
+    uint32_t num_sort_fields;
+    if(fread(&num_sort_fields, sizeof(uint32_t), 1, fp) != 1) return false;
+
+    for(uint32_t i = 0; i < num_sort_fields; i++) {
+        std::string field_name;
+        if(!fread_string(field_name, fp)) return false;
+        if(sort_index.count(field_name) == 0) return false;
+
+        sort_column *doc_to_score = sort_index.at(field_name);
+
+        uint32_t num_scores;
+        if(fread(&num_scores, sizeof(uint32_t), 1, fp) != 1) return false;
+
+        for(uint32_t j = 0; j < num_scores; j++) {
+            uint32_t seq_id;
+            uint8_t is_float;
+            if(fread(&seq_id, sizeof(uint32_t), 1, fp) != 1) return false;
+            if(fread(&is_float, sizeof(uint8_t), 1, fp) != 1) return false;
+
+            if(is_float) {
+                float floatval;
+                if(fread(&floatval, sizeof(float), 1, fp) != 1) return false;
+                doc_to_score->set(seq_id, number_t(floatval));
+            } else {
+                int64_t intval;
+                if(fread(&intval, sizeof(int64_t), 1, fp) != 1) return false;
+                doc_to_score->set(seq_id, number_t(intval));
+            }
+        }
+    }
+
+    uint32_t num_facet_fields;
+    if(fread(&num_facet_fields, sizeof(uint32_t), 1, fp) != 1) return false;
+
+    for(uint32_t i = 0; i < num_facet_fields; i++) {
+        std::string field_name;
+        if(!fread_string(field_name, fp)) return false;
+        if(facet_index.count(field_name) == 0) return false;
+
+        facet_value & fvalue = facet_index.at(field_name);
+
+        uint32_t num_values;
+        if(fread(&num_values, sizeof(uint32_t), 1, fp) != 1) return false;
+
+        for(uint32_t j = 0; j < num_values; j++) {
+            std::string value;
+            uint32_t value_idx;
+            if(!fread_string(value, fp)) return false;
+            if(fread(&value_idx, sizeof(uint32_t), 1, fp) != 1) return false;
+
+            fvalue.load_value(value, value_idx);
+        }
+
+        uint32_t num_docs;
+        if(fread(&num_docs, sizeof(uint32_t), 1, fp) != 1) return false;
+
+        for(uint32_t j = 0; j < num_docs; j++) {
+            uint32_t seq_id;
+            uint32_t num_indices;
+            if(fread(&seq_id, sizeof(uint32_t), 1, fp) != 1) return false;
+            if(fread(&num_indices, sizeof(uint32_t), 1, fp) != 1) return false;
+
+            std::vector<uint32_t> value_indices(num_indices);
+            if(num_indices != 0 && fread(value_indices.data(), sizeof(uint32_t), num_indices, fp) != num_indices) {
+                return false;
+            }
+
+            if(num_indices != 0) {
+                fvalue.assign_slot(seq_id, value_indices);
+            }
+        }
+    }
+
+    uint32_t num_range_fields;
+    if(fread(&num_range_fields, sizeof(uint32_t), 1, fp) != 1) return false;
+
+    for(uint32_t i = 0; i < num_range_fields; i++) {
+        std::string field_name;
+        if(!fread_string(field_name, fp)) return false;
+        if(numeric_range_index.count(field_name) == 0) return false;
+
+        range_index* rindex = numeric_range_index.at(field_name);
+
+        uint32_t num_entries;
+        if(fread(&num_entries, sizeof(uint32_t), 1, fp) != 1) return false;
+
+        // entries were written in sorted order, so they can be appended directly
+        rindex->entries.reserve(num_entries);
+
+        for(uint32_t j = 0; j < num_entries; j++) {
+            int64_t value;
+            uint32_t seq_id;
+            if(fread(&value, sizeof(int64_t), 1, fp) != 1) return false;
+            if(fread(&seq_id, sizeof(uint32_t), 1, fp) != 1) return false;
+            rindex->entries.push_back(std::make_pair(value, seq_id));
+        }
+    }
+
+    num_documents = index_num_documents;
+    return true;
+}
+
 void Index::index_int32_field(const int32_t value, uint32_t score, art_tree *t, uint32_t seq_id) const {
     const int KEY_LEN = 8;
     unsigned char key[KEY_LEN];
@@ -217,18 +590,19 @@ void Index::index_float_field(const float value, uint32_t score, art_tree *t, ui
 
 void Index::index_string_field(const std::string & text, const uint32_t score, art_tree *t,
                                     uint32_t seq_id, const bool verbatim) const {
-    std::vector<std::string> tokens;
     std::unordered_map<std::string, std::vector<uint32_t>> token_to_offsets;
 
     if(verbatim) {
-        tokens.push_back(text);
         token_to_offsets[text].push_back(0);
     } else {
-        StringUtils::split(text, tokens, " ");
-        for(uint32_t i=0; i<tokens.size(); i++) {
-            auto & token = tokens[i];
-            string_utils.unicode_normalize(token);
-            token_to_offsets[token].push_back(i);
+        Tokenizer tokenizer(text, string_utils);
+        const char* token;
+        size_t token_len;
+        uint32_t i = 0;
+
+        while(tokenizer.next(token, token_len)) {
+            token_to_offsets[std::string(token, token_len)].push_back(i);
+            i++;
         }
     }
 
@@ -296,22 +670,63 @@ void Index::index_float_array_field(const std::vector<float> & values, const uin
     }
 }
 
+// below this many result ids per counting thread, spawning threads costs more than the walk saves
+static const size_t FACET_IDS_PER_THREAD = 250000;
+
 void Index::do_facets(std::vector<facet> & facets, uint32_t* result_ids, size_t results_size) {
     for(auto & a_facet: facets) {
         // assumed that facet fields have already been validated upstream
         const field & facet_field = facet_schema.at(a_facet.field_name);
         const facet_value & fvalue = facet_index.at(facet_field.name);
 
-        for(size_t i = 0; i < results_size; i++) {
-            uint32_t doc_seq_id = result_ids[i];
-            if(fvalue.doc_values.count(doc_seq_id) != 0) {
-                // for every result document, get the values associated and increment counter
-                const std::vector<uint32_t> & value_indices = fvalue.doc_values.at(doc_seq_id);
-                for(size_t j = 0; j < value_indices.size(); j++) {
-                    const std::string & facet_value = fvalue.index_value.at(value_indices.at(j));
-                    a_facet.result_map[facet_value] += 1;
+        const size_t num_values = fvalue.index_value.size();
+        if(num_values == 0) {
+            continue;
+        }
+
+        // counts are accumulated into dense per-dictionary arrays and folded into the
+        // string-keyed result map only once per distinct value
+        std::vector<size_t> counts(num_values, 0);
+
+        const size_t num_threads = std::min((size_t) 4, (results_size / FACET_IDS_PER_THREAD) + 1);
+
+        if(num_threads > 1) {
+            // partition the result id range, count into per-thread arrays, then merge
+            std::vector<std::vector<size_t>> thread_counts(num_threads, std::vector<size_t>(num_values, 0));
+            std::vector<std::thread> counters;
+            const size_t ids_per_thread = (results_size + num_threads - 1) / num_threads;
+
+            for(size_t thread_index = 0; thread_index < num_threads; thread_index++) {
+                counters.emplace_back([&, thread_index]() {
+                    size_t* local_counts = thread_counts[thread_index].data();
+                    const size_t begin = thread_index * ids_per_thread;
+                    const size_t end = std::min(begin + ids_per_thread, results_size);
+
+                    for(size_t i = begin; i < end; i++) {
+                        fvalue.count_doc(result_ids[i], local_counts);
+                    }
+                });
+            }
+
+            for(std::thread & counter: counters) {
+                counter.join();
+            }
+
+            for(const std::vector<size_t> & local_counts: thread_counts) {
+                for(size_t value_id = 0; value_id < num_values; value_id++) {
+                    counts[value_id] += local_counts[value_id];
                 }
             }
+        } else {
+            for(size_t i = 0; i < results_size; i++) {
+                fvalue.count_doc(result_ids[i], counts.data());
+            }
+        }
+
+        for(size_t value_id = 0; value_id < num_values; value_id++) {
+            if(counts[value_id] != 0) {
+                a_facet.result_map[fvalue.index_value[value_id]] += counts[value_id];
+            }
         }
     }
 }
@@ -319,14 +734,18 @@ void Index::do_facets(std::vector<facet> & facets, uint32_t* result_ids, size_t
 void Index::search_candidates(uint32_t* filter_ids, size_t filter_ids_length, std::vector<facet> & facets,
                                    const std::vector<sort_by> & sort_fields,
                                    std::vector<token_candidates> & token_candidates_vec, const token_ordering token_order,
-                                   std::vector<std::vector<art_leaf*>> & searched_queries, Topster<512> & topster,
+                                   std::vector<std::vector<art_leaf*>> & searched_queries, Topster & topster,
                                    size_t & total_results, uint32_t** all_result_ids, size_t & all_result_ids_len,
-                                   const size_t & max_results, const bool prefix) {
-    const long long combination_limit = 10;
+                                   const size_t & max_results, const bool prefix, const bool exhaustive_search,
+                                   const size_t max_candidates, query_timings & timings) {
+    const long long combination_limit = max_candidates;
 
     auto product = []( long long a, token_candidates & b ) { return a*b.candidates.size(); };
     long long int N = std::accumulate(token_candidates_vec.begin(), token_candidates_vec.end(), 1LL, product);
 
+    // ids that each suggestion matched are accumulated here and merged into `all_result_ids` in one shot
+    std::vector<std::pair<uint32_t*, size_t>> suggestion_result_pairs;
+
     for(long long n=0; n<N && n<combination_limit; ++n) {
         // every element in `query_suggestion` contains a token and its associated hits
         std::vector<art_leaf *> query_suggestion = next_suggestion(token_candidates_vec, n);
@@ -335,25 +754,48 @@ void Index::search_candidates(uint32_t* filter_ids, size_t filter_ids_length, st
             LOG(INFO) << "i: " << i << " - " << query_suggestion[i]->key;
         }*/
 
-        // initialize results with the starting element (for further intersection)
-        size_t result_size = query_suggestion[0]->values->ids.getLength();
+        // Selectivity ordering: intersect starting from the rarest token and work towards the
+        // most frequent one, so the intermediate id set never grows beyond the rarest list.
+        // `query_suggestion` itself stays in query order - scoring and highlighting depend on it.
+        std::vector<art_leaf*> intersect_order(query_suggestion);
+        std::sort(intersect_order.begin(), intersect_order.end(), [](const art_leaf* a, const art_leaf* b) {
+            return a->values->ids.getLength() < b->values->ids.getLength();
+        });
+
+        // the intersection can never produce more ids than the rarest token's list holds
+        size_t result_size = intersect_order[0]->values->ids.getLength();
         if(result_size == 0) {
             continue;
         }
 
         uint32_t total_cost = 0;
-        uint32_t* result_ids = query_suggestion[0]->values->ids.uncompress();
 
         for(auto tc: token_candidates_vec) {
             total_cost += tc.cost;
         }
 
-        // intersect the document ids for each token to find docs that contain all the tokens (stored in `result_ids`)
-        for(size_t i=1; i < query_suggestion.size(); i++) {
+        timings.max_typo_cost = std::max(timings.max_typo_cost, (uint64_t) total_cost);
+
+        if(!exhaustive_search) {
+            // max-score style early termination: the best score this suggestion can produce assumes
+            // that every token matches with perfect proximity - when even that cannot beat the
+            // smallest match score retained by a full topster, the whole posting list is skipped
+            const uint64_t max_possible_score = ((uint64_t) query_suggestion.size() << 24) |
+                                                ((uint64_t) (255 - total_cost) << 16) |
+                                                ((uint64_t) MAX_TOKENS_DISTANCE);
+
+            if(max_possible_score < topster.min_match_score()) {
+                continue;
+            }
+        }
+
+        uint32_t* result_ids = intersect_order[0]->values->ids.uncompress();
+
+        // intersect the document ids for each token to find docs that contain all the tokens
+        // (stored in `result_ids`) - bailing out as soon as an intersection comes up empty
+        for(size_t i=1; i < intersect_order.size() && result_size != 0; i++) {
             uint32_t* out = nullptr;
-            uint32_t* ids = query_suggestion[i]->values->ids.uncompress();
-            result_size = ArrayUtils::and_scalar(ids, query_suggestion[i]->values->ids.getLength(), result_ids, result_size, &out);
-            delete[] ids;
+            result_size = intersect_order[i]->values->ids.intersect(result_ids, result_size, &out);
             delete[] result_ids;
             result_ids = out;
         }
@@ -361,35 +803,38 @@ void Index::search_candidates(uint32_t* filter_ids, size_t filter_ids_length, st
         if(filter_ids != nullptr) {
             // intersect once again with filter ids
             uint32_t* filtered_result_ids = nullptr;
-            size_t filtered_results_size = ArrayUtils::and_scalar(filter_ids, filter_ids_length, result_ids,
+            size_t filtered_results_size = ArrayUtils::intersect(filter_ids, filter_ids_length, result_ids,
                                                                   result_size, &filtered_result_ids);
 
-            uint32_t* new_all_result_ids;
-            all_result_ids_len = ArrayUtils::or_scalar(*all_result_ids, all_result_ids_len, filtered_result_ids,
-                                  filtered_results_size, &new_all_result_ids);
-            delete [] *all_result_ids;
-            *all_result_ids = new_all_result_ids;
+            filtered_results_size = exclude_deleted_ids(filtered_result_ids, filtered_results_size);
+            timings.ids_scanned += filtered_results_size;
 
+            uint64_t begin_micros = query_timings::now_micros();
             do_facets(facets, filtered_result_ids, filtered_results_size);
+            timings.record(STAGE_FACETING, begin_micros);
 
             // go through each matching document id and calculate match score
+            begin_micros = query_timings::now_micros();
             score_results(sort_fields, searched_queries.size(), total_cost, topster, query_suggestion,
                           filtered_result_ids, filtered_results_size);
+            timings.record(STAGE_SCORING, begin_micros);
 
-            delete[] filtered_result_ids;
+            suggestion_result_pairs.push_back(std::make_pair(filtered_result_ids, filtered_results_size));
             delete[] result_ids;
         } else {
-            do_facets(facets, result_ids, result_size);
+            result_size = exclude_deleted_ids(result_ids, result_size);
+            timings.ids_scanned += result_size;
 
-            uint32_t* new_all_result_ids;
-            all_result_ids_len = ArrayUtils::or_scalar(*all_result_ids, all_result_ids_len, result_ids,
-                                  result_size, &new_all_result_ids);
-            delete [] *all_result_ids;
-            *all_result_ids = new_all_result_ids;
+            uint64_t begin_micros = query_timings::now_micros();
+            do_facets(facets, result_ids, result_size);
+            timings.record(STAGE_FACETING, begin_micros);
 
+            begin_micros = query_timings::now_micros();
             score_results(sort_fields, searched_queries.size(), total_cost, topster, query_suggestion,
                           result_ids, result_size);
-            delete[] result_ids;
+            timings.record(STAGE_SCORING, begin_micros);
+
+            suggestion_result_pairs.push_back(std::make_pair(result_ids, result_size));
         }
 
         total_results += topster.size;
@@ -399,32 +844,137 @@ void Index::search_candidates(uint32_t* filter_ids, size_t filter_ids_length, st
             break;
         }
     }
+
+    if(!suggestion_result_pairs.empty()) {
+        // a single k-way union of all suggestion results with the previously accumulated ids
+        suggestion_result_pairs.push_back(std::make_pair(*all_result_ids, all_result_ids_len));
+
+        uint32_t* new_all_result_ids = nullptr;
+        all_result_ids_len = ArrayUtils::or_many(suggestion_result_pairs, &new_all_result_ids);
+
+        for(const auto & result_pair: suggestion_result_pairs) {
+            delete [] result_pair.first;
+        }
+
+        *all_result_ids = new_all_result_ids;
+    }
 }
 
 size_t Index::union_of_ids(std::vector<std::pair<uint32_t*, size_t>> & result_array_pairs,
                                 uint32_t **results_out) {
-    uint32_t *results = nullptr;
-    size_t results_length = 0;
+    return ArrayUtils::or_many(result_array_pairs, results_out);
+}
 
-    uint32_t *prev_results = nullptr;
-    size_t prev_results_length = 0;
+std::string Index::filter_cache_key(const std::vector<filter> & filters) {
+    // canonicalize so that the order of filters and of their values does not matter
+    std::vector<std::string> parts;
+
+    for(const filter & a_filter: filters) {
+        std::vector<std::string> values = a_filter.values;
+        std::sort(values.begin(), values.end());
+
+        std::string part = a_filter.field_name + ":" + std::to_string(a_filter.compare_operator);
+        for(const std::string & value: values) {
+            part += ":" + value;
+        }
 
-    for(const std::pair<uint32_t*, size_t> & result_array_pair: result_array_pairs) {
-        results_length = ArrayUtils::or_scalar(prev_results, prev_results_length, result_array_pair.first,
-                                               result_array_pair.second, &results);
-        delete [] prev_results;
-        prev_results = results;
-        prev_results_length = results_length;
+        parts.push_back(part);
     }
 
-    *results_out = results;
-    return results_length;
+    std::sort(parts.begin(), parts.end());
+
+    std::string cache_key;
+    for(const std::string & part: parts) {
+        cache_key += part + "&&";
+    }
+
+    return cache_key;
+}
+
+bool Index::filter_cache_get(const std::string & cache_key, uint32_t** filter_ids_out, uint32_t* filter_ids_length) {
+    std::lock_guard<std::mutex> lock(filter_cache_m);
+
+    const auto & it = filter_cache_map.find(cache_key);
+    if(it == filter_cache_map.end()) {
+        return false;
+    }
+
+    // bump the entry to the front of the LRU list
+    filter_cache_lru.splice(filter_cache_lru.begin(), filter_cache_lru, it->second);
+
+    const filter_cache_entry & entry = *(it->second);
+    uint32_t* ids = new uint32_t[entry.ids_length];
+    memcpy(ids, entry.ids, entry.ids_length * sizeof(uint32_t));
+
+    *filter_ids_out = ids;
+    *filter_ids_length = entry.ids_length;
+    return true;
+}
+
+void Index::filter_cache_put(const std::string & cache_key, const uint32_t* filter_ids,
+                             uint32_t filter_ids_length) {
+    const size_t entry_bytes = cache_key.size() + (filter_ids_length * sizeof(uint32_t)) +
+                               sizeof(filter_cache_entry);
+
+    if(entry_bytes > FILTER_CACHE_BUDGET_BYTES) {
+        return;  // a single entry must never blow the whole budget
+    }
+
+    std::lock_guard<std::mutex> lock(filter_cache_m);
+
+    if(filter_cache_map.count(cache_key) != 0) {
+        return;  // a concurrent search has already cached this expression
+    }
+
+    // evict least recently used entries until the new entry fits the budget
+    while(!filter_cache_lru.empty() && filter_cache_bytes + entry_bytes > FILTER_CACHE_BUDGET_BYTES) {
+        const filter_cache_entry & lru_entry = filter_cache_lru.back();
+        filter_cache_bytes -= lru_entry.key.size() + (lru_entry.ids_length * sizeof(uint32_t)) +
+                              sizeof(filter_cache_entry);
+        filter_cache_map.erase(lru_entry.key);
+        delete[] lru_entry.ids;
+        filter_cache_lru.pop_back();
+    }
+
+    filter_cache_entry entry;
+    entry.key = cache_key;
+    entry.ids = new uint32_t[filter_ids_length];
+    entry.ids_length = filter_ids_length;
+    memcpy(entry.ids, filter_ids, filter_ids_length * sizeof(uint32_t));
+
+    filter_cache_lru.push_front(entry);
+    filter_cache_map.emplace(cache_key, filter_cache_lru.begin());
+    filter_cache_bytes += entry_bytes;
+}
+
+void Index::clear_filter_cache() {
+    std::lock_guard<std::mutex> lock(filter_cache_m);
+
+    for(filter_cache_entry & entry: filter_cache_lru) {
+        delete[] entry.ids;
+    }
+
+    filter_cache_lru.clear();
+    filter_cache_map.clear();
+    filter_cache_bytes = 0;
 }
 
 Option<uint32_t> Index::do_filtering(uint32_t** filter_ids_out, const std::vector<filter> & filters) {
     uint32_t* filter_ids = nullptr;
     uint32_t filter_ids_length = 0;
 
+    if(filters.empty()) {
+        *filter_ids_out = filter_ids;
+        return Option<>(filter_ids_length);
+    }
+
+    const std::string & cache_key = filter_cache_key(filters);
+
+    if(filter_cache_get(cache_key, &filter_ids, &filter_ids_length)) {
+        *filter_ids_out = filter_ids;
+        return Option<>(filter_ids_length);
+    }
+
     for(size_t i = 0; i < filters.size(); i++) {
         const filter & a_filter = filters[i];
 
@@ -433,34 +983,33 @@ Option<uint32_t> Index::do_filtering(uint32_t** filter_ids_out, const std::vecto
             field f = search_schema.at(a_filter.field_name);
             std::vector<std::pair<uint32_t*, size_t>> filter_result_array_pairs;
 
-            if(f.is_integer()) {
-                std::vector<const art_leaf*> leaves;
+            if(f.is_integer() || f.is_float()) {
+                // a binary search plus contiguous scan on the range index, instead of collecting
+                // every matching encoded-key leaf from the ART and unioning their id lists
+                range_index* rindex = numeric_range_index.at(a_filter.field_name);
+                std::vector<uint32_t> rindex_ids;
 
                 for(const std::string & filter_value: a_filter.values) {
-                    if(f.type == field_types::INT32 || f.type == field_types::INT32_ARRAY) {
-                        int32_t value = (int32_t) std::stoi(filter_value);
-                        art_int32_search(t, value, a_filter.compare_operator, leaves);
+                    int64_t value;
+
+                    if(f.is_float()) {
+                        value = range_index::encode_value((float) std::atof(filter_value.c_str()));
+                    } else if(f.type == field_types::INT32 || f.type == field_types::INT32_ARRAY) {
+                        value = (int32_t) std::stoi(filter_value);
                     } else {
-                        int64_t value = (int64_t) std::stoi(filter_value);
-                        art_int64_search(t, value, a_filter.compare_operator, leaves);
+                        value = (int64_t) std::stoi(filter_value);
                     }
 
-                    for(const art_leaf* leaf: leaves) {
-                        filter_result_array_pairs.push_back(std::make_pair(leaf->values->ids.uncompress(),
-                                                                leaf->values->ids.getLength()));
-                    }
+                    rindex->query(value, a_filter.compare_operator, rindex_ids);
                 }
-            } else if(f.is_float()) {
-                std::vector<const art_leaf*> leaves;
 
-                for(const std::string & filter_value: a_filter.values) {
-                    float value = (float) std::atof(filter_value.c_str());
-                    art_float_search(t, value, a_filter.compare_operator, leaves);
-                    for(const art_leaf* leaf: leaves) {
-                        filter_result_array_pairs.push_back(std::make_pair(leaf->values->ids.uncompress(),
-                                                                leaf->values->ids.getLength()));
-                    }
-                }
+                // ids come back in value order - sort and de-dupe (array fields, multiple values) once
+                std::sort(rindex_ids.begin(), rindex_ids.end());
+                rindex_ids.erase(std::unique(rindex_ids.begin(), rindex_ids.end()), rindex_ids.end());
+
+                uint32_t* ids = new uint32_t[rindex_ids.size()];
+                std::copy(rindex_ids.begin(), rindex_ids.end(), ids);
+                filter_result_array_pairs.push_back(std::make_pair(ids, rindex_ids.size()));
             } else if(f.is_bool()) {
                 std::vector<const art_leaf*> leaves;
 
@@ -496,10 +1045,7 @@ Option<uint32_t> Index::do_filtering(uint32_t** filter_ids_out, const std::vecto
                         } else {
                             // do AND for an exact match
                             uint32_t* out = nullptr;
-                            uint32_t* leaf_ids = leaf->values->ids.uncompress();
-                            filtered_size = ArrayUtils::and_scalar(filtered_ids, filtered_size, leaf_ids,
-                                                                   leaf->values->ids.getLength(), &out);
-                            delete[] leaf_ids;
+                            filtered_size = leaf->values->ids.intersect(filtered_ids, filtered_size, &out);
                             delete[] filtered_ids;
                             filtered_ids = out;
                         }
@@ -517,7 +1063,7 @@ Option<uint32_t> Index::do_filtering(uint32_t** filter_ids_out, const std::vecto
                 filter_ids_length = result_ids_length;
             } else {
                 uint32_t* filtered_results = nullptr;
-                filter_ids_length = ArrayUtils::and_scalar(filter_ids, filter_ids_length, result_ids,
+                filter_ids_length = ArrayUtils::intersect(filter_ids, filter_ids_length, result_ids,
                                                              result_ids_length, &filtered_results);
                 delete [] result_ids;
                 delete [] filter_ids;
@@ -530,50 +1076,39 @@ Option<uint32_t> Index::do_filtering(uint32_t** filter_ids_out, const std::vecto
         }
     }
 
-    *filter_ids_out = filter_ids;
-    return Option<>(filter_ids_length);
-}
+    // tombstoned ids are dropped before caching - a removal wipes the cache, so cached
+    // entries can never go stale with respect to the tombstones
+    filter_ids_length = exclude_deleted_ids(filter_ids, filter_ids_length);
 
-void Index::run_search() {
-    while(true) {
-        // wait until main thread sends data
-        std::unique_lock<std::mutex> lk(m);
-        cv.wait(lk, [this]{return ready;});
+    filter_cache_put(cache_key, filter_ids, filter_ids_length);
 
-        if(terminate) {
-            break;
-        }
-
-        // after the wait, we own the lock.
-        search(search_params.outcome, search_params.query, search_params.search_fields,
-               search_params.filters, search_params.facets,
-               search_params.sort_fields_std, search_params.num_typos, search_params.per_page, search_params.page,
-               search_params.token_order, search_params.prefix, search_params.field_order_kvs,
-               search_params.all_result_ids_len, search_params.searched_queries);
-
-        // hand control back to main thread
-        processed = true;
-        ready = false;
-
-        // manual unlocking is done before notifying, to avoid waking up the waiting thread only to block again
-        lk.unlock();
-        cv.notify_one();
-    }
+    *filter_ids_out = filter_ids;
+    return Option<>(filter_ids_length);
 }
 
 void Index::search(Option<uint32_t> & outcome, std::string query, const std::vector<std::string> search_fields,
                              const std::vector<filter> & filters, std::vector<facet> & facets,
                              std::vector<sort_by> sort_fields_std, const int num_typos,
                              const size_t per_page, const size_t page, const token_ordering token_order,
-                             const bool prefix, std::vector<std::pair<int, Topster<512>::KV>> & field_order_kvs,
-                             size_t & all_result_ids_len, std::vector<std::vector<art_leaf*>> & searched_queries) {
+                             const bool prefix, const bool exhaustive_search,
+                             const size_t max_candidates, const search_cursor & cursor,
+                             std::vector<std::pair<int, Topster::KV>> & field_order_kvs,
+                             size_t & all_result_ids_len, std::vector<std::vector<art_leaf*>> & searched_queries,
+                             query_timings & timings) {
+
+    read_guard guard(this);
 
     const size_t num_results = (page * per_page);
 
     // process the filters first
 
     uint32_t* filter_ids = nullptr;
+    const uint64_t filter_begin_micros = query_timings::now_micros();
     Option<uint32_t> op_filter_ids_length = do_filtering(&filter_ids, filters);
+    if(filters.size() != 0) {
+        timings.record(STAGE_FILTER, filter_begin_micros);
+    }
+
     if(!op_filter_ids_length.ok()) {
         outcome = Option<uint32_t>(op_filter_ids_length);
         return ;
@@ -585,20 +1120,112 @@ void Index::search(Option<uint32_t> & outcome, std::string query, const std::vec
     //auto begin = std::chrono::high_resolution_clock::now();
     uint32_t* all_result_ids = nullptr;
 
+    // each field is searched into its own state and merged afterwards, so that the
+    // per-field searches can run concurrently
+    struct field_search_result {
+        Topster topster;
+        std::vector<std::vector<art_leaf*>> searched_queries;
+        std::vector<facet> facets;
+        uint32_t* result_ids;
+        size_t result_ids_len;
+        query_timings timings;  // per-field, since fields are searched concurrently
+
+        // the topster is sized to the results actually requested, so a 10-result query
+        // maintains a 10-element heap instead of a fixed 512
+        field_search_result(size_t max_results): topster((uint32_t) max_results),
+                                                 result_ids(nullptr), result_ids_len(0) {
+
+        }
+    };
+
+    std::vector<field_search_result*> field_results(search_fields.size(), nullptr);
+
+    // proceed to query search only when no filters are provided or when filtering produces results
+    if(filters.size() == 0 || filter_ids_length > 0) {
+        std::vector<std::thread> field_searchers;
+
+        for(size_t i = 0; i < search_fields.size(); i++) {
+            field_results[i] = new field_search_result(num_results);
+            for(const facet & a_facet: facets) {
+                field_results[i]->facets.push_back(facet(a_facet.field_name));
+            }
+
+            if(cursor.valid) {
+                // hits tying with the cursor on the ranking attributes are ordered by field
+                // and then by key, and each topster serves exactly one field
+                const int field_order = (int)(search_fields.size() - i);
+                Topster::ceiling_tie_policy tie_policy = Topster::TIES_ON_KEY;
+
+                if(field_order > cursor.field_order) {
+                    tie_policy = Topster::TIES_RANK_ABOVE;
+                } else if(field_order < cursor.field_order) {
+                    tie_policy = Topster::TIES_RANK_BELOW;
+                }
+
+                field_results[i]->topster.set_ceiling(cursor.match_score, cursor.primary_attr,
+                                                      cursor.secondary_attr, cursor.key, tie_policy);
+            }
+
+            auto search_single_field = [&, i]() {
+                field_search_result* field_result = field_results[i];
+                std::string field_query = query;
+                search_field(field_query, search_fields[i], filter_ids, filter_ids_length, field_result->facets,
+                             sort_fields_std, num_typos, num_results, field_result->searched_queries,
+                             field_result->topster, &field_result->result_ids, field_result->result_ids_len,
+                             field_result->timings, token_order, prefix, exhaustive_search, max_candidates);
+                field_result->topster.sort();
+            };
+
+            if(search_fields.size() == 1) {
+                // not worth paying the thread spawn cost for a single field
+                search_single_field();
+            } else {
+                field_searchers.emplace_back(search_single_field);
+            }
+        }
+
+        for(std::thread & searcher: field_searchers) {
+            searcher.join();
+        }
+    }
+
     for(size_t i = 0; i < search_fields.size(); i++) {
-        Topster<512> topster;
-        const std::string & field = search_fields[i];
-        // proceed to query search only when no filters are provided or when filtering produces results
-        if(filters.size() == 0 || filter_ids_length > 0) {
-            search_field(query, field, filter_ids, filter_ids_length, facets, sort_fields_std, num_typos, num_results,
-                         searched_queries, topster, &all_result_ids, all_result_ids_len, token_order, prefix);
-            topster.sort();
+        field_search_result* field_result = field_results[i];
+        if(field_result == nullptr) {
+            continue;
         }
 
         // order of fields specified matter: matching docs from earlier fields are more important
-        for(uint32_t t = 0; t < topster.size && t < num_results; t++) {
-            field_order_kvs.push_back(std::make_pair(search_fields.size() - i, topster.getKV(t)));
+        for(uint32_t t = 0; t < field_result->topster.size && t < num_results; t++) {
+            Topster::KV kv = field_result->topster.getKV(t);
+            // need to remap the query index against the merged `searched_queries`
+            kv.query_index += searched_queries.size();
+            field_order_kvs.push_back(std::make_pair(search_fields.size() - i, kv));
+        }
+
+        searched_queries.insert(searched_queries.end(), field_result->searched_queries.begin(),
+                                field_result->searched_queries.end());
+
+        for(size_t fi = 0; fi < field_result->facets.size(); fi++) {
+            for(const auto & facet_kv: field_result->facets[fi].result_map) {
+                facets[fi].result_map[facet_kv.first] += facet_kv.second;
+            }
+        }
+
+        if(field_result->result_ids != nullptr) {
+            uint32_t* merged_result_ids = nullptr;
+            all_result_ids_len = ArrayUtils::or_scalar(all_result_ids, all_result_ids_len,
+                                                       field_result->result_ids, field_result->result_ids_len,
+                                                       &merged_result_ids);
+            delete [] all_result_ids;
+            all_result_ids = merged_result_ids;
         }
+
+        timings.merge(field_result->timings);
+        timings.topster_evictions += field_result->topster.evictions;
+
+        delete [] field_result->result_ids;
+        delete field_result;
     }
 
     delete [] filter_ids;
@@ -622,10 +1249,23 @@ void Index::search(Option<uint32_t> & outcome, std::string query, const std::vec
 void Index::search_field(std::string & query, const std::string & field, uint32_t *filter_ids, size_t filter_ids_length,
                               std::vector<facet> & facets, const std::vector<sort_by> & sort_fields, const int num_typos,
                               const size_t num_results, std::vector<std::vector<art_leaf*>> & searched_queries,
-                              Topster<512> &topster, uint32_t** all_result_ids, size_t & all_result_ids_len,
-                              const token_ordering token_order, const bool prefix) {
+                              Topster &topster, uint32_t** all_result_ids, size_t & all_result_ids_len,
+                              query_timings & timings, const token_ordering token_order, const bool prefix,
+                              const bool exhaustive_search, const size_t max_candidates) {
     std::vector<std::string> tokens;
-    StringUtils::split(query, tokens, " ");
+    std::vector<size_t> raw_token_lens;
+
+    {
+        Tokenizer tokenizer(query, string_utils);
+        const char* token;
+        size_t token_len;
+        size_t raw_token_len;
+
+        while(tokenizer.next(token, token_len, raw_token_len)) {
+            tokens.push_back(std::string(token, token_len));
+            raw_token_lens.push_back(raw_token_len);
+        }
+    }
 
     const size_t max_cost = (num_typos < 0 || num_typos > 2) ? 2 : num_typos;
 
@@ -641,7 +1281,7 @@ void Index::search_field(std::string & query, const std::string & field, uint32_
 
     for(size_t token_index = 0; token_index < tokens.size(); token_index++) {
         std::vector<int> all_costs;
-        const size_t token_len = tokens[token_index].length();
+        const size_t token_len = raw_token_lens[token_index];
 
         // This ensures that we don't end up doing a cost of 1 for a single char etc.
         int bounded_cost = max_cost;
@@ -654,13 +1294,12 @@ void Index::search_field(std::string & query, const std::string & field, uint32_
         }
 
         token_to_costs.push_back(all_costs);
-        string_utils.unicode_normalize(tokens[token_index]);
     }
 
     // stores candidates for each token, i.e. i-th index would have all possible tokens with a cost of "c"
     std::vector<token_candidates> token_candidates_vec;
 
-    const long long combination_limit = 10;
+    const long long combination_limit = max_candidates;
     auto product = []( long long a, std::vector<int>& b ) { return a*b.size(); };
     long long n = 0;
     long long int N = std::accumulate(token_to_costs.begin(), token_to_costs.end(), 1LL, product);
@@ -675,6 +1314,25 @@ void Index::search_field(std::string & query, const std::string & field, uint32_
             costs[i] = token_to_costs[i][q.rem];
         }
 
+        if(!exhaustive_search) {
+            // Adaptive budget: a typo strictly lowers the score's cost component, so once the
+            // topster is full, a costlier combination whose best possible score cannot beat the
+            // current floor is not worth expanding - no ART lookups, no posting list scans.
+            uint32_t total_cost = 0;
+            for(const uint32_t cost: costs) {
+                total_cost += cost;
+            }
+
+            const uint64_t max_possible_score = ((uint64_t) tokens.size() << 24) |
+                                                ((uint64_t) (255 - total_cost) << 16) |
+                                                ((uint64_t) MAX_TOKENS_DISTANCE);
+
+            if(max_possible_score < topster.min_match_score()) {
+                n++;
+                continue;
+            }
+        }
+
         token_candidates_vec.clear();
         size_t token_index = 0;
 
@@ -695,8 +1353,11 @@ void Index::search_field(std::string & query, const std::string & field, uint32_
 
                 // If this is a prefix search, look for more candidates and do a union of those document IDs
                 const int max_candidates = prefix_search ? 10 : 3;
+                const uint64_t begin_micros = query_timings::now_micros();
                 art_fuzzy_search(search_index.at(field), (const unsigned char *) token.c_str(), token_len,
                                  costs[token_index], costs[token_index], max_candidates, token_order, prefix_search, leaves);
+                timings.record(STAGE_TOKEN_SEARCH, begin_micros);
+                timings.leaves_expanded += leaves.size();
 
                 if(!leaves.empty()) {
                     token_cost_cache.emplace(token_cost_hash, leaves);
@@ -735,7 +1396,7 @@ void Index::search_field(std::string & query, const std::string & field, uint32_
             // If all tokens were found, go ahead and search for candidates with what we have so far
             search_candidates(filter_ids, filter_ids_length, facets, sort_fields, token_candidates_vec,
                               token_order, searched_queries, topster, total_results, all_result_ids, all_result_ids_len,
-                              Index::SEARCH_LIMIT_NUM, prefix);
+                              Index::SEARCH_LIMIT_NUM, prefix, exhaustive_search, max_candidates, timings);
 
             if (total_results >= Index::SEARCH_LIMIT_NUM) {
                 // If we don't find enough results, we continue outerloop (looking at tokens with greater cost)
@@ -769,7 +1430,7 @@ void Index::search_field(std::string & query, const std::string & field, uint32_
 
         return search_field(truncated_query, field, filter_ids, filter_ids_length, facets, sort_fields, num_typos,
                             num_results, searched_queries, topster, all_result_ids, all_result_ids_len,
-                            token_order, prefix);
+                            timings, token_order, prefix, exhaustive_search, max_candidates);
     }
 }
 
@@ -786,20 +1447,57 @@ void Index::log_leaves(const int cost, const std::string &token, const std::vect
 }
 
 void Index::score_results(const std::vector<sort_by> & sort_fields, const int & query_index,
-                          const uint32_t total_cost, Topster<512> & topster,
+                          const uint32_t total_cost, Topster & topster,
                           const std::vector<art_leaf *> &query_suggestion,
                           const uint32_t *result_ids, const size_t result_size) const {
 
-    spp::sparse_hash_map<const art_leaf*, uint32_t*> leaf_to_indices;
+    // per-leaf offset data, batch-decoded once for the whole result block
+    struct leaf_block {
+        uint32_t* indices;       // position of every result id within the leaf's id list
+        uint32_t* offset_index;  // start of each document's offsets, for the entire leaf
+        uint32_t num_ids;
+        uint32_t num_offsets;
+        size_t arena_base;       // where this leaf's offsets begin in the flat arena
+    };
+
+    std::vector<leaf_block> leaf_blocks;
+    uint16_t* offsets_arena = nullptr;
+
+    if(query_suggestion.size() > 1) {
+        // Decode each leaf's offsets up front: one bulk decode per leaf instead of element-wise
+        // `at()` calls per document, with all offsets landing in a single flat arena so that the
+        // scoring loop below reads slices instead of building per-document vectors.
+        size_t total_offsets = 0;
+        for(art_leaf* token_leaf: query_suggestion) {
+            total_offsets += token_leaf->values->offsets.getLength();
+        }
+
+        offsets_arena = new uint16_t[total_offsets];
+        size_t arena_len = 0;
 
-    for (art_leaf *token_leaf : query_suggestion) {
-        uint32_t *indices = new uint32_t[result_size];
-        token_leaf->values->ids.indexOf(result_ids, result_size, indices);
-        leaf_to_indices.emplace(token_leaf, indices);
+        for(art_leaf* token_leaf: query_suggestion) {
+            leaf_block block;
+            block.num_ids = token_leaf->values->ids.getLength();
+            block.num_offsets = token_leaf->values->offsets.getLength();
+            block.arena_base = arena_len;
+
+            block.indices = new uint32_t[result_size];
+            token_leaf->values->ids.indexOf(result_ids, result_size, block.indices);
+
+            block.offset_index = token_leaf->values->offset_index.uncompress();
+
+            uint32_t* leaf_offsets = token_leaf->values->offsets.uncompress();
+            for(uint32_t j = 0; j < block.num_offsets; j++) {
+                offsets_arena[arena_len++] = (uint16_t) leaf_offsets[j];
+            }
+            delete [] leaf_offsets;
+
+            leaf_blocks.push_back(block);
+        }
     }
 
-    spp::sparse_hash_map<uint32_t, number_t> * primary_rank_scores = nullptr;
-    spp::sparse_hash_map<uint32_t, number_t> * secondary_rank_scores = nullptr;
+    const sort_column * primary_rank_scores = nullptr;
+    const sort_column * secondary_rank_scores = nullptr;
 
     // Used for asc/desc ordering. NOTE: Topster keeps biggest keys (i.e. it's desc in nature)
     number_t primary_rank_factor;
@@ -847,17 +1545,54 @@ void Index::score_results(const std::vector<sort_by> & sort_fields, const int &
                                               ((int64_t)(255 - total_cost) << 16) |
                                               ((int64_t)(single_token_match.distance));
 
+    // scoring hops around the columns in seq_id order, so warm the slots a few ids ahead
+    const size_t PREFETCH_DISTANCE = 8;
+
+    // scratch reused across documents - `match_window` only ever grows its capacity
+    OffsetSlice token_slices[WINDOW_SIZE];
+    std::vector<TokenOffset> match_window;
+
     for(size_t i=0; i<result_size; i++) {
         const uint32_t seq_id = result_ids[i];
 
+        if(i + PREFETCH_DISTANCE < result_size) {
+            const uint32_t ahead_id = result_ids[i + PREFETCH_DISTANCE];
+            if(primary_rank_scores) {
+                primary_rank_scores->prefetch(ahead_id);
+            }
+            if(secondary_rank_scores) {
+                secondary_rank_scores->prefetch(ahead_id);
+            }
+        }
+
         uint64_t match_score = 0;
 
         if(query_suggestion.size() == 1) {
             match_score = single_token_match_score;
         } else {
-            std::vector<std::vector<uint16_t>> token_positions;
-            populate_token_positions(query_suggestion, leaf_to_indices, i, token_positions);
-            const Match & match = Match::match(seq_id, token_positions);
+            // hand the match kernel slices of the decoded arena - no per-document allocation
+            size_t num_slices = 0;
+            for(const leaf_block & block: leaf_blocks) {
+                const uint32_t doc_index = block.indices[i];
+                if(doc_index == block.num_ids) {
+                    continue;
+                }
+
+                const uint32_t start_offset = block.offset_index[doc_index];
+                const uint32_t end_offset = (doc_index == block.num_ids - 1) ?
+                                            block.num_offsets : block.offset_index[doc_index + 1];
+
+                token_slices[num_slices] = OffsetSlice{offsets_arena + block.arena_base + start_offset,
+                                                       end_offset - start_offset};
+                num_slices++;
+
+                if(num_slices == WINDOW_SIZE) {
+                    // the match window tracks at most WINDOW_SIZE tokens
+                    break;
+                }
+            }
+
+            const Match & match = Match::match(seq_id, token_slices, num_slices, match_window);
 
             // Construct a single match score from individual components (for multi-field sort)
             match_score = ((int64_t)(match.words_present) << 24) |
@@ -870,13 +1605,11 @@ void Index::score_results(const std::vector<sort_by> & sort_fields, const int &
         number_t secondary_rank_score = default_score;
 
         if(primary_rank_scores) {
-            auto it = primary_rank_scores->find(seq_id);
-            primary_rank_score = (it == primary_rank_scores->end()) ? default_score : it->second;
+            primary_rank_scores->get(seq_id, primary_rank_score);
         }
 
         if(secondary_rank_scores) {
-            auto it = secondary_rank_scores->find(seq_id);
-            secondary_rank_score = (it == secondary_rank_scores->end()) ? default_score : it->second;
+            secondary_rank_scores->get(seq_id, secondary_rank_score);
         }
 
         const number_t & primary_rank_value = primary_rank_score * primary_rank_factor;
@@ -896,35 +1629,12 @@ void Index::score_results(const std::vector<sort_by> & sort_fields, const int &
     //long long int timeNanos = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::high_resolution_clock::now() - begin).count();
     //LOG(INFO) << "Time taken for results iteration: " << timeNanos << "ms";
 
-    for (auto it = leaf_to_indices.begin(); it != leaf_to_indices.end(); it++) {
-        delete [] it->second;
-        it->second = nullptr;
+    for(leaf_block & block: leaf_blocks) {
+        delete [] block.indices;
+        delete [] block.offset_index;
     }
-}
 
-void Index::populate_token_positions(const std::vector<art_leaf *> &query_suggestion,
-                                          spp::sparse_hash_map<const art_leaf *, uint32_t *> &leaf_to_indices,
-                                          size_t result_index, std::vector<std::vector<uint16_t>> &token_positions) const {
-    // for each token in the query, find the positions that it appears in this document
-    for (const art_leaf *token_leaf : query_suggestion) {
-            std::vector<uint16_t> positions;
-            uint32_t doc_index = leaf_to_indices.at(token_leaf)[result_index];
-            if(doc_index == token_leaf->values->ids.getLength()) {
-                continue;
-            }
-
-            uint32_t start_offset = token_leaf->values->offset_index.at(doc_index);
-            uint32_t end_offset = (doc_index == token_leaf->values->ids.getLength() - 1) ?
-                                  token_leaf->values->offsets.getLength() :
-                                  token_leaf->values->offset_index.at(doc_index+1);
-
-            while(start_offset < end_offset) {
-                positions.push_back((uint16_t) token_leaf->values->offsets.at(start_offset));
-                start_offset++;
-            }
-
-            token_positions.push_back(positions);
-        }
+    delete [] offsets_arena;
 }
 
 inline std::vector<art_leaf *> Index::next_suggestion(const std::vector<token_candidates> &token_candidates_vec,
@@ -947,111 +1657,207 @@ inline std::vector<art_leaf *> Index::next_suggestion(const std::vector<token_ca
     return query_suggestion;
 }
 
-void Index::remove_and_shift_offset_index(sorted_array &offset_index, const uint32_t *indices_sorted,
-                                               const uint32_t indices_length) {
-    uint32_t *curr_array = offset_index.uncompress();
-    uint32_t *new_array = new uint32_t[offset_index.getLength()];
+Option<uint32_t> Index::remove(const uint32_t seq_id) {
+    write_guard guard(this);
+    clear_filter_cache();
 
-    new_array[0] = 0;
-    uint32_t new_index = 0;
-    uint32_t curr_index = 0;
-    uint32_t indices_counter = 0;
-    uint32_t shift_value = 0;
-
-    while(curr_index < offset_index.getLength()) {
-        if(indices_counter < indices_length && curr_index >= indices_sorted[indices_counter]) {
-            // skip copying
-            if(curr_index == indices_sorted[indices_counter]) {
-                curr_index++;
-                const uint32_t diff = curr_index == offset_index.getLength() ?
-                                0 : (offset_index.at(curr_index) - offset_index.at(curr_index-1));
-
-                shift_value += diff;
-            }
-            indices_counter++;
-        } else {
-            new_array[new_index++] = curr_array[curr_index++] - shift_value;
-        }
+    // Rewriting the posting lists of every token of the document would stall the shard, so the
+    // document is only tombstoned here - searches skip tombstoned ids at read time and compact()
+    // purges them from the posting lists in the background.
+    deleted_ids.insert(seq_id);
+
+    // facet and sort entries are plain hash erases, cheap enough to do eagerly
+    for(auto & field_facet_value: facet_index) {
+        field_facet_value.second.erase(seq_id);
     }
 
-    offset_index.load(new_array, new_index);
+    for(auto & field_doc_value_map: sort_index) {
+        field_doc_value_map.second->erase(seq_id);
+    }
 
-    delete[] curr_array;
-    delete[] new_array;
+    return Option<uint32_t>(seq_id);
 }
 
-Option<uint32_t> Index::remove(const uint32_t seq_id, nlohmann::json & document) {
-    for(auto & name_field: search_schema) {
-        // Go through all the field names and find the keys+values so that they can be removed from in-memory index
-        std::vector<std::string> tokens;
-        if(name_field.second.type == field_types::STRING) {
-            StringUtils::split(document[name_field.first], tokens, " ");
-        } else if(name_field.second.type == field_types::STRING_ARRAY) {
-            tokens = document[name_field.first].get<std::vector<std::string>>();
-        } else if(name_field.second.type == field_types::INT32) {
+// The encoded ART keys under which a field's value is indexed, mirroring the index_* helpers.
+// Verbatim (facet) strings are kept whole and unnormalized, like index_string_field stores them.
+static void get_field_tokens(const field & a_field, const nlohmann::json & document,
+                             std::vector<std::string> & tokens) {
+    const std::string & field_name = a_field.name;
+
+    if(a_field.type == field_types::STRING) {
+        if(a_field.is_facet()) {
+            tokens.push_back(document[field_name]);
+        } else {
+            StringUtils::split(document[field_name], tokens, " ");
+        }
+    } else if(a_field.type == field_types::STRING_ARRAY) {
+        std::vector<std::string> values = document[field_name].get<std::vector<std::string>>();
+        if(a_field.is_facet()) {
+            tokens = values;
+        } else {
+            for(const std::string & value: values) {
+                StringUtils::split(value, tokens, " ");
+            }
+        }
+    } else if(a_field.type == field_types::INT32) {
+        const int KEY_LEN = 8;
+        unsigned char key[KEY_LEN];
+        int32_t value = document[field_name].get<int32_t>();
+        encode_int32(value, key);
+        tokens.push_back(std::string((char*)key, KEY_LEN));
+    } else if(a_field.type == field_types::INT32_ARRAY) {
+        std::vector<int32_t> values = document[field_name].get<std::vector<int32_t>>();
+        for(const int32_t value: values) {
             const int KEY_LEN = 8;
             unsigned char key[KEY_LEN];
-            int32_t value = document[name_field.first].get<int32_t>();
             encode_int32(value, key);
             tokens.push_back(std::string((char*)key, KEY_LEN));
-        } else if(name_field.second.type == field_types::INT32_ARRAY) {
-            std::vector<int32_t> values = document[name_field.first].get<std::vector<int32_t>>();
-            for(const int32_t value: values) {
-                const int KEY_LEN = 8;
-                unsigned char key[KEY_LEN];
-                encode_int32(value, key);
-                tokens.push_back(std::string((char*)key, KEY_LEN));
-            }
-        } else if(name_field.second.type == field_types::INT64) {
+        }
+    } else if(a_field.type == field_types::INT64) {
+        const int KEY_LEN = 8;
+        unsigned char key[KEY_LEN];
+        int64_t value = document[field_name].get<int64_t>();
+        encode_int64(value, key);
+        tokens.push_back(std::string((char*)key, KEY_LEN));
+    } else if(a_field.type == field_types::INT64_ARRAY) {
+        std::vector<int64_t> values = document[field_name].get<std::vector<int64_t>>();
+        for(const int64_t value: values) {
             const int KEY_LEN = 8;
             unsigned char key[KEY_LEN];
-            int64_t value = document[name_field.first].get<int64_t>();
             encode_int64(value, key);
             tokens.push_back(std::string((char*)key, KEY_LEN));
-        } else if(name_field.second.type == field_types::INT64_ARRAY) {
-            std::vector<int64_t> values = document[name_field.first].get<std::vector<int64_t>>();
-            for(const int64_t value: values) {
-                const int KEY_LEN = 8;
-                unsigned char key[KEY_LEN];
-                encode_int64(value, key);
-                tokens.push_back(std::string((char*)key, KEY_LEN));
-            }
-        } else if(name_field.second.type == field_types::FLOAT) {
+        }
+    } else if(a_field.type == field_types::FLOAT) {
+        const int KEY_LEN = 8;
+        unsigned char key[KEY_LEN];
+        float value = document[field_name].get<float>();
+        encode_float(value, key);
+        tokens.push_back(std::string((char*)key, KEY_LEN));
+    } else if(a_field.type == field_types::FLOAT_ARRAY) {
+        std::vector<float> values = document[field_name].get<std::vector<float>>();
+        for(const float value: values) {
             const int KEY_LEN = 8;
             unsigned char key[KEY_LEN];
-            int64_t value = document[name_field.first].get<int64_t>();
             encode_float(value, key);
             tokens.push_back(std::string((char*)key, KEY_LEN));
-        } else if(name_field.second.type == field_types::FLOAT_ARRAY) {
-            std::vector<float> values = document[name_field.first].get<std::vector<float>>();
-            for(const float value: values) {
-                const int KEY_LEN = 8;
-                unsigned char key[KEY_LEN];
-                encode_float(value, key);
-                tokens.push_back(std::string((char*)key, KEY_LEN));
-            }
-        } else if(name_field.second.type == field_types::BOOL) {
-            const int KEY_LEN = 1;
-            unsigned char key[KEY_LEN];
-            bool value = document[name_field.first].get<bool>();
-            key[0] = value ? '1' : '0';
-            tokens.push_back(std::string((char*)key, KEY_LEN));
-        } else if(name_field.second.type == field_types::BOOL_ARRAY) {
-            std::vector<bool> values = document[name_field.first].get<std::vector<bool>>();
-            for(const bool value: values) {
-                const int KEY_LEN = 1;
-                unsigned char key[KEY_LEN];
-                key[0] = value ? '1' : '0';
-                tokens.push_back(std::string((char*)key, KEY_LEN));
-            }
+        }
+    } else if(a_field.type == field_types::BOOL) {
+        bool value = document[field_name].get<bool>();
+        tokens.push_back(value ? "1" : "0");
+    } else if(a_field.type == field_types::BOOL_ARRAY) {
+        std::vector<bool> values = document[field_name].get<std::vector<bool>>();
+        for(const bool value: values) {
+            tokens.push_back(value ? "1" : "0");
+        }
+    }
+}
+
+// Removes a single document's posting from a leaf. Returns true if the leaf became empty.
+static bool remove_seq_id_from_leaf(art_leaf* leaf, const uint32_t seq_id) {
+    const uint32_t doc_index = leaf->values->ids.indexOf(seq_id);
+
+    if(doc_index == leaf->values->ids.getLength()) {
+        return false;
+    }
+
+    const uint32_t start_offset = leaf->values->offset_index.at(doc_index);
+    const uint32_t end_offset = (doc_index == leaf->values->ids.getLength() - 1) ?
+                                leaf->values->offsets.getLength() :
+                                leaf->values->offset_index.at(doc_index+1);
+
+    // entries after the removed document shift left by the size of its offsets range
+    const uint32_t num_entries = leaf->values->offset_index.getLength();
+    uint32_t* curr_array = leaf->values->offset_index.uncompress();
+    uint32_t* new_array = new uint32_t[num_entries];
+    uint32_t new_index = 0;
+
+    for(uint32_t i = 0; i < num_entries; i++) {
+        if(i == doc_index) {
+            continue;
+        }
+
+        new_array[new_index++] = (i > doc_index) ? curr_array[i] - (end_offset - start_offset) : curr_array[i];
+    }
+
+    leaf->values->offset_index.load(new_array, new_index);
+    delete[] curr_array;
+    delete[] new_array;
+
+    leaf->values->offsets.remove_index(start_offset, end_offset);
+
+    uint32_t seq_id_values[1] = {seq_id};
+    leaf->values->ids.remove_values(seq_id_values, 1);
+
+    return leaf->values->ids.getLength() == 0;
+}
+
+void Index::range_index_values(const field & a_field, const nlohmann::json & document,
+                               const uint32_t seq_id, const bool erase) {
+    if(numeric_range_index.count(a_field.name) == 0) {
+        return;
+    }
+
+    range_index* rindex = numeric_range_index.at(a_field.name);
+    std::vector<int64_t> values;
+
+    if(a_field.type == field_types::INT32) {
+        values.push_back(document[a_field.name].get<int32_t>());
+    } else if(a_field.type == field_types::INT32_ARRAY) {
+        for(const int32_t value: document[a_field.name].get<std::vector<int32_t>>()) {
+            values.push_back(value);
+        }
+    } else if(a_field.type == field_types::INT64) {
+        values.push_back(document[a_field.name].get<int64_t>());
+    } else if(a_field.type == field_types::INT64_ARRAY) {
+        for(const int64_t value: document[a_field.name].get<std::vector<int64_t>>()) {
+            values.push_back(value);
+        }
+    } else if(a_field.type == field_types::FLOAT) {
+        values.push_back(range_index::encode_value(document[a_field.name].get<float>()));
+    } else if(a_field.type == field_types::FLOAT_ARRAY) {
+        for(const float value: document[a_field.name].get<std::vector<float>>()) {
+            values.push_back(range_index::encode_value(value));
+        }
+    }
+
+    for(const int64_t value: values) {
+        if(erase) {
+            rindex->erase(value, seq_id);
+        } else {
+            rindex->insert(value, seq_id);
+        }
+    }
+}
+
+Option<uint32_t> Index::update_fields(const nlohmann::json & old_document, const nlohmann::json & new_document,
+                                      const std::vector<std::string> & changed_fields, const uint32_t seq_id,
+                                      const int32_t points) {
+    write_guard guard(this);
+    clear_filter_cache();
+
+    for(const std::string & field_name: changed_fields) {
+        if(search_schema.count(field_name) == 0) {
+            continue;
         }
 
-        for(auto & token: tokens) {
+        const field & a_field = search_schema.at(field_name);
+        art_tree* t = search_index.at(field_name);
+
+        // postings are about to shrink in place, which the completion cache cannot see
+        art_completion_clear(t);
+
+        // drop the postings of the old value
+        std::vector<std::string> tokens;
+        get_field_tokens(a_field, old_document, tokens);
+
+        for(std::string & token: tokens) {
             const unsigned char *key;
             int key_len;
 
-            if(name_field.second.type == field_types::STRING_ARRAY || name_field.second.type == field_types::STRING) {
-                string_utils.unicode_normalize(token);
+            if(a_field.type == field_types::STRING || a_field.type == field_types::STRING_ARRAY) {
+                if(!a_field.is_facet()) {
+                    string_utils.unicode_normalize(token);
+                }
                 key = (const unsigned char *) token.c_str();
                 key_len = (int) (token.length() + 1);
             } else {
@@ -1059,51 +1865,291 @@ Option<uint32_t> Index::remove(const uint32_t seq_id, nlohmann::json & document)
                 key_len = (int) (token.length());
             }
 
-            art_leaf* leaf = (art_leaf *) art_search(search_index.at(name_field.first), key, key_len);
-            if(leaf != NULL) {
-                uint32_t seq_id_values[1] = {seq_id};
-                uint32_t doc_index = leaf->values->ids.indexOf(seq_id);
+            art_leaf* leaf = (art_leaf *) art_search(t, key, key_len);
+            if(leaf == nullptr) {
+                continue;
+            }
 
-                if(doc_index == leaf->values->ids.getLength()) {
-                    // not found - happens when 2 tokens repeat in a field, e.g "is it or is is not?"
-                    continue;
-                }
+            if(remove_seq_id_from_leaf(leaf, seq_id)) {
+                art_values* values = (art_values*) art_delete(t, key, key_len);
+                delete values;
+            }
+        }
 
-                uint32_t start_offset = leaf->values->offset_index.at(doc_index);
-                uint32_t end_offset = (doc_index == leaf->values->ids.getLength() - 1) ?
-                                      leaf->values->offsets.getLength() :
-                                      leaf->values->offset_index.at(doc_index+1);
+        range_index_values(a_field, old_document, seq_id, true);
 
-                uint32_t doc_indices[1] = {doc_index};
-                remove_and_shift_offset_index(leaf->values->offset_index, doc_indices, 1);
+        // index the new value - same dispatch as index_in_memory, but for a single field
+        if(a_field.type == field_types::STRING) {
+            const std::string & text = new_document[field_name];
+            index_string_field(text, points, t, seq_id, a_field.is_facet());
+        } else if(a_field.type == field_types::INT32) {
+            uint32_t value = new_document[field_name];
+            index_int32_field(value, points, t, seq_id);
+        } else if(a_field.type == field_types::INT64) {
+            uint64_t value = new_document[field_name];
+            index_int64_field(value, points, t, seq_id);
+        } else if(a_field.type == field_types::FLOAT) {
+            float value = new_document[field_name];
+            index_float_field(value, points, t, seq_id);
+        } else if(a_field.type == field_types::BOOL) {
+            bool value = new_document[field_name];
+            index_bool_field(value, points, t, seq_id);
+        } else if(a_field.type == field_types::STRING_ARRAY) {
+            std::vector<std::string> strings = new_document[field_name];
+            index_string_array_field(strings, points, t, seq_id, a_field.is_facet());
+        } else if(a_field.type == field_types::INT32_ARRAY) {
+            std::vector<int32_t> values = new_document[field_name];
+            index_int32_array_field(values, points, t, seq_id);
+        } else if(a_field.type == field_types::INT64_ARRAY) {
+            std::vector<int64_t> values = new_document[field_name];
+            index_int64_array_field(values, points, t, seq_id);
+        } else if(a_field.type == field_types::FLOAT_ARRAY) {
+            std::vector<float> values = new_document[field_name];
+            index_float_array_field(values, points, t, seq_id);
+        } else if(a_field.type == field_types::BOOL_ARRAY) {
+            std::vector<bool> values = new_document[field_name];
+            index_bool_array_field(values, points, t, seq_id);
+        }
 
-                leaf->values->offsets.remove_index(start_offset, end_offset);
-                leaf->values->ids.remove_values(seq_id_values, 1);
+        range_index_values(a_field, new_document, seq_id, false);
 
-                /*len = leaf->values->offset_index.getLength();
-                for(auto i=0; i<len; i++) {
-                    LOG(INFO) << "i: " << i << ", val: " << leaf->values->offset_index.at(i);
-                }
-                LOG(INFO) << "----";*/
+        // numerical values feed the sort index
+        if(a_field.type == field_types::INT32 || a_field.type == field_types::INT64 ||
+           a_field.type == field_types::FLOAT || a_field.type == field_types::BOOL) {
+            sort_column *doc_to_score = sort_index.at(field_name);
 
-                if(leaf->values->ids.getLength() == 0) {
-                    art_values* values = (art_values*) art_delete(search_index.at(name_field.first), key, key_len);
-                    delete values;
-                    values = nullptr;
-                }
+            if(new_document[field_name].is_number_integer()) {
+                doc_to_score->set(seq_id, number_t(new_document[field_name].get<int64_t>()));
+            } else if(new_document[field_name].is_number_float()) {
+                doc_to_score->set(seq_id, number_t(new_document[field_name].get<float>()));
+            } else if(new_document[field_name].is_boolean()) {
+                doc_to_score->set(seq_id, number_t((int64_t) new_document[field_name].get<bool>()));
+            }
+        }
+
+        // facet values are re-indexed wholesale
+        if(facet_schema.count(field_name) != 0) {
+            facet_value & fvalue = facet_index.at(field_name);
+            fvalue.erase(seq_id);
+
+            if(a_field.type == field_types::STRING) {
+                const std::string & value = new_document[field_name];
+                fvalue.index_values(seq_id, { value });
+            } else if(a_field.type == field_types::STRING_ARRAY) {
+                const std::vector<std::string> & values = new_document[field_name];
+                fvalue.index_values(seq_id, values);
             }
         }
     }
 
-    // remove facets if any
-    for(auto & field_facet_value: facet_index) {
-        field_facet_value.second.doc_values.erase(seq_id);
+    return Option<>(200);
+}
+
+struct compaction_iter_state {
+    const spp::sparse_hash_set<uint32_t>* deleted_ids;
+    std::vector<std::string> empty_leaf_keys;
+};
+
+// Rewrites the posting data of a single leaf without the tombstoned ids. Leaves that would
+// become empty are only collected here, since the tree must not be mutated mid-iteration.
+static int compact_leaf(void *data, const unsigned char *key, uint32_t key_len, void *value) {
+    compaction_iter_state* state = (compaction_iter_state*) data;
+    art_values* values = (art_values*) value;
+
+    const uint32_t num_ids = values->ids.getLength();
+    uint32_t* ids = values->ids.uncompress();
+
+    // `ids` is sorted, so the tombstoned values collected from it are sorted too
+    std::vector<uint32_t> tombstoned_values;
+    for(uint32_t i = 0; i < num_ids; i++) {
+        if(state->deleted_ids->count(ids[i]) != 0) {
+            tombstoned_values.push_back(ids[i]);
+        }
     }
 
-    // remove sort index if any
-    for(auto & field_doc_value_map: sort_index) {
-        field_doc_value_map.second->erase(seq_id);
+    if(tombstoned_values.empty()) {
+        delete[] ids;
+        return 0;
     }
 
-    return Option<uint32_t>(seq_id);
-}
\ No newline at end of file
+    if(tombstoned_values.size() == num_ids) {
+        delete[] ids;
+        state->empty_leaf_keys.push_back(std::string((const char*) key, key_len));
+        return 0;
+    }
+
+    uint32_t* offset_index = values->offset_index.uncompress();
+    uint32_t* offsets = values->offsets.uncompress();
+    const uint32_t num_offsets = values->offsets.getLength();
+
+    std::vector<uint32_t> new_offset_index;
+    std::vector<uint32_t> new_offsets;
+
+    for(uint32_t i = 0; i < num_ids; i++) {
+        if(state->deleted_ids->count(ids[i]) != 0) {
+            continue;
+        }
+
+        const uint32_t start_offset = offset_index[i];
+        const uint32_t end_offset = (i == num_ids - 1) ? num_offsets : offset_index[i + 1];
+
+        new_offset_index.push_back(new_offsets.size());
+        for(uint32_t j = start_offset; j < end_offset; j++) {
+            new_offsets.push_back(offsets[j]);
+        }
+    }
+
+    values->ids.remove_values(tombstoned_values.data(), tombstoned_values.size());
+    values->offset_index.load(new_offset_index.data(), new_offset_index.size());
+    values->offsets.load(new_offsets.data(), new_offsets.size());
+
+    delete[] ids;
+    delete[] offset_index;
+    delete[] offsets;
+
+    return 0;
+}
+
+struct freeze_iter_state {
+    OffsetStore* offset_store;
+    size_t num_frozen;
+    bool arena_full;
+};
+
+// Moves a leaf's compressed offsets payload into the memory-mapped offset store, so that the
+// OS can page it out when cold. The ids and offset_index arrays stay on the heap - they are
+// touched on every search that reaches the leaf.
+static int freeze_leaf_offsets(void *data, const unsigned char *key, uint32_t key_len, void *value) {
+    freeze_iter_state* state = (freeze_iter_state*) data;
+    art_values* values = (art_values*) value;
+
+    if(values->offsets.is_external()) {
+        return 0;
+    }
+
+    uint8_t* mapped = state->offset_store->append(values->offsets.get_raw(), values->offsets.getLengthInBytes());
+
+    if(mapped == nullptr) {
+        state->arena_full = true;
+        return 1;  // a non-zero return stops the iteration
+    }
+
+    values->offsets.use_external(mapped);
+    state->num_frozen++;
+    return 0;
+}
+
+void Index::freeze_offsets() {
+    if(offset_store == nullptr || !offset_store->ok()) {
+        return ;
+    }
+
+    freeze_iter_state state;
+    state.offset_store = offset_store;
+    state.num_frozen = 0;
+    state.arena_full = false;
+
+    for(auto & field_tree: search_index) {
+        art_iter(field_tree.second, freeze_leaf_offsets, &state);
+    }
+
+    if(state.arena_full) {
+        LOG(ERR) << "Offset store of index " << name << " is full - remaining offsets stay on the heap.";
+    }
+
+    if(state.num_frozen != 0) {
+        LOG(INFO) << "Froze offsets of " << state.num_frozen << " terms of index " << name
+                  << ", arena bytes used: " << offset_store->bytes_used();
+    }
+}
+
+void Index::compact() {
+    write_guard guard(this);
+
+    if(deleted_ids.empty()) {
+        // background maintenance is also when cold offset payloads migrate to the arena
+        freeze_offsets();
+        return;
+    }
+
+    clear_filter_cache();
+
+    for(auto & field_tree: search_index) {
+        art_tree* t = field_tree.second;
+
+        compaction_iter_state state;
+        state.deleted_ids = &deleted_ids;
+        art_iter(t, compact_leaf, &state);
+
+        for(const std::string & key: state.empty_leaf_keys) {
+            art_values* values = (art_values*) art_delete(t, (const unsigned char *) key.data(), key.size());
+            delete values;
+        }
+
+        // surviving leaves shrank in place, so cached completions are stale
+        art_completion_clear(t);
+    }
+
+    for(auto & name_rindex: numeric_range_index) {
+        std::vector<std::pair<int64_t, uint32_t>> & entries = name_rindex.second->entries;
+        entries.erase(std::remove_if(entries.begin(), entries.end(),
+                                     [this](const std::pair<int64_t, uint32_t> & entry) {
+                                         return deleted_ids.count(entry.second) != 0;
+                                     }), entries.end());
+    }
+
+    // The max_score/max_token_count hints of inner nodes are left as-is: they are upper bounds
+    // used only for pruning, so over-estimating them is harmless.
+
+    LOG(INFO) << "Compacted " << deleted_ids.size() << " tombstones from index " << name;
+    deleted_ids.clear();
+
+    // leaves rewritten above fell back to the heap - re-freeze them along with new cold leaves
+    freeze_offsets();
+}
+
+nlohmann::json Index::get_memory_stats() {
+    read_guard guard(this);
+    nlohmann::json fields = nlohmann::json::object();
+
+    for(const auto & field_tree: search_index) {
+        fields[field_tree.first]["art_bytes"] = art_memory_usage(field_tree.second);
+    }
+
+    for(const auto & field_column: sort_index) {
+        fields[field_column.first]["sort_bytes"] = field_column.second->memory_usage();
+    }
+
+    for(const auto & field_facet: facet_index) {
+        fields[field_facet.first]["facet_bytes"] = field_facet.second.memory_usage();
+    }
+
+    for(const auto & field_range: numeric_range_index) {
+        fields[field_range.first]["range_bytes"] = field_range.second->memory_usage();
+    }
+
+    return fields;
+}
+
+bool Index::needs_compaction() {
+    read_guard guard(this);
+    return deleted_ids.size() >= COMPACTION_MIN_TOMBSTONES &&
+           deleted_ids.size() * 100 >= num_documents * COMPACTION_TOMBSTONE_PCT;
+}
+
+size_t Index::exclude_deleted_ids(uint32_t* ids, size_t ids_len) const {
+    if(deleted_ids.empty()) {
+        return ids_len;
+    }
+
+    // in-place filtering keeps the array sorted
+    size_t new_len = 0;
+    for(size_t i = 0; i < ids_len; i++) {
+        if(deleted_ids.count(ids[i]) == 0) {
+            ids[new_len++] = ids[i];
+        }
+    }
+
+    return new_len;
+}
+
@@ -2,61 +2,332 @@
 #include <iostream>
 #include <fstream>
 #include <vector>
-#include <numeric>
+#include <algorithm>
+#include <functional>
 #include <chrono>
-#include <art.h>
+#include <thread>
+#include <random>
 #include <unordered_map>
-#include <queue>
+#include <cmdline.h>
 #include "collection.h"
 #include "string_utils.h"
 #include "collection_manager.h"
 
-using namespace std;
+/*
+* Benchmark harness with pluggable workloads, meant for performance regression tracking: it
+* indexes a JSONL corpus, then drives the collection with concurrent client threads per
+* workload and prints latency percentiles and throughput as machine-readable JSON on stdout.
+*
+* Every document of the corpus must carry a string `title` and an integer `points` field
+* (e.g. the hnstories dataset). A synthetic single-character `bucket` facet field is derived
+* from the title, so that the faceted workload exercises real facet counting.
+*/
+
+struct workload_result {
+    std::string name;
+    size_t threads;
+    size_t count;
+    uint64_t p50_micros;
+    uint64_t p95_micros;
+    uint64_t p99_micros;
+    uint64_t max_micros;
+    double per_second;
+};
+
+// a search workload is just a query generator plus fixed search options - the harness
+// takes care of warmup, concurrency and measurement
+struct search_workload {
+    std::string name;
+    std::string filter;
+    std::vector<std::string> facets;
+    std::vector<sort_by> sort_fields;
+    int num_typos = 0;
+    bool prefix = false;
+    std::function<std::string(std::mt19937 &)> make_query;
+};
+
+static uint64_t now_micros() {
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::high_resolution_clock::now().time_since_epoch()).count();
+}
+
+static uint64_t percentile_of(const std::vector<uint64_t> & sorted_latencies, const size_t pct) {
+    size_t rank = (sorted_latencies.size() * pct + 99) / 100;
+    rank = (rank == 0) ? 0 : rank - 1;
+    return sorted_latencies[std::min(rank, sorted_latencies.size() - 1)];
+}
+
+static workload_result summarize(const std::string & name, const size_t threads,
+                                 std::vector<uint64_t> & latencies, const uint64_t wall_micros) {
+    std::sort(latencies.begin(), latencies.end());
+
+    workload_result result;
+    result.name = name;
+    result.threads = threads;
+    result.count = latencies.size();
+    result.p50_micros = percentile_of(latencies, 50);
+    result.p95_micros = percentile_of(latencies, 95);
+    result.p99_micros = percentile_of(latencies, 99);
+    result.max_micros = latencies.back();
+    result.per_second = (wall_micros == 0) ? 0 : (latencies.size() * 1000000.0) / wall_micros;
+    return result;
+}
+
+// runs a workload with `num_threads` concurrent clients, each discarding `warmup` queries
+// before recording `queries` measured ones
+static workload_result run_search_workload(Collection* collection, const search_workload & workload,
+                                           const size_t num_threads, const size_t warmup, const size_t queries) {
+    const std::vector<std::string> search_fields = {"title"};
+    std::vector<std::vector<uint64_t>> thread_latencies(num_threads);
+    std::vector<std::thread> clients;
+
+    const uint64_t wall_begin = now_micros();
+
+    for(size_t thread_index = 0; thread_index < num_threads; thread_index++) {
+        clients.emplace_back([&, thread_index]() {
+            std::mt19937 rng(42 + thread_index);  // deterministic per thread, so runs are comparable
+            std::vector<uint64_t> & latencies = thread_latencies[thread_index];
+            latencies.reserve(queries);
+
+            for(size_t i = 0; i < warmup + queries; i++) {
+                const std::string query = workload.make_query(rng);
+
+                const uint64_t begin = now_micros();
+                collection->search(query, search_fields, workload.filter, workload.facets,
+                                   workload.sort_fields, workload.num_typos, 10, 1,
+                                   FREQUENCY, workload.prefix);
+                const uint64_t took = now_micros() - begin;
+
+                if(i >= warmup) {
+                    latencies.push_back(took);
+                }
+            }
+        });
+    }
+
+    for(std::thread & client: clients) {
+        client.join();
+    }
+
+    const uint64_t wall_micros = now_micros() - wall_begin;
+
+    std::vector<uint64_t> latencies;
+    for(const std::vector<uint64_t> & client_latencies: thread_latencies) {
+        latencies.insert(latencies.end(), client_latencies.begin(), client_latencies.end());
+    }
+
+    return summarize(workload.name, num_threads, latencies, wall_micros);
+}
+
+static nlohmann::json result_to_json(const workload_result & result) {
+    nlohmann::json json_result;
+    json_result["threads"] = result.threads;
+    json_result["count"] = result.count;
+    json_result["p50_micros"] = result.p50_micros;
+    json_result["p95_micros"] = result.p95_micros;
+    json_result["p99_micros"] = result.p99_micros;
+    json_result["max_micros"] = result.max_micros;
+    json_result["per_second"] = result.per_second;
+    return json_result;
+}
 
 int main(int argc, char* argv[]) {
-    system("rm -rf /tmp/typesense-data && mkdir -p /tmp/typesense-data");
+    cmdline::parser options;
+    options.set_program_name("./benchmark");
+
+    options.add<std::string>("docs", 'd', "Path to a JSONL corpus with `title` and `points` fields.", true);
+    options.add<std::string>("workload", 'w', "Workload to run: all, bulk_index, single_term, "
+                                              "multi_term, typo or prefix.", false, "all");
+    options.add<uint32_t>("threads", 't', "Number of concurrent client threads.", false, 4);
+    options.add<uint32_t>("warmup", '\0', "Warmup queries per thread (not measured).", false, 100);
+    options.add<uint32_t>("queries", '\0', "Measured queries per thread.", false, 1000);
+
+    options.parse_check(argc, argv);
+
+    const std::string workload_name = options.get<std::string>("workload");
+    const size_t num_threads = options.get<uint32_t>("threads");
+    const size_t warmup = options.get<uint32_t>("warmup");
+    const size_t queries = options.get<uint32_t>("queries");
+
+    system("rm -rf /tmp/typesense-bench && mkdir -p /tmp/typesense-bench");
 
     std::vector<field> fields_to_index = { field("title", field_types::STRING, false),
+                                           field("bucket", field_types::STRING, true),
                                            field("points", field_types::INT32, false) };
 
-    Store *store = new Store("/tmp/typesense-data");
+    Store *store = new Store("/tmp/typesense-bench");
     CollectionManager & collectionManager = CollectionManager::get_instance();
     collectionManager.init(store, "abcd", "1234");
 
-    Collection *collection = collectionManager.get_collection("hnstories_direct");
-    if(collection == nullptr) {
-        collection = collectionManager.create_collection("hnstories_direct", fields_to_index, "points").get();
-    }
-
-    std::ifstream infile(argv[1]);
+    Collection *collection = collectionManager.create_collection("bench", fields_to_index, "points").get();
 
+    // Load the corpus: derive the synthetic facet field, and harvest tokens and point values
+    // so that the query workloads search for terms that actually occur in the index.
+    std::ifstream infile(options.get<std::string>("docs"));
     std::string json_line;
-    auto begin = std::chrono::high_resolution_clock::now();
+
+    std::unordered_map<std::string, size_t> token_counts;
+    std::vector<int32_t> point_values;
+    std::vector<std::string> batch_lines;
+    std::vector<uint64_t> batch_latencies;
+    size_t num_docs = 0;
+    uint64_t index_micros = 0;
+
+    auto flush_batch = [&]() {
+        if(batch_lines.empty()) {
+            return;
+        }
+
+        std::string import_body;
+        for(const std::string & line: batch_lines) {
+            import_body += line;
+            import_body += "\n";
+        }
+
+        const uint64_t begin = now_micros();
+        collection->add_many(import_body);
+        const uint64_t took = now_micros() - begin;
+
+        batch_latencies.push_back(took);
+        index_micros += took;
+        batch_lines.clear();
+    };
 
     while (std::getline(infile, json_line)) {
-        collection->add(json_line);
+        nlohmann::json document;
+        try {
+            document = nlohmann::json::parse(json_line);
+        } catch(const std::invalid_argument & e) {
+            continue;
+        }
+
+        if(document.count("title") == 0 || !document["title"].is_string() ||
+           document.count("points") == 0 || !document["points"].is_number_integer()) {
+            continue;
+        }
+
+        const std::string title = document["title"];
+        char bucket = 'z';
+        for(const char c: title) {
+            if(isalpha(c)) {
+                bucket = (char) tolower(c);
+                break;
+            }
+        }
+        document["bucket"] = std::string(1, bucket);
+
+        std::vector<std::string> tokens;
+        StringUtils::split(title, tokens, " ");
+        for(std::string & token: tokens) {
+            std::transform(token.begin(), token.end(), token.begin(), ::tolower);
+            token_counts[token] += 1;
+        }
+
+        point_values.push_back(document["points"].get<int32_t>());
+        batch_lines.push_back(document.dump());
+        num_docs++;
+
+        if(batch_lines.size() == Collection::IMPORT_BATCH_SIZE) {
+            flush_batch();
+        }
     }
 
+    flush_batch();
     infile.close();
-    std::cout << "FINISHED INDEXING!" << flush << std::endl;
 
-    /*std::vector<std::string> search_fields = {"title"};
+    if(num_docs == 0) {
+        std::cerr << "No usable documents found in the corpus." << std::endl;
+        return 1;
+    }
+
+    // term pool: the most frequent tokens, so that queries hit non-trivial posting lists
+    std::vector<std::pair<std::string, size_t>> token_count_pairs(token_counts.begin(), token_counts.end());
+    std::sort(token_count_pairs.begin(), token_count_pairs.end(),
+              [](const std::pair<std::string, size_t> & a, const std::pair<std::string, size_t> & b) {
+                  return a.second > b.second;
+              });
 
-    std::vector<string> queries = {"the", "and", "to", "of", "in"};
-    auto counter = 0;
-    uint64_t results_total = 0; // to prevent optimizations!
+    std::vector<std::string> term_pool;
+    std::vector<std::string> long_term_pool;  // terms long enough for typo corruption and prefixes
 
-    auto begin = std::chrono::high_resolution_clock::now();
+    for(size_t i = 0; i < std::min((size_t) 500, token_count_pairs.size()); i++) {
+        term_pool.push_back(token_count_pairs[i].first);
+        if(token_count_pairs[i].first.size() >= 5) {
+            long_term_pool.push_back(token_count_pairs[i].first);
+        }
+    }
+
+    if(long_term_pool.empty()) {
+        long_term_pool = term_pool;
+    }
+
+    std::nth_element(point_values.begin(), point_values.begin() + point_values.size() / 2, point_values.end());
+    const int32_t median_points = point_values[point_values.size() / 2];
+
+    auto random_term = [](const std::vector<std::string> & pool, std::mt19937 & rng) -> const std::string & {
+        return pool[rng() % pool.size()];
+    };
+
+    std::vector<search_workload> workloads;
+
+    search_workload single_term;
+    single_term.name = "single_term";
+    single_term.make_query = [&](std::mt19937 & rng) { return random_term(term_pool, rng); };
+    workloads.push_back(single_term);
+
+    search_workload multi_term;
+    multi_term.name = "multi_term";
+    multi_term.filter = "points:>" + std::to_string(median_points);
+    multi_term.facets = {"bucket"};
+    multi_term.sort_fields = { sort_by("points", "DESC") };
+    multi_term.make_query = [&](std::mt19937 & rng) {
+        return random_term(term_pool, rng) + " " + random_term(term_pool, rng);
+    };
+    workloads.push_back(multi_term);
+
+    search_workload typo;
+    typo.name = "typo";
+    typo.num_typos = 2;
+    typo.make_query = [&](std::mt19937 & rng) {
+        std::string term = random_term(long_term_pool, rng);
+        term[rng() % term.size()] = (char) ('a' + rng() % 26);  // corrupt one character
+        return term;
+    };
+    workloads.push_back(typo);
+
+    search_workload prefix;
+    prefix.name = "prefix";
+    prefix.prefix = true;
+    prefix.make_query = [&](std::mt19937 & rng) {
+        const std::string & term = random_term(long_term_pool, rng);
+        return term.substr(0, 3 + rng() % 2);
+    };
+    workloads.push_back(prefix);
+
+    nlohmann::json output;
+    output["num_docs"] = num_docs;
+    output["workloads"] = nlohmann::json::object();
+
+    if(workload_name == "all" || workload_name == "bulk_index") {
+        workload_result index_result = summarize("bulk_index", 1, batch_latencies, index_micros);
+        nlohmann::json json_result = result_to_json(index_result);
+        json_result["batch_size"] = Collection::IMPORT_BATCH_SIZE;
+        json_result["docs_per_second"] = (index_micros == 0) ? 0 : (num_docs * 1000000.0) / index_micros;
+        output["workloads"]["bulk_index"] = json_result;
+    }
+
+    for(const search_workload & workload: workloads) {
+        if(workload_name != "all" && workload_name != workload.name) {
+            continue;
+        }
+
+        const workload_result result = run_search_workload(collection, workload, num_threads, warmup, queries);
+        output["workloads"][result.name] = result_to_json(result);
+    }
 
-    while(counter < 3000) {
-        auto i = counter % 5;
-        auto results = collection->search(queries[i], search_fields, "", { }, {sort_field("points", "DESC")}, 1, 10, 1, MAX_SCORE, 0).get();
-        results_total += results.size();
-        counter++;
-    }*/
+    std::cout << output.dump(2) << std::endl;
 
-    long long int timeMillis = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::high_resolution_clock::now() - begin).count();
-    std::cout << "Time taken: " << timeMillis << "ms" << std::endl;
-    //std::cout << "Total: " << results_total << std::endl;
+    collectionManager.dispose();
+    delete store;
     return 0;
-}
\ No newline at end of file
+}
@@ -0,0 +1,238 @@
+#include <benchmark/benchmark.h>
+#include <vector>
+#include <random>
+#include <algorithm>
+#include "art.h"
+#include "array_utils.h"
+#include "sorted_array.h"
+#include "match_score.h"
+#include "topster.h"
+
+/*
+* Microbenchmarks for the kernels that dominate search profiles, so that kernel-level
+* changes (e.g. the SIMD intersection work) can be validated in isolation instead of
+* through end-to-end runs.
+*
+* Benchmarks are parameterized on input size, and additionally on the skew ratio between
+* the two list lengths where that decides which code path is taken.
+*
+* Run with: ./kernel_bench [--benchmark_filter=<regex>]
+*/
+
+// Deterministic sorted id set: seeded per call so that every run sees identical inputs.
+// `max_step` controls density - a larger step spreads the same number of ids over a
+// wider value range.
+static std::vector<uint32_t> sorted_ids(const size_t len, const uint32_t seed, const uint32_t max_step) {
+    std::mt19937 rng(seed);
+    std::vector<uint32_t> ids(len);
+    uint32_t value = 0;
+
+    for(size_t i = 0; i < len; i++) {
+        value += 1 + rng() % max_step;
+        ids[i] = value;
+    }
+
+    return ids;
+}
+
+static void BM_and_scalar(benchmark::State& state) {
+    const size_t lenA = state.range(0);
+    const size_t skew = state.range(1);
+    const size_t lenB = std::max((size_t) 1, lenA / skew);
+
+    // scale the step of the shorter list so that both span roughly the same id range
+    const std::vector<uint32_t> A = sorted_ids(lenA, 1, 4);
+    const std::vector<uint32_t> B = sorted_ids(lenB, 2, 4 * skew);
+
+    while(state.KeepRunning()) {
+        uint32_t* out = nullptr;
+        benchmark::DoNotOptimize(ArrayUtils::and_scalar(A.data(), lenA, B.data(), lenB, &out));
+        delete[] out;
+    }
+
+    state.SetItemsProcessed(state.iterations() * (lenA + lenB));
+}
+BENCHMARK(BM_and_scalar)->Args({1024, 1})->Args({65536, 1})->Args({65536, 16})->Args({65536, 256})
+                        ->Args({1048576, 1})->Args({1048576, 256});
+
+static void BM_intersect(benchmark::State& state) {
+    const size_t lenA = state.range(0);
+    const size_t skew = state.range(1);
+    const size_t lenB = std::max((size_t) 1, lenA / skew);
+
+    const std::vector<uint32_t> A = sorted_ids(lenA, 1, 4);
+    const std::vector<uint32_t> B = sorted_ids(lenB, 2, 4 * skew);
+
+    while(state.KeepRunning()) {
+        uint32_t* out = nullptr;
+        benchmark::DoNotOptimize(ArrayUtils::intersect(A.data(), lenA, B.data(), lenB, &out));
+        delete[] out;
+    }
+
+    state.SetItemsProcessed(state.iterations() * (lenA + lenB));
+}
+BENCHMARK(BM_intersect)->Args({1024, 1})->Args({65536, 1})->Args({65536, 16})->Args({65536, 256})
+                       ->Args({1048576, 1})->Args({1048576, 256});
+
+static void BM_or_scalar(benchmark::State& state) {
+    const size_t lenA = state.range(0);
+    const size_t skew = state.range(1);
+    const size_t lenB = std::max((size_t) 1, lenA / skew);
+
+    const std::vector<uint32_t> A = sorted_ids(lenA, 1, 4);
+    const std::vector<uint32_t> B = sorted_ids(lenB, 2, 4 * skew);
+
+    while(state.KeepRunning()) {
+        uint32_t* out = nullptr;
+        benchmark::DoNotOptimize(ArrayUtils::or_scalar(A.data(), lenA, B.data(), lenB, &out));
+        delete[] out;
+    }
+
+    state.SetItemsProcessed(state.iterations() * (lenA + lenB));
+}
+BENCHMARK(BM_or_scalar)->Args({1024, 1})->Args({65536, 1})->Args({65536, 16})->Args({1048576, 1});
+
+static void BM_sorted_array_append(benchmark::State& state) {
+    const size_t len = state.range(0);
+    const std::vector<uint32_t> ids = sorted_ids(len, 3, 4);
+
+    while(state.KeepRunning()) {
+        sorted_array arr;
+        for(size_t i = 0; i < len; i++) {
+            arr.append(ids[i]);
+        }
+        benchmark::DoNotOptimize(arr.getLength());
+    }
+
+    state.SetItemsProcessed(state.iterations() * len);
+}
+BENCHMARK(BM_sorted_array_append)->Arg(1024)->Arg(16384)->Arg(262144);
+
+static void BM_sorted_array_indexOf(benchmark::State& state) {
+    const size_t len = state.range(0);
+    const std::vector<uint32_t> ids = sorted_ids(len, 4, 4);
+
+    sorted_array arr;
+    arr.load(ids.data(), len);
+
+    size_t i = 0;
+    while(state.KeepRunning()) {
+        benchmark::DoNotOptimize(arr.indexOf(ids[i]));
+        i = (i + 7919) % len;  // co-prime stride, visits every element
+    }
+}
+BENCHMARK(BM_sorted_array_indexOf)->Arg(1024)->Arg(16384)->Arg(262144);
+
+static void BM_sorted_array_uncompress(benchmark::State& state) {
+    const size_t len = state.range(0);
+    const std::vector<uint32_t> ids = sorted_ids(len, 5, 4);
+
+    sorted_array arr;
+    arr.load(ids.data(), len);
+
+    while(state.KeepRunning()) {
+        uint32_t* out = arr.uncompress();
+        benchmark::DoNotOptimize(out);
+        delete[] out;
+    }
+
+    state.SetItemsProcessed(state.iterations() * len);
+}
+BENCHMARK(BM_sorted_array_uncompress)->Arg(1024)->Arg(16384)->Arg(262144);
+
+// Populates a tree with `num_words` synthetic words over a small alphabet, so that
+// fuzzy expansion has plenty of close neighbours to explore.
+static void populate_art_tree(art_tree* t, const size_t num_words, std::vector<std::string> & words) {
+    std::mt19937 rng(6);
+
+    for(uint32_t i = 0; i < num_words; i++) {
+        std::string word;
+        const size_t word_len = 4 + rng() % 8;
+        for(size_t j = 0; j < word_len; j++) {
+            word += (char) ('a' + rng() % 8);
+        }
+
+        uint32_t offset = 0;
+        art_document document;
+        document.id = i;
+        document.score = (int32_t) (rng() % 1000);
+        document.offsets_len = 1;
+        document.offsets = &offset;
+
+        art_insert(t, (const unsigned char *) word.c_str(), word.size() + 1, &document, 1);
+        words.push_back(word);
+    }
+}
+
+static void BM_art_fuzzy_search(benchmark::State& state) {
+    const size_t num_words = state.range(0);
+    const int max_cost = state.range(1);
+
+    art_tree t;
+    art_tree_init(&t);
+
+    std::vector<std::string> words;
+    populate_art_tree(&t, num_words, words);
+
+    size_t i = 0;
+    while(state.KeepRunning()) {
+        std::string term = words[i % words.size()];
+        if(max_cost != 0) {
+            term[i % term.size()] = (char) ('a' + i % 8);  // corrupt one character
+        }
+
+        std::vector<art_leaf*> results;
+        art_fuzzy_search(&t, (const unsigned char *) term.c_str(), term.size() + 1, 0, max_cost,
+                         10, FREQUENCY, false, results);
+        benchmark::DoNotOptimize(results.size());
+        i++;
+    }
+
+    art_tree_destroy(&t);
+}
+BENCHMARK(BM_art_fuzzy_search)->Args({1000, 0})->Args({1000, 2})->Args({100000, 0})
+                              ->Args({100000, 1})->Args({100000, 2});
+
+static void BM_match(benchmark::State& state) {
+    const size_t num_tokens = state.range(0);
+    const size_t offsets_per_token = state.range(1);
+
+    std::mt19937 rng(7);
+    std::vector<std::vector<uint16_t>> token_offsets(num_tokens);
+
+    for(size_t i = 0; i < num_tokens; i++) {
+        for(size_t j = 0; j < offsets_per_token; j++) {
+            token_offsets[i].push_back((uint16_t) (rng() % 512));
+        }
+        std::sort(token_offsets[i].begin(), token_offsets[i].end());
+    }
+
+    while(state.KeepRunning()) {
+        Match match = Match::match(0, token_offsets);
+        benchmark::DoNotOptimize(match.words_present);
+    }
+}
+BENCHMARK(BM_match)->Args({2, 4})->Args({4, 16})->Args({8, 64});
+
+static void BM_topster_add(benchmark::State& state) {
+    const size_t num_keys = state.range(0);
+
+    std::mt19937 rng(8);
+    std::vector<uint64_t> scores(num_keys);
+    for(size_t i = 0; i < num_keys; i++) {
+        scores[i] = rng();
+    }
+
+    while(state.KeepRunning()) {
+        Topster topster(512);
+        for(size_t i = 0; i < num_keys; i++) {
+            topster.add(i, 0, scores[i], (int64_t) 0, (int64_t) 0);
+        }
+        benchmark::DoNotOptimize(topster.size);
+    }
+
+    state.SetItemsProcessed(state.iterations() * num_keys);
+}
+BENCHMARK(BM_topster_add)->Arg(1024)->Arg(16384)->Arg(262144);
+
+BENCHMARK_MAIN();
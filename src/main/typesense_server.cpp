@@ -11,6 +11,7 @@
 #include "string_utils.h"
 #include "replicator.h"
 #include "logger.h"
+#include "query_metrics.h"
 
 HttpServer* server;
 
@@ -31,25 +32,33 @@ void master_server_routes() {
     server->get("/collections", get_collections);
     server->del("/collections/:collection", del_drop_collection);
     server->get("/collections/:collection", get_collection_summary);
+    server->get("/collections/:collection/stats", get_collection_stats);
 
     // document management - `/documents/:id` end-points must be placed last in the list
     server->post("/collections/:collection/documents", post_add_document);
+    server->post("/collections/:collection/documents/import", post_import_documents);
     server->get("/collections/:collection/documents/search", get_search);
     server->get("/collections/:collection/documents/export", get_collection_export, true);
     server->get("/collections/:collection/documents/:id", get_fetch_document);
+    server->patch("/collections/:collection/documents/:id", patch_update_document);
     server->del("/collections/:collection/documents/:id", del_remove_document);
 
     // meta
     server->get("/debug", get_debug);
+    server->get("/metrics", get_metrics);
 
     // replication
     server->get("/replication/updates", get_replication_updates, true);
+    server->get("/replication/stream", get_replication_stream, true);
+    server->get("/replication/store_snapshot", get_replication_store_snapshot, true);
+    server->get("/replication/index_snapshot", get_replication_index_snapshot, true);
 }
 
 void replica_server_routes() {
     // collection management
     server->get("/collections", get_collections);
     server->get("/collections/:collection", get_collection_summary);
+    server->get("/collections/:collection/stats", get_collection_stats);
 
     // document management - `/documents/:id` end-points must be placed last in the list
     server->get("/collections/:collection/documents/search", get_search);
@@ -58,9 +67,13 @@ void replica_server_routes() {
 
     // meta
     server->get("/debug", get_debug);
+    server->get("/metrics", get_metrics);
 
     // replication
     server->get("/replication/updates", get_replication_updates, true);
+    server->get("/replication/stream", get_replication_stream, true);
+    server->get("/replication/store_snapshot", get_replication_store_snapshot, true);
+    server->get("/replication/index_snapshot", get_replication_index_snapshot, true);
 }
 
 int main(int argc, char **argv) {
@@ -87,7 +100,10 @@ int main(int argc, char **argv) {
     options.add<std::string>("ssl-certificate-key", 'k', "Path to the SSL certificate key file.", false, "");
 
     options.add("enable-cors", '\0', "Enable CORS requests.");
+    options.add<uint32_t>("http-threads", '\0', "Number of HTTP event loop threads.", false, 4);
     options.add<std::string>("log-dir", '\0', "Path to the log file.", false, "");
+    options.add<int>("slow-query-threshold-ms", '\0', "Searches taking longer than this many milliseconds are "
+                     "logged with a per-stage breakdown. A negative value disables the slow query log.", false, 1000);
 
     options.parse_check(argc, argv);
 
@@ -114,15 +130,44 @@ int main(int argc, char **argv) {
 
     LOG(INFO) << "Starting Typesense " << TYPESENSE_VERSION;
 
+    QueryMetrics::get_instance().set_slow_query_threshold_ms(options.get<int>("slow-query-threshold-ms"));
+
     if(!directory_exists(options.get<std::string>("data-dir"))) {
         LOG(ERR) << "Typesense failed to start. " << "Data directory " << options.get<std::string>("data-dir")
                   << " does not exist.";
         return 1;
     }
 
+    Store store(options.get<std::string>("data-dir"));
+
+    const std::string & master_host_port = options.get<std::string>("master");
+
+    if(!master_host_port.empty()) {
+        std::vector<std::string> parts;
+        StringUtils::split(master_host_port, parts, ":");
+        if(parts.size() != 3) {
+            LOG(ERR) << "Invalid value for --master option. Usage: http(s)://<master_address>:<master_port>";
+            return 1;
+        }
+
+        if(store.get_latest_seq_number() == 0) {
+            // A replica with an empty data directory bootstraps from master snapshots before
+            // collections are loaded, so that it starts serving searches in minutes instead of
+            // replaying the master's entire WAL. The WAL tail is applied by the replication
+            // thread once the server is up.
+            LOG(INFO) << "Bootstrapping replica from the master's snapshots...";
+
+            if(!Replicator::bootstrap(master_host_port, options.get<std::string>("api-key"), store)) {
+                LOG(ERR) << "Typesense failed to start. Could not bootstrap from the master.";
+                return 1;
+            }
+
+            LOG(INFO) << "Finished bootstrapping from the master.";
+        }
+    }
+
     LOG(INFO) << "Loading collections from disk...";
 
-    Store store(options.get<std::string>("data-dir"));
     CollectionManager & collectionManager = CollectionManager::get_instance();
     Option<bool> init_op = collectionManager.init(&store, options.get<std::string>("api-key"),
                                                   options.get<std::string>("search-only-api-key"));
@@ -139,7 +184,8 @@ int main(int argc, char **argv) {
         options.get<uint32_t>("listen-port"),
         options.get<std::string>("ssl-certificate"),
         options.get<std::string>("ssl-certificate-key"),
-        options.exist("enable-cors")
+        options.exist("enable-cors"),
+        options.get<uint32_t>("http-threads")
     );
 
     server->set_auth_handler(handle_authentication);
@@ -147,19 +193,11 @@ int main(int argc, char **argv) {
     server->on(SEND_RESPONSE_MSG, on_send_response);
     server->on(REPLICATION_EVENT_MSG, Replicator::on_replication_event);
 
-    if(options.get<std::string>("master").empty()) {
+    if(master_host_port.empty()) {
         master_server_routes();
     } else {
         replica_server_routes();
 
-        const std::string & master_host_port = options.get<std::string>("master");
-        std::vector<std::string> parts;
-        StringUtils::split(master_host_port, parts, ":");
-        if(parts.size() != 3) {
-            LOG(ERR) << "Invalid value for --master option. Usage: http(s)://<master_address>:<master_port>";
-            return 1;
-        }
-
         LOG(INFO) << "Typesense is starting as a read-only replica... Spawning replication thread...";
         std::thread replication_thread([&master_host_port, &store, &options]() {
             Replicator::start(::server, master_host_port, options.get<std::string>("api-key"), store);
@@ -171,6 +209,10 @@ int main(int argc, char **argv) {
     int return_code = server->run();
 
     // we are out of the event loop here
+
+    LOG(INFO) << "Writing index snapshots to disk...";
+    collectionManager.save_index_snapshots();
+
     delete server;
     CollectionManager::get_instance().dispose();
 
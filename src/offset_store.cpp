@@ -0,0 +1,76 @@
+#include "offset_store.h"
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <cstring>
+#include "logger.h"
+
+OffsetStore::OffsetStore(const std::string & path, const size_t capacity):
+        path(path), fd(-1), base(nullptr), capacity(capacity), used(0) {
+    fd = open(path.c_str(), O_CREAT | O_RDWR | O_TRUNC, 0644);
+
+    if(fd == -1) {
+        LOG(ERR) << "Could not create offset store file: " << path;
+        return ;
+    }
+
+    if(ftruncate(fd, capacity) != 0) {
+        LOG(ERR) << "Could not size offset store file: " << path;
+        close(fd);
+        fd = -1;
+        return ;
+    }
+
+    void* addr = mmap(nullptr, capacity, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+
+    if(addr == MAP_FAILED) {
+        LOG(ERR) << "Could not map offset store file: " << path;
+        close(fd);
+        fd = -1;
+        return ;
+    }
+
+    base = (uint8_t*) addr;
+
+    // unlinking makes the file anonymous: the mapping stays usable and the kernel
+    // frees the blocks once the store is destroyed, even if the process crashes
+    unlink(path.c_str());
+}
+
+OffsetStore::~OffsetStore() {
+    if(base != nullptr) {
+        munmap(base, capacity);
+    }
+
+    if(fd != -1) {
+        close(fd);
+    }
+}
+
+bool OffsetStore::ok() {
+    return base != nullptr;
+}
+
+uint8_t* OffsetStore::append(const uint8_t* data, const size_t len) {
+    std::unique_lock<std::mutex> lock(m);
+
+    if(base == nullptr || used + len > capacity) {
+        return nullptr;
+    }
+
+    uint8_t* dest = base + used;
+    memcpy(dest, data, len);
+    used += len;
+
+    return dest;
+}
+
+size_t OffsetStore::bytes_used() {
+    std::unique_lock<std::mutex> lock(m);
+    return used;
+}
+
+size_t OffsetStore::get_capacity() {
+    return capacity;
+}
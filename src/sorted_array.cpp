@@ -1,6 +1,10 @@
 #include "sorted_array.h"
 #include "array_utils.h"
 
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
 void sorted_array::load(const uint32_t *sorted_array, const uint32_t array_length) {
     min = array_length != 0 ? sorted_array[0] : 0;
     max = array_length > 1 ? sorted_array[array_length-1] : min;
@@ -44,6 +48,45 @@ bool sorted_array::append(uint32_t value) {
     return true;
 }
 
+bool sorted_array::append(const uint32_t* values, const uint32_t values_length) {
+    if(values_length == 0) {
+        return true;
+    }
+
+    // `values` must be sorted ascending and not precede the current maximum
+    uint32_t new_min = length == 0 ? values[0] : min;
+    uint32_t new_max = std::max(max, values[values_length-1]);
+
+    uint32_t size_required = METADATA_OVERHEAD + 4 +
+                             for_compressed_size_bits(length + values_length, required_bits(new_max - new_min));
+
+    if(size_required+FOR_ELE_SIZE > size_bytes) {
+        size_t new_size = (size_t) (size_required * FOR_GROWTH_FACTOR);
+        uint8_t *new_location = (uint8_t *) realloc(in, new_size);
+        if(new_location == NULL) {
+            return false;
+        }
+        in = new_location;
+        size_bytes = (uint32_t) new_size;
+    }
+
+    uint32_t new_length_bytes = length_bytes;
+
+    for(uint32_t i = 0; i < values_length; i++) {
+        new_length_bytes = for_append_sorted(in, length + i, values[i]);
+        if(new_length_bytes == 0) {
+            return false;
+        }
+    }
+
+    length_bytes = new_length_bytes;
+    length += values_length;
+    min = new_min;
+    max = new_max;
+
+    return true;
+}
+
 uint32_t sorted_array::at(uint32_t index) {
     return for_select(in, index);
 }
@@ -65,53 +108,71 @@ uint32_t sorted_array::indexOf(uint32_t value) {
     return length;
 }
 
-uint32_t sorted_array::lower_bound_search_bits(const uint8_t *in, uint32_t imin, uint32_t imax, uint32_t base,
-                                               uint32_t bits, uint32_t value, uint32_t *actual) {
-    uint32_t imid;
-    uint32_t v;
+void sorted_array::unpack_block(uint32_t base, uint32_t bits, uint32_t start, uint32_t count, uint32_t *out) {
+    const uint8_t *payload = in + METADATA_OVERHEAD;
+    const uint32_t payload_bytes = length_bytes - METADATA_OVERHEAD;
 
-    while (imin + 1 < imax) {
-        imid = imin + ((imax - imin) / 2);
-
-        v = for_select_bits(in, base, bits, imid);
-        if (v >= value) {
-            imax = imid;
-        }
-        else if (v < value) {
-            imin = imid;
+    if(bits == 0) {
+        for(uint32_t i = 0; i < count; i++) {
+            out[i] = base;
         }
+        return ;
     }
 
-    v = for_select_bits(in, base, bits, imin);
-    if (v >= value) {
-        *actual = v;
-        return imin;
-    }
+    const uint64_t value_mask = (bits == 32) ? 0xFFFFFFFFULL : ((1ULL << bits) - 1);
+    uint64_t bit_pos = (uint64_t) start * bits;
 
-    v = for_select_bits(in, base, bits, imax);
-    *actual = v;
-    return imax;
+    for(uint32_t i = 0; i < count; i++) {
+        uint64_t byte_pos = bit_pos >> 3;
+        if(byte_pos + sizeof(uint64_t) <= payload_bytes) {
+            // bits <= 32 and the sub-byte shift is at most 7, so one word read always covers the value
+            uint64_t word;
+            memcpy(&word, payload + byte_pos, sizeof(word));
+            out[i] = base + (uint32_t) ((word >> (bit_pos & 7)) & value_mask);
+        } else {
+            // too close to the end of the payload for a whole-word read
+            out[i] = for_select_bits(payload, base, bits, start + i);
+        }
+
+        bit_pos += bits;
+    }
 }
 
-void sorted_array::binary_search_indices(const uint32_t *values, int low_vindex, int high_vindex,
-                                         int low_index, int high_index, uint32_t base, uint32_t bits,
-                                         uint32_t *indices) {
-    uint32_t actual_value =  0;
+uint32_t sorted_array::block_lower_bound(const uint32_t *block, uint32_t count, uint32_t value) {
+    uint32_t low = 0;
+    uint32_t range = count;
 
-    if(high_vindex >= low_vindex && high_index >= low_index) {
-        size_t pivot_vindex = (low_vindex + high_vindex) / 2;
+    // branch-free binary search until the range is small enough for a linear SIMD scan
+    while(range > 8) {
+        uint32_t half = range / 2;
+        low += (block[low + half - 1] < value) ? half : 0;
+        range -= half;
+    }
 
-        uint32_t in_index = lower_bound_search_bits(in+METADATA_OVERHEAD, low_index, high_index, base, bits,
-                                                    values[pivot_vindex], &actual_value);
-        if(actual_value == values[pivot_vindex]) {
-            indices[pivot_vindex] = in_index;
-        } else {
-            indices[pivot_vindex] = length;
+#if defined(__x86_64__) || defined(__i386__)
+    // 4-wide unsigned comparison: flipping the sign bits makes the signed compare order correctly
+    const __m128i sign_flip = _mm_set1_epi32((int32_t) 0x80000000);
+    const __m128i v_value = _mm_xor_si128(_mm_set1_epi32((int32_t) value), sign_flip);
+
+    while(range >= 4) {
+        __m128i v_block = _mm_xor_si128(_mm_loadu_si128(reinterpret_cast<const __m128i *>(block + low)),
+                                        sign_flip);
+        int lt_mask = _mm_movemask_epi8(_mm_cmplt_epi32(v_block, v_value));
+        if(lt_mask != 0xFFFF) {
+            return low + (__builtin_ctz(~lt_mask) >> 2);
         }
 
-        binary_search_indices(values, low_vindex, pivot_vindex-1, low_index, in_index-1, base, bits, indices);
-        binary_search_indices(values, pivot_vindex+1, high_vindex, in_index+1, high_index, base, bits, indices);
+        low += 4;
+        range -= 4;
+    }
+#endif
+
+    while(range != 0 && block[low] < value) {
+        low++;
+        range--;
     }
+
+    return low;
 }
 
 void sorted_array::indexOf(const uint32_t *values, const size_t values_len, uint32_t *indices) {
@@ -119,33 +180,43 @@ void sorted_array::indexOf(const uint32_t *values, const size_t values_len, uint
         return ;
     }
 
+    if(length == 0) {
+        for(size_t i = 0; i < values_len; i++) {
+            indices[i] = length;
+        }
+        return ;
+    }
+
     uint32_t base = *(uint32_t *)(in + 0);
     uint32_t bits = *(in + 4);
 
-    uint32_t low_index, high_index;
-    uint32_t actual_value = 0;
+    uint32_t block[UNPACK_BLOCK_SIZE];
+    size_t vindex = 0;
 
-    int head = -1;
-    do {
-        head++;
-        low_index = lower_bound_search_bits(in+METADATA_OVERHEAD, 0, length-1, base, bits, values[head], &actual_value);
-    } while(actual_value != values[head]);
+    // `values` is assumed to be sorted: the blocks and the values are walked in lock-step,
+    // bulk-decoding a whole block at a time instead of selecting each element bit-by-bit
+    for(uint32_t block_start = 0; block_start < length && vindex < values_len;
+        block_start += UNPACK_BLOCK_SIZE) {
+        uint32_t block_count = std::min((uint32_t) UNPACK_BLOCK_SIZE, length - block_start);
+        uint32_t block_last = for_select_bits(in+METADATA_OVERHEAD, base, bits, block_start + block_count - 1);
 
-    int tail = values_len;
-    do {
-        tail--;
-        high_index = lower_bound_search_bits(in+METADATA_OVERHEAD, 0, length-1, base, bits, values[tail], &actual_value);
-    } while(actual_value != values[tail]);
+        if(values[vindex] > block_last) {
+            // no remaining value can fall inside this block
+            continue;
+        }
 
-    for(int i = 0; i < head; i++) {
-        indices[i] = length;
-    }
+        unpack_block(base, bits, block_start, block_count, block);
 
-    for(int j = values_len-1; j > tail; j--) {
-        indices[j] = length;
+        while(vindex < values_len && values[vindex] <= block_last) {
+            uint32_t pos = block_lower_bound(block, block_count, values[vindex]);
+            indices[vindex] = (pos < block_count && block[pos] == values[vindex]) ? (block_start + pos) : length;
+            vindex++;
+        }
     }
 
-    binary_search_indices(values, head, tail, low_index, high_index, base, bits, indices);
+    while(vindex < values_len) {
+        indices[vindex++] = length;
+    }
 }
 
 void sorted_array::remove_values(uint32_t *sorted_values, uint32_t values_length) {
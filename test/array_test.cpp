@@ -111,4 +111,82 @@ TEST(ArrayTest, RemoveBetweenIndices) {
     for(size_t i=0; i<NEW_SIZE-3; i++) {
         ASSERT_EQ(arr.at(i), unsorted.at(i));
     }
-}
\ No newline at end of file
+}
+TEST(ArrayTest, ExternalPayload) {
+    array arr;
+
+    const size_t SIZE = 10*1000;
+    std::vector<uint32_t> unsorted;
+
+    for(size_t i=0; i<SIZE; i++) {
+        uint32_t r = (uint32_t) rand();
+        unsorted.push_back(r);
+        arr.append(r);
+    }
+
+    // simulate a frozen payload: the test owns the buffer, like the offset store would
+    uint8_t *frozen = new uint8_t[arr.getLengthInBytes()];
+    memcpy(frozen, arr.get_raw(), arr.getLengthInBytes());
+    arr.use_external(frozen);
+
+    ASSERT_TRUE(arr.is_external());
+    ASSERT_EQ(arr.getLength(), SIZE);
+
+    for(size_t i=0; i<SIZE; i++) {
+        ASSERT_EQ(arr.at(i), unsorted.at(i));
+    }
+
+    uint32_t *uncompressed = arr.uncompress();
+    for(size_t i=0; i<SIZE; i++) {
+        ASSERT_EQ(uncompressed[i], unsorted.at(i));
+    }
+    delete[] uncompressed;
+
+    // appending must copy the payload back to the heap first
+    uint32_t extra = (uint32_t) rand();
+    arr.append(extra);
+    unsorted.push_back(extra);
+
+    ASSERT_FALSE(arr.is_external());
+    ASSERT_EQ(arr.getLength(), SIZE+1);
+
+    for(size_t i=0; i<SIZE+1; i++) {
+        ASSERT_EQ(arr.at(i), unsorted.at(i));
+    }
+
+    delete[] frozen;
+}
+
+TEST(ArrayTest, BulkAppend) {
+    array arr;
+    array arr_bulk;
+
+    const size_t SIZE = 10*1000;
+    std::vector<uint32_t> unsorted;
+
+    for(size_t i=0; i<SIZE; i++) {
+        unsorted.push_back((uint32_t) rand());
+    }
+
+    // seed both with a few per-element appends, then append the rest as one run
+    for(size_t i=0; i<SIZE; i++) {
+        arr.append(unsorted[i]);
+        if(i < 10) {
+            arr_bulk.append(unsorted[i]);
+        }
+    }
+
+    arr_bulk.append(&unsorted[10], SIZE-10);
+
+    ASSERT_EQ(arr_bulk.getLength(), arr.getLength());
+    ASSERT_EQ(arr_bulk.getMin(), arr.getMin());
+    ASSERT_EQ(arr_bulk.getMax(), arr.getMax());
+
+    for(size_t i=0; i<SIZE; i++) {
+        ASSERT_EQ(arr_bulk.at(i), unsorted.at(i));
+    }
+
+    // empty run is a no-op
+    arr_bulk.append(nullptr, 0);
+    ASSERT_EQ(arr_bulk.getLength(), SIZE);
+}
@@ -33,6 +33,85 @@ TEST(SortedArrayTest, AndScalar) {
     delete [] arr2;
 }
 
+TEST(SortedArrayTest, IntersectListsOfComparableLengths) {
+    // sizes are chosen to exercise the vectorized kernel along with its scalar tail
+    const size_t size1 = 1003;
+    uint32_t *arr1 = new uint32_t[size1];
+    for(size_t i = 0; i < size1; i++) {
+        arr1[i] = 2 * i;               // even numbers
+    }
+
+    const size_t size2 = 1205;
+    uint32_t *arr2 = new uint32_t[size2];
+    for(size_t i = 0; i < size2; i++) {
+        arr2[i] = 3 * i;               // multiples of 3
+    }
+
+    uint32_t *results = nullptr;
+    size_t results_size = ArrayUtils::intersect(arr1, size1, arr2, size2, &results);
+
+    uint32_t *expected = nullptr;
+    size_t expected_size = ArrayUtils::and_scalar(arr1, size1, arr2, size2, &expected);
+
+    ASSERT_EQ(expected_size, results_size);
+    for(size_t i = 0; i < results_size; i++) {
+        ASSERT_EQ(expected[i], results[i]);
+    }
+
+    delete[] results;
+    delete[] expected;
+    delete[] arr1;
+    delete[] arr2;
+}
+
+TEST(SortedArrayTest, IntersectSkewedLists) {
+    // long list is 100x the short list, so the galloping kernel is picked
+    const size_t size1 = 100000;
+    uint32_t *arr1 = new uint32_t[size1];
+    for(size_t i = 0; i < size1; i++) {
+        arr1[i] = i;
+    }
+
+    const size_t size2 = 1000;
+    uint32_t *arr2 = new uint32_t[size2];
+    for(size_t i = 0; i < size2; i++) {
+        arr2[i] = 7 * i + 3;           // some present, some beyond the long list
+    }
+
+    uint32_t *results = nullptr;
+    size_t results_size = ArrayUtils::intersect(arr1, size1, arr2, size2, &results);
+
+    uint32_t *expected = nullptr;
+    size_t expected_size = ArrayUtils::and_scalar(arr1, size1, arr2, size2, &expected);
+
+    ASSERT_EQ(expected_size, results_size);
+    for(size_t i = 0; i < results_size; i++) {
+        ASSERT_EQ(expected[i], results[i]);
+    }
+
+    // argument order must not matter
+    uint32_t *results2 = nullptr;
+    size_t results2_size = ArrayUtils::intersect(arr2, size2, arr1, size1, &results2);
+    ASSERT_EQ(results_size, results2_size);
+    for(size_t i = 0; i < results2_size; i++) {
+        ASSERT_EQ(results[i], results2[i]);
+    }
+
+    delete[] results;
+    delete[] results2;
+    delete[] expected;
+    delete[] arr1;
+    delete[] arr2;
+}
+
+TEST(SortedArrayTest, IntersectWithEmptyList) {
+    uint32_t arr[3] = {1, 5, 9};
+    uint32_t *results = nullptr;
+    ASSERT_EQ(0, ArrayUtils::intersect(arr, 3, nullptr, 0, &results));
+    ASSERT_EQ(0, ArrayUtils::intersect(nullptr, 0, arr, 3, &results));
+    ASSERT_EQ(nullptr, results);
+}
+
 TEST(SortedArrayTest, OrScalarMergeShouldRemoveDuplicates) {
     const size_t size1 = 9;
     uint32_t *arr1 = new uint32_t[size1];
@@ -94,6 +173,36 @@ TEST(SortedArrayTest, OrScalarMergeShouldRemoveDuplicatesAtBoundary) {
     delete[] arr2;
 }
 
+TEST(SortedArrayTest, OrManyShouldMergeMultipleListsAndRemoveDuplicates) {
+    uint32_t arr1[5] = {0, 2, 4, 6, 8};
+    uint32_t arr2[4] = {1, 2, 5, 8};
+    uint32_t arr3[3] = {2, 9, 12};
+
+    std::vector<std::pair<uint32_t*, size_t>> arrays = {
+        std::make_pair(arr1, 5),
+        std::make_pair(arr2, 4),
+        std::make_pair(arr3, 3),
+        std::make_pair(nullptr, 0)
+    };
+
+    uint32_t *results = nullptr;
+    size_t results_size = ArrayUtils::or_many(arrays, &results);
+    ASSERT_EQ(9, results_size);
+
+    std::vector<uint32_t> expected = {0, 1, 2, 4, 5, 6, 8, 9, 12};
+    for(size_t i = 0; i < results_size; i++) {
+        ASSERT_EQ(expected[i], results[i]);
+    }
+
+    delete[] results;
+
+    // all empty lists
+    std::vector<std::pair<uint32_t*, size_t>> empty_arrays = {std::make_pair(nullptr, 0)};
+    results = nullptr;
+    ASSERT_EQ(0, ArrayUtils::or_many(empty_arrays, &results));
+    ASSERT_EQ(nullptr, results);
+}
+
 TEST(SortedArrayTest, OrScalarWithEitherArrayAsNull) {
     const size_t size1 = 9;
     uint32_t *arr1 = new uint32_t[size1];
@@ -608,6 +608,62 @@ TEST(ArtTest, test_art_fuzzy_search_single_leaf) {
     ASSERT_TRUE(res == 0);
 }
 
+TEST(ArtTest, test_art_completion_cache) {
+    art_tree t;
+    int res = art_tree_init(&t);
+    ASSERT_TRUE(res == 0);
+
+    // apple: 3 hits, apply: 2 hits, apron: 1 hit
+    const char* words[] = {"apple", "apple", "apple", "apply", "apply", "apron"};
+    std::map<std::string, uint32_t> num_hits;
+
+    uint32_t doc_id = 1;
+    for(const char* word: words) {
+        art_document doc = get_document(doc_id++);
+        num_hits[word]++;
+        art_insert(&t, (unsigned char*)word, strlen(word)+1, &doc, num_hits[word]);
+    }
+
+    std::vector<art_leaf*> leaves;
+    art_fuzzy_search(&t, (const unsigned char *) "ap", 2, 0, 0, 2, FREQUENCY, true, leaves);
+    ASSERT_EQ(2, leaves.size());
+    ASSERT_STREQ("apple", (const char *)leaves.at(0)->key);
+    ASSERT_STREQ("apply", (const char *)leaves.at(1)->key);
+
+    // the repeat query is served from the completion cache
+    leaves.clear();
+    art_fuzzy_search(&t, (const unsigned char *) "ap", 2, 0, 0, 2, FREQUENCY, true, leaves);
+    ASSERT_EQ(2, leaves.size());
+    ASSERT_STREQ("apple", (const char *)leaves.at(0)->key);
+    ASSERT_STREQ("apply", (const char *)leaves.at(1)->key);
+
+    // an insert below the cached floor keeps the entry intact
+    art_document aptly_doc = get_document(100);
+    art_insert(&t, (unsigned char*)"aptly", strlen("aptly")+1, &aptly_doc, 1);
+
+    leaves.clear();
+    art_fuzzy_search(&t, (const unsigned char *) "ap", 2, 0, 0, 2, FREQUENCY, true, leaves);
+    ASSERT_EQ(2, leaves.size());
+    ASSERT_STREQ("apple", (const char *)leaves.at(0)->key);
+    ASSERT_STREQ("apply", (const char *)leaves.at(1)->key);
+
+    // pushing a word past the floor invalidates the entry and changes the top-k
+    for(uint32_t i = 101; i <= 104; i++) {
+        art_document apron_doc = get_document(i);
+        num_hits["apron"]++;
+        art_insert(&t, (unsigned char*)"apron", strlen("apron")+1, &apron_doc, num_hits["apron"]);
+    }
+
+    leaves.clear();
+    art_fuzzy_search(&t, (const unsigned char *) "ap", 2, 0, 0, 2, FREQUENCY, true, leaves);
+    ASSERT_EQ(2, leaves.size());
+    ASSERT_STREQ("apron", (const char *)leaves.at(0)->key);
+    ASSERT_STREQ("apple", (const char *)leaves.at(1)->key);
+
+    res = art_tree_destroy(&t);
+    ASSERT_TRUE(res == 0);
+}
+
 TEST(ArtTest, test_art_fuzzy_search) {
     art_tree t;
     int res = art_tree_init(&t);
@@ -2,6 +2,7 @@
 #include <string>
 #include <vector>
 #include <fstream>
+#include <sys/stat.h>
 #include <collection_manager.h>
 #include "string_utils.h"
 #include "collection.h"
@@ -144,6 +145,121 @@ TEST_F(CollectionManagerTest, RestoreRecordsOnRestart) {
     ASSERT_EQ(4, results["hits"].size());
 }
 
+TEST_F(CollectionManagerTest, ReshardCollection) {
+    std::ifstream infile(std::string(ROOT_DIR)+"test/multi_field_documents.jsonl");
+    std::string json_line;
+
+    while (std::getline(infile, json_line)) {
+        collection1->add(json_line);
+    }
+
+    infile.close();
+
+    std::vector<std::string> search_fields = {"starring", "title"};
+    std::vector<std::string> facets;
+
+    nlohmann::json results = collection1->search("thomas", search_fields, "", facets, sort_fields, 0, 10, 1, FREQUENCY, false).get();
+    ASSERT_EQ(4, results["hits"].size());
+
+    ASSERT_EQ(4, collection1->get_num_indices());
+
+    // spread the collection over more shards - results must be identical
+    Option<bool> reshard_op = collectionManager.reshard_collection("collection1", 7);
+    ASSERT_TRUE(reshard_op.ok());
+    ASSERT_EQ(7, collection1->get_num_indices());
+
+    results = collection1->search("thomas", search_fields, "", facets, sort_fields, 0, 10, 1, FREQUENCY, false).get();
+    ASSERT_EQ(4, results["hits"].size());
+
+    // writes must keep working against the new layout
+    Option<std::string> remove_op = collection1->remove("1");
+    ASSERT_TRUE(remove_op.ok());
+
+    results = collection1->search("thomas", search_fields, "", facets, sort_fields, 0, 10, 1, FREQUENCY, false).get();
+    ASSERT_EQ(3, results["hits"].size());
+
+    // merge back down to a single shard
+    reshard_op = collectionManager.reshard_collection("collection1", 1);
+    ASSERT_TRUE(reshard_op.ok());
+    ASSERT_EQ(1, collection1->get_num_indices());
+
+    results = collection1->search("thomas", search_fields, "", facets, sort_fields, 0, 10, 1, FREQUENCY, false).get();
+    ASSERT_EQ(3, results["hits"].size());
+
+    // the new shard count is persisted in the collection meta
+    std::string collection_meta_json;
+    store->get(Collection::get_meta_key("collection1"), collection_meta_json);
+    nlohmann::json collection_meta = nlohmann::json::parse(collection_meta_json);
+    ASSERT_EQ(1, collection_meta["num_indices"].get<size_t>());
+
+    // a restart must rebuild the resharded layout
+    CollectionManager & collectionManager2 = CollectionManager::get_instance();
+    collectionManager2.init(store, "auth_key", "search_auth_key");
+
+    collection1 = collectionManager2.get_collection("collection1");
+    ASSERT_NE(nullptr, collection1);
+    ASSERT_EQ(1, collection1->get_num_indices());
+
+    results = collection1->search("thomas", search_fields, "", facets, sort_fields, 0, 10, 1, FREQUENCY, false).get();
+    ASSERT_EQ(3, results["hits"].size());
+
+    // invalid shard counts are rejected
+    ASSERT_FALSE(collectionManager.reshard_collection("collection1", 0).ok());
+    ASSERT_FALSE(collectionManager.reshard_collection("collection1", 1000).ok());
+    ASSERT_FALSE(collectionManager.reshard_collection("no_such_collection", 4).ok());
+}
+
+TEST_F(CollectionManagerTest, RestoreFromIndexSnapshot) {
+    std::ifstream infile(std::string(ROOT_DIR)+"test/multi_field_documents.jsonl");
+    std::string json_line;
+
+    while (std::getline(infile, json_line)) {
+        collection1->add(json_line);
+    }
+
+    infile.close();
+
+    collectionManager.save_index_snapshots();
+
+    const std::string & snapshot_path = collectionManager.get_index_snapshot_path(collection1->get_collection_id());
+    struct stat snapshot_info;
+    ASSERT_EQ(0, stat(snapshot_path.c_str(), &snapshot_info));
+
+    // a new collection manager must restore the index from the snapshot
+    CollectionManager & collectionManager2 = CollectionManager::get_instance();
+    collectionManager2.init(store, "auth_key", "search_auth_key");
+
+    collection1 = collectionManager2.get_collection("collection1");
+    ASSERT_NE(nullptr, collection1);
+    ASSERT_EQ(18, collection1->get_next_seq_id());
+    ASSERT_EQ(18, collection1->get_num_documents());
+
+    // the snapshot must have been consumed during the load
+    ASSERT_NE(0, stat(snapshot_path.c_str(), &snapshot_info));
+
+    std::vector<std::string> search_fields = {"starring", "title"};
+    std::vector<std::string> facets = {"cast"};
+
+    nlohmann::json results = collection1->search("thomas", search_fields, "", facets, sort_fields, 0, 10, 1,
+                                                 FREQUENCY, false).get();
+    ASSERT_EQ(4, results["hits"].size());
+    ASSERT_EQ(1, results["facet_counts"].size());
+}
+
+TEST_F(CollectionManagerTest, ResultCacheRoundTrip) {
+    std::string cached_json;
+    ASSERT_FALSE(collectionManager.result_cache_get("some_key", cached_json));
+
+    collectionManager.result_cache_put("some_key", "{\"found\": 3}");
+    ASSERT_TRUE(collectionManager.result_cache_get("some_key", cached_json));
+    ASSERT_STREQ("{\"found\": 3}", cached_json.c_str());
+
+    // a write bumps the collection's generation, so a key embedding the new generation must miss
+    uint64_t generation = collection1->get_write_generation();
+    collection1->add("{\"title\": \"Quick brown fox\", \"starring\": \"Jack\", \"cast\": [\"Jack\"], \"points\": 10}");
+    ASSERT_EQ(generation + 1, collection1->get_write_generation());
+}
+
 TEST_F(CollectionManagerTest, DropCollectionCleanly) {
     std::ifstream infile(std::string(ROOT_DIR)+"test/multi_field_documents.jsonl");
     std::string json_line;
@@ -3,6 +3,9 @@
 #include <vector>
 #include <fstream>
 #include <algorithm>
+#include <thread>
+#include <sys/stat.h>
+#include <unistd.h>
 #include <collection_manager.h>
 #include "collection.h"
 #include "number.h"
@@ -114,6 +117,102 @@ TEST_F(CollectionTest, ExactSearchShouldBeStable) {
     }
 }
 
+TEST_F(CollectionTest, StreamedHitsShouldMatchBufferedResults) {
+    std::vector<std::string> facets;
+    nlohmann::json results = collection->search("the", query_fields, "", facets, sort_fields, 0, 10).get();
+    ASSERT_EQ(7, results["hits"].size());
+
+    std::vector<search_hit> stream_hits;
+    nlohmann::json envelope = collection->search("the", query_fields, "", facets, sort_fields, 0, 10, 1,
+                                                 FREQUENCY, false, true, "", &stream_hits).get();
+
+    // the envelope must carry everything except the hits themselves
+    ASSERT_EQ(0, envelope["hits"].size());
+    ASSERT_EQ(results["found"].get<int>(), envelope["found"].get<int>());
+    ASSERT_EQ(results["search_after"], envelope["search_after"]);
+
+    // streamed hits are raw stored documents with the same content and highlights, in the same order
+    ASSERT_EQ(results["hits"].size(), stream_hits.size());
+
+    for(size_t i = 0; i < stream_hits.size(); i++) {
+        nlohmann::json document = nlohmann::json::parse(stream_hits[i].json_doc);
+        ASSERT_EQ(results["hits"][i]["document"], document);
+        ASSERT_STREQ("title", stream_hits[i].highlight_field.c_str());
+        ASSERT_EQ(results["hits"][i]["highlight"]["title"], stream_hits[i].snippet);
+    }
+}
+
+TEST_F(CollectionTest, ConcurrentSearchesShouldReturnIdenticalResults) {
+    std::vector<std::string> facets;
+
+    // results of searches running concurrently should be no different from those of a lone search
+    nlohmann::json expected_results = collection->search("the", query_fields, "", facets, sort_fields, 0, 10).get();
+
+    std::vector<std::thread> searchers;
+    std::vector<nlohmann::json> concurrent_results(8);
+
+    for(size_t i = 0; i < concurrent_results.size(); i++) {
+        searchers.emplace_back([&, i]() {
+            std::vector<std::string> thread_facets;
+            concurrent_results[i] = collection->search("the", query_fields, "", thread_facets,
+                                                       sort_fields, 0, 10).get();
+        });
+    }
+
+    for(std::thread & searcher: searchers) {
+        searcher.join();
+    }
+
+    for(const nlohmann::json & results: concurrent_results) {
+        ASSERT_EQ(expected_results.dump(), results.dump());
+    }
+}
+
+TEST_F(CollectionTest, HighlightedSnippetShouldMarkQueryTokens) {
+    std::vector<std::string> facets;
+    nlohmann::json results = collection->search("rocket launch", query_fields, "", facets, sort_fields, 0, 10).get();
+    ASSERT_EQ(5, results["hits"].size());
+
+    nlohmann::json & top_hit = results["hits"].at(0);
+    ASSERT_STREQ("What is the power requirement of a <mark>rocket</mark> <mark>launch</mark> these days?",
+                 top_hit["highlight"]["title"].get<std::string>().c_str());
+}
+
+TEST_F(CollectionTest, NonExhaustiveSearchShouldMatchExhaustiveOnSmallDataset) {
+    std::vector<std::string> facets;
+
+    // with fewer documents than the topster size, early termination can never kick in,
+    // so both modes must produce identical results
+    nlohmann::json exhaustive_results = collection->search("the", query_fields, "", facets, sort_fields,
+                                                           0, 10, 1, FREQUENCY, false, true).get();
+    nlohmann::json pruned_results = collection->search("the", query_fields, "", facets, sort_fields,
+                                                       0, 10, 1, FREQUENCY, false, false).get();
+
+    ASSERT_EQ(exhaustive_results.dump(), pruned_results.dump());
+}
+
+TEST_F(CollectionTest, ConcurrentWritesShouldNotDisruptSearches) {
+    std::vector<std::string> facets;
+
+    // writes from another thread must interleave safely with searches - every search
+    // must see a consistent index even while documents are being added
+    std::thread writer([this]() {
+        for(size_t i = 0; i < 50; i++) {
+            collection->add("{\"points\":1,\"title\":\"an interleaved rocket launch\"}");
+        }
+    });
+
+    for(size_t i = 0; i < 50; i++) {
+        nlohmann::json results = collection->search("rocket", query_fields, "", facets, sort_fields, 0, 10).get();
+        ASSERT_TRUE(results["found"].get<size_t>() >= 4);
+    }
+
+    writer.join();
+
+    nlohmann::json results = collection->search("interleaved", query_fields, "", facets, sort_fields, 0, 10).get();
+    ASSERT_EQ(50, results["found"].get<size_t>());
+}
+
 TEST_F(CollectionTest, ExactPhraseSearch) {
     std::vector<std::string> facets;
     nlohmann::json results = collection->search("rocket launch", query_fields, "", facets, sort_fields, 0, 10).get();
@@ -215,6 +314,40 @@ TEST_F(CollectionTest, SkipUnindexedTokensDuringPhraseSearch) {
     ASSERT_EQ(0, results["hits"].size());
 }
 
+TEST_F(CollectionTest, TypoExpansionBudget) {
+    std::vector<std::string> facets;
+
+    // a generous budget must produce the same results as the default one on this dataset
+    nlohmann::json results = collection->search("kind biologcal", query_fields, "", facets, sort_fields, 2, 3).get();
+    nlohmann::json budget_results = collection->search("kind biologcal", query_fields, "", facets, sort_fields, 2, 3, 1,
+                                                       FREQUENCY, false, true, "", nullptr, 100).get();
+    ASSERT_EQ(results.dump(), budget_results.dump());
+    ASSERT_EQ(3, budget_results["hits"].size());
+
+    // an exact query is served from the zero-cost combination, so even the smallest
+    // budget must not change its results
+    results = collection->search("rocket research", query_fields, "", facets, sort_fields, 2, 10).get();
+    budget_results = collection->search("rocket research", query_fields, "", facets, sort_fields, 2, 10, 1,
+                                        FREQUENCY, false, true, "", nullptr, 1).get();
+
+    ASSERT_EQ(results["hits"].size(), budget_results["hits"].size());
+    for(size_t i = 0; i < results["hits"].size(); i++) {
+        ASSERT_EQ(results["hits"][i]["document"]["id"], budget_results["hits"][i]["document"]["id"]);
+    }
+
+    // the adaptive early exit skips unpromising cost combinations, but the hits
+    // that can fill the page must still be found
+    nlohmann::json pruned_results = collection->search("kind biologcal", query_fields, "", facets, sort_fields, 2, 3, 1,
+                                                       FREQUENCY, false, false).get();
+    ASSERT_EQ(3, pruned_results["hits"].size());
+
+    std::vector<std::string> ids = {"19", "20", "21"};
+    for(size_t i = 0; i < pruned_results["hits"].size(); i++) {
+        std::string result_id = pruned_results["hits"][i]["document"]["id"];
+        ASSERT_STREQ(ids.at(i).c_str(), result_id.c_str());
+    }
+}
+
 TEST_F(CollectionTest, PartialPhraseSearch) {
     std::vector<std::string> facets;
     nlohmann::json results = collection->search("rocket research", query_fields, "", facets, sort_fields, 0, 10).get();
@@ -390,6 +523,39 @@ TEST_F(CollectionTest, Pagination) {
     }
 }
 
+TEST_F(CollectionTest, CursorPagination) {
+    // pages fetched via `search_after` must match plain page-based pagination
+    std::vector<std::string> expected_ids = {"1", "6", "foo", "13", "10", "8", "16"};
+    std::vector<std::string> cursor_ids;
+
+    std::string search_after = "";
+
+    while(true) {
+        nlohmann::json results = collection->search("the", query_fields, "", {}, sort_fields, 0, 3, 1,
+                                                    FREQUENCY, false, true, search_after).get();
+        if(results["hits"].size() == 0) {
+            break;
+        }
+
+        for(size_t i = 0; i < results["hits"].size(); i++) {
+            cursor_ids.push_back(results["hits"].at(i)["document"]["id"]);
+        }
+
+        search_after = results["search_after"].get<std::string>();
+    }
+
+    ASSERT_EQ(expected_ids.size(), cursor_ids.size());
+    for(size_t i = 0; i < expected_ids.size(); i++) {
+        ASSERT_STREQ(expected_ids[i].c_str(), cursor_ids[i].c_str());
+    }
+
+    // a malformed cursor must be rejected
+    Option<nlohmann::json> res_op = collection->search("the", query_fields, "", {}, sort_fields, 0, 3, 1,
+                                                       FREQUENCY, false, true, "not_a_cursor");
+    ASSERT_FALSE(res_op.ok());
+    ASSERT_EQ(400, res_op.code());
+}
+
 TEST_F(CollectionTest, PrefixSearching) {
     std::vector<std::string> facets;
     nlohmann::json results = collection->search("ex", query_fields, "", facets, sort_fields, 0, 10, 1, FREQUENCY, true).get();
@@ -609,6 +775,37 @@ TEST_F(CollectionTest, FilterAndQueryFieldRestrictions) {
     collectionManager.drop_collection("coll_mul_fields");
 }
 
+TEST_F(CollectionTest, RepeatedFilterQueriesShouldStayFreshAcrossMutations) {
+    std::vector<std::string> facets;
+
+    // repeated identical filter expressions exercise the filter cache
+    nlohmann::json results = collection->search("the", query_fields, "points:>12", facets, sort_fields,
+                                                0, 10, 1, FREQUENCY, false).get();
+    size_t num_hits = results["hits"].size();
+    ASSERT_TRUE(num_hits > 0);
+
+    for(size_t i = 0; i < 3; i++) {
+        results = collection->search("the", query_fields, "points:>12", facets, sort_fields,
+                                     0, 10, 1, FREQUENCY, false).get();
+        ASSERT_EQ(num_hits, results["hits"].size());
+    }
+
+    // a mutation must invalidate previously cached filter results
+    collection->add("{\"points\":100,\"title\":\"the biggest of them all\"}");
+
+    results = collection->search("the", query_fields, "points:>12", facets, sort_fields,
+                                 0, 10, 1, FREQUENCY, false).get();
+    ASSERT_EQ(num_hits + 1, results["hits"].size());
+
+    // same for removals
+    std::string top_id = results["hits"].at(0)["document"]["id"];
+    collection->remove(top_id);
+
+    results = collection->search("the", query_fields, "points:>12", facets, sort_fields,
+                                 0, 10, 1, FREQUENCY, false).get();
+    ASSERT_EQ(num_hits, results["hits"].size());
+}
+
 TEST_F(CollectionTest, FilterOnNumericFields) {
     Collection *coll_array_fields;
 
@@ -1567,6 +1764,153 @@ TEST_F(CollectionTest, AnIntegerCanBePassedToAFloatField) {
     collectionManager.drop_collection("coll1");
 }
 
+TEST_F(CollectionTest, ImportOfDocuments) {
+    Collection *coll_import;
+
+    std::vector<field> fields = {field("title", field_types::STRING, false),
+                                 field("points", field_types::INT32, false)};
+
+    std::vector<std::string> query_fields = {"title"};
+    std::vector<sort_by> sort_fields = { sort_by("points", "DESC") };
+
+    coll_import = collectionManager.get_collection("coll_import");
+    if(coll_import == nullptr) {
+        coll_import = collectionManager.create_collection("coll_import", fields, "points").get();
+    }
+
+    std::string import_body = "{\"id\": \"1\", \"title\": \"The quick brown fox\", \"points\": 80}\n"
+                              "{\"id\": \"2\", \"title\": \"The lazy dog sleeps\", \"points\": 70}\n"
+                              "{\"title\": \"A document without an id\", \"points\": 60}\n"
+                              "{\"id\": \"1\", \"title\": \"Duplicate identifier\", \"points\": 50}\n"
+                              "{\"bad json\n"
+                              "{\"id\": \"3\", \"title\": \"Missing the sorting field\"}";
+
+    Option<nlohmann::json> import_op = coll_import->add_many(import_body);
+    ASSERT_TRUE(import_op.ok());
+
+    nlohmann::json import_response = import_op.get();
+    ASSERT_EQ(3, import_response["num_imported"].get<size_t>());
+    ASSERT_EQ(3, import_response["errors"].size());
+
+    ASSERT_EQ(3, import_response["errors"][0]["line"].get<size_t>());
+    ASSERT_STREQ("A document with id 1 already exists.", import_response["errors"][0]["error"].get<std::string>().c_str());
+
+    ASSERT_EQ(4, import_response["errors"][1]["line"].get<size_t>());
+    ASSERT_STREQ("Bad JSON.", import_response["errors"][1]["error"].get<std::string>().c_str());
+
+    ASSERT_EQ(5, import_response["errors"][2]["line"].get<size_t>());
+    ASSERT_STREQ("Field `points` has been declared as a default sorting field, but is not found in the document.",
+                 import_response["errors"][2]["error"].get<std::string>().c_str());
+
+    ASSERT_EQ(3, coll_import->get_num_documents());
+
+    // imported documents should be searchable
+    nlohmann::json results = coll_import->search("fox", query_fields, "", {}, sort_fields, 0, 10, 1,
+                                                 FREQUENCY, false).get();
+    ASSERT_EQ(1, results["hits"].size());
+
+    // and also retrievable by ID from the store
+    Option<nlohmann::json> doc_op = coll_import->get("2");
+    ASSERT_TRUE(doc_op.ok());
+    ASSERT_STREQ("The lazy dog sleeps", doc_op.get()["title"].get<std::string>().c_str());
+
+    // importing an empty body should not succeed
+    Option<nlohmann::json> empty_import_op = coll_import->add_many("");
+    ASSERT_FALSE(empty_import_op.ok());
+    ASSERT_STREQ("The import body is empty.", empty_import_op.error().c_str());
+
+    collectionManager.drop_collection("coll_import");
+}
+
+TEST_F(CollectionTest, MemoryStatsPerField) {
+    nlohmann::json memory = collection->get_memory_stats();
+
+    ASSERT_GT(memory["total_bytes"].get<uint64_t>(), 0);
+    ASSERT_EQ(2, memory["fields"].size());
+
+    // a string field holds only an ART tree, a numeric field also carries sort and range columns
+    ASSERT_GT(memory["fields"]["title"]["art_bytes"].get<uint64_t>(), 0);
+    ASSERT_GT(memory["fields"]["points"]["sort_bytes"].get<uint64_t>(), 0);
+    ASSERT_GT(memory["fields"]["points"]["range_bytes"].get<uint64_t>(), 0);
+
+    // per-field totals must add up to the collection total
+    uint64_t fields_total = 0;
+    for(auto field_it = memory["fields"].begin(); field_it != memory["fields"].end(); ++field_it) {
+        fields_total += field_it.value()["total_bytes"].get<uint64_t>();
+    }
+
+    ASSERT_EQ(memory["total_bytes"].get<uint64_t>(), fields_total);
+}
+
+TEST_F(CollectionTest, QueryMetricsAggregatePerStage) {
+    auto count_of = [](const std::string & stage_name) -> uint64_t {
+        for(const QueryMetrics::stage_stats & stats: QueryMetrics::get_instance().get_stats()) {
+            if(stats.stage == stage_name) {
+                return stats.count;
+            }
+        }
+        return 0;
+    };
+
+    const uint64_t token_search_count = count_of("token_search");
+    const uint64_t filter_count = count_of("filter");
+
+    nlohmann::json results = collection->search("the", query_fields, "points:>0", {}, sort_fields, 0, 10, 1,
+                                                FREQUENCY, false).get();
+    ASSERT_TRUE(results["hits"].size() > 0);
+
+    // the metrics singleton should have folded in the stages this search exercised
+    ASSERT_GT(count_of("token_search"), token_search_count);
+    ASSERT_GT(count_of("filter"), filter_count);
+}
+
+TEST_F(CollectionTest, ImportFallsBackToDOMForEscapedStrings) {
+    Collection *coll_fast;
+
+    std::vector<field> fields = {field("title", field_types::STRING, false),
+                                 field("points", field_types::INT32, false)};
+
+    std::vector<std::string> query_fields = {"title"};
+    std::vector<sort_by> sort_fields = { sort_by("points", "DESC") };
+
+    coll_fast = collectionManager.get_collection("coll_fast");
+    if(coll_fast == nullptr) {
+        coll_fast = collectionManager.create_collection("coll_fast", fields, "points").get();
+    }
+
+    // the first line carries escape sequences, so it must be handled by the DOM fallback;
+    // the second carries an unknown nested field the flat scanner has to skip over;
+    // the third has no id and gets the generated one spliced into the stored document
+    std::string import_body =
+        "{\"id\": \"1\", \"title\": \"An \\\"escaped\\\" title\", \"points\": 10}\n"
+        "{\"id\": \"2\", \"title\": \"plain sailing\", \"points\": 20, \"extra\": {\"nested\": [1, 2, \"three\"]}}\n"
+        "{\"points\": 30, \"title\": \"no identifier here\"}";
+
+    Option<nlohmann::json> import_op = coll_fast->add_many(import_body);
+    ASSERT_TRUE(import_op.ok());
+
+    nlohmann::json import_response = import_op.get();
+    ASSERT_EQ(3, import_response["num_imported"].get<size_t>());
+    ASSERT_EQ(0, import_response["errors"].size());
+
+    nlohmann::json results = coll_fast->search("escaped", query_fields, "", {}, sort_fields, 0, 10, 1,
+                                               FREQUENCY, false).get();
+    ASSERT_EQ(1, results["hits"].size());
+    ASSERT_STREQ("1", results["hits"][0]["id"].get<std::string>().c_str());
+
+    results = coll_fast->search("identifier", query_fields, "", {}, sort_fields, 0, 10, 1,
+                                FREQUENCY, false).get();
+    ASSERT_EQ(1, results["hits"].size());
+
+    // the stored document of the fast path line must retain fields outside the schema
+    Option<nlohmann::json> doc_op = coll_fast->get("2");
+    ASSERT_TRUE(doc_op.ok());
+    ASSERT_EQ(1, doc_op.get().count("extra"));
+    ASSERT_EQ(3, doc_op.get()["extra"]["nested"].size());
+
+    collectionManager.drop_collection("coll_fast");
+}
+
 TEST_F(CollectionTest, DeletionOfADocument) {
     collectionManager.drop_collection("collection");
 
@@ -1644,4 +1988,129 @@ TEST_F(CollectionTest, DeletionOfADocument) {
     ASSERT_EQ(3, num_keys);
 
     collectionManager.drop_collection("collection_for_del");
-}
\ No newline at end of file
+}
+TEST_F(CollectionTest, CompactionAfterDeletionsKeepsIndexSearchable) {
+    std::vector<field> fields = {field("title", field_types::STRING, false),
+                                 field("points", field_types::INT32, false)};
+    std::vector<sort_by> sort_fields = { sort_by("points", "DESC") };
+
+    Collection* coll_compact = collectionManager.get_collection("coll_compact");
+    if(coll_compact == nullptr) {
+        coll_compact = collectionManager.create_collection("coll_compact", fields, "points").get();
+    }
+
+    for(size_t i = 0; i < 40; i++) {
+        nlohmann::json doc;
+        doc["id"] = std::to_string(i);
+        doc["title"] = "shared token record " + std::to_string(i);
+        doc["points"] = (int) i;
+        coll_compact->add(doc.dump());
+    }
+
+    // removals are lazy: searches must skip the tombstoned documents right away
+    for(size_t i = 0; i < 40; i += 2) {
+        coll_compact->remove(std::to_string(i));
+    }
+
+    nlohmann::json results = coll_compact->search("shared", {"title"}, "", {}, sort_fields, 0, 50, 1,
+                                                  FREQUENCY, false).get();
+    ASSERT_EQ(20, results["found"].get<int>());
+
+    // saving a snapshot forces a compaction pass that rewrites the posting lists
+    const std::string & snapshot_path = "/tmp/typesense_test/coll_compact_snapshot";
+    ASSERT_TRUE(coll_compact->save_index_snapshot(snapshot_path).ok());
+
+    results = coll_compact->search("shared", {"title"}, "", {}, sort_fields, 0, 50, 1,
+                                   FREQUENCY, false).get();
+    ASSERT_EQ(20, results["found"].get<int>());
+
+    for(size_t i = 1; i < 40; i += 2) {
+        results = coll_compact->search(std::to_string(i), {"title"}, "", {}, sort_fields, 0, 5, 1,
+                                       FREQUENCY, false).get();
+        ASSERT_EQ(1, results["found"].get<int>());
+    }
+
+    remove(snapshot_path.c_str());
+    collectionManager.drop_collection("coll_compact");
+}
+
+TEST_F(CollectionTest, FailedIndexSnapshotCleansUpTempFile) {
+    std::vector<field> fields = {field("title", field_types::STRING, false),
+                                 field("points", field_types::INT32, false)};
+
+    Collection* coll_snap = collectionManager.get_collection("coll_snap");
+    if(coll_snap == nullptr) {
+        coll_snap = collectionManager.create_collection("coll_snap", fields, "points").get();
+    }
+
+    coll_snap->add("{\"id\": \"0\", \"title\": \"snapshot record\", \"points\": 10}");
+
+    // renaming the temp file onto an existing directory fails, exercising the cleanup path
+    const std::string & snapshot_path = "/tmp/typesense_test/snapshot_as_dir";
+    mkdir(snapshot_path.c_str(), 0755);
+
+    Option<bool> save_op = coll_snap->save_index_snapshot(snapshot_path);
+    ASSERT_FALSE(save_op.ok());
+    ASSERT_EQ(500, save_op.code());
+
+    // the temp file must be gone and the collection untouched
+    std::ifstream tmp_file(snapshot_path + ".tmp");
+    ASSERT_FALSE(tmp_file.good());
+    ASSERT_EQ(1, coll_snap->get_num_documents());
+
+    rmdir(snapshot_path.c_str());
+    collectionManager.drop_collection("coll_snap");
+}
+
+TEST_F(CollectionTest, PartialUpdateOfADocument) {
+    std::vector<field> fields = {field("title", field_types::STRING, false),
+                                 field("stock", field_types::INT32, false),
+                                 field("points", field_types::INT32, false)};
+    std::vector<sort_by> sort_fields = { sort_by("points", "DESC") };
+
+    Collection* coll_update = collectionManager.get_collection("coll_update");
+    if(coll_update == nullptr) {
+        coll_update = collectionManager.create_collection("coll_update", fields, "points").get();
+    }
+
+    coll_update->add("{\"id\": \"100\", \"title\": \"running shoes\", \"stock\": 5, \"points\": 10}");
+    coll_update->add("{\"id\": \"101\", \"title\": \"walking shoes\", \"stock\": 8, \"points\": 20}");
+
+    // a numeric-only patch must not disturb the text index
+    Option<nlohmann::json> update_op = coll_update->update("100", "{\"stock\": 0, \"points\": 30}");
+    ASSERT_TRUE(update_op.ok());
+    ASSERT_EQ(0, update_op.get()["stock"].get<int>());
+    ASSERT_STREQ("running shoes", update_op.get()["title"].get<std::string>().c_str());
+
+    nlohmann::json results = coll_update->search("shoes", {"title"}, "", {}, sort_fields, 0, 10, 1,
+                                                 FREQUENCY, false).get();
+    ASSERT_EQ(2, results["found"].get<int>());
+
+    // the new points value must drive the sort order
+    ASSERT_STREQ("100", results["hits"][0]["id"].get<std::string>().c_str());
+
+    // the numeric filter must see the new value
+    results = coll_update->search("shoes", {"title"}, "stock:>0", {}, sort_fields, 0, 10, 1,
+                                  FREQUENCY, false).get();
+    ASSERT_EQ(1, results["found"].get<int>());
+    ASSERT_STREQ("101", results["hits"][0]["id"].get<std::string>().c_str());
+
+    // a string patch removes the old tokens and indexes the new ones
+    update_op = coll_update->update("101", "{\"title\": \"trail boots\"}");
+    ASSERT_TRUE(update_op.ok());
+
+    results = coll_update->search("walking", {"title"}, "", {}, sort_fields, 0, 10, 1,
+                                  FREQUENCY, false).get();
+    ASSERT_EQ(0, results["found"].get<int>());
+
+    results = coll_update->search("boots", {"title"}, "", {}, sort_fields, 0, 10, 1,
+                                  FREQUENCY, false).get();
+    ASSERT_EQ(1, results["found"].get<int>());
+
+    // patching the id, an unknown document, or bad JSON must be rejected
+    ASSERT_EQ(400, coll_update->update("100", "{\"id\": \"200\"}").code());
+    ASSERT_EQ(404, coll_update->update("999", "{\"stock\": 1}").code());
+    ASSERT_EQ(400, coll_update->update("100", "not json").code());
+
+    collectionManager.drop_collection("coll_update");
+}
@@ -0,0 +1,130 @@
+#include <gtest/gtest.h>
+#include "id_list.h"
+#include <vector>
+
+TEST(IdListTest, ShouldPromoteToBitmapWhenDense) {
+    id_list list;
+    const uint32_t SIZE = 2 * id_list::DENSE_MIN_LENGTH;
+
+    EXPECT_EQ(0, list.getLength());
+    EXPECT_FALSE(list.is_dense());
+
+    // consecutive ids are maximally dense, so the list must promote past the threshold
+    for(uint32_t i = 0; i < SIZE; i++) {
+        list.append(i);
+    }
+
+    EXPECT_TRUE(list.is_dense());
+    EXPECT_EQ(SIZE, list.getLength());
+    EXPECT_EQ(0, list.getMin());
+    EXPECT_EQ(SIZE-1, list.getMax());
+
+    for(uint32_t i = 0; i < SIZE; i++) {
+        EXPECT_TRUE(list.contains(i));
+        EXPECT_EQ(i, list.at(i));
+        EXPECT_EQ(i, list.indexOf(i));
+    }
+
+    EXPECT_FALSE(list.contains(SIZE));
+    EXPECT_EQ(SIZE, list.indexOf(SIZE));
+
+    uint32_t *uncompressed = list.uncompress();
+    for(uint32_t i = 0; i < SIZE; i++) {
+        EXPECT_EQ(i, uncompressed[i]);
+    }
+    delete[] uncompressed;
+}
+
+TEST(IdListTest, SparseListShouldStaySparse) {
+    id_list list;
+
+    // ids spread far apart: large cardinality but low density
+    for(uint32_t i = 0; i < 2 * id_list::DENSE_MIN_LENGTH; i++) {
+        list.append(i * 100);
+    }
+
+    EXPECT_FALSE(list.is_dense());
+    EXPECT_EQ(2 * id_list::DENSE_MIN_LENGTH, list.getLength());
+    EXPECT_TRUE(list.contains(500));
+    EXPECT_FALSE(list.contains(501));
+}
+
+TEST(IdListTest, IntersectAgainstUncompressedArray) {
+    id_list list;
+    const uint32_t SIZE = 2 * id_list::DENSE_MIN_LENGTH;
+
+    for(uint32_t i = 0; i < SIZE; i++) {
+        list.append(i * 2);  // even ids
+    }
+
+    ASSERT_TRUE(list.is_dense());
+
+    std::vector<uint32_t> probe;
+    for(uint32_t i = 0; i < 100; i++) {
+        probe.push_back(i * 3);  // multiples of 3
+    }
+
+    uint32_t *results = nullptr;
+    size_t results_size = list.intersect(&probe[0], probe.size(), &results);
+
+    ASSERT_EQ(50, results_size);  // multiples of 6
+    for(size_t i = 0; i < results_size; i++) {
+        EXPECT_EQ(i * 6, results[i]);
+    }
+
+    delete[] results;
+}
+
+TEST(IdListTest, ContainerToContainerOperations) {
+    id_list dense_evens, sparse_multiples_of_five;
+    const uint32_t SIZE = 2 * id_list::DENSE_MIN_LENGTH;
+
+    for(uint32_t i = 0; i < SIZE; i++) {
+        dense_evens.append(i * 2);
+    }
+
+    for(uint32_t i = 0; i < 100; i++) {
+        sparse_multiples_of_five.append(i * 5);
+    }
+
+    ASSERT_TRUE(dense_evens.is_dense());
+    ASSERT_FALSE(sparse_multiples_of_five.is_dense());
+
+    uint32_t *results = nullptr;
+    size_t results_size = id_list::intersect(dense_evens, sparse_multiples_of_five, &results);
+
+    ASSERT_EQ(50, results_size);  // multiples of 10
+    for(size_t i = 0; i < results_size; i++) {
+        EXPECT_EQ(i * 10, results[i]);
+    }
+    delete[] results;
+
+    results = nullptr;
+    results_size = id_list::do_union(dense_evens, sparse_multiples_of_five, &results);
+
+    // evens plus odd multiples of 5 within the probe range
+    ASSERT_EQ(SIZE + 50, results_size);
+    for(size_t i = 1; i < results_size; i++) {
+        EXPECT_LT(results[i-1], results[i]);
+    }
+    delete[] results;
+}
+
+TEST(IdListTest, RemoveValuesFromBitmap) {
+    id_list list;
+    const uint32_t SIZE = 2 * id_list::DENSE_MIN_LENGTH;
+
+    for(uint32_t i = 0; i < SIZE; i++) {
+        list.append(i);
+    }
+
+    ASSERT_TRUE(list.is_dense());
+
+    uint32_t removals[3] = {10, 20, 30};
+    list.remove_values(removals, 3);
+
+    EXPECT_EQ(SIZE-3, list.getLength());
+    EXPECT_FALSE(list.contains(20));
+    EXPECT_TRUE(list.contains(21));
+    EXPECT_EQ(11, list.at(10));  // removing 10 shifts every index after it
+}
@@ -0,0 +1,65 @@
+#include <gtest/gtest.h>
+#include "route_trie.h"
+
+namespace {
+    std::vector<std::pair<const char*, size_t>> make_segments(const std::vector<std::string> & parts) {
+        std::vector<std::pair<const char*, size_t>> segments;
+        for(const std::string & part: parts) {
+            segments.push_back(std::make_pair(part.data(), part.size()));
+        }
+        return segments;
+    }
+}
+
+TEST(RouteTrieTest, ShouldMatchLiteralAndParamRoutes) {
+    route_trie trie;
+
+    trie.add("GET", {"collections"}, 0);
+    trie.add("POST", {"collections"}, 1);
+    trie.add("GET", {"collections", ":collection"}, 2);
+    trie.add("POST", {"collections", ":collection", "documents", "import"}, 3);
+    trie.add("GET", {"collections", ":collection", "documents", "search"}, 4);
+
+    std::vector<std::string> parts = {"GET", "collections"};
+    ASSERT_EQ(0, trie.find(make_segments(parts)));
+
+    parts = {"POST", "collections"};
+    ASSERT_EQ(1, trie.find(make_segments(parts)));
+
+    parts = {"GET", "collections", "companies"};
+    ASSERT_EQ(2, trie.find(make_segments(parts)));
+
+    parts = {"POST", "companies", "documents", "import"};
+    ASSERT_EQ(-1, trie.find(make_segments(parts)));
+
+    parts = {"POST", "collections", "companies", "documents", "import"};
+    ASSERT_EQ(3, trie.find(make_segments(parts)));
+
+    parts = {"GET", "collections", "companies", "documents", "search"};
+    ASSERT_EQ(4, trie.find(make_segments(parts)));
+
+    // wrong method, too few segments, too many segments
+    parts = {"DELETE", "collections"};
+    ASSERT_EQ(-1, trie.find(make_segments(parts)));
+
+    parts = {"GET"};
+    ASSERT_EQ(-1, trie.find(make_segments(parts)));
+
+    parts = {"GET", "collections", "companies", "documents", "search", "extra"};
+    ASSERT_EQ(-1, trie.find(make_segments(parts)));
+}
+
+TEST(RouteTrieTest, LiteralDeadEndShouldBacktrackToParam) {
+    route_trie trie;
+
+    // "search" is a literal at the same depth where ":collection" is a wildcard
+    trie.add("GET", {"collections", "search", "status"}, 0);
+    trie.add("GET", {"collections", ":collection", "documents"}, 1);
+
+    std::vector<std::string> parts = {"GET", "collections", "search", "status"};
+    ASSERT_EQ(0, trie.find(make_segments(parts)));
+
+    // descending into the "search" literal dead-ends, so the wildcard must be tried
+    parts = {"GET", "collections", "search", "documents"};
+    ASSERT_EQ(1, trie.find(make_segments(parts)));
+}
@@ -0,0 +1,51 @@
+#include <gtest/gtest.h>
+#include "sort_column.h"
+
+TEST(SortColumnTest, SetGetAndErase) {
+    sort_column column;
+
+    ASSERT_EQ(0, column.size());
+    ASSERT_FALSE(column.has(0));
+
+    column.set(3, number_t((int64_t) 30));
+    column.set(1000, number_t(2.5f));
+    column.set(3, number_t((int64_t) 35));  // overwrite must not bump the count
+
+    ASSERT_EQ(2, column.size());
+
+    number_t value;
+    ASSERT_TRUE(column.get(3, value));
+    ASSERT_EQ(35, value.intval);
+
+    ASSERT_TRUE(column.get(1000, value));
+    ASSERT_FLOAT_EQ(2.5f, value.floatval);
+
+    // ids without a value must not report one, whether in or out of the grown range
+    ASSERT_FALSE(column.get(4, value));
+    ASSERT_FALSE(column.get(100000, value));
+
+    column.erase(3);
+    ASSERT_EQ(1, column.size());
+    ASSERT_FALSE(column.has(3));
+
+    // erasing an id that holds no value is a no-op
+    column.erase(500);
+    ASSERT_EQ(1, column.size());
+}
+
+TEST(SortColumnTest, DenseFill) {
+    sort_column column;
+    const uint32_t SIZE = 10 * 1000;
+
+    for(uint32_t seq_id = 0; seq_id < SIZE; seq_id++) {
+        column.set(seq_id, number_t((int64_t) seq_id * 2));
+    }
+
+    ASSERT_EQ(SIZE, column.size());
+
+    for(uint32_t seq_id = 0; seq_id < SIZE; seq_id++) {
+        number_t value;
+        ASSERT_TRUE(column.get(seq_id, value));
+        ASSERT_EQ(seq_id * 2, value.intval);
+    }
+}
@@ -93,6 +93,30 @@ TEST(SortedArrayTest, RemoveValues) {
     }
 }
 
+TEST(SortedArrayTest, BulkIndexOfLargeQuerySet) {
+    sorted_array arr;
+    const uint32_t SIZE = 50 * 1000;
+
+    for(uint32_t i = 0; i < SIZE; i++) {
+        arr.append(i * 3);  // 0, 3, 6, ...
+    }
+
+    // query every even number in range: roughly half are present, spread across all blocks
+    std::vector<uint32_t> search_values;
+    for(uint32_t v = 0; v < SIZE * 3; v += 2) {
+        search_values.push_back(v);
+    }
+
+    uint32_t *results = new uint32_t[search_values.size()];
+    arr.indexOf(&search_values[0], search_values.size(), results);
+
+    for(size_t i = 0; i < search_values.size(); i++) {
+        ASSERT_EQ(arr.indexOf(search_values[i]), results[i]);
+    }
+
+    delete [] results;
+}
+
 TEST(SortedArrayTest, BulkIndexOf) {
     std::ifstream infile(std::string(ROOT_DIR)+"test/ids.txt");
 
@@ -129,4 +153,35 @@ TEST(SortedArrayTest, BulkIndexOf) {
         auto search_id = search_ids.at(i);
         ASSERT_EQ(ids.indexOf(search_id), results[i]);
     }
-}
\ No newline at end of file
+}
+TEST(SortedArrayTest, BulkAppend) {
+    sorted_array arr;
+    const uint32_t SIZE = 10 * 1000;
+
+    std::vector<uint32_t> values;
+    for(uint32_t i=0; i < SIZE; i++) {
+        values.push_back(i * 3);
+    }
+
+    // seed with per-element appends, then append the rest as one ascending run
+    for(uint32_t i=0; i < 10; i++) {
+        arr.append(values[i]);
+    }
+
+    ASSERT_TRUE(arr.append(&values[10], SIZE-10));
+
+    EXPECT_EQ(arr.getLength(), SIZE);
+    EXPECT_EQ(arr.getMin(), values.front());
+    EXPECT_EQ(arr.getMax(), values.back());
+
+    for(uint32_t i=0; i < SIZE; i++) {
+        EXPECT_EQ(arr.at(i), values[i]);
+    }
+
+    // bulk append into an empty array establishes min/max from the run itself
+    sorted_array arr_fresh;
+    ASSERT_TRUE(arr_fresh.append(&values[0], SIZE));
+    EXPECT_EQ(arr_fresh.getLength(), SIZE);
+    EXPECT_EQ(arr_fresh.getMin(), values.front());
+    EXPECT_EQ(arr_fresh.getMax(), values.back());
+}
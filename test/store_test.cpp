@@ -1,5 +1,7 @@
 #include <gtest/gtest.h>
 #include <vector>
+#include <thread>
+#include <atomic>
 #include <store.h>
 #include <string_utils.h>
 
@@ -111,6 +113,76 @@ TEST(StoreTest, GetUpdatesSince) {
     ASSERT_EQ("Unable to fetch updates. Master's latest sequence number is 3", updates_op.error());
 }
 
+TEST(StoreTest, MultiGet) {
+    std::string store_path = "/tmp/typesense_test/multi_get_store_test";
+    LOG(INFO) << "Truncating and creating: " << store_path;
+    system(("rm -rf "+store_path+" && mkdir -p "+store_path).c_str());
+
+    Store store(store_path);
+
+    store.insert("foo1", "bar1");
+    store.insert("foo2", "bar2");
+    store.insert("foo3", "bar3");
+
+    std::vector<std::string> keys = {"foo1", "missing", "foo3"};
+    std::vector<std::string> values;
+    std::vector<StoreStatus> statuses = store.multi_get(keys, values);
+
+    ASSERT_EQ(3, statuses.size());
+    ASSERT_EQ(StoreStatus::FOUND, statuses[0]);
+    ASSERT_EQ("bar1", values[0]);
+    ASSERT_EQ(StoreStatus::NOT_FOUND, statuses[1]);
+    ASSERT_EQ(StoreStatus::FOUND, statuses[2]);
+    ASSERT_EQ("bar3", values[2]);
+
+    // empty key list
+    keys.clear();
+    values.clear();
+    statuses = store.multi_get(keys, values);
+    ASSERT_EQ(0, statuses.size());
+}
+
+TEST(StoreTest, GroupCommitBatchWrite) {
+    std::string store_path = "/tmp/typesense_test/group_commit_store_test";
+    LOG(INFO) << "Truncating and creating: " << store_path;
+    system(("rm -rf "+store_path+" && mkdir -p "+store_path).c_str());
+
+    Store store(store_path);
+
+    // concurrent writers land in shared commit groups - every write must still be
+    // individually acknowledged and durable
+    std::vector<std::thread> writers;
+    std::atomic<size_t> num_ok(0);
+
+    for(size_t i = 0; i < 8; i++) {
+        writers.push_back(std::thread([&store, &num_ok, i]() {
+            for(size_t j = 0; j < 25; j++) {
+                const std::string suffix = std::to_string(i) + "_" + std::to_string(j);
+                rocksdb::WriteBatch batch;
+                batch.Put("key_" + suffix, "value_" + suffix);
+                if(store.batch_write(batch)) {
+                    num_ok++;
+                }
+            }
+        }));
+    }
+
+    for(std::thread & writer: writers) {
+        writer.join();
+    }
+
+    ASSERT_EQ(8 * 25, num_ok.load());
+
+    for(size_t i = 0; i < 8; i++) {
+        for(size_t j = 0; j < 25; j++) {
+            const std::string suffix = std::to_string(i) + "_" + std::to_string(j);
+            std::string value;
+            ASSERT_EQ(StoreStatus::FOUND, store.get("key_" + suffix, value));
+            ASSERT_EQ("value_" + suffix, value);
+        }
+    }
+}
+
 TEST(StoreTest, GetUpdateSinceInvalidIterator) {
     std::string primary_store_path = "/tmp/typesense_test/primary_store_test";
     LOG(INFO) << "Truncating and creating: " << primary_store_path;
@@ -0,0 +1,86 @@
+#include <gtest/gtest.h>
+#include "tokenizer.h"
+
+TEST(TokenizerTest, ShouldNormalizeTokensInASingleScan) {
+    StringUtils string_utils;
+    std::string text = "  The QUICK, brown-fox   jumped!  ";
+
+    Tokenizer tokenizer(text, string_utils);
+    const char* token;
+    size_t token_len;
+
+    std::vector<std::string> tokens;
+    while(tokenizer.next(token, token_len)) {
+        tokens.push_back(std::string(token, token_len));
+    }
+
+    ASSERT_EQ(4, tokens.size());
+    ASSERT_STREQ("the", tokens[0].c_str());
+    ASSERT_STREQ("quick", tokens[1].c_str());
+    ASSERT_STREQ("brownfox", tokens[2].c_str());
+    ASSERT_STREQ("jumped", tokens[3].c_str());
+}
+
+TEST(TokenizerTest, ShouldKeepOrdinalsOfWordsThatNormalizeToNothing) {
+    StringUtils string_utils;
+    std::string text = "foo !!! bar";
+
+    Tokenizer tokenizer(text, string_utils);
+    const char* token;
+    size_t token_len;
+    size_t raw_token_len;
+
+    ASSERT_TRUE(tokenizer.next(token, token_len, raw_token_len));
+    ASSERT_STREQ("foo", std::string(token, token_len).c_str());
+
+    // "!!!" normalizes to an empty token but must still occupy position 1
+    ASSERT_TRUE(tokenizer.next(token, token_len, raw_token_len));
+    ASSERT_EQ(0, token_len);
+    ASSERT_EQ(3, raw_token_len);
+
+    ASSERT_TRUE(tokenizer.next(token, token_len, raw_token_len));
+    ASSERT_STREQ("bar", std::string(token, token_len).c_str());
+
+    ASSERT_FALSE(tokenizer.next(token, token_len, raw_token_len));
+}
+
+TEST(TokenizerTest, ShouldTransliterateNonASCIITokens) {
+    StringUtils string_utils;
+    std::string text = "René żółw";
+
+    Tokenizer tokenizer(text, string_utils);
+    const char* token;
+    size_t token_len;
+
+    std::vector<std::string> tokens;
+    while(tokenizer.next(token, token_len)) {
+        tokens.push_back(std::string(token, token_len));
+    }
+
+    // must match what StringUtils::unicode_normalize produces for the same words
+    std::string rene = "René", zolw = "żółw";
+    string_utils.unicode_normalize(rene);
+    string_utils.unicode_normalize(zolw);
+
+    ASSERT_EQ(2, tokens.size());
+    ASSERT_STREQ(rene.c_str(), tokens[0].c_str());
+    ASSERT_STREQ(zolw.c_str(), tokens[1].c_str());
+}
+
+TEST(TokenizerTest, ShouldYieldRawViewsWhenNormalizationIsOff) {
+    StringUtils string_utils;
+    std::string text = "Hello, World!";
+
+    Tokenizer tokenizer(text, string_utils, false);
+    const char* token;
+    size_t token_len;
+
+    ASSERT_TRUE(tokenizer.next(token, token_len));
+    ASSERT_STREQ("Hello,", std::string(token, token_len).c_str());
+    ASSERT_EQ(text.c_str(), token);  // view points into the input buffer itself
+
+    ASSERT_TRUE(tokenizer.next(token, token_len));
+    ASSERT_STREQ("World!", std::string(token, token_len).c_str());
+
+    ASSERT_FALSE(tokenizer.next(token, token_len));
+}
@@ -3,7 +3,7 @@
 #include "match_score.h"
 
 TEST(TopsterTest, StoreMaxIntValuesWithoutRepetition) {
-    Topster<5> topster;
+    Topster topster(5);
 
     struct {
         uint16_t query_index;
@@ -42,8 +42,49 @@ TEST(TopsterTest, StoreMaxIntValuesWithoutRepetition) {
     }
 }
 
+TEST(TopsterTest, CountEvictionsOnceFull) {
+    Topster topster(3);
+
+    for(uint64_t key = 1; key <= 3; key++) {
+        topster.add(key, 0, key * 10, (int64_t) 0, (int64_t) 0);
+    }
+
+    // filling up the topster should not count as eviction
+    EXPECT_EQ(0, topster.evictions);
+
+    topster.add(4, 0, 5, (int64_t) 0, (int64_t) 0);   // worse than the current minimum, ignored
+    EXPECT_EQ(0, topster.evictions);
+
+    topster.add(5, 0, 100, (int64_t) 0, (int64_t) 0); // pushes out the current minimum
+    EXPECT_EQ(1, topster.evictions);
+
+    topster.clear();
+    EXPECT_EQ(0, topster.evictions);
+}
+
+TEST(TopsterTest, DedupSurvivesHeavyEviction) {
+    Topster topster(4);
+
+    // every add beyond the fill evicts the current minimum, churning the dedup table
+    for(uint64_t key = 1; key <= 1000; key++) {
+        topster.add(key, 0, key, (int64_t) 0, (int64_t) 0);
+    }
+
+    // re-adding a retained key with a better score must still be ignored as a duplicate
+    topster.add(998, 0, 5000, (int64_t) 0, (int64_t) 0);
+
+    topster.sort();
+
+    ASSERT_EQ(4, topster.size);
+
+    std::vector<uint64_t> ids = {1000, 999, 998, 997};
+    for(uint32_t i = 0; i < topster.size; i++) {
+        EXPECT_EQ(ids[i], topster.getKeyAt(i));
+    }
+}
+
 TEST(TopsterTest, StoreMaxFloatValuesWithoutRepetition) {
-    Topster<5> topster;
+    Topster topster(5);
 
     struct {
         uint16_t query_index;